@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <string>
+#include <vector>
+
+// Base
+#include "common/base_clp.h"
+
+/**
+Command Line Processor for the shard coordinator.
+*/
+class CLP : public BaseCLP {
+public:
+    CLP(const std::string &desc, const std::string &version) : BaseCLP(desc, version)
+    {}
+
+    virtual void add_args()
+    {
+        add(shard_addr_arg_);
+        add(net_port_arg_);
+        add(shard_timeout_arg_);
+    }
+
+    virtual void get_args()
+    {
+        shard_addrs_ = shard_addr_arg_.getValue();
+        net_port_ = net_port_arg_.getValue();
+        shard_timeout_ = shard_timeout_arg_.getValue();
+    }
+
+    const std::vector<std::string> &shard_addrs() const
+    {
+        return shard_addrs_;
+    }
+
+    int net_port() const
+    {
+        return net_port_;
+    }
+
+    int shard_timeout() const
+    {
+        return shard_timeout_;
+    }
+
+private:
+    TCLAP::MultiArg<std::string> shard_addr_arg_ = TCLAP::MultiArg<std::string>(
+        "",
+        "shardAddr",
+        "Connection point of a sender serving a shard of the SenderDB, e.g., "
+        "tcp://localhost:1213; can be given multiple times",
+        true,
+        "string");
+
+    TCLAP::ValueArg<int> net_port_arg_ = TCLAP::ValueArg<int>(
+        "", "port", "TCP port to bind to (default is 1212)", false, 1212, "TCP port");
+
+    TCLAP::ValueArg<int> shard_timeout_arg_ = TCLAP::ValueArg<int>(
+        "",
+        "shardTimeout",
+        "Seconds to wait for the next message from a shard before failing the request "
+        "(default is 60)",
+        false,
+        60,
+        "positive integer");
+
+    std::vector<std::string> shard_addrs_;
+
+    int net_port_;
+
+    int shard_timeout_;
+};
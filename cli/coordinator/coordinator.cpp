@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+
+// APSI
+#include "apsi/log.h"
+#include "apsi/thread_pool_mgr.h"
+#include "apsi/version.h"
+#include "apsi/zmq/shard_coordinator.h"
+#include "common/common_utils.h"
+#include "coordinator/clp.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::sender;
+using namespace apsi::util;
+
+void sigint_handler(int param [[maybe_unused]])
+{
+    APSI_LOG_WARNING("Coordinator interrupted");
+    print_timing_report(sender_stopwatch);
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    prepare_console();
+
+    CLP cmd(
+        "Example of a coordinator that serves receivers on behalf of senders that each hold a "
+        "shard of a SenderDB",
+        APSI_VERSION);
+    if (!cmd.parse_args(argc, argv)) {
+        APSI_LOG_ERROR("Failed parsing command line arguments");
+        return -1;
+    }
+
+    ThreadPoolMgr::SetThreadCount(cmd.threads());
+    APSI_LOG_INFO("Setting thread count to " << ThreadPoolMgr::GetThreadCount());
+    signal(SIGINT, sigint_handler);
+
+    unique_ptr<ZMQShardCoordinator> coordinator;
+    try {
+        coordinator = make_unique<ZMQShardCoordinator>(
+            cmd.shard_addrs(), chrono::seconds(cmd.shard_timeout()));
+    } catch (const exception &ex) {
+        APSI_LOG_ERROR("Failed to connect to the shards: " << ex.what());
+        return -1;
+    }
+    APSI_LOG_INFO(
+        "Coordinating " << coordinator->get_shard_count() << " shards with PSIParams: "
+                        << coordinator->get_params().to_string());
+
+    // The coordinator will run until stopped.
+    atomic<bool> stop = false;
+    coordinator->run(stop, cmd.net_port());
+
+    return 0;
+}
@@ -4,6 +4,8 @@
 #pragma once
 
 // STD
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -31,8 +33,9 @@ public:
         TCLAP::ValueArg<std::uint32_t> bound_arg(
             "b",
             "bound",
-            "Up to what power we want to compute (max_items_per_bin)",
-            /* req */ true,
+            "Up to what power we want to compute (max_items_per_bin); defaults to the value in the "
+            "parameter file given with --paramsFile",
+            /* req */ false,
             /* value */ 1,
             /* type desc */ "unsigned integer");
         add(bound_arg);
@@ -55,21 +58,108 @@ public:
             /* type desc */ "string");
         add(dot_file_arg);
 
+        TCLAP::SwitchArg search_arg(
+            "s",
+            "search",
+            "Search for source powers instead of using the given ones",
+            /* value */ false);
+        add(search_arg);
+
+        TCLAP::ValueArg<std::uint32_t> depth_arg(
+            "d",
+            "depth",
+            "Largest allowed depth when searching for source powers",
+            /* req */ false,
+            /* value */ 2,
+            /* type desc */ "unsigned integer");
+        add(depth_arg);
+
+        TCLAP::ValueArg<std::uint32_t> max_sources_arg(
+            "m",
+            "maxSources",
+            "Largest allowed number of source powers when searching",
+            /* req */ false,
+            /* value */ 16,
+            /* type desc */ "unsigned integer");
+        add(max_sources_arg);
+
+        TCLAP::ValueArg<double> query_weight_arg(
+            "w",
+            "queryWeight",
+            "Cost of one query ciphertext relative to one multiplication and relinearization on "
+            "the sender",
+            /* req */ false,
+            /* value */ 1.0,
+            /* type desc */ "non-negative number");
+        add(query_weight_arg);
+
+        TCLAP::ValueArg<std::size_t> beam_width_arg(
+            "",
+            "beamWidth",
+            "Number of partial source sets kept at each step of the search",
+            /* req */ false,
+            /* value */ 64,
+            /* type desc */ "unsigned integer");
+        add(beam_width_arg);
+
+        TCLAP::ValueArg<std::size_t> candidates_arg(
+            "c",
+            "candidates",
+            "Number of best source sets to report when searching",
+            /* req */ false,
+            /* value */ 10,
+            /* type desc */ "unsigned integer");
+        add(candidates_arg);
+
+        TCLAP::ValueArg<std::string> params_file_arg(
+            "",
+            "paramsFile",
+            "Parameter file in JSON format to take the bound and ps_low_degree from",
+            /* req */ false,
+            /* value */ "",
+            /* type desc */ "string");
+        add(params_file_arg);
+
+        TCLAP::ValueArg<std::string> params_out_arg(
+            "",
+            "paramsOutFile",
+            "Write the parameter file given with --paramsFile to given file, with query_params "
+            "replaced by the best configuration",
+            /* req */ false,
+            /* value */ "",
+            /* type desc */ "string");
+        add(params_out_arg);
+
         TCLAP::UnlabeledMultiArg<std::uint32_t> sources_arg(
             "sources",
             "The source powers",
-            /* req */ true,
+            /* req */ false,
             "list of unsigned integers");
         add(sources_arg);
 
         try {
             parse(argc, argv);
 
-            bound_ = bound_arg.getValue();
+            if (bound_arg.isSet()) {
+                bound_ = bound_arg.getValue();
+            }
             ps_low_degree_ = ps_low_degree_arg.getValue();
+            has_ps_low_degree_ = ps_low_degree_arg.isSet();
             if (dot_file_arg.isSet()) {
                 dot_file_ = dot_file_arg.getValue();
             }
+            search_ = search_arg.getValue();
+            depth_ = depth_arg.getValue();
+            max_sources_ = max_sources_arg.getValue();
+            query_weight_ = query_weight_arg.getValue();
+            beam_width_ = beam_width_arg.getValue();
+            candidates_ = candidates_arg.getValue();
+            if (params_file_arg.isSet()) {
+                params_file_ = params_file_arg.getValue();
+            }
+            if (params_out_arg.isSet()) {
+                params_out_file_ = params_out_arg.getValue();
+            }
             sources_ = sources_arg.getValue();
         } catch (...) {
             std::cout << "Error parsing parameters.";
@@ -79,6 +169,9 @@ public:
         return true;
     }
 
+    /**
+    Returns the bound, or zero if it was not given.
+    */
     std::uint32_t bound() const
     {
         return bound_;
@@ -89,6 +182,14 @@ public:
         return ps_low_degree_;
     }
 
+    /**
+    Returns whether ps_low_degree was given on the command line.
+    */
+    bool has_ps_low_degree() const
+    {
+        return has_ps_low_degree_;
+    }
+
     std::string dot_file() const
     {
         return dot_file_;
@@ -99,12 +200,70 @@ public:
         return sources_;
     }
 
+    bool search() const
+    {
+        return search_;
+    }
+
+    std::uint32_t depth() const
+    {
+        return depth_;
+    }
+
+    std::uint32_t max_sources() const
+    {
+        return max_sources_;
+    }
+
+    double query_weight() const
+    {
+        return query_weight_;
+    }
+
+    std::size_t beam_width() const
+    {
+        return beam_width_;
+    }
+
+    std::size_t candidates() const
+    {
+        return candidates_;
+    }
+
+    const std::string &params_file() const
+    {
+        return params_file_;
+    }
+
+    const std::string &params_out_file() const
+    {
+        return params_out_file_;
+    }
+
 private:
-    std::uint32_t bound_;
+    std::uint32_t bound_ = 0;
 
     std::uint32_t ps_low_degree_ = 0;
 
+    bool has_ps_low_degree_ = false;
+
     std::string dot_file_;
 
+    bool search_ = false;
+
+    std::uint32_t depth_ = 2;
+
+    std::uint32_t max_sources_ = 16;
+
+    double query_weight_ = 1.0;
+
+    std::size_t beam_width_ = 64;
+
+    std::size_t candidates_ = 10;
+
+    std::string params_file_;
+
+    std::string params_out_file_;
+
     std::vector<std::uint32_t> sources_;
 };
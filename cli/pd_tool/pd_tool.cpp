@@ -3,17 +3,25 @@
 
 // STD
 #include <algorithm>
+#include <exception>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <set>
+#include <vector>
 
 // APSI
 #include "apsi/powers.h"
+#include "apsi/psi_params.h"
 #include "apsi/version.h"
+#include "apsi/util/source_optimizer.h"
 #include "apsi/util/utils.h"
 #include "pd_tool/clp.h"
 
+// JSON
+#include "json/json.h"
+
 using namespace std;
 using namespace apsi;
 
@@ -33,16 +41,131 @@ void write_dot(const PowersDag &pd, string dot_file)
     cout << "DOT was written to file: " << dot_file << endl;
 }
 
+bool load_params_json(const string &params_file, Json::Value &root)
+{
+    try {
+        ifstream fs(params_file);
+        if (!fs.is_open()) {
+            cout << "Failed to open parameter file: " << params_file << endl;
+            return false;
+        }
+        fs >> root;
+    } catch (const exception &ex) {
+        cout << "Failed to read parameter file " << params_file << ": " << ex.what() << endl;
+        return false;
+    }
+
+    return true;
+}
+
+void write_params_json(
+    Json::Value root, uint32_t ps_low_degree, const set<uint32_t> &sources, string params_file)
+{
+    Json::Value query_powers(Json::arrayValue);
+    for (uint32_t s : sources) {
+        query_powers.append(s);
+    }
+    root["query_params"]["ps_low_degree"] = ps_low_degree;
+    root["query_params"]["query_powers"] = query_powers;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "    ";
+    string params_json = Json::writeString(builder, root);
+
+    // Make sure the result is usable before writing it out
+    try {
+        PSIParams::Load(params_json);
+    } catch (const exception &ex) {
+        cout << "Resulting parameters are invalid: " << ex.what() << endl;
+        return;
+    }
+
+    try {
+        ofstream fs(params_file);
+        fs.exceptions(ios_base::badbit | ios_base::failbit);
+        fs << params_json << endl;
+    } catch (const ios_base::failure &ex) {
+        cout << "Failed to write to file: " << ex.what() << endl;
+        return;
+    }
+
+    cout << "Parameters were written to file: " << params_file << endl;
+}
+
+void print_candidates(const vector<util::SourcesCandidate> &candidates)
+{
+    cout << setw(6) << "Rank" << setw(7) << "Depth" << setw(10) << "Queries" << setw(8)
+         << "Mults" << setw(10) << "Squares" << setw(10) << "Cost"
+         << "  Sources" << endl;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const auto &c = candidates[i];
+        cout << setw(6) << i + 1 << setw(7) << c.depth << setw(10) << c.sources.size()
+             << setw(8) << c.multiplication_count << setw(10) << c.square_count << setw(10)
+             << fixed << setprecision(2) << c.cost << "  " << util::to_string(c.sources)
+             << endl;
+    }
+}
+
 int main(int argc, char **argv)
 {
     CLP clp(
-        "pd_tool is a command-line tool for computing the depths of source power configurations.",
+        "pd_tool is a command-line tool for computing the depths of source power configurations "
+        "and for searching for good ones.",
         to_string(apsi_version));
-    clp.parse_args(argc, argv);
+    if (!clp.parse_args(argc, argv)) {
+        return -1;
+    }
+
+    uint32_t bound = clp.bound();
+    uint32_t ps_low_degree = clp.ps_low_degree();
+    Json::Value params_root;
+    if (!clp.params_file().empty()) {
+        if (!load_params_json(clp.params_file(), params_root)) {
+            return -1;
+        }
+        if (!bound) {
+            bound = params_root["table_params"]["max_items_per_bin"].asUInt();
+        }
+        if (!clp.has_ps_low_degree()) {
+            ps_low_degree = params_root["query_params"]["ps_low_degree"].asUInt();
+        }
+    } else if (!clp.params_out_file().empty()) {
+        cout << "Writing parameters requires a parameter file given with --paramsFile" << endl;
+        return -1;
+    }
+    if (!bound || ps_low_degree > bound) {
+        cout << "Invalid bound " << bound << " for ps_low_degree " << ps_low_degree << endl;
+        return -1;
+    }
+
+    set<uint32_t> sources_set;
+    if (clp.search()) {
+        util::SourcesSearchOptions options;
+        options.max_depth = clp.depth();
+        options.max_source_count = clp.max_sources();
+        options.query_weight = clp.query_weight();
+        options.beam_width = clp.beam_width();
+        options.candidate_count = clp.candidates();
+
+        vector<util::SourcesCandidate> candidates =
+            util::find_sources(ps_low_degree, bound, options);
+        if (candidates.empty()) {
+            cout << "Found no source powers with depth at most " << clp.depth() << endl;
+            return 0;
+        }
+        print_candidates(candidates);
+        sources_set = candidates.front().sources;
+    } else {
+        util::SourcesCandidate candidate;
+        candidate.sources.insert(clp.sources().begin(), clp.sources().end());
+        if (util::evaluate_sources(ps_low_degree, bound, clp.query_weight(), candidate)) {
+            print_candidates({ candidate });
+        }
+        sources_set = candidate.sources;
+    }
 
     PowersDag pd;
-    set<uint32_t> sources_set(clp.sources().begin(), clp.sources().end());
-    set<uint32_t> targets_set = util::create_powers_set(clp.ps_low_degree(), clp.bound());
+    set<uint32_t> targets_set = util::create_powers_set(ps_low_degree, bound);
     pd.configure(sources_set, targets_set);
     if (pd.is_configured()) {
         cout << "Found configuration with depth " << pd.depth() << endl;
@@ -52,6 +175,9 @@ int main(int argc, char **argv)
     if (pd.is_configured() && !clp.dot_file().empty()) {
         write_dot(pd, clp.dot_file());
     }
+    if (pd.is_configured() && !clp.params_out_file().empty()) {
+        write_params_json(params_root, ps_low_degree, sources_set, clp.params_out_file());
+    }
 
     return 0;
 }
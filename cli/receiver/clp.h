@@ -21,6 +21,7 @@ public:
     {
         add(net_addr_arg_);
         add(net_port_arg_);
+        add(db_name_arg_);
         add(query_file_arg_);
         add(out_file_arg_);
     }
@@ -29,6 +30,7 @@ public:
     {
         net_addr_ = net_addr_arg_.getValue();
         net_port_ = net_port_arg_.getValue();
+        db_name_ = db_name_arg_.getValue();
         query_file_ = query_file_arg_.getValue();
         output_file_ = out_file_arg_.getValue();
     }
@@ -43,6 +45,11 @@ public:
         return net_port_;
     }
 
+    const std::string &db_name() const
+    {
+        return db_name_;
+    }
+
     const std::string &query_file() const
     {
         return query_file_;
@@ -60,6 +67,15 @@ private:
     TCLAP::ValueArg<int> net_port_arg_ = TCLAP::ValueArg<int>(
         "", "port", "TCP port to connect to (default is 1212)", false, 1212, "TCP port");
 
+    TCLAP::ValueArg<std::string> db_name_arg_ = TCLAP::ValueArg<std::string>(
+        "",
+        "dbName",
+        "Name of the SenderDB to query when the sender hosts several (default is the sender's "
+        "default SenderDB)",
+        false,
+        "",
+        "string");
+
     TCLAP::ValueArg<std::string> query_file_arg_ = TCLAP::ValueArg<std::string>(
         "q",
         "queryFile",
@@ -80,6 +96,8 @@ private:
 
     int net_port_;
 
+    std::string db_name_;
+
     std::string query_file_;
 
     std::string output_file_;
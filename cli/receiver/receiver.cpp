@@ -90,6 +90,12 @@ int remote_query(const CLP &cmd)
         return -1;
     }
 
+    // Direct all requests to the chosen SenderDB
+    if (!cmd.db_name().empty()) {
+        channel.set_db_name(cmd.db_name());
+        APSI_LOG_INFO("Querying SenderDB `" << cmd.db_name() << "`");
+    }
+
     unique_ptr<PSIParams> params;
     try {
         APSI_LOG_INFO("Sending parameter request");
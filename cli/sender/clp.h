@@ -7,6 +7,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <set>
+#include <string>
 #include <vector>
 
 // APSI
@@ -27,21 +28,37 @@ public:
     virtual void add_args()
     {
         add(compress_arg_);
+        add(pack_arg_);
         add(nonce_byte_count_arg_);
         add(net_port_arg_);
         add(params_file_arg_);
         add(db_file_arg_);
+        add(named_db_file_arg_);
         add(sdb_out_file_arg_);
+        add(sdb_shard_count_arg_);
+        add(pt_cache_size_arg_);
+        add(bundle_tile_size_arg_);
+        add(eval_memory_limit_arg_);
+        add(query_batch_size_arg_);
+        add(max_queued_queries_arg_);
     }
 
     virtual void get_args()
     {
         compress_ = compress_arg_.getValue();
+        pack_ = pack_arg_.getValue();
         nonce_byte_count_ = nonce_byte_count_arg_.getValue();
         db_file_ = db_file_arg_.isSet() ? db_file_arg_.getValue() : "";
+        named_db_files_ = named_db_file_arg_.getValue();
         net_port_ = net_port_arg_.getValue();
         params_file_ = params_file_arg_.getValue();
         sdb_out_file_ = sdb_out_file_arg_.getValue();
+        sdb_shard_count_ = sdb_shard_count_arg_.getValue();
+        pt_cache_size_ = pt_cache_size_arg_.getValue();
+        bundle_tile_size_ = bundle_tile_size_arg_.getValue();
+        eval_memory_limit_ = eval_memory_limit_arg_.getValue();
+        query_batch_size_ = query_batch_size_arg_.getValue();
+        max_queued_queries_ = max_queued_queries_arg_.getValue();
     }
 
     std::size_t nonce_byte_count() const
@@ -54,6 +71,11 @@ public:
         return compress_;
     }
 
+    bool pack() const
+    {
+        return pack_;
+    }
+
     int net_port() const
     {
         return net_port_;
@@ -64,6 +86,11 @@ public:
         return db_file_;
     }
 
+    const std::vector<std::string> &named_db_files() const
+    {
+        return named_db_files_;
+    }
+
     const std::string &params_file() const
     {
         return params_file_;
@@ -74,6 +101,36 @@ public:
         return sdb_out_file_;
     }
 
+    std::uint32_t sdb_shard_count() const
+    {
+        return sdb_shard_count_;
+    }
+
+    std::size_t pt_cache_size() const
+    {
+        return pt_cache_size_;
+    }
+
+    std::size_t bundle_tile_size() const
+    {
+        return bundle_tile_size_;
+    }
+
+    std::size_t eval_memory_limit() const
+    {
+        return eval_memory_limit_;
+    }
+
+    std::size_t query_batch_size() const
+    {
+        return query_batch_size_;
+    }
+
+    std::size_t max_queued_queries() const
+    {
+        return max_queued_queries_;
+    }
+
 private:
     TCLAP::ValueArg<std::size_t> nonce_byte_count_arg_ = TCLAP::ValueArg<std::size_t>(
         "n",
@@ -95,6 +152,14 @@ private:
         "",
         "string");
 
+    TCLAP::MultiArg<std::string> named_db_file_arg_ = TCLAP::MultiArg<std::string>(
+        "",
+        "namedDbFile",
+        "An additional SenderDB to serve under a name, given as name=path, where path is a saved "
+        "SenderDB file or a CSV file; may be given multiple times",
+        false,
+        "name=path");
+
     TCLAP::ValueArg<std::string> params_file_arg_ = TCLAP::ValueArg<std::string>(
         "p",
         "paramsFile",
@@ -108,18 +173,95 @@ private:
     TCLAP::ValueArg<std::string> sdb_out_file_arg_ = TCLAP::ValueArg<std::string>(
         "o", "sdbOutFile", "Save the SenderDB in the given file", false, "", "string");
 
+    TCLAP::ValueArg<std::uint32_t> sdb_shard_count_arg_ = TCLAP::ValueArg<std::uint32_t>(
+        "",
+        "sdbShardCount",
+        "Save the SenderDB split by bundle index into the given number of shards, written to "
+        "files named by appending .0, .1, ... to --sdbOutFile (default is 1, i.e., no sharding)",
+        false,
+        1,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> pt_cache_size_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "ptCacheSize",
+        "Memory budget in megabytes for caching decompressed plaintexts when the SenderDB is "
+        "compressed or packed (default is 0, i.e., no caching)",
+        false,
+        0,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> bundle_tile_size_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "bundleTileSize",
+        "Number of bin bundles at the same bundle index to evaluate together in one task; 0 means "
+        "all of them (default is 1)",
+        false,
+        1,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> eval_memory_limit_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "evalMemoryLimit",
+        "Approximate memory limit in megabytes for evaluating the polynomials of one task; "
+        "polynomials that do not fit are evaluated in chunks; 0 means no limit (default is 256)",
+        false,
+        256,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> query_batch_size_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "queryBatchSize",
+        "Maximum number of waiting queries to process together; this increases throughput when "
+        "many queries arrive at once (default is 1)",
+        false,
+        1,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> max_queued_queries_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "maxQueuedQueries",
+        "Maximum number of queries that may wait to be processed for each SenderDB; further "
+        "queries are rejected; 0 means no limit (default is 16)",
+        false,
+        16,
+        "unsigned integer");
+
     TCLAP::SwitchArg compress_arg_ =
         TCLAP::SwitchArg("c", "compress", "Whether to compress the SenderDB in memory", false);
 
+    TCLAP::SwitchArg pack_arg_ = TCLAP::SwitchArg(
+        "",
+        "pack",
+        "Whether to store the SenderDB in memory as bit-packed field elements; this overrides "
+        "--compress",
+        false);
+
     std::size_t nonce_byte_count_;
 
     bool compress_;
 
+    bool pack_;
+
     int net_port_;
 
     std::string db_file_;
 
+    std::vector<std::string> named_db_files_;
+
     std::string params_file_;
 
     std::string sdb_out_file_;
+
+    std::uint32_t sdb_shard_count_;
+
+    std::size_t pt_cache_size_;
+
+    std::size_t bundle_tile_size_;
+
+    std::size_t eval_memory_limit_;
+
+    std::size_t query_batch_size_;
+
+    std::size_t max_queued_queries_;
 };
@@ -2,11 +2,14 @@
 // Licensed under the MIT license.
 
 // STD
+#include <atomic>
+#include <chrono>
 #include <csignal>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <string>
+#include <thread>
 #if defined(__GNUC__) && (__GNUC__ < 8) && !defined(__clang__)
 #include <experimental/filesystem>
 #else
@@ -16,7 +19,9 @@
 // APSI
 #include "apsi/log.h"
 #include "apsi/oprf/oprf_sender.h"
+#include "apsi/sender.h"
 #include "apsi/thread_pool_mgr.h"
+#include "apsi/util/plaintext_cache.h"
 #include "apsi/version.h"
 #include "apsi/zmq/sender_dispatcher.h"
 #include "common/common_utils.h"
@@ -44,7 +49,9 @@ shared_ptr<SenderDB> create_sender_db(
     unique_ptr<PSIParams> psi_params,
     OPRFKey &oprf_key,
     size_t nonce_byte_count,
-    bool compress);
+    bool compress,
+    bool pack,
+    bool reuse_oprf_key = false);
 
 int main(int argc, char *argv[])
 {
@@ -66,15 +73,25 @@ void sigint_handler(int param [[maybe_unused]])
     exit(0);
 }
 
-shared_ptr<SenderDB> try_load_sender_db(const CLP &cmd, OPRFKey &oprf_key)
+/**
+Set by SIGHUP to request the SenderDBs to be reloaded from their files.
+*/
+atomic<bool> reload_requested = false;
+
+void sighup_handler(int param [[maybe_unused]])
+{
+    reload_requested = true;
+}
+
+shared_ptr<SenderDB> try_load_sender_db(const CLP &cmd, const string &db_file, OPRFKey &oprf_key)
 {
     shared_ptr<SenderDB> result = nullptr;
 
-    ifstream fs(cmd.db_file(), ios::binary);
+    ifstream fs(db_file, ios::binary);
     fs.exceptions(ios_base::badbit | ios_base::failbit);
     try {
         auto [data, size] = SenderDB::Load(fs);
-        APSI_LOG_INFO("Loaded SenderDB (" << size << " bytes) from " << cmd.db_file());
+        APSI_LOG_INFO("Loaded SenderDB (" << size << " bytes) from " << db_file);
         if (!cmd.params_file().empty()) {
             APSI_LOG_WARNING(
                 "PSI parameters were loaded with the SenderDB; ignoring given PSI parameters");
@@ -83,7 +100,7 @@ shared_ptr<SenderDB> try_load_sender_db(const CLP &cmd, OPRFKey &oprf_key)
 
         // Load also the OPRF key
         oprf_key.load(fs);
-        APSI_LOG_INFO("Loaded OPRF key (" << oprf_key_size << " bytes) from " << cmd.db_file());
+        APSI_LOG_INFO("Loaded OPRF key (" << oprf_key_size << " bytes) from " << db_file);
     } catch (const exception &e) {
         // Failed to load SenderDB
         APSI_LOG_DEBUG("Failed to load SenderDB: " << e.what());
@@ -92,7 +109,8 @@ shared_ptr<SenderDB> try_load_sender_db(const CLP &cmd, OPRFKey &oprf_key)
     return result;
 }
 
-shared_ptr<SenderDB> try_load_csv_db(const CLP &cmd, OPRFKey &oprf_key)
+shared_ptr<SenderDB> try_load_csv_db(
+    const CLP &cmd, const string &db_file, OPRFKey &oprf_key, bool reuse_oprf_key)
 {
     unique_ptr<PSIParams> params = build_psi_params(cmd);
     if (!params) {
@@ -102,14 +120,20 @@ shared_ptr<SenderDB> try_load_csv_db(const CLP &cmd, OPRFKey &oprf_key)
     }
 
     unique_ptr<CSVReader::DBData> db_data;
-    if (cmd.db_file().empty() || !(db_data = load_db(cmd.db_file()))) {
+    if (db_file.empty() || !(db_data = load_db(db_file))) {
         // Failed to read db file
         APSI_LOG_DEBUG("Failed to load data from a CSV file");
         return nullptr;
     }
 
     return create_sender_db(
-        *db_data, move(params), oprf_key, cmd.nonce_byte_count(), cmd.compress());
+        *db_data,
+        move(params),
+        oprf_key,
+        cmd.nonce_byte_count(),
+        cmd.compress(),
+        cmd.pack(),
+        reuse_oprf_key);
 }
 
 bool try_save_sender_db(const CLP &cmd, shared_ptr<SenderDB> sender_db, const OPRFKey &oprf_key)
@@ -118,42 +142,89 @@ bool try_save_sender_db(const CLP &cmd, shared_ptr<SenderDB> sender_db, const OP
         return false;
     }
 
-    ofstream fs(cmd.sdb_out_file(), ios::binary);
-    fs.exceptions(ios_base::badbit | ios_base::failbit);
-    try {
-        size_t size = sender_db->save(fs);
-        APSI_LOG_INFO("Saved SenderDB (" << size << " bytes) to " << cmd.sdb_out_file());
+    uint32_t shard_count = cmd.sdb_shard_count();
+    uint32_t bundle_idx_count = sender_db->get_params().bundle_idx_count();
+    if (!shard_count || shard_count > bundle_idx_count) {
+        APSI_LOG_WARNING(
+            "Failed to save SenderDB: shard count must be between 1 and the number of bundle "
+            "indices ("
+            << bundle_idx_count << ")");
+        return false;
+    }
 
-        // Save also the OPRF key (fixed size: oprf_key_size bytes)
-        oprf_key.save(fs);
-        APSI_LOG_INFO("Saved OPRF key (" << oprf_key_size << " bytes) to " << cmd.sdb_out_file());
+    // Split the bundle indices as evenly as possible; each shard is saved with the OPRF key
+    for (uint32_t shard_idx = 0; shard_idx < shard_count; shard_idx++) {
+        string out_file = cmd.sdb_out_file();
+        if (shard_count > 1) {
+            out_file += "." + to_string(shard_idx);
+        }
 
-    } catch (const exception &e) {
-        APSI_LOG_WARNING("Failed to save SenderDB: " << e.what());
-        return false;
+        ofstream fs(out_file, ios::binary);
+        fs.exceptions(ios_base::badbit | ios_base::failbit);
+        try {
+            size_t size = 0;
+            if (shard_count > 1) {
+                uint32_t bundle_idx_begin = static_cast<uint32_t>(
+                    uint64_t(bundle_idx_count) * shard_idx / shard_count);
+                uint32_t bundle_idx_end = static_cast<uint32_t>(
+                    uint64_t(bundle_idx_count) * (shard_idx + 1) / shard_count);
+                size = sender_db->save_shard(fs, bundle_idx_begin, bundle_idx_end);
+                APSI_LOG_INFO(
+                    "Saved SenderDB shard for bundle indices [" << bundle_idx_begin << ", "
+                                                                << bundle_idx_end << ") ("
+                                                                << size << " bytes) to "
+                                                                << out_file);
+            } else {
+                size = sender_db->save(fs);
+                APSI_LOG_INFO("Saved SenderDB (" << size << " bytes) to " << out_file);
+            }
+
+            // Save also the OPRF key (fixed size: oprf_key_size bytes)
+            oprf_key.save(fs);
+            APSI_LOG_INFO("Saved OPRF key (" << oprf_key_size << " bytes) to " << out_file);
+        } catch (const exception &e) {
+            APSI_LOG_WARNING("Failed to save SenderDB: " << e.what());
+            return false;
+        }
     }
 
     return true;
 }
 
-int start_sender(const CLP &cmd)
+/**
+Loads a SenderDB and its OPRF key from a SenderDB file or a CSV file. A SenderDB created from a CSV
+file uses the given OPRF key if reuse_oprf_key is set, and a new OPRF key otherwise.
+*/
+shared_ptr<SenderDB> load_sender_db(
+    const CLP &cmd, const string &db_file, OPRFKey &oprf_key, bool reuse_oprf_key = false)
 {
-    ThreadPoolMgr::SetThreadCount(cmd.threads());
-    APSI_LOG_INFO("Setting thread count to " << ThreadPoolMgr::GetThreadCount());
-    signal(SIGINT, sigint_handler);
-
-    // Check that the database file is valid
-    throw_if_file_invalid(cmd.db_file());
-
     // Try loading first as a SenderDB, then as a CSV file
     shared_ptr<SenderDB> sender_db;
-    OPRFKey oprf_key;
-    if (!(sender_db = try_load_sender_db(cmd, oprf_key)) &&
-        !(sender_db = try_load_csv_db(cmd, oprf_key))) {
-        APSI_LOG_ERROR("Failed to create SenderDB: terminating");
-        return -1;
+    if (!(sender_db = try_load_sender_db(cmd, db_file, oprf_key))) {
+        sender_db = try_load_csv_db(cmd, db_file, oprf_key, reuse_oprf_key);
+    }
+
+    return sender_db;
+}
+
+/**
+Splits an argument of the form name=path into the name of a SenderDB and the path to its file.
+*/
+bool parse_named_db_file(const string &arg, string &db_name, string &db_file)
+{
+    size_t separator_pos = arg.find('=');
+    if (separator_pos == 0 || separator_pos == string::npos || separator_pos + 1 == arg.size()) {
+        APSI_LOG_ERROR("Invalid named SenderDB `" << arg << "`: expected name=path");
+        return false;
     }
 
+    db_name = arg.substr(0, separator_pos);
+    db_file = arg.substr(separator_pos + 1);
+    return true;
+}
+
+void print_sender_db_info(const shared_ptr<SenderDB> &sender_db)
+{
     // Print the total number of bin bundles and the largest number of bin bundles for any bundle
     // index
     uint32_t max_bin_bundles_per_bundle_idx = 0;
@@ -169,19 +240,159 @@ int start_sender(const CLP &cmd)
                                      << " bundle indices");
     APSI_LOG_INFO(
         "The largest bundle index holds " << max_bin_bundles_per_bundle_idx << " bin bundles");
+}
+
+/**
+Reloads a SenderDB from its file and swaps it into the dispatcher. The new SenderDB is loaded, and
+its caches generated, while the dispatcher continues to serve queries from the previous one. A
+SenderDB rebuilt from a CSV file keeps the current OPRF key, so receivers that have already run OPRF
+get correct results; a SenderDB file with a different OPRF key is rejected by the dispatcher.
+*/
+void reload_sender_db(
+    const CLP &cmd, ZMQSenderDispatcher &dispatcher, const string &db_name, const string &db_file)
+{
+    APSI_LOG_INFO("Reloading SenderDB `" << db_name << "` from " << db_file);
+    OPRFKey oprf_key = dispatcher.get_oprf_key(db_name);
+    shared_ptr<SenderDB> sender_db = load_sender_db(cmd, db_file, oprf_key, true);
+    if (!sender_db) {
+        APSI_LOG_ERROR("Failed to reload SenderDB: continuing with the current SenderDB");
+        return;
+    }
+    print_sender_db_info(sender_db);
+
+    try {
+        dispatcher.set_sender_db(db_name, move(sender_db), move(oprf_key));
+    } catch (const exception &ex) {
+        APSI_LOG_ERROR(
+            "Failed to replace SenderDB: " << ex.what()
+                                           << "; continuing with the current SenderDB");
+    }
+}
+
+/**
+Reloads all SenderDBs whenever SIGHUP is received.
+*/
+void reload_sender_dbs_on_signal(
+    const CLP &cmd, ZMQSenderDispatcher &dispatcher, const atomic<bool> &stop)
+{
+    while (!stop) {
+        if (!reload_requested.exchange(false)) {
+            this_thread::sleep_for(100ms);
+            continue;
+        }
+
+        reload_sender_db(cmd, dispatcher, "", cmd.db_file());
+        for (const auto &named_db_file : cmd.named_db_files()) {
+            string db_name, db_file;
+            if (parse_named_db_file(named_db_file, db_name, db_file)) {
+                reload_sender_db(cmd, dispatcher, db_name, db_file);
+            }
+        }
+    }
+}
+
+int start_sender(const CLP &cmd)
+{
+    ThreadPoolMgr::SetThreadCount(cmd.threads());
+    APSI_LOG_INFO("Setting thread count to " << ThreadPoolMgr::GetThreadCount());
+    signal(SIGINT, sigint_handler);
+
+    // Check that the database file is valid
+    throw_if_file_invalid(cmd.db_file());
+
+    shared_ptr<SenderDB> sender_db;
+    OPRFKey oprf_key;
+    if (!(sender_db = load_sender_db(cmd, cmd.db_file(), oprf_key))) {
+        APSI_LOG_ERROR("Failed to create SenderDB: terminating");
+        return -1;
+    }
+    print_sender_db_info(sender_db);
 
     // Try to save the SenderDB if a save file was given
     if (!cmd.sdb_out_file().empty() && !try_save_sender_db(cmd, sender_db, oprf_key)) {
         return -1;
     }
 
+    // Set up the cache of decompressed plaintexts; this only matters for a compressed or packed
+    // SenderDB
+    if (cmd.pt_cache_size()) {
+        if (sender_db->is_compressed() || sender_db->is_packed()) {
+            apsi::sender::util::PlaintextCache::Global().set_memory_budget(
+                cmd.pt_cache_size() << 20);
+            APSI_LOG_INFO(
+                "Caching decompressed plaintexts with a budget of " << cmd.pt_cache_size()
+                                                                    << " MB");
+        } else {
+            APSI_LOG_WARNING(
+                "SenderDB is not compressed or packed; ignoring plaintext cache size");
+        }
+    }
+
+    // Set how many bin bundles are evaluated together
+    Sender::SetBinBundleTileSize(cmd.bundle_tile_size());
+    if (cmd.bundle_tile_size() != 1) {
+        APSI_LOG_INFO("Evaluating bin bundles in tiles of size " << cmd.bundle_tile_size());
+    }
+
+    // Bound the memory used for evaluating the polynomials of one task
+    Sender::SetEvalMemoryLimit(cmd.eval_memory_limit() << 20);
+    if (cmd.eval_memory_limit() != 256) {
+        APSI_LOG_INFO(
+            "Evaluating polynomials with a memory limit of " << cmd.eval_memory_limit() << " MB");
+    }
+
     // Run the dispatcher
     atomic<bool> stop = false;
     ZMQSenderDispatcher dispatcher(sender_db, oprf_key);
+    if (cmd.query_batch_size() > 1) {
+        dispatcher.set_query_batch_size(cmd.query_batch_size());
+        APSI_LOG_INFO("Processing up to " << cmd.query_batch_size() << " queries together");
+    }
+    dispatcher.set_max_queued_queries(cmd.max_queued_queries());
+    if (cmd.max_queued_queries() != 16) {
+        APSI_LOG_INFO(
+            "Allowing up to " << cmd.max_queued_queries() << " waiting queries per SenderDB");
+    }
+
+    // Add the named SenderDBs; they share the thread pool and the plaintext cache budget with the
+    // default SenderDB
+    for (const auto &named_db_file : cmd.named_db_files()) {
+        string db_name, db_file;
+        if (!parse_named_db_file(named_db_file, db_name, db_file)) {
+            return -1;
+        }
+
+        OPRFKey named_oprf_key;
+        shared_ptr<SenderDB> named_sender_db = load_sender_db(cmd, db_file, named_oprf_key);
+        if (!named_sender_db) {
+            APSI_LOG_ERROR("Failed to create SenderDB `" << db_name << "`: terminating");
+            return -1;
+        }
+        print_sender_db_info(named_sender_db);
+
+        try {
+            dispatcher.add_sender_db(db_name, named_sender_db, named_oprf_key);
+        } catch (const exception &ex) {
+            APSI_LOG_ERROR("Failed to add SenderDB `" << db_name << "`: " << ex.what());
+            return -1;
+        }
+    }
+
+#ifdef SIGHUP
+    // Reload the SenderDBs in the background on SIGHUP; queries continue to be served meanwhile
+    signal(SIGHUP, sighup_handler);
+    thread reload_thread(reload_sender_dbs_on_signal, cref(cmd), ref(dispatcher), cref(stop));
+    APSI_LOG_INFO("Send SIGHUP to reload the SenderDBs from their files");
+#endif
 
     // The dispatcher will run until stopped.
     dispatcher.run(stop, cmd.net_port());
 
+#ifdef SIGHUP
+    stop = true;
+    reload_thread.join();
+#endif
+
     return 0;
 }
 
@@ -204,7 +415,9 @@ shared_ptr<SenderDB> create_sender_db(
     unique_ptr<PSIParams> psi_params,
     OPRFKey &oprf_key,
     size_t nonce_byte_count,
-    bool compress)
+    bool compress,
+    bool pack,
+    bool reuse_oprf_key)
 {
     if (!psi_params) {
         APSI_LOG_ERROR("No PSI parameters were given");
@@ -214,7 +427,11 @@ shared_ptr<SenderDB> create_sender_db(
     shared_ptr<SenderDB> sender_db;
     if (holds_alternative<CSVReader::UnlabeledData>(db_data)) {
         try {
-            sender_db = make_shared<SenderDB>(*psi_params, 0, 0, compress);
+            if (reuse_oprf_key) {
+                sender_db = make_shared<SenderDB>(*psi_params, oprf_key, 0, 0, compress, pack);
+            } else {
+                sender_db = make_shared<SenderDB>(*psi_params, 0, 0, compress, pack);
+            }
             sender_db->set_data(get<CSVReader::UnlabeledData>(db_data));
 
             APSI_LOG_INFO(
@@ -233,8 +450,13 @@ shared_ptr<SenderDB> create_sender_db(
                     return a.second.size() < b.second.size();
                 })->second.size();
 
-            sender_db =
-                make_shared<SenderDB>(*psi_params, label_byte_count, nonce_byte_count, compress);
+            if (reuse_oprf_key) {
+                sender_db = make_shared<SenderDB>(
+                    *psi_params, oprf_key, label_byte_count, nonce_byte_count, compress, pack);
+            } else {
+                sender_db = make_shared<SenderDB>(
+                    *psi_params, label_byte_count, nonce_byte_count, compress, pack);
+            }
             sender_db->set_data(labeled_db_data);
             APSI_LOG_INFO(
                 "Created labeled SenderDB with " << sender_db->get_item_count() << " items and "
@@ -250,7 +472,9 @@ shared_ptr<SenderDB> create_sender_db(
         return nullptr;
     }
 
-    if (compress) {
+    if (pack) {
+        APSI_LOG_INFO("Using bit-packed field elements to reduce memory footprint");
+    } else if (compress) {
         APSI_LOG_INFO("Using in-memory compression to reduce memory footprint");
     }
 
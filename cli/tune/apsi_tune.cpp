@@ -0,0 +1,185 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// APSI
+#include "apsi/log.h"
+#include "apsi/thread_pool_mgr.h"
+#include "apsi/version.h"
+#include "common/common_utils.h"
+#include "tune/benchmark.h"
+#include "tune/candidates.h"
+#include "tune/clp.h"
+
+using namespace std;
+using namespace apsi;
+
+namespace {
+    /**
+    Returns whether a is at least as good as b in every measurement and better in at least one.
+    */
+    bool dominates(const BenchmarkResult &a, const BenchmarkResult &b)
+    {
+        bool no_worse = a.latency_ms <= b.latency_ms && a.throughput >= b.throughput &&
+                        a.communication_bytes <= b.communication_bytes &&
+                        a.memory_bytes <= b.memory_bytes;
+        bool better = a.latency_ms < b.latency_ms || a.throughput > b.throughput ||
+                      a.communication_bytes < b.communication_bytes ||
+                      a.memory_bytes < b.memory_bytes;
+        return no_worse && better;
+    }
+
+    vector<bool> find_pareto_front(const vector<BenchmarkResult> &results)
+    {
+        vector<bool> on_front(results.size(), false);
+        for (size_t i = 0; i < results.size(); i++) {
+            if (!results[i].success) {
+                continue;
+            }
+            on_front[i] = none_of(results.begin(), results.end(), [&](const auto &other) {
+                return other.success && dominates(other, results[i]);
+            });
+        }
+
+        return on_front;
+    }
+
+    string file_name(const string &path)
+    {
+        size_t pos = path.find_last_of("/\\");
+        return pos == string::npos ? path : path.substr(pos + 1);
+    }
+
+    void print_report(
+        const vector<TuneCandidate> &candidates,
+        const vector<BenchmarkResult> &results,
+        const vector<bool> &on_front)
+    {
+        // Successful candidates first, fastest first
+        vector<size_t> order(candidates.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (results[a].success != results[b].success) {
+                return results[a].success;
+            }
+            return results[a].latency_ms < results[b].latency_ms;
+        });
+
+        cout << setw(4) << "#" << setw(4) << "PF" << setw(20) << "Seed" << setw(8) << "Table"
+             << setw(7) << "Bin" << setw(6) << "PS" << setw(8) << "Powers" << setw(7) << "Depth"
+             << setw(12) << "Latency ms" << setw(11) << "Queries/s" << setw(11) << "Comm KB"
+             << setw(11) << "SDB MB"
+             << "  Status" << endl;
+        for (size_t i : order) {
+            const auto &params = *candidates[i].params;
+            const auto &result = results[i];
+            cout << setw(4) << i + 1 << setw(4) << (on_front[i] ? "*" : "") << setw(20)
+                 << file_name(candidates[i].seed_file) << setw(8)
+                 << params.table_params().table_size << setw(7)
+                 << params.table_params().max_items_per_bin << setw(6)
+                 << params.query_params().ps_low_degree << setw(8)
+                 << params.query_params().query_powers.size() << setw(7) << candidates[i].depth;
+            if (result.success) {
+                cout << fixed << setprecision(1) << setw(12) << result.latency_ms << setw(11)
+                     << result.throughput << setw(11)
+                     << static_cast<double>(result.communication_bytes) / 1024.0 << setw(11)
+                     << static_cast<double>(result.memory_bytes) / (1024.0 * 1024.0) << "  ok";
+            } else {
+                cout << setw(45) << "" << "  failed: " << result.error;
+            }
+            cout << endl;
+        }
+    }
+
+    void write_front(
+        const vector<TuneCandidate> &candidates,
+        const vector<bool> &on_front,
+        const string &out_dir)
+    {
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (!on_front[i]) {
+                continue;
+            }
+
+            string out_file = out_dir + "/apsi_tune_" + to_string(i + 1) + ".json";
+            try {
+                ofstream fs(out_file);
+                fs.exceptions(ios_base::badbit | ios_base::failbit);
+                fs << candidate_to_json(candidates[i]) << endl;
+                APSI_LOG_INFO("Wrote parameters for candidate " << i + 1 << " to " << out_file);
+            } catch (const exception &ex) {
+                APSI_LOG_ERROR("Failed to write " << out_file << ": " << ex.what());
+            }
+        }
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    prepare_console();
+
+    CLP cmd(
+        "apsi_tune benchmarks candidate PSI parameters derived from given parameter files and "
+        "reports the Pareto front of latency, throughput, communication, and memory",
+        APSI_VERSION);
+    if (!cmd.parse_args(argc, argv)) {
+        APSI_LOG_ERROR("Failed parsing command line arguments");
+        return -1;
+    }
+
+    ThreadPoolMgr::SetThreadCount(cmd.threads());
+    APSI_LOG_INFO("Setting thread count to " << ThreadPoolMgr::GetThreadCount());
+
+    CandidateOptions candidate_options;
+    candidate_options.receiver_size = cmd.receiver_size();
+    candidate_options.max_items_per_bin = cmd.max_items_per_bin();
+    candidate_options.table_ratio = cmd.table_ratio();
+    candidate_options.beam_width = cmd.beam_width();
+    vector<TuneCandidate> candidates = create_candidates(cmd.seed_files(), candidate_options);
+    if (candidates.empty()) {
+        APSI_LOG_ERROR("Found no valid candidate parameters");
+        return -1;
+    }
+    if (candidates.size() > cmd.max_candidates()) {
+        APSI_LOG_WARNING(
+            "Benchmarking only the first " << cmd.max_candidates() << " of "
+                                           << candidates.size() << " candidates");
+        candidates.resize(cmd.max_candidates());
+    }
+
+    BenchmarkOptions benchmark_options;
+    benchmark_options.sender_size = cmd.sender_size();
+    benchmark_options.receiver_size = cmd.receiver_size();
+    benchmark_options.label_byte_count = cmd.label_byte_count();
+    benchmark_options.repeat_count = cmd.repeat();
+    benchmark_options.batch_size = cmd.batch_size();
+
+    vector<BenchmarkResult> results;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        APSI_LOG_INFO(
+            "Benchmarking candidate " << i + 1 << " of " << candidates.size() << ": "
+                                      << candidates[i].params->to_string());
+        results.push_back(run_benchmark(*candidates[i].params, benchmark_options));
+        if (!results.back().success) {
+            APSI_LOG_WARNING("Candidate " << i + 1 << " failed: " << results.back().error);
+        }
+    }
+
+    vector<bool> on_front = find_pareto_front(results);
+    print_report(candidates, results, on_front);
+    if (!cmd.out_dir().empty()) {
+        write_front(candidates, on_front, cmd.out_dir());
+    }
+
+    return 0;
+}
@@ -0,0 +1,268 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <streambuf>
+#include <utility>
+#include <vector>
+
+// APSI
+#include "apsi/item.h"
+#include "apsi/match_record.h"
+#include "apsi/network/stream_channel.h"
+#include "apsi/receiver.h"
+#include "apsi/sender.h"
+#include "apsi/sender_db.h"
+#include "tune/benchmark.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::network;
+using namespace apsi::oprf;
+using namespace apsi::receiver;
+using namespace apsi::sender;
+
+namespace {
+    /**
+    A stream buffer that discards its output.
+    */
+    class NullStreamBuf : public streambuf {
+    protected:
+        int_type overflow(int_type ch) override
+        {
+            return traits_type::not_eof(ch);
+        }
+
+        streamsize xsputn(const char *, streamsize count) override
+        {
+            return count;
+        }
+    };
+
+    constexpr size_t no_match = numeric_limits<size_t>::max();
+
+    Label create_label(size_t sender_idx, size_t label_byte_count)
+    {
+        Label label(label_byte_count);
+        for (size_t i = 0; i < label_byte_count; i++) {
+            label[i] = static_cast<unsigned char>((sender_idx + i) & 0xFF);
+        }
+        return label;
+    }
+
+    /**
+    Holds the OPRF-processed items and the label keys of a receiver's query.
+    */
+    struct HashedQuery {
+        vector<HashedItem> items;
+
+        vector<LabelKey> label_keys;
+    };
+
+    HashedQuery run_oprf(const vector<Item> &items, const OPRFKey &oprf_key, StreamChannel &chl)
+    {
+        OPRFReceiver oprf_receiver = Receiver::CreateOPRFReceiver(items);
+        chl.send(Receiver::CreateOPRFRequest(oprf_receiver));
+        OPRFRequest oprf_request =
+            to_oprf_request(chl.receive_operation(nullptr, SenderOperationType::sop_oprf));
+        Sender::RunOPRF(oprf_request, oprf_key, chl);
+        OPRFResponse oprf_response = to_oprf_response(chl.receive_response());
+
+        HashedQuery result;
+        tie(result.items, result.label_keys) =
+            Receiver::ExtractHashes(oprf_response, oprf_receiver);
+        return result;
+    }
+
+    vector<ResultPart> receive_result(const Receiver &receiver, StreamChannel &chl)
+    {
+        QueryResponse query_response = to_query_response(chl.receive_response());
+        uint32_t package_count = query_response->package_count;
+
+        vector<ResultPart> rps;
+        while (package_count--) {
+            rps.push_back(chl.receive_result(receiver.get_seal_context()));
+        }
+        return rps;
+    }
+
+    vector<MatchRecord> run_query(
+        Receiver &receiver,
+        shared_ptr<SenderDB> sender_db,
+        const OPRFKey &oprf_key,
+        StreamChannel &chl,
+        const vector<Item> &items)
+    {
+        HashedQuery hashed_query = run_oprf(items, oprf_key, chl);
+
+        pair<Request, IndexTranslationTable> query = receiver.create_query(hashed_query.items);
+        chl.send(move(query.first));
+        QueryRequest query_request =
+            to_query_request(chl.receive_operation(sender_db->get_seal_context()));
+        Sender::RunQuery(Query(move(query_request), sender_db), chl);
+
+        return receiver.process_result(
+            hashed_query.label_keys, query.second, receive_result(receiver, chl));
+    }
+
+    bool check_result(
+        const vector<MatchRecord> &result, const vector<size_t> &expected, size_t label_byte_count)
+    {
+        if (result.size() != expected.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < result.size(); i++) {
+            if (result[i].found != (expected[i] != no_match)) {
+                return false;
+            }
+            if (result[i].found && label_byte_count) {
+                Label label = create_label(expected[i], label_byte_count);
+                auto received = result[i].label.get_as<unsigned char>();
+                if (!equal(label.begin(), label.end(), received.begin(), received.end())) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    double seconds_since(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+} // namespace
+
+BenchmarkResult run_benchmark(const PSIParams &params, const BenchmarkOptions &options)
+{
+    BenchmarkResult result;
+
+    try {
+        // The receiver's items are spread over the sender's set for half of the query and do not
+        // match for the other half
+        size_t match_count = min(options.sender_size, (options.receiver_size + 1) / 2);
+        size_t match_stride = match_count ? options.sender_size / match_count : 0;
+        vector<Item> recv_items;
+        vector<size_t> expected;
+        for (size_t i = 0; i < options.receiver_size; i++) {
+            if (i < match_count) {
+                size_t sender_idx = i * match_stride;
+                recv_items.emplace_back(sender_idx + 1, sender_idx + 1);
+                expected.push_back(sender_idx);
+            } else {
+                recv_items.emplace_back(i + 1, ~(i + 1));
+                expected.push_back(no_match);
+            }
+        }
+
+        auto start = chrono::steady_clock::now();
+        auto sender_db = make_shared<SenderDB>(params, options.label_byte_count);
+        if (options.label_byte_count) {
+            vector<pair<Item, Label>> sender_items;
+            sender_items.reserve(options.sender_size);
+            for (size_t i = 0; i < options.sender_size; i++) {
+                sender_items.emplace_back(
+                    Item(i + 1, i + 1), create_label(i, options.label_byte_count));
+            }
+            sender_db->set_data(sender_items);
+        } else {
+            vector<Item> sender_items;
+            sender_items.reserve(options.sender_size);
+            for (size_t i = 0; i < options.sender_size; i++) {
+                sender_items.emplace_back(i + 1, i + 1);
+            }
+            sender_db->set_data(sender_items);
+        }
+        result.setup_seconds = seconds_since(start);
+
+        // SenderDB::save returns the number of bytes written
+        NullStreamBuf null_buf;
+        ostream null_stream(&null_buf);
+        result.memory_bytes = sender_db->save(null_stream);
+
+        OPRFKey oprf_key = sender_db->get_oprf_key();
+        Receiver receiver(params);
+
+        // Time single queries; the channel counts the bytes sent by both parties
+        vector<double> latencies;
+        for (size_t i = 0; i < max<size_t>(options.repeat_count, 1); i++) {
+            stringstream ss;
+            StreamChannel chl(ss);
+
+            start = chrono::steady_clock::now();
+            vector<MatchRecord> query_result =
+                run_query(receiver, sender_db, oprf_key, chl, recv_items);
+            latencies.push_back(1000.0 * seconds_since(start));
+
+            result.communication_bytes = chl.bytes_sent();
+            if (!check_result(query_result, expected, options.label_byte_count)) {
+                result.error = "incorrect query result";
+                return result;
+            }
+        }
+        nth_element(
+            latencies.begin(),
+            latencies.begin() + static_cast<ptrdiff_t>(latencies.size() / 2),
+            latencies.end());
+        result.latency_ms = latencies[latencies.size() / 2];
+
+        // Time a batch of queries processed together; each receives its result on its own channel
+        size_t batch_size = max<size_t>(options.batch_size, 1);
+        stringstream ss;
+        StreamChannel chl(ss);
+        vector<unique_ptr<stringstream>> result_streams;
+        vector<unique_ptr<StreamChannel>> result_chls;
+        vector<HashedQuery> hashed_queries;
+        vector<IndexTranslationTable> itts;
+        vector<Query> queries;
+
+        start = chrono::steady_clock::now();
+        for (size_t i = 0; i < batch_size; i++) {
+            hashed_queries.push_back(run_oprf(recv_items, oprf_key, chl));
+            pair<Request, IndexTranslationTable> query =
+                receiver.create_query(hashed_queries.back().items);
+            itts.push_back(move(query.second));
+            chl.send(move(query.first));
+            queries.emplace_back(
+                to_query_request(chl.receive_operation(sender_db->get_seal_context())),
+                sender_db);
+
+            result_streams.push_back(make_unique<stringstream>());
+            result_chls.push_back(make_unique<StreamChannel>(*result_streams.back()));
+        }
+        Sender::RunQueries(
+            vector<reference_wrapper<const Query>>(queries.begin(), queries.end()),
+            chl,
+            [&](Channel &, Response response, size_t query_idx) {
+                result_chls[query_idx]->send(move(response));
+            },
+            [&](Channel &, ResultPart rp, size_t query_idx) {
+                result_chls[query_idx]->send(move(rp));
+            });
+        for (size_t i = 0; i < batch_size; i++) {
+            vector<MatchRecord> query_result = receiver.process_result(
+                hashed_queries[i].label_keys, itts[i], receive_result(receiver, *result_chls[i]));
+            if (!check_result(query_result, expected, options.label_byte_count)) {
+                result.error = "incorrect query result in batch";
+                return result;
+            }
+        }
+        result.throughput = static_cast<double>(batch_size) / seconds_since(start);
+
+        result.success = true;
+    } catch (const exception &ex) {
+        result.error = ex.what();
+    }
+
+    return result;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// APSI
+#include "apsi/psi_params.h"
+
+/**
+Options for benchmarking candidate parameters.
+*/
+struct BenchmarkOptions {
+    std::size_t sender_size = 0;
+
+    std::size_t receiver_size = 0;
+
+    /**
+    The label size in bytes; zero means unlabeled mode.
+    */
+    std::size_t label_byte_count = 0;
+
+    /**
+    The number of queries timed for the latency.
+    */
+    std::size_t repeat_count = 3;
+
+    /**
+    The number of queries processed together for the throughput.
+    */
+    std::size_t batch_size = 4;
+};
+
+/**
+Measurements from benchmarking one set of parameters.
+*/
+struct BenchmarkResult {
+    /**
+    Whether the benchmark ran and every query returned the correct result. Incorrect results
+    typically mean that the SEAL parameters do not leave enough noise budget.
+    */
+    bool success = false;
+
+    std::string error;
+
+    /**
+    Time in seconds to create the SenderDB.
+    */
+    double setup_seconds = 0;
+
+    /**
+    Median time in milliseconds for a single query, including the OPRF step.
+    */
+    double latency_ms = 0;
+
+    /**
+    Queries per second when processing a batch of queries together.
+    */
+    double throughput = 0;
+
+    /**
+    Total bytes sent in both directions for a single query, including the OPRF step.
+    */
+    std::uint64_t communication_bytes = 0;
+
+    /**
+    Size in bytes of the serialized SenderDB, used as a measure of its memory use.
+    */
+    std::uint64_t memory_bytes = 0;
+};
+
+/**
+Creates a SenderDB with synthetic data for the given parameters, and times queries against it
+over an in-memory StreamChannel. Exceptions are caught and reported in the result.
+*/
+BenchmarkResult run_benchmark(const apsi::PSIParams &params, const BenchmarkOptions &options);
@@ -0,0 +1,181 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+// APSI
+#include "apsi/log.h"
+#include "apsi/powers.h"
+#include "apsi/util/source_optimizer.h"
+#include "apsi/util/utils.h"
+#include "tune/candidates.h"
+
+using namespace std;
+using namespace apsi;
+
+namespace {
+    /**
+    Searching for query_powers is quadratic in the number of target powers per evaluated source
+    set; larger searches are skipped.
+    */
+    constexpr size_t max_search_target_count = 256;
+
+    string read_file(const string &file_name)
+    {
+        ifstream fs(file_name);
+        if (!fs.is_open()) {
+            throw runtime_error("could not open file " + file_name);
+        }
+        stringstream ss;
+        ss << fs.rdbuf();
+        return ss.str();
+    }
+
+    uint32_t get_depth(const PSIParams::QueryParams &query_params, uint32_t bound)
+    {
+        PowersDag pd;
+        pd.configure(
+            query_params.query_powers,
+            util::create_powers_set(query_params.ps_low_degree, bound));
+        if (!pd.is_configured()) {
+            throw runtime_error("failed to configure PowersDag");
+        }
+        return pd.depth();
+    }
+
+    /**
+    Creates the candidates for a single seed and appends them to the given vector.
+    */
+    void add_seed_candidates(
+        const string &seed_file, const CandidateOptions &options, vector<TuneCandidate> &out)
+    {
+        string seed_str = read_file(seed_file);
+        Json::Value seed_json;
+        stringstream(seed_str) >> seed_json;
+        PSIParams seed = PSIParams::Load(seed_str);
+
+        const auto &seed_table_params = seed.table_params();
+        const auto &seed_query_params = seed.query_params();
+        uint32_t seed_bound = seed_table_params.max_items_per_bin;
+        uint32_t max_depth = get_depth(seed_query_params, seed_bound);
+
+        // Use the smallest table that fits the receiver's set; table_size must be a multiple of
+        // items_per_bundle
+        uint32_t items_per_bundle = seed.items_per_bundle();
+        double min_table_size =
+            max<double>(1.0, static_cast<double>(options.receiver_size) * options.table_ratio);
+        uint32_t bundle_idx_count = static_cast<uint32_t>(
+            ceil(min_table_size / static_cast<double>(items_per_bundle)));
+        PSIParams::TableParams table_params = seed_table_params;
+        table_params.table_size = bundle_idx_count * items_per_bundle;
+
+        set<uint32_t> bounds(options.max_items_per_bin.begin(), options.max_items_per_bin.end());
+        if (bounds.empty()) {
+            bounds = { seed_bound / 2, seed_bound, seed_bound * 2 };
+        }
+        bounds.erase(0);
+
+        for (uint32_t bound : bounds) {
+            table_params.max_items_per_bin = bound;
+
+            PSIParams::QueryParams query_params;
+            if (seed_query_params.ps_low_degree) {
+                double scale = sqrt(static_cast<double>(bound) / static_cast<double>(seed_bound));
+                query_params.ps_low_degree = min(
+                    bound,
+                    max<uint32_t>(
+                        1,
+                        static_cast<uint32_t>(
+                            lround(seed_query_params.ps_low_degree * scale))));
+            }
+
+            if (bound == seed_bound &&
+                query_params.ps_low_degree == seed_query_params.ps_low_degree) {
+                query_params.query_powers = seed_query_params.query_powers;
+            } else {
+                size_t target_count =
+                    util::create_powers_set(query_params.ps_low_degree, bound).size();
+                if (target_count > max_search_target_count) {
+                    APSI_LOG_INFO(
+                        "Skipping max_items_per_bin " << bound << " for " << seed_file
+                                                      << ": too many powers to search");
+                    continue;
+                }
+
+                util::SourcesSearchOptions search_options;
+                search_options.max_depth = max_depth;
+                search_options.max_source_count =
+                    static_cast<uint32_t>(seed_query_params.query_powers.size() + 2);
+                search_options.beam_width = options.beam_width;
+                search_options.candidate_count = 1;
+                vector<util::SourcesCandidate> sources =
+                    util::find_sources(query_params.ps_low_degree, bound, search_options);
+                if (sources.empty()) {
+                    APSI_LOG_INFO(
+                        "Skipping max_items_per_bin " << bound << " for " << seed_file
+                                                      << ": no query_powers with depth at most "
+                                                      << max_depth);
+                    continue;
+                }
+                query_params.query_powers = sources.front().sources;
+            }
+
+            TuneCandidate candidate;
+            try {
+                candidate.params = make_unique<PSIParams>(
+                    seed.item_params(), table_params, query_params, seed.seal_params());
+            } catch (const exception &ex) {
+                APSI_LOG_INFO(
+                    "Skipping max_items_per_bin " << bound << " for " << seed_file << ": "
+                                                  << ex.what());
+                continue;
+            }
+            candidate.seed_file = seed_file;
+            candidate.seed_json = seed_json;
+            candidate.depth = get_depth(query_params, bound);
+            out.push_back(move(candidate));
+        }
+    }
+} // namespace
+
+vector<TuneCandidate> create_candidates(
+    const vector<string> &seed_files, const CandidateOptions &options)
+{
+    vector<TuneCandidate> candidates;
+    for (const auto &seed_file : seed_files) {
+        try {
+            add_seed_candidates(seed_file, options, candidates);
+        } catch (const exception &ex) {
+            APSI_LOG_WARNING("Skipping seed " << seed_file << ": " << ex.what());
+        }
+    }
+
+    return candidates;
+}
+
+string candidate_to_json(const TuneCandidate &candidate)
+{
+    const PSIParams &params = *candidate.params;
+    Json::Value root = candidate.seed_json;
+
+    root["table_params"]["table_size"] = params.table_params().table_size;
+    root["table_params"]["max_items_per_bin"] = params.table_params().max_items_per_bin;
+
+    Json::Value query_powers(Json::arrayValue);
+    for (uint32_t power : params.query_params().query_powers) {
+        query_powers.append(power);
+    }
+    root["query_params"]["ps_low_degree"] = params.query_params().ps_low_degree;
+    root["query_params"]["query_powers"] = query_powers;
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "    ";
+    return Json::writeString(builder, root);
+}
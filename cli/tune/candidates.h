@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// APSI
+#include "apsi/psi_params.h"
+
+// JSON
+#include "json/json.h"
+
+/**
+Options controlling which candidate parameters are created.
+*/
+struct CandidateOptions {
+    std::size_t receiver_size = 0;
+
+    /**
+    The values of max_items_per_bin to try. If empty, half, one, and two times the value in each
+    seed file are tried.
+    */
+    std::vector<std::uint32_t> max_items_per_bin;
+
+    /**
+    The smallest allowed ratio of table_size to receiver_size.
+    */
+    double table_ratio = 1.5;
+
+    /**
+    The beam width used when searching for query_powers.
+    */
+    std::size_t beam_width = 8;
+};
+
+/**
+Candidate parameters derived from a seed parameter file.
+*/
+struct TuneCandidate {
+    std::string seed_file;
+
+    /**
+    The seed parameter file; the candidate is written out by replacing table_params and
+    query_params in it.
+    */
+    Json::Value seed_json;
+
+    std::unique_ptr<apsi::PSIParams> params;
+
+    /**
+    The depth of the PowersDag for the query_powers of the candidate.
+    */
+    std::uint32_t depth = 0;
+};
+
+/**
+Creates candidate parameters from the given seed parameter files. Each seed file fixes the SEAL
+parameters, item parameters, and hash function count, as well as the largest depth of the
+PowersDag, since the SEAL parameters were chosen for it. For each seed, table_size is set to fit
+the receiver's set, and for each value of max_items_per_bin, ps_low_degree is scaled with the
+square root of max_items_per_bin and new query_powers are searched for. Seeds or candidates that
+are invalid are skipped.
+*/
+std::vector<TuneCandidate> create_candidates(
+    const std::vector<std::string> &seed_files, const CandidateOptions &options);
+
+/**
+Returns the candidate parameters in JSON format.
+*/
+std::string candidate_to_json(const TuneCandidate &candidate);
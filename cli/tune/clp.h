@@ -0,0 +1,208 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// APSI
+#include "common/base_clp.h"
+
+/**
+Command Line Processor for apsi_tune.
+*/
+class CLP : public BaseCLP {
+public:
+    CLP(const std::string &desc, const std::string &version) : BaseCLP(desc, version)
+    {}
+
+    virtual void add_args()
+    {
+        add(sender_size_arg_);
+        add(receiver_size_arg_);
+        add(label_byte_count_arg_);
+        add(max_items_per_bin_arg_);
+        add(table_ratio_arg_);
+        add(beam_width_arg_);
+        add(max_candidates_arg_);
+        add(repeat_arg_);
+        add(batch_size_arg_);
+        add(out_dir_arg_);
+        add(seed_files_arg_);
+    }
+
+    virtual void get_args()
+    {
+        sender_size_ = sender_size_arg_.getValue();
+        receiver_size_ = receiver_size_arg_.getValue();
+        label_byte_count_ = label_byte_count_arg_.getValue();
+        max_items_per_bin_ = max_items_per_bin_arg_.getValue();
+        table_ratio_ = table_ratio_arg_.getValue();
+        beam_width_ = beam_width_arg_.getValue();
+        max_candidates_ = max_candidates_arg_.getValue();
+        repeat_ = repeat_arg_.getValue();
+        batch_size_ = batch_size_arg_.getValue();
+        out_dir_ = out_dir_arg_.getValue();
+        seed_files_ = seed_files_arg_.getValue();
+    }
+
+    std::size_t sender_size() const
+    {
+        return sender_size_;
+    }
+
+    std::size_t receiver_size() const
+    {
+        return receiver_size_;
+    }
+
+    std::size_t label_byte_count() const
+    {
+        return label_byte_count_;
+    }
+
+    const std::vector<std::uint32_t> &max_items_per_bin() const
+    {
+        return max_items_per_bin_;
+    }
+
+    double table_ratio() const
+    {
+        return table_ratio_;
+    }
+
+    std::size_t beam_width() const
+    {
+        return beam_width_;
+    }
+
+    std::size_t max_candidates() const
+    {
+        return max_candidates_;
+    }
+
+    std::size_t repeat() const
+    {
+        return repeat_;
+    }
+
+    std::size_t batch_size() const
+    {
+        return batch_size_;
+    }
+
+    const std::string &out_dir() const
+    {
+        return out_dir_;
+    }
+
+    const std::vector<std::string> &seed_files() const
+    {
+        return seed_files_;
+    }
+
+private:
+    TCLAP::ValueArg<std::size_t> sender_size_arg_ = TCLAP::ValueArg<std::size_t>(
+        "", "senderSize", "Number of items in the sender's set", true, 0, "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> receiver_size_arg_ = TCLAP::ValueArg<std::size_t>(
+        "", "receiverSize", "Number of items in a receiver's query", true, 0, "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> label_byte_count_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "labelByteCount",
+        "Number of bytes in each label; 0 means unlabeled mode (default is 0)",
+        false,
+        0,
+        "unsigned integer");
+
+    TCLAP::MultiArg<std::uint32_t> max_items_per_bin_arg_ = TCLAP::MultiArg<std::uint32_t>(
+        "m",
+        "maxItemsPerBin",
+        "A value of max_items_per_bin to try; may be given multiple times (default is half, one, "
+        "and two times the value in each seed file)",
+        false,
+        "unsigned integer");
+
+    TCLAP::ValueArg<double> table_ratio_arg_ = TCLAP::ValueArg<double>(
+        "",
+        "tableRatio",
+        "Smallest allowed ratio of table_size to the receiver's set size (default is 1.5)",
+        false,
+        1.5,
+        "number");
+
+    TCLAP::ValueArg<std::size_t> beam_width_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "beamWidth",
+        "Beam width of the search for query_powers when max_items_per_bin or ps_low_degree "
+        "differs from the seed file (default is 8)",
+        false,
+        8,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> max_candidates_arg_ = TCLAP::ValueArg<std::size_t>(
+        "",
+        "maxCandidates",
+        "Largest number of candidate parameters to benchmark (default is 16)",
+        false,
+        16,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> repeat_arg_ = TCLAP::ValueArg<std::size_t>(
+        "r",
+        "repeat",
+        "Number of queries to time for the latency of each candidate (default is 3)",
+        false,
+        3,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::size_t> batch_size_arg_ = TCLAP::ValueArg<std::size_t>(
+        "b",
+        "batchSize",
+        "Number of queries processed together to measure throughput (default is 4)",
+        false,
+        4,
+        "unsigned integer");
+
+    TCLAP::ValueArg<std::string> out_dir_arg_ = TCLAP::ValueArg<std::string>(
+        "o",
+        "outDir",
+        "Directory to write the parameters on the Pareto front to as JSON files",
+        false,
+        "",
+        "string");
+
+    TCLAP::UnlabeledMultiArg<std::string> seed_files_arg_ = TCLAP::UnlabeledMultiArg<std::string>(
+        "seeds",
+        "Parameter files in JSON format to start from; the SEAL parameters, item parameters, "
+        "hash function count, and depth of each are kept",
+        true,
+        "list of file paths");
+
+    std::size_t sender_size_;
+
+    std::size_t receiver_size_;
+
+    std::size_t label_byte_count_;
+
+    std::vector<std::uint32_t> max_items_per_bin_;
+
+    double table_ratio_;
+
+    std::size_t beam_width_;
+
+    std::size_t max_candidates_;
+
+    std::size_t repeat_;
+
+    std::size_t batch_size_;
+
+    std::string out_dir_;
+
+    std::vector<std::string> seed_files_;
+};
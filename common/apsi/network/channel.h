@@ -62,7 +62,8 @@ namespace apsi {
 
             /**
             Receive a SenderOperationResponse from a sender. The function returns nullptr on
-            failure.
+            failure, and throws SenderOperationError if the sender reported that it failed to
+            process the request.
             */
             virtual std::unique_ptr<SenderOperationResponse> receive_response(
                 SenderOperationType expected = SenderOperationType::sop_unknown) = 0;
@@ -49,9 +49,18 @@ namespace apsi {
         {
             flatbuffers::FlatBufferBuilder fbs_builder(128);
 
+            // The default SenderDB is selected by omitting the name
+            flatbuffers::Offset<flatbuffers::String> fbs_db_name;
+            if (!db_name.empty()) {
+                fbs_db_name = fbs_builder.CreateString(db_name);
+            }
+
             fbs::SenderOperationHeaderBuilder sop_header_builder(fbs_builder);
             sop_header_builder.add_version(version);
             sop_header_builder.add_type(static_cast<fbs::SenderOperationType>(type));
+            if (!db_name.empty()) {
+                sop_header_builder.add_db_name(fbs_db_name);
+            }
             auto sop_header = sop_header_builder.Finish();
             fbs_builder.FinishSizePrefixed(sop_header);
 
@@ -81,6 +90,9 @@ namespace apsi {
             // Read the operation type
             type = static_cast<SenderOperationType>(sop_header->type());
 
+            // Read the SenderDB name, if present
+            db_name = sop_header->db_name() ? sop_header->db_name()->str() : string();
+
             return in_data.size();
         }
 
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -49,6 +50,12 @@ namespace apsi {
             std::uint32_t version = apsi_serialization_version;
 
             SenderOperationType type = SenderOperationType::sop_unknown;
+
+            /**
+            The name of the SenderDB the operation is directed to when the sender hosts several
+            SenderDBs. An empty name selects the default SenderDB.
+            */
+            std::string db_name;
         };
 
         /**
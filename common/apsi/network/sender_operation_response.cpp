@@ -23,6 +23,22 @@ namespace apsi {
     using namespace util;
 
     namespace network {
+        namespace {
+            /**
+            Throws SenderOperationError if the sender responded with an error.
+            */
+            void throw_if_error(const fbs::SenderOperationResponse &sop_response)
+            {
+                if (sop_response.response_type() != fbs::Response_ErrorResponse) {
+                    return;
+                }
+
+                auto message = sop_response.response_as_ErrorResponse()->message();
+                throw SenderOperationError(
+                    message ? message->str() : string("sender failed to process the request"));
+            }
+        } // namespace
+
         size_t SenderOperationResponseParms::save(ostream &out) const
         {
             if (!params) {
@@ -70,6 +86,7 @@ namespace apsi {
             }
 
             auto sop_response = fbs::GetSizePrefixedSenderOperationResponse(in_data.data());
+            throw_if_error(*sop_response);
 
             // Need to check that the operation is of the right type
             if (sop_response->response_type() != fbs::Response_ParmsResponse) {
@@ -124,6 +141,7 @@ namespace apsi {
             }
 
             auto sop_response = fbs::GetSizePrefixedSenderOperationResponse(in_data.data());
+            throw_if_error(*sop_response);
 
             // Need to check that the operation is of the right type
             if (sop_response->response_type() != fbs::Response_OPRFResponse) {
@@ -172,6 +190,7 @@ namespace apsi {
             }
 
             auto sop_response = fbs::GetSizePrefixedSenderOperationResponse(in_data.data());
+            throw_if_error(*sop_response);
 
             // Need to check that the operation is of the right type
             if (sop_response->response_type() != fbs::Response_QueryResponse) {
@@ -183,5 +202,54 @@ namespace apsi {
 
             return in_data.size();
         }
+
+        size_t SenderOperationResponseError::save(ostream &out) const
+        {
+            flatbuffers::FlatBufferBuilder fbs_builder(128);
+
+            auto message_data = fbs_builder.CreateString(message);
+            auto resp = fbs::CreateErrorResponse(fbs_builder, message_data);
+
+            fbs::SenderOperationResponseBuilder sop_response_builder(fbs_builder);
+            sop_response_builder.add_response_type(fbs::Response_ErrorResponse);
+            sop_response_builder.add_response(resp.Union());
+            auto sop_response = sop_response_builder.Finish();
+            fbs_builder.FinishSizePrefixed(sop_response);
+
+            out.write(
+                reinterpret_cast<const char *>(fbs_builder.GetBufferPointer()),
+                safe_cast<streamsize>(fbs_builder.GetSize()));
+
+            return fbs_builder.GetSize();
+        }
+
+        size_t SenderOperationResponseError::load(istream &in)
+        {
+            message.clear();
+
+            vector<unsigned char> in_data(util::read_from_stream(in));
+
+            auto verifier = flatbuffers::Verifier(
+                reinterpret_cast<const uint8_t *>(in_data.data()), in_data.size());
+            bool safe = fbs::VerifySizePrefixedSenderOperationResponseBuffer(verifier);
+            if (!safe) {
+                throw runtime_error("failed to load SenderOperationResponse: invalid buffer");
+            }
+
+            auto sop_response = fbs::GetSizePrefixedSenderOperationResponse(in_data.data());
+
+            // Need to check that the operation is of the right type
+            if (sop_response->response_type() != fbs::Response_ErrorResponse) {
+                throw runtime_error("unexpected operation type");
+            }
+
+            // Load the error message
+            auto message_data = sop_response->response_as_ErrorResponse()->message();
+            if (message_data) {
+                message = message_data->str();
+            }
+
+            return in_data.size();
+        }
     } // namespace network
 } // namespace apsi
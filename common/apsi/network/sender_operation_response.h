@@ -5,6 +5,9 @@
 
 // STD
 #include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 // APSI
@@ -114,5 +117,47 @@ namespace apsi {
             */
             std::uint32_t package_count;
         }; // class SenderOperationResponseQuery
+
+        /**
+        A kind of SenderOperationResponse for reporting that the sender failed to process a
+        request. It is sent with the type of the failed request, so the receiver waiting for the
+        response gets it, and loading it as the expected response throws SenderOperationError.
+        */
+        class SenderOperationResponseError final : public SenderOperationResponse {
+        public:
+            SenderOperationResponseError(SenderOperationType request_type, std::string message)
+                : request_type(request_type), message(std::move(message))
+            {}
+
+            ~SenderOperationResponseError() = default;
+
+            std::size_t save(std::ostream &out) const override;
+
+            std::size_t load(std::istream &in) override;
+
+            SenderOperationType type() const noexcept override
+            {
+                return request_type;
+            }
+
+            /**
+            The type of the request that failed.
+            */
+            SenderOperationType request_type;
+
+            /**
+            Describes the error to the receiver.
+            */
+            std::string message;
+        }; // class SenderOperationResponseError
+
+        /**
+        Thrown when loading a SenderOperationResponse that reports an error from the sender
+        instead of the expected response.
+        */
+        class SenderOperationError : public std::runtime_error {
+        public:
+            using std::runtime_error::runtime_error;
+        }; // class SenderOperationError
     }      // namespace network
 } // namespace apsi
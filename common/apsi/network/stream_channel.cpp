@@ -210,6 +210,10 @@ namespace apsi {
                         << sender_operation_type_str(sop_header.type));
                     return nullptr;
                 }
+            } catch (const SenderOperationError &ex) {
+                // The sender will not send the expected response
+                APSI_LOG_ERROR("Sender failed to process the request: " << ex.what());
+                throw;
             } catch (const runtime_error &ex) {
                 APSI_LOG_ERROR("An exception was thrown loading response data: " << ex.what());
                 return nullptr;
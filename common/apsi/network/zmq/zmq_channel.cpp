@@ -3,6 +3,7 @@
 
 // STD
 #include <cstddef>
+#include <functional>
 #include <iterator>
 #include <sstream>
 #include <stdexcept>
@@ -169,6 +170,7 @@ namespace apsi {
             // Construct the header
             SenderOperationHeader sop_header;
             sop_header.type = sop->type();
+            sop_header.db_name = db_name_;
             APSI_LOG_DEBUG(
                 "Sending operation of type " << sender_operation_type_str(sop_header.type));
 
@@ -203,6 +205,17 @@ namespace apsi {
                 return nullptr;
             }
 
+            return receive_db_operation(
+                [&context](const string &) { return context; }, wait_for_message, expected);
+        }
+
+        unique_ptr<ZMQSenderOperation> ZMQChannel::receive_db_operation(
+            function<shared_ptr<SEALContext>(const string &)> get_context,
+            bool wait_for_message,
+            SenderOperationType expected)
+        {
+            throw_if_not_connected();
+
             size_t old_bytes_received = bytes_received_;
 
             multipart_t msg;
@@ -268,11 +281,28 @@ namespace apsi {
                     bytes_received = load_from_string(msg[2].to_string(), *sop);
                     bytes_received_ += bytes_received;
                     break;
-                case SenderOperationType::sop_query:
+                case SenderOperationType::sop_query: {
+                    // The query can only be loaded with the SEALContext of the SenderDB it is
+                    // directed to
+                    shared_ptr<SEALContext> context = get_context(sop_header.db_name);
+                    if (!context || !context->parameters_set()) {
+                        APSI_LOG_ERROR(
+                            "Cannot receive a query for SenderDB `"
+                            << sop_header.db_name << "`; SEALContext is missing or invalid");
+
+                        // Tell the receiver, which would otherwise wait for a response forever
+                        auto sop_response = make_unique<ZMQSenderOperationResponse>();
+                        sop_response->sop_response = make_unique<SenderOperationResponseError>(
+                            SenderOperationType::sop_query, "SenderDB does not exist");
+                        sop_response->client_id = move(client_id);
+                        send(move(sop_response));
+                        return nullptr;
+                    }
                     sop = make_unique<SenderOperationQuery>();
                     bytes_received = load_from_string(msg[2].to_string(), move(context), *sop);
                     bytes_received_ += bytes_received;
                     break;
+                }
                 default:
                     // Invalid operation
                     APSI_LOG_ERROR(
@@ -292,6 +322,7 @@ namespace apsi {
             auto n_sop = make_unique<ZMQSenderOperation>();
             n_sop->client_id = move(client_id);
             n_sop->sop = move(sop);
+            n_sop->db_name = move(sop_header.db_name);
 
             APSI_LOG_DEBUG(
                 "Received an operation of type " << sender_operation_type_str(sop_header.type)
@@ -430,6 +461,10 @@ namespace apsi {
                         << sender_operation_type_str(sop_header.type));
                     return nullptr;
                 }
+            } catch (const SenderOperationError &ex) {
+                // The sender will not send the expected response
+                APSI_LOG_ERROR("Sender failed to process the request: " << ex.what());
+                throw;
             } catch (const runtime_error &ex) {
                 APSI_LOG_ERROR("An exception was thrown loading response data: " << ex.what());
                 return nullptr;
@@ -4,8 +4,10 @@
 #pragma once
 
 // STD
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -34,6 +36,11 @@ namespace apsi {
             std::unique_ptr<SenderOperation> sop;
 
             std::vector<unsigned char> client_id;
+
+            /**
+            The name of the SenderDB the operation is directed to; empty for the default SenderDB.
+            */
+            std::string db_name;
         };
 
         /**
@@ -102,6 +109,25 @@ namespace apsi {
                 return !end_point_.empty();
             }
 
+            /**
+            Sets the name of the SenderDB that subsequent SenderOperations sent on this channel are
+            directed to, when the sender hosts several SenderDBs. An empty name, which is the
+            default, selects the sender's default SenderDB.
+            */
+            void set_db_name(std::string db_name)
+            {
+                db_name_ = std::move(db_name);
+            }
+
+            /**
+            Returns the name of the SenderDB that SenderOperations sent on this channel are directed
+            to.
+            */
+            const std::string &get_db_name() const noexcept
+            {
+                return db_name_;
+            }
+
             /**
             Send a SenderOperation from a receiver to a sender. These operations represent either a
             parameter request, an OPRF request, or a query request. The function throws an exception
@@ -135,6 +161,20 @@ namespace apsi {
                 return receive_network_operation(std::move(context), false, expected);
             }
 
+            /**
+            Receive a ZMQSenderOperation from a receiver, when the sender hosts several SenderDBs
+            with possibly different parameters. The given function is called with the name of the
+            SenderDB the operation is directed to, and must return the seal::SEALContext for it, or
+            nullptr if there is no such SenderDB. Operations of type sop_query that are directed to
+            an unknown SenderDB are answered with a SenderOperationResponseError and dropped. The
+            function returns nullptr on failure. This call does not block if wait_for_message is
+            false: if there is no operation pending, it will immediately return nullptr.
+            */
+            virtual std::unique_ptr<ZMQSenderOperation> receive_db_operation(
+                std::function<std::shared_ptr<seal::SEALContext>(const std::string &)> get_context,
+                bool wait_for_message,
+                SenderOperationType expected = SenderOperationType::sop_unknown);
+
             /**
             Send a ZMQSenderOperationResponse from a sender to a receiver. These operations
             represent a response to either a parameter request, an OPRF request, or a query request.
@@ -146,7 +186,8 @@ namespace apsi {
 
             /**
             Receive a SenderOperationResponse from a sender. The function returns nullptr on
-            failure.
+            failure, and throws SenderOperationError if the sender reported that it failed to
+            process the request.
             */
             std::unique_ptr<SenderOperationResponse> receive_response(
                 SenderOperationType expected = SenderOperationType::sop_unknown) override;
@@ -200,6 +241,8 @@ namespace apsi {
 
             std::string end_point_;
 
+            std::string db_name_;
+
             std::mutex receive_mutex_;
 
             std::mutex send_mutex_;
@@ -2,6 +2,8 @@
 // Licensed under the MIT license.
 
 // STD
+#include <algorithm>
+#include <functional>
 #include <sstream>
 
 // APSI
@@ -146,6 +148,36 @@ namespace apsi {
         return result;
     }
 
+    void PowersDag::plan_levels(
+        uint32_t max_level, const function<uint32_t(uint32_t)> &final_level)
+    {
+        if (!configured_) {
+            throw logic_error("PowersDag has not been configured");
+        }
+
+        // Every node must reach at least its own final level
+        for (uint32_t power : target_powers_) {
+            nodes_.at(power).level = min(final_level(power), max_level);
+        }
+
+        // The powers of the parents of a node are always smaller than the power of the node, so
+        // going over the nodes in decreasing order of powers processes all nodes that depend on a
+        // given node before the node itself. Each parent must be at least one level above its
+        // child.
+        for (auto it = target_powers_.crbegin(); it != target_powers_.crend(); it++) {
+            const PowersNode &node = nodes_.at(*it);
+            if (node.is_source()) {
+                continue;
+            }
+
+            uint32_t parent_level = min(node.level + 1, max_level);
+            for (uint32_t parent : { node.parents.first, node.parents.second }) {
+                uint32_t &level = nodes_.at(parent).level;
+                level = max(level, parent_level);
+            }
+        }
+    }
+
     string PowersDag::to_dot() const
     {
         if (!configured_) {
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <memory>
@@ -67,6 +68,12 @@ namespace apsi {
             */
             std::pair<std::uint32_t, std::uint32_t> parents{ 0, 0 };
 
+            /**
+            The planned level of this node, i.e., the chain index in the modulus switching chain
+            at which the power is stored once computed. This is set by PowersDag::plan_levels.
+            */
+            std::uint32_t level = 0;
+
             /**
             Returns whether this is a source node.
             */
@@ -131,6 +138,20 @@ namespace apsi {
         */
         std::vector<PowersNode> source_nodes() const;
 
+        /**
+        Plans a level for each node so that every power is stored at the lowest level that still
+        leaves one level for each multiplication on any path from it to the nodes that depend on
+        it, and that is not below the level given for the power by final_level. Powers that are
+        computed early in the DAG but only used for a few multiplications can then be modulus
+        switched down early, making the remaining multiplications, relinearizations, and NTTs
+        cheaper. The plan assumes that a multiplication consumes at most the noise budget of one
+        level. No level exceeds max_level. If the PowersDag is not configured, this function
+        throws an exception.
+        */
+        void plan_levels(
+            std::uint32_t max_level,
+            const std::function<std::uint32_t(std::uint32_t)> &final_level);
+
         /**
         Returns this PowersDag in the DOT format as a string.
         */
@@ -3,11 +3,17 @@
 
 // STD
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 // APSI
+#include "apsi/oprf/oprf_common.h"
+#include "apsi/powers.h"
 #include "apsi/psi_params.h"
 #include "apsi/psi_params_generated.h"
 #include "apsi/version.h"
@@ -91,6 +97,43 @@ namespace {
 } // namespace
 #endif
 
+namespace {
+    /**
+    Returns the expected value of ceil(M / bin_capacity), where M is the maximum of bin_count
+    independent Poisson random variables with the given mean. This approximates the expected
+    number of BinBundles at a bundle index, since a new BinBundle is needed when any of its bins
+    overflows. Bins that cannot hold any items need infinitely many BinBundles.
+    */
+    double expected_bin_bundle_count(double load, uint32_t bin_count, uint32_t bin_capacity)
+    {
+        if (load <= 0.0) {
+            return 0.0;
+        }
+        if (!bin_capacity) {
+            return numeric_limits<double>::infinity();
+        }
+
+        // Upper tail probabilities P(X > x) of the Poisson distribution, computed as suffix sums;
+        // probabilities beyond max_value are negligible
+        double max_value = ceil(load + 20.0 * sqrt(load) + 20.0);
+        vector<double> tail(static_cast<size_t>(max_value) + 1, 0.0);
+        double log_load = log(load);
+        for (size_t x = tail.size() - 1; x > 0; x--) {
+            double value = static_cast<double>(x);
+            double pmf = exp(value * log_load - load - lgamma(value + 1.0));
+            tail[x - 1] = min(tail[x] + pmf, 1.0);
+        }
+
+        // E[ceil(M / c)] is the sum over k >= 0 of P(M > k * c) = 1 - (1 - P(X > k * c))^bin_count
+        double result = 0.0;
+        for (size_t bound = 0; bound < tail.size(); bound += bin_capacity) {
+            result += -expm1(static_cast<double>(bin_count) * log1p(-tail[bound]));
+        }
+
+        return result;
+    }
+} // namespace
+
 namespace apsi {
     void PSIParams::initialize()
     {
@@ -179,6 +222,90 @@ namespace apsi {
         bundle_idx_count_ = table_params_.table_size / items_per_bundle_;
     }
 
+    PSIParams::CostEstimate PSIParams::estimate_cost(
+        size_t sender_item_count, size_t receiver_item_count, size_t label_byte_count) const
+    {
+        CostEstimate result;
+        result.label_size = label_size(label_byte_count);
+        double polyn_count = static_cast<double>(result.label_size + 1);
+        uint32_t max_bin_size = table_params_.max_items_per_bin;
+        uint32_t ps_low_degree = query_params_.ps_low_degree;
+
+        // A BinBundle accepts an item only if its bins stay smaller than max_items_per_bin, so a
+        // bin holds at most max_items_per_bin - 1 items
+        uint32_t bin_capacity = max_bin_size - 1;
+
+        // Every item is inserted in hash_func_count bins
+        double insertion_count =
+            static_cast<double>(sender_item_count) * table_params_.hash_func_count;
+        double load = insertion_count / table_params_.table_size;
+        result.bin_bundle_count =
+            bundle_idx_count_ * expected_bin_bundle_count(load, items_per_bundle_, bin_capacity);
+        double capacity =
+            result.bin_bundle_count * static_cast<double>(items_per_bundle_) * bin_capacity;
+        result.packing_rate = capacity > 0.0 ? insertion_count / capacity : 0.0;
+
+        // The query is encrypted at the first data level and serialized with a seed in place of
+        // its second polynomial. Results are switched to the last level.
+        const auto &coeff_modulus = seal_params_.coeff_modulus();
+        size_t data_prime_count = coeff_modulus.size() > 1 ? coeff_modulus.size() - 1 : 1;
+        double n = static_cast<double>(seal_params_.poly_modulus_degree());
+        double query_bit_count = 0.0;
+        for (size_t i = 0; i < data_prime_count; i++) {
+            query_bit_count += coeff_modulus[i].bit_count();
+        }
+        double query_ct_byte_count = n * query_bit_count / 8.0;
+        double result_ct_byte_count = 2.0 * n * coeff_modulus[0].bit_count() / 8.0;
+
+        double receiver_items = static_cast<double>(receiver_item_count);
+        result.query_byte_count =
+            receiver_items * oprf::oprf_query_size +
+            static_cast<double>(bundle_idx_count_) *
+                static_cast<double>(query_params_.query_powers.size()) * query_ct_byte_count;
+        result.response_byte_count = receiver_items * oprf::oprf_response_size +
+                                     result.bin_bundle_count * polyn_count * result_ct_byte_count;
+
+        // Every power that is not a source takes one multiplication and relinearization at each
+        // bundle index
+        PowersDag pd;
+        set<uint32_t> target_powers = util::create_powers_set(ps_low_degree, max_bin_size);
+        if (!pd.configure(query_params_.query_powers, target_powers)) {
+            throw invalid_argument("query_powers cannot be used to compute all needed powers");
+        }
+        double computed_power_count = static_cast<double>(target_powers.size() - pd.source_count());
+        result.ciphertext_multiplication_count = bundle_idx_count_ * computed_power_count;
+        result.relinearization_count = result.ciphertext_multiplication_count;
+
+        // The polynomials of a full bin have degree bin_capacity. The constant coefficient is
+        // added, and every other coefficient is multiplied with a power of the query. The
+        // Paterson-Stockmeyer algorithm is used if 1 < ps_low_degree < bin_capacity. Then the
+        // constant coefficients of the inner polynomials are multiplied with the high powers
+        // directly, every inner polynomial but the first is multiplied with a high power, and the
+        // sum is relinearized once.
+        double evaluated_polyn_count = result.bin_bundle_count * polyn_count;
+        bool use_ps = ps_low_degree > 1 && ps_low_degree < bin_capacity;
+        uint32_t high_power_count = use_ps ? bin_capacity / (ps_low_degree + 1) : 0;
+        double ntt_coeff_count = static_cast<double>(bin_capacity - high_power_count);
+        result.plaintext_multiplication_count = evaluated_polyn_count * bin_capacity;
+        if (high_power_count) {
+            result.ciphertext_multiplication_count += evaluated_polyn_count * high_power_count;
+            result.relinearization_count += evaluated_polyn_count;
+        }
+
+        // The coefficients that are multiplied with powers are cached in NTT form with one or two
+        // levels left; the constant coefficients are not in NTT form. The field elements of the
+        // items and labels are stored both in the bins and in the interpolated polynomials.
+        size_t coeff_prime_count = min<size_t>(data_prime_count - 1, ps_low_degree ? 2 : 1) + 1;
+        double coeff_byte_count = polyn_count * n * sizeof(uint64_t) *
+                                  (ntt_coeff_count * static_cast<double>(coeff_prime_count) +
+                                   static_cast<double>(high_power_count + 1));
+        double felt_byte_count =
+            2.0 * insertion_count * item_params_.felts_per_item * polyn_count * sizeof(uint64_t);
+        result.sender_db_byte_count = result.bin_bundle_count * coeff_byte_count + felt_byte_count;
+
+        return result;
+    }
+
     size_t PSIParams::save(ostream &out) const
     {
         flatbuffers::FlatBufferBuilder fbs_builder(128);
@@ -5,6 +5,7 @@
 
 // STD
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <limits>
@@ -184,6 +185,85 @@ namespace apsi {
                     item_params_.felts_per_item);
         }
 
+        /**
+        Returns the number of item-sized chunks needed to hold a label of the given byte count,
+        i.e., the number of label polynomials in each BinBundle. The byte count must include the
+        nonce.
+        */
+        std::size_t label_size(std::size_t label_byte_count) const
+        {
+            return (label_byte_count * 8 + item_bit_count_ - 1) / item_bit_count_;
+        }
+
+        /**
+        Holds resource estimates computed by PSIParams::estimate_cost. Byte counts assume that
+        serialized ciphertexts compress down to the bit sizes of their coefficient moduli. The
+        sender's multiplication counts are per query.
+        */
+        struct CostEstimate {
+            /**
+            The expected number of BinBundles in the SenderDB.
+            */
+            double bin_bundle_count = 0;
+
+            /**
+            The expected fraction of BinBundle capacity that is used.
+            */
+            double packing_rate = 0;
+
+            /**
+            The number of label polynomials in each BinBundle; zero in unlabeled mode.
+            */
+            std::size_t label_size = 0;
+
+            /**
+            Bytes sent from the receiver to the sender: the OPRF request and the query.
+            */
+            double query_byte_count = 0;
+
+            /**
+            Bytes sent from the sender to the receiver: the OPRF response and the result.
+            */
+            double response_byte_count = 0;
+
+            /**
+            Ciphertext-ciphertext multiplications, both for computing the powers of the query and
+            for the Paterson-Stockmeyer algorithm.
+            */
+            double ciphertext_multiplication_count = 0;
+
+            /**
+            Relinearizations performed by the sender.
+            */
+            double relinearization_count = 0;
+
+            /**
+            Ciphertext-plaintext multiplications for evaluating the matching and label
+            polynomials.
+            */
+            double plaintext_multiplication_count = 0;
+
+            /**
+            Approximate memory use of an uncompressed SenderDB in bytes, dominated by the cached
+            polynomial coefficients.
+            */
+            double sender_db_byte_count = 0;
+        };
+
+        /**
+        Estimates the resources needed for a SenderDB with the given number of items and label
+        byte count, and for a query of the given number of items against it, without running
+        anything. The label byte count must include the nonce in labeled mode, and must be zero
+        in unlabeled mode. The BinBundle count is computed from the expected maximum load of the
+        bins at each bundle index, assuming each item lands in hash_func_count uniformly random
+        bins. Throws std::invalid_argument if query_powers cannot be used to compute all powers
+        needed.
+        */
+        CostEstimate estimate_cost(
+            std::size_t sender_item_count,
+            std::size_t receiver_item_count,
+            std::size_t label_byte_count) const;
+
         /**
         Writes the PSIParams to a stream.
         */
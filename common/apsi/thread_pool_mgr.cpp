@@ -2,6 +2,10 @@
 // Licensed under the MIT license.
 
 // STD
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -72,6 +76,65 @@ ThreadPool &ThreadPoolMgr::thread_pool() const
     return *thread_pool_;
 }
 
+void ThreadPoolMgr::parallel_for(size_t count, const function<void(size_t)> &func) const
+{
+    if (count <= 1) {
+        if (count) {
+            func(0);
+        }
+        return;
+    }
+
+    // The state is shared with the helper tasks, which may start only after this function has
+    // returned; in that case they find no work left and never touch func.
+    struct State {
+        atomic<size_t> next_idx{ 0 };
+        size_t count;
+        const function<void(size_t)> *func;
+        mutex mtx;
+        condition_variable done_cond;
+        size_t done_count = 0;
+        exception_ptr ex;
+    };
+    auto state = make_shared<State>();
+    state->count = count;
+    state->func = &func;
+
+    auto worker = [state]() {
+        size_t idx;
+        while ((idx = state->next_idx.fetch_add(1)) < state->count) {
+            exception_ptr ex;
+            try {
+                (*state->func)(idx);
+            } catch (...) {
+                ex = current_exception();
+            }
+
+            unique_lock<mutex> lock(state->mtx);
+            if (ex && !state->ex) {
+                state->ex = ex;
+            }
+            if (++state->done_count == state->count) {
+                state->done_cond.notify_all();
+            }
+        }
+    };
+
+    // The calling thread is one of the workers
+    size_t helper_count = min(count, max<size_t>(GetThreadCount(), 1)) - 1;
+    for (size_t i = 0; i < helper_count; i++) {
+        thread_pool().enqueue(worker);
+    }
+    worker();
+
+    // Wait only for the calls that have already started in other threads
+    unique_lock<mutex> lock(state->mtx);
+    state->done_cond.wait(lock, [&state]() { return state->done_count == state->count; });
+    if (state->ex) {
+        rethrow_exception(state->ex);
+    }
+}
+
 void ThreadPoolMgr::SetThreadCount(size_t threads)
 {
     unique_lock<mutex> lock(tp_mutex);
@@ -5,6 +5,7 @@
 
 // STD
 #include <cstddef>
+#include <functional>
 
 // APSI
 #include "apsi/util/thread_pool.h"
@@ -31,6 +32,15 @@ namespace apsi {
         */
         util::ThreadPool &thread_pool() const;
 
+        /**
+        Calls the given function for every index from 0 to count - 1 using the thread pool and
+        returns once all calls have completed. The calling thread processes indices as well and
+        never waits for a task that has not started, so this function can safely be called from
+        within a thread pool task. If any of the calls throws, one of the exceptions is rethrown
+        in the calling thread after all calls have completed.
+        */
+        void parallel_for(std::size_t count, const std::function<void(std::size_t)> &func) const;
+
         /**
         Set the number of threads to be used by the thread pool
         */
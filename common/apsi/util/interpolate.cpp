@@ -95,26 +95,82 @@ namespace apsi {
                 throw invalid_argument("mod must be prime");
             }
 
-            auto size = points.size();
-
             bool all_zeros = all_of(values.cbegin(), values.cend(), [](auto a) { return a == 0; });
             if (all_zeros) {
                 // Return a vector of all zeros
-                return vector<uint64_t>(max<size_t>(size, 1));
+                return vector<uint64_t>(max<size_t>(points.size(), 1));
             }
 
-            vector<vector<uint64_t>> divided_differences;
-            divided_differences.reserve(size);
-            for (size_t i = 0; i < size; i++) {
-                vector<uint64_t> inner;
-                inner.reserve(size - i);
-                inner.push_back(values[i]);
-                divided_differences.push_back(move(inner));
+            return NewtonInterpolator(points, mod).interpolate(values);
+        }
+
+        NewtonInterpolator::NewtonInterpolator(const vector<uint64_t> &points, const Modulus &mod)
+            : points_(points), mod_(mod)
+        {
+            if (!mod_.is_prime()) {
+                throw invalid_argument("mod must be prime");
+            }
+
+            // The points must be distinct for every denominator to be invertible
+            vector<uint64_t> sorted_points(points_);
+            sort(sorted_points.begin(), sorted_points.end());
+            if (adjacent_find(sorted_points.cbegin(), sorted_points.cend()) !=
+                sorted_points.cend()) {
+                throw logic_error("tried to interpolate at repeated points");
             }
+        }
 
+        void NewtonInterpolator::invert_denominators(
+            size_t j,
+            vector<MultiplyUIntModOperand> &inv_denominators,
+            vector<uint64_t> &prefix_products) const
+        {
             /**
-            Make a table of divided differences so that DD[i][j] is [yᵢ, yᵢ₊₁, ..., yᵢ₊ⱼ]
-            Here's an example:
+            The divided differences are computed in-place (see interpolate below), so in round j
+            the denominator for position i is xᵢ - xᵢ₋ⱼ. Invert all denominators of the round at
+            once with Montgomery's trick: compute the prefix products, invert the full product with
+            a single exponentiation, and then walk backwards peeling off one factor at a time.
+            */
+            size_t count = points_.size() - j;
+            auto denominator = [&](size_t k) {
+                return sub_uint_mod(points_[j + k], points_[k], mod_);
+            };
+
+            prefix_products[0] = denominator(0);
+            for (size_t k = 1; k < count; k++) {
+                prefix_products[k] =
+                    multiply_uint_mod(prefix_products[k - 1], denominator(k), mod_);
+            }
+
+            uint64_t inv_product =
+                exponentiate_uint_mod(prefix_products[count - 1], mod_.value() - 2, mod_);
+            for (size_t k = count - 1; k > 0; k--) {
+                inv_denominators[k].set(
+                    multiply_uint_mod(inv_product, prefix_products[k - 1], mod_), mod_);
+                inv_product = multiply_uint_mod(inv_product, denominator(k), mod_);
+            }
+            inv_denominators[0].set(inv_product, mod_);
+        }
+
+        vector<uint64_t> NewtonInterpolator::interpolate(const vector<uint64_t> &values) const
+        {
+            if (points_.size() != values.size()) {
+                throw invalid_argument(
+                    "number of values does not match the number of interpolation points");
+            }
+
+            size_t size = points_.size();
+
+            bool all_zeros = all_of(values.cbegin(), values.cend(), [](auto a) { return a == 0; });
+            if (all_zeros) {
+                // Return a vector of all zeros
+                return vector<uint64_t>(max<size_t>(size, 1));
+            }
+
+            /**
+            Compute the divided differences in-place. After round j, position i (for i >= j) holds
+            [yᵢ₋ⱼ, ..., yᵢ], so once all rounds are done, position i holds [y₀, ..., yᵢ], which is
+            exactly the top row of the divided-difference table:
 
                     | j=0 |    j=1   |         j=2         |    ...
                 ----------------------------------------------
@@ -123,34 +179,22 @@ namespace apsi {
                 i=0 |  y₀ |  ------- |  x₂ - x₁   x₁ - x₀  |    ...
                     |     |  x₁ - x₀ | ------------------- |
                     |     |          |       x₂ - x₀       |
-                ----------------------------------------------
-                    |     |          |  y₃ - y₂   y₂ - y₁  |
-                    |     |  y₂ - y₁ |  ------- - -------  |
-                i=1 |  y₁ |  ------- |  x₃ - x₂   x₂ - x₁  |    ...
-                    |     |  x₂ - x₁ | ------------------- |
-                    |     |          |       x₃ - x₁       |
                 ----------------------------------------------
                 ... | ... |    ...   |         ...         |
+
+            We proceed from right to left in each round, so no intermediate copy is needed.
             */
+            vector<uint64_t> divided_differences(values);
+            vector<MultiplyUIntModOperand> inv_denominators(size);
+            vector<uint64_t> prefix_products(size);
             for (size_t j = 1; j < size; j++) {
-                for (size_t i = 0; i < size - j; i++) {
-                    // numerator = DD[i + 1][j - 1] - DD[i][j - 1]
-                    uint64_t numerator = sub_uint_mod(
-                        divided_differences[i + 1][j - 1], divided_differences[i][j - 1], mod);
-
-                    // denominator = points[i + j] - points[i]
-                    uint64_t denominator = sub_uint_mod(points[i + j], points[i], mod);
-                    if (!denominator) {
-                        throw logic_error("tried to interpolate at repeated points");
-                    }
-
-                    // DD[i][j] = numerator / denominator
-                    uint64_t inv_denominator =
-                        exponentiate_uint_mod(denominator, mod.value() - 2, mod);
-
-                    // Push as divided_differences[i][j]
-                    divided_differences[i].push_back(
-                        multiply_uint_mod(numerator, inv_denominator, mod));
+                // The inverse denominators for round j are in order i = j, ..., size - 1
+                invert_denominators(j, inv_denominators, prefix_products);
+                for (size_t i = size - 1; i >= j; i--) {
+                    uint64_t numerator =
+                        sub_uint_mod(divided_differences[i], divided_differences[i - 1], mod_);
+                    divided_differences[i] =
+                        multiply_uint_mod(numerator, inv_denominators[i - j], mod_);
                 }
             }
 
@@ -175,15 +219,96 @@ namespace apsi {
             // Do Horner's method for all inner terms
             for (size_t i = size - 1; i > 0; i--) {
                 // P += [y₀, ..., yᵢ]
-                result[0] = add_uint_mod(result[0], divided_differences[0][i], mod);
+                result[0] = add_uint_mod(result[0], divided_differences[i], mod_);
                 // P *= (x - xᵢ₋₁)
-                polyn_mul_monic_monomial_inplace(result, points[i - 1], mod);
+                polyn_mul_monic_monomial_inplace(result, points_[i - 1], mod_);
             }
 
             // Add the last constant term [y₀]
-            result[0] = add_uint_mod(result[0], divided_differences[0][0], mod);
+            result[0] = add_uint_mod(result[0], divided_differences[0], mod_);
 
             return result;
         }
+
+        vector<vector<uint64_t>> NewtonInterpolator::interpolate_many(
+            const vector<vector<uint64_t>> &values_set) const
+        {
+            size_t size = points_.size();
+            size_t lanes = values_set.size();
+            for (const auto &values : values_set) {
+                if (values.size() != size) {
+                    throw invalid_argument(
+                        "number of values does not match the number of interpolation points");
+                }
+            }
+
+            if (!size) {
+                return vector<vector<uint64_t>>(lanes, vector<uint64_t>(1, 0));
+            }
+
+            // Interleave the value sets: position i of value set k is stored at i * lanes + k
+            vector<uint64_t> divided_differences(size * lanes);
+            for (size_t k = 0; k < lanes; k++) {
+                for (size_t i = 0; i < size; i++) {
+                    divided_differences[i * lanes + k] = values_set[k][i];
+                }
+            }
+
+            // Compute the divided differences in-place exactly as in interpolate
+            vector<MultiplyUIntModOperand> inv_denominators(size);
+            vector<uint64_t> prefix_products(size);
+            for (size_t j = 1; j < size; j++) {
+                invert_denominators(j, inv_denominators, prefix_products);
+                for (size_t i = size - 1; i >= j; i--) {
+                    const MultiplyUIntModOperand &inv_denominator = inv_denominators[i - j];
+                    uint64_t *curr = divided_differences.data() + i * lanes;
+                    const uint64_t *prev = curr - lanes;
+                    for (size_t k = 0; k < lanes; k++) {
+                        curr[k] = multiply_uint_mod(
+                            sub_uint_mod(curr[k], prev[k], mod_), inv_denominator, mod_);
+                    }
+                }
+            }
+
+            /**
+            Do Horner's method for all value sets at once. The interleaved result has room for the
+            final degree; result_size tracks the current number of coefficients.
+            */
+            vector<uint64_t> result(size * lanes, 0);
+            size_t result_size = 1;
+            for (size_t i = size - 1; i > 0; i--) {
+                // P += [y₀, ..., yᵢ]
+                const uint64_t *dd = divided_differences.data() + i * lanes;
+                for (size_t k = 0; k < lanes; k++) {
+                    result[k] = add_uint_mod(result[k], dd[k], mod_);
+                }
+
+                // P *= (x - xᵢ₋₁); the new top coefficient starts at zero
+                MultiplyUIntModOperand neg_a;
+                neg_a.set(negate_uint_mod(points_[i - 1], mod_), mod_);
+                for (size_t d = result_size; d > 0; d--) {
+                    uint64_t *curr = result.data() + d * lanes;
+                    const uint64_t *prev = curr - lanes;
+                    for (size_t k = 0; k < lanes; k++) {
+                        curr[k] = multiply_add_uint_mod(curr[k], neg_a, prev[k], mod_);
+                    }
+                }
+                for (size_t k = 0; k < lanes; k++) {
+                    result[k] = multiply_uint_mod(result[k], neg_a, mod_);
+                }
+                result_size++;
+            }
+
+            // Add the last constant term [y₀] and de-interleave
+            vector<vector<uint64_t>> polyns(lanes, vector<uint64_t>(size));
+            for (size_t k = 0; k < lanes; k++) {
+                polyns[k][0] = add_uint_mod(result[k], divided_differences[k], mod_);
+                for (size_t d = 1; d < size; d++) {
+                    polyns[k][d] = result[d * lanes + k];
+                }
+            }
+
+            return polyns;
+        }
     } // namespace util
 } // namespace apsi
@@ -10,6 +10,7 @@
 
 // SEAL
 #include "seal/modulus.h"
+#include "seal/util/uintarithsmallmod.h"
 
 // GSL
 #include "gsl/span"
@@ -41,5 +42,65 @@ namespace apsi {
             const std::vector<std::uint64_t> &points,
             const std::vector<std::uint64_t> &values,
             const seal::Modulus &mod);
+
+        /**
+        Performs Newton interpolation repeatedly at a fixed set of interpolation points. The
+        inverses of the divided-difference denominators of each column are computed together with
+        a single modular inversion, so interpolating over n points takes n - 1 inversions and only
+        O(n) memory besides the result. Interpolating several sets of values at once with
+        interpolate_many shares these inverses between all of them. This is useful when many
+        polynomials must be interpolated over the same points, e.g., all label polynomials of a
+        single bin.
+        */
+        class NewtonInterpolator {
+        public:
+            /**
+            Creates a NewtonInterpolator for the given interpolation points. Throws
+            std::invalid_argument if mod is not prime, and std::logic_error if the points are not
+            distinct.
+            */
+            NewtonInterpolator(const std::vector<std::uint64_t> &points, const seal::Modulus &mod);
+
+            /**
+            Returns the coefficients of the polynomial P in degree-ascending order, where
+            P(pointᵢ) == valueᵢ for all i. The number of values must match the number of points.
+            */
+            std::vector<std::uint64_t> interpolate(const std::vector<std::uint64_t> &values) const;
+
+            /**
+            Interpolates several sets of values over the same points at once. The result is
+            identical to calling interpolate separately for each set of values, but all sets are
+            processed in lockstep: the value sets are interleaved in memory, so every inverse
+            denominator is computed once for all of them, and every inverse denominator and every
+            Horner step is applied to all of them in a single inner loop of independent modular
+            multiplications.
+            */
+            std::vector<std::vector<std::uint64_t>> interpolate_many(
+                const std::vector<std::vector<std::uint64_t>> &values_set) const;
+
+            /**
+            Returns the number of interpolation points.
+            */
+            std::size_t point_count() const noexcept
+            {
+                return points_.size();
+            }
+
+        private:
+            /**
+            Writes the inverses of the denominators xᵢ - xᵢ₋ⱼ for i = j, ..., n-1 of round j of the
+            divided differences to the first n - j entries of inv_denominators. The inverses are
+            computed with Montgomery's trick; prefix_products is used as scratch space. Both
+            vectors must have at least n - j entries.
+            */
+            void invert_denominators(
+                std::size_t j,
+                std::vector<seal::util::MultiplyUIntModOperand> &inv_denominators,
+                std::vector<std::uint64_t> &prefix_products) const;
+
+            std::vector<std::uint64_t> points_;
+
+            seal::Modulus mod_;
+        };
     } // namespace util
 } // namespace apsi
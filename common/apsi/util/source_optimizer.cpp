@@ -0,0 +1,156 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+// APSI
+#include "apsi/powers.h"
+#include "apsi/util/source_optimizer.h"
+#include "apsi/util/utils.h"
+
+using namespace std;
+
+namespace apsi {
+    namespace util {
+        namespace {
+            /**
+            Squaring a ciphertext takes three polynomial products instead of the four needed for a
+            general multiplication, so it is counted as cheaper.
+            */
+            constexpr double square_weight = 0.75;
+
+            bool evaluate_for_targets(
+                const set<uint32_t> &target_powers,
+                double query_weight,
+                SourcesCandidate &candidate)
+            {
+                PowersDag pd;
+                if (!pd.configure(candidate.sources, target_powers)) {
+                    return false;
+                }
+
+                candidate.depth = pd.depth();
+                candidate.multiplication_count = 0;
+                candidate.square_count = 0;
+                pd.apply([&](const PowersDag::PowersNode &node) {
+                    if (!node.is_source()) {
+                        candidate.multiplication_count++;
+                        if (node.parents.first == node.parents.second) {
+                            candidate.square_count++;
+                        }
+                    }
+                });
+
+                candidate.cost =
+                    query_weight * static_cast<double>(candidate.sources.size()) +
+                    static_cast<double>(candidate.multiplication_count) -
+                    (1.0 - square_weight) * static_cast<double>(candidate.square_count);
+                return true;
+            }
+
+            /**
+            Orders the final candidates: a lower cost comes first, then a lower depth, then fewer
+            query ciphertexts.
+            */
+            bool result_order(const SourcesCandidate &a, const SourcesCandidate &b)
+            {
+                size_t a_count = a.sources.size();
+                size_t b_count = b.sources.size();
+                return tie(a.cost, a.depth, a_count, a.sources) <
+                       tie(b.cost, b.depth, b_count, b.sources);
+            }
+        } // namespace
+
+        vector<SourcesCandidate> find_sources(
+            uint32_t ps_low_degree, uint32_t bound, const SourcesSearchOptions &options)
+        {
+            set<uint32_t> target_powers = create_powers_set(ps_low_degree, bound);
+
+            vector<SourcesCandidate> results;
+            if (!options.max_source_count || !options.beam_width || !options.candidate_count) {
+                return results;
+            }
+
+            // Every source set contains 1. A PowersDag can be configured with any subset of the
+            // target powers that contains 1, unless the target powers themselves are invalid.
+            SourcesCandidate first;
+            first.sources.insert(1);
+            if (!evaluate_for_targets(target_powers, options.query_weight, first)) {
+                return results;
+            }
+            vector<SourcesCandidate> beam{ first };
+
+            for (uint32_t source_count = 1;; source_count++) {
+                for (const auto &candidate : beam) {
+                    if (candidate.depth <= options.max_depth) {
+                        results.push_back(candidate);
+                    }
+                }
+                if (source_count == options.max_source_count ||
+                    source_count == target_powers.size()) {
+                    break;
+                }
+
+                // Grow each partial set by one more source power
+                set<set<uint32_t>> seen;
+                vector<SourcesCandidate> next_beam;
+                for (const auto &candidate : beam) {
+                    for (uint32_t power : target_powers) {
+                        if (candidate.sources.count(power)) {
+                            continue;
+                        }
+
+                        SourcesCandidate next;
+                        next.sources = candidate.sources;
+                        next.sources.insert(power);
+                        if (!seen.insert(next.sources).second) {
+                            continue;
+                        }
+                        if (evaluate_for_targets(target_powers, options.query_weight, next)) {
+                            next_beam.push_back(move(next));
+                        }
+                    }
+                }
+
+                if (next_beam.size() > options.beam_width) {
+                    partial_sort(
+                        next_beam.begin(),
+                        next_beam.begin() + static_cast<ptrdiff_t>(options.beam_width),
+                        next_beam.end(),
+                        [&](const SourcesCandidate &a, const SourcesCandidate &b) {
+                            // Any depth within the bound is equally good; only then compare costs
+                            uint32_t a_depth = max(a.depth, options.max_depth);
+                            uint32_t b_depth = max(b.depth, options.max_depth);
+                            return tie(a_depth, a.cost, a.sources) <
+                                   tie(b_depth, b.cost, b.sources);
+                        });
+                    next_beam.resize(options.beam_width);
+                }
+                beam = move(next_beam);
+                if (beam.empty()) {
+                    break;
+                }
+            }
+
+            sort(results.begin(), results.end(), result_order);
+            if (results.size() > options.candidate_count) {
+                results.resize(options.candidate_count);
+            }
+
+            return results;
+        }
+
+        bool evaluate_sources(
+            uint32_t ps_low_degree,
+            uint32_t bound,
+            double query_weight,
+            SourcesCandidate &candidate)
+        {
+            return evaluate_for_targets(
+                create_powers_set(ps_low_degree, bound), query_weight, candidate);
+        }
+    } // namespace util
+} // namespace apsi
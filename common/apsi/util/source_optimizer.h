@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+namespace apsi {
+    namespace util {
+        /**
+        Options controlling the search for source powers.
+        */
+        struct SourcesSearchOptions {
+            /**
+            The largest allowed depth of the PowersDag.
+            */
+            std::uint32_t max_depth = 0;
+
+            /**
+            The largest allowed number of source powers, i.e., query ciphertexts per bundle index.
+            */
+            std::uint32_t max_source_count = 16;
+
+            /**
+            The cost of sending one query ciphertext relative to the cost of one multiplication and
+            relinearization on the sender.
+            */
+            double query_weight = 1.0;
+
+            /**
+            The number of partial source sets kept at each step of the search. A larger value finds
+            better candidates at the cost of a slower search.
+            */
+            std::size_t beam_width = 64;
+
+            /**
+            The number of best candidates returned.
+            */
+            std::size_t candidate_count = 10;
+        };
+
+        /**
+        A set of source powers together with the cost of computing all target powers from it.
+        */
+        struct SourcesCandidate {
+            std::set<std::uint32_t> sources;
+
+            /**
+            The depth of the PowersDag configured with these sources.
+            */
+            std::uint32_t depth = 0;
+
+            /**
+            The number of ciphertext multiplications the sender performs to compute the target
+            powers. Each multiplication is followed by a relinearization.
+            */
+            std::uint32_t multiplication_count = 0;
+
+            /**
+            The number of the multiplications that are squarings.
+            */
+            std::uint32_t square_count = 0;
+
+            /**
+            The combined cost of communication and sender computation.
+            */
+            double cost = 0;
+        };
+
+        /**
+        Searches for sets of source powers from which all target powers for the given ps_low_degree
+        and bound can be computed within the given depth. The search grows source sets one power at
+        a time, keeping only the most promising partial sets at each step. Returns the feasible
+        candidates with the lowest combined cost, best first.
+        */
+        std::vector<SourcesCandidate> find_sources(
+            std::uint32_t ps_low_degree, std::uint32_t bound, const SourcesSearchOptions &options);
+
+        /**
+        Computes the depth and costs of the given source powers. Returns false if no PowersDag can
+        be configured with these sources.
+        */
+        bool evaluate_sources(
+            std::uint32_t ps_low_degree,
+            std::uint32_t bound,
+            double query_weight,
+            SourcesCandidate &candidate);
+    } // namespace util
+} // namespace apsi
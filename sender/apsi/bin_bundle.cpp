@@ -13,9 +13,11 @@
 #include "apsi/bin_bundle_generated.h"
 #include "apsi/thread_pool_mgr.h"
 #include "apsi/util/interpolate.h"
+#include "apsi/util/ntt_multiply_accumulator.h"
 #include "apsi/util/utils.h"
 
 // SEAL
+#include "seal/util/common.h"
 #include "seal/util/defines.h"
 
 namespace apsi {
@@ -95,6 +97,86 @@ namespace apsi {
                     }
                 }
             }
+
+            /**
+            Returns whether the batched coefficient of the given degree is stored in NTT form. When
+            evaluating the match and interpolation polynomials on encrypted query data, we multiply
+            each power of the encrypted query with a plaintext corresponding to the polynomial
+            coefficient, and add the results together. The constant coefficient is handled by simply
+            adding to the result, which requires that the plaintext is not in NTT form. When
+            Paterson-Stockmeyer is used, this applies also to the constant coefficients for all
+            inner polynomials, i.e., with degree a multiple of the ps_high_degree == ps_low_degree +
+            1.
+            */
+            bool is_ntt_coeff(size_t deg, uint32_t ps_low_degree)
+            {
+                return (ps_low_degree ? deg % (ps_low_degree + 1) : deg) != 0;
+            }
+
+            /**
+            Returns the parms_id the batched coefficients are encoded at. We will encode with
+            parameters that leave one or two levels, depending on whether Paterson-Stockmeyer is
+            used.
+            */
+            parms_id_type get_coeff_parms_id(const SEALContext &context, uint32_t ps_low_degree)
+            {
+                size_t plain_coeffs_chain_idx = min<size_t>(
+                    context.first_context_data()->chain_index(), ps_low_degree ? 2 : 1);
+                return get_parms_id_for_chain_idx(context, plain_coeffs_chain_idx);
+            }
+
+            /**
+            Returns the number of bytes needed to store the given number of bit-packed field
+            elements.
+            */
+            size_t get_packed_byte_count(size_t felt_count, int bit_count)
+            {
+                return (felt_count * static_cast<size_t>(bit_count) + 7) / 8;
+            }
+
+            /**
+            Packs field elements of at most bit_count bits each into a contiguous bit string.
+            */
+            vector<unsigned char> pack_felts(const vector<felt_t> &felts, int bit_count)
+            {
+                vector<unsigned char> packed(get_packed_byte_count(felts.size(), bit_count), 0);
+                size_t bit_idx = 0;
+                for (felt_t felt : felts) {
+                    for (int remaining = bit_count; remaining;) {
+                        int shift = static_cast<int>(bit_idx & 7);
+                        int chunk = min(8 - shift, remaining);
+                        felt_t bits = felt & ((felt_t(1) << chunk) - 1);
+                        packed[bit_idx >> 3] |= static_cast<unsigned char>(bits << shift);
+                        felt >>= chunk;
+                        remaining -= chunk;
+                        bit_idx += static_cast<size_t>(chunk);
+                    }
+                }
+
+                return packed;
+            }
+
+            /**
+            Unpacks field elements of bit_count bits each from a bit string created by pack_felts.
+            The size of felts determines the number of field elements unpacked.
+            */
+            void unpack_felts(
+                const vector<unsigned char> &packed, int bit_count, vector<felt_t> &felts)
+            {
+                size_t bit_idx = 0;
+                for (felt_t &felt : felts) {
+                    felt = 0;
+                    for (int read = 0; read < bit_count;) {
+                        int shift = static_cast<int>(bit_idx & 7);
+                        int chunk = min(8 - shift, bit_count - read);
+                        felt_t bits = static_cast<felt_t>(packed[bit_idx >> 3] >> shift) &
+                                      ((felt_t(1) << chunk) - 1);
+                        felt |= bits << read;
+                        read += chunk;
+                        bit_idx += static_cast<size_t>(chunk);
+                    }
+                }
+            }
         } // namespace
 
         /**
@@ -106,61 +188,124 @@ namespace apsi {
         Ciphertext BatchedPlaintextPolyn::eval(
             const vector<Ciphertext> &ciphertext_powers, MemoryPoolHandle &pool) const
         {
+            return EvalMany({ cref(*this) }, ciphertext_powers, pool)[0];
+        }
+
+        vector<Ciphertext> BatchedPlaintextPolyn::EvalMany(
+            const vector<reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+            const vector<Ciphertext> &ciphertext_powers,
+            MemoryPoolHandle &pool)
+        {
+            vector<reference_wrapper<const vector<Ciphertext>>> ciphertext_powers_sets;
+            ciphertext_powers_sets.push_back(cref(ciphertext_powers));
+            return move(EvalMany(polyns, ciphertext_powers_sets, pool)[0]);
+        }
+
+        vector<vector<Ciphertext>> BatchedPlaintextPolyn::EvalMany(
+            const vector<reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+            const vector<reference_wrapper<const vector<Ciphertext>>> &ciphertext_powers_sets,
+            MemoryPoolHandle &pool)
+        {
 #ifdef SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT
             static_assert(
                 false, "SEAL must be built with SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT=OFF");
 #endif
-            // We need to have enough ciphertext powers to evaluate this polynomial
-            if (ciphertext_powers.size() < max<size_t>(batched_coeffs.size(), 2)) {
-                throw invalid_argument("not enough ciphertext powers available");
+            size_t set_count = ciphertext_powers_sets.size();
+            vector<vector<Ciphertext>> results(set_count);
+            if (polyns.empty() || !set_count) {
+                return results;
             }
 
+            // We need to have enough ciphertext powers to evaluate all of the polynomials
+            size_t max_coeff_count = 0;
+            for (const auto &polyn : polyns) {
+                max_coeff_count = max(max_coeff_count, polyn.get().coeff_count());
+            }
+            for (const auto &ciphertext_powers : ciphertext_powers_sets) {
+                if (ciphertext_powers.get().size() < max<size_t>(max_coeff_count, 2)) {
+                    throw invalid_argument("not enough ciphertext powers available");
+                }
+            }
+
+            const CryptoContext &crypto_context = polyns[0].get().crypto_context;
             auto seal_context = crypto_context.seal_context();
             auto evaluator = crypto_context.evaluator();
 
-            // We know now that ciphertext_powers is non-empty so read the parms_id from the first
-            // one; they should all be the same.
-            const auto &encode_parms_id = ciphertext_powers[1].parms_id();
+            // We know now that the powers are non-empty so read the parms_id from the first one;
+            // they should all be the same.
+            const auto &encode_parms_id = ciphertext_powers_sets[0].get()[1].parms_id();
+
+            // Each polynomial gets its own coefficient buffer, and each pair of power set and
+            // polynomial gets its own accumulator
+            size_t polyn_count = polyns.size();
+            vector<CoeffBuffer> coeff_buffers;
+            coeff_buffers.reserve(polyn_count);
+            for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                coeff_buffers.emplace_back(pool);
+            }
+            vector<NTTMultiplyAccumulator> accs;
+            accs.reserve(set_count * polyn_count);
+            for (size_t acc_idx = 0; acc_idx < set_count * polyn_count; acc_idx++) {
+                accs.emplace_back(*seal_context, encode_parms_id, pool);
+            }
 
             // Lowest degree terms are stored in the lowest index positions in vectors.
             // Specifically, ciphertext_powers[1] is the first power of the ciphertext data, but
             // batched_coeffs[0] is the constant coefficient.
             //
             // Because the plaintexts in batched_coeffs can be identically zero, SEAL should be
-            // built with SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT=OFF. We create a result ciphertext
-            // that is identically zero and set its NTT form flag to true so the additions below
-            // will work.
-            Ciphertext result(pool);
-            result.resize(*seal_context, encode_parms_id, 2);
-            result.is_ntt_form() = true;
-            Ciphertext temp(pool);
-            Plaintext coeff(pool);
-            for (size_t deg = 1; deg < batched_coeffs.size(); deg++) {
-                coeff.unsafe_load(
-                    *seal_context,
-                    reinterpret_cast<const seal_byte *>(batched_coeffs[deg].data()),
-                    batched_coeffs[deg].size());
-                evaluator->multiply_plain(ciphertext_powers[deg], coeff, temp, pool);
-                evaluator->add_inplace(result, temp);
-            }
-
-            // Need to transform back from NTT form before we can add the constant coefficient. The
-            // constant coefficient is specifically not in NTT form so this can work.
-            evaluator->transform_from_ntt_inplace(result);
-            coeff.unsafe_load(
-                *seal_context,
-                reinterpret_cast<const seal_byte *>(batched_coeffs[0].data()),
-                batched_coeffs[0].size());
-            evaluator->add_plain_inplace(result, coeff);
-
-            // Make the result as small as possible by modulus switching and possibly clearing
-            // irrelevant bits.
-            while (result.parms_id() != seal_context->last_parms_id()) {
-                evaluator->mod_switch_to_next_inplace(result, pool);
-            }
-            try_clear_irrelevant_bits(seal_context->last_context_data()->parms(), result);
+            // built with SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT=OFF. All products are summed by an
+            // NTTMultiplyAccumulator, which produces an identically zero NTT-form ciphertext if
+            // there is nothing to add.
+            //
+            // The loop over the powers is outermost so each power is read only once for all
+            // polynomials, and each coefficient is loaded only once for all power sets.
+            for (size_t deg = 1; deg < max_coeff_count; deg++) {
+                for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                    // Identically zero terms contribute nothing
+                    const BatchedPlaintextPolyn &polyn = polyns[polyn_idx].get();
+                    if (deg >= polyn.coeff_count() || polyn.is_zero_coeff(deg)) {
+                        continue;
+                    }
 
-            return result;
+                    const Plaintext &coeff = polyn.get_coeff(deg, coeff_buffers[polyn_idx]);
+                    for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                        accs[set_idx * polyn_count + polyn_idx].multiply_plain_add(
+                            ciphertext_powers_sets[set_idx].get()[deg], coeff);
+                    }
+                }
+            }
+
+            for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                const BatchedPlaintextPolyn &polyn = polyns[polyn_idx].get();
+                bool add_constant = polyn.coeff_count() && !polyn.is_zero_coeff(0);
+                const Plaintext *constant_coeff =
+                    add_constant ? &polyn.get_coeff(0, coeff_buffers[polyn_idx]) : nullptr;
+
+                for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                    Ciphertext result(pool);
+                    accs[set_idx * polyn_count + polyn_idx].finalize(result);
+
+                    // Need to transform back from NTT form before we can add the constant
+                    // coefficient. The constant coefficient is specifically not in NTT form so this
+                    // can work.
+                    evaluator->transform_from_ntt_inplace(result);
+                    if (constant_coeff) {
+                        evaluator->add_plain_inplace(result, *constant_coeff);
+                    }
+
+                    // Make the result as small as possible by modulus switching and possibly
+                    // clearing irrelevant bits.
+                    while (result.parms_id() != seal_context->last_parms_id()) {
+                        evaluator->mod_switch_to_next_inplace(result, pool);
+                    }
+                    try_clear_irrelevant_bits(seal_context->last_context_data()->parms(), result);
+
+                    results[set_idx].push_back(move(result));
+                }
+            }
+
+            return results;
         }
 
         /**
@@ -185,160 +330,359 @@ namespace apsi {
             size_t ps_low_degree,
             MemoryPoolHandle &pool) const
         {
+            return move(EvalPatstockMany(
+                { cref(*this) },
+                { cref(eval_crypto_context) },
+                { cref(ciphertext_powers) },
+                ps_low_degree,
+                pool)[0][0]);
+        }
+
+        size_t BatchedPlaintextPolyn::EstimateEvalBytes(
+            size_t polyn_count,
+            size_t set_count,
+            size_t coeff_count,
+            const Ciphertext &power,
+            size_t ps_low_degree)
+        {
+            // Everything is counted in polynomials of the size of the power
+            size_t poly_bytes = mul_safe(
+                power.poly_modulus_degree(), power.coeff_modulus_size(), sizeof(uint64_t));
+
+            // Without Paterson-Stockmeyer, each polynomial and set of powers needs an
+            // NTTMultiplyAccumulator with 128-bit values for two components, and a result with two
+            // components. Each polynomial needs a coefficient buffer, and modulus switching the
+            // results needs a few temporaries.
+            size_t per_polyn_count = 7;
+            size_t fixed_count = 4;
+            size_t degree = coeff_count ? coeff_count - 1 : 0;
+            if ((ps_low_degree > 1) && (ps_low_degree < degree)) {
+                // With Paterson-Stockmeyer, the h+1 inner polynomials are evaluated by up to as
+                // many tasks in parallel as there are threads. Each running task holds its own
+                // accumulators and coefficient buffers, and the temporaries of a ciphertext
+                // multiplication with a high power take a few dozen polynomials. Every inner
+                // polynomial leaves a three-component product until all products are summed.
+                // Relinearizing and modulus switching the results needs a few more temporaries.
+                size_t task_count = degree / (ps_low_degree + 1) + 1;
+                size_t parallel_task_count =
+                    min(task_count, max<size_t>(ThreadPoolMgr::GetThreadCount(), 1));
+                per_polyn_count = add_safe(
+                    mul_safe(parallel_task_count, size_t(5)), mul_safe(task_count, size_t(3)));
+                fixed_count = add_safe(mul_safe(parallel_task_count, size_t(40)), size_t(20));
+            }
+
+            size_t poly_count = mul_safe(polyn_count, set_count, per_polyn_count);
+            if (polyn_count) {
+                poly_count = add_safe(poly_count, fixed_count);
+            }
+            return mul_safe(poly_bytes, poly_count);
+        }
+
+        vector<vector<Ciphertext>> BatchedPlaintextPolyn::EvalPatstockMany(
+            const vector<reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+            const vector<reference_wrapper<const CryptoContext>> &eval_crypto_contexts,
+            const vector<reference_wrapper<const vector<Ciphertext>>> &ciphertext_powers_sets,
+            size_t ps_low_degree,
+            MemoryPoolHandle &pool)
+        {
 #ifdef SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT
             static_assert(
                 false, "SEAL must be built with SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT=OFF");
 #endif
-            // We need to have enough ciphertext powers to evaluate this polynomial
-            if (ciphertext_powers.size() < max<size_t>(batched_coeffs.size(), 2)) {
-                throw invalid_argument("not enough ciphertext powers available");
+            size_t set_count = ciphertext_powers_sets.size();
+            if (eval_crypto_contexts.size() != set_count) {
+                throw invalid_argument(
+                    "eval_crypto_contexts and ciphertext_powers_sets must have the same size");
+            }
+
+            // We need to have enough ciphertext powers to evaluate all of the polynomials
+            size_t max_coeff_count = 0;
+            for (const auto &polyn : polyns) {
+                max_coeff_count = max(max_coeff_count, polyn.get().coeff_count());
+            }
+            for (const auto &ciphertext_powers : ciphertext_powers_sets) {
+                if (ciphertext_powers.get().size() < max<size_t>(max_coeff_count, 2)) {
+                    throw invalid_argument("not enough ciphertext powers available");
+                }
             }
 
             // This function should not be called when the low-degree is 1
-            size_t degree = batched_coeffs.size() - 1;
-            if (ps_low_degree <= 1 || ps_low_degree >= degree) {
-                throw invalid_argument("ps_low_degree must be greater than 1 and less than the "
-                                       "size of batched_coeffs");
+            for (const auto &polyn : polyns) {
+                size_t degree = polyn.get().coeff_count() - 1;
+                if (ps_low_degree <= 1 || ps_low_degree >= degree) {
+                    throw invalid_argument("ps_low_degree must be greater than 1 and less than the "
+                                           "size of batched_coeffs");
+                }
             }
 
-            auto seal_context = eval_crypto_context.seal_context();
-            auto evaluator = eval_crypto_context.evaluator();
-            auto relin_keys = eval_crypto_context.relin_keys();
-            bool relinearize = eval_crypto_context.seal_context()->using_keyswitching();
+            vector<vector<Ciphertext>> results(set_count);
+            size_t polyn_count = polyns.size();
+            if (!set_count || !polyn_count) {
+                return results;
+            }
+
+            // All sets use the same SEALContext; only the relinearization keys may differ
+            auto seal_context = eval_crypto_contexts[0].get().seal_context();
+            bool relinearize = seal_context->using_keyswitching();
 
-            auto high_powers_parms_id =
-                get_parms_id_for_chain_idx(*crypto_context.seal_context(), 1);
+            auto high_powers_parms_id = get_parms_id_for_chain_idx(*seal_context, 1);
+            auto low_powers_parms_id = ciphertext_powers_sets[0].get()[1].parms_id();
 
             // This is the number of high-degree powers we have: the first high-degree is
             // ps_low_degree + 1 and the rest are multiples of that up to (but not exceeding) the
-            // total degree.
+            // total degree. The polynomials may have different degrees.
             size_t ps_high_degree = ps_low_degree + 1;
-            size_t ps_high_degree_powers = degree / ps_high_degree;
+            size_t max_ps_high_degree_powers = (max_coeff_count - 1) / ps_high_degree;
 
             // Lowest degree terms are stored in the lowest index positions in vectors.
             // Specifically, ciphertext_powers[1] is the first power of the ciphertext data, but
             // batched_coeffs[0] is the constant coefficient.
             //
             // Because the plaintexts in batched_coeffs can be identically zero, SEAL should be
-            // built with SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT=OFF. We create a result ciphertext
-            // that is identically zero and set its NTT form flag to true so the additions below
-            // will work. The ciphertext here will have three components; we relinearize only at the
-            // end.
-            Ciphertext result(pool);
-            result.resize(*seal_context, high_powers_parms_id, 3);
-            result.is_ntt_form() = false;
-
-            // Temporary variables
-            Ciphertext temp(pool);
-            Ciphertext temp_in(pool);
-            Plaintext coeff(pool);
-
-            // Calculate polynomial for i=1,...,ps_high_degree_powers-1
-            for (size_t i = 1; i < ps_high_degree_powers; i++) {
-                // Evaluate inner polynomial. The free term is left out and added later on.
-                // The evaluation result is stored in temp_in.
-                for (size_t j = 1; j < ps_high_degree; j++) {
-                    coeff.unsafe_load(
-                        *seal_context,
-                        reinterpret_cast<const seal_byte *>(
-                            batched_coeffs[i * ps_high_degree + j].data()),
-                        batched_coeffs[i * ps_high_degree + j].size());
-
-                    evaluator->multiply_plain(ciphertext_powers[j], coeff, temp, pool);
-
-                    if (j == 1) {
-                        temp_in = temp;
-                    } else {
-                        evaluator->add_inplace(temp_in, temp);
-                    }
+            // built with SEAL_THROW_ON_TRANSPARENT_CIPHERTEXT=OFF. The inner polynomials are
+            // evaluated on the low powers, which are in NTT form. Their terms are summed by an
+            // NTTMultiplyAccumulator for each polynomial and each set of powers. The loop over the
+            // low powers is outside the loop over the polynomials, so each power is read only once
+            // for all of the polynomials, and each coefficient is loaded only once for all sets.
+            // Identically zero terms are skipped; if all of them are zero, the whole inner
+            // polynomial is skipped, including the multiplication by the high power.
+            //
+            // The inner polynomials for i=1,...,ps_high_degree_powers are independent of each
+            // other and are evaluated in parallel. The last one is different in that the degree of
+            // the inner polynomial is degree % ps_high_degree (it may be empty). The free terms are
+            // left out and added later on. The products with the high powers have three components;
+            // they are summed with a tree reduction and we relinearize only at the end.
+            //
+            // An additional subtask evaluates the inner polynomial for i=0, which needs no
+            // multiplication with a high power, and adds the free terms of the other inner
+            // polynomials multiplied by the respective high powers. Empty partial results mean
+            // that there was nothing to add.
+            //
+            // The partial results are indexed as [task][polynomial][set].
+            vector<vector<vector<Ciphertext>>> partials(
+                max_ps_high_degree_powers + 1, vector<vector<Ciphertext>>(polyn_count));
+            auto eval_partial = [&](size_t task_idx) {
+                vector<NTTMultiplyAccumulator> accs;
+                accs.reserve(polyn_count * set_count);
+                for (size_t acc_idx = 0; acc_idx < polyn_count * set_count; acc_idx++) {
+                    accs.emplace_back(*seal_context, low_powers_parms_id, pool);
                 }
+                vector<CoeffBuffer> coeff_buffers;
+                coeff_buffers.reserve(polyn_count);
+                for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                    coeff_buffers.emplace_back(pool);
+                }
+                Ciphertext temp(pool);
+
+                // Subtasks 0,...,max_ps_high_degree_powers-1 compute the inner polynomials
+                // i=1,...,max_ps_high_degree_powers; the last subtask computes the inner
+                // polynomial for i=0.
+                size_t i = (task_idx == max_ps_high_degree_powers) ? 0 : task_idx + 1;
+                auto get_inner_degree = [&](const BatchedPlaintextPolyn &polyn) -> size_t {
+                    size_t degree = polyn.coeff_count() - 1;
+                    size_t ps_high_degree_powers = degree / ps_high_degree;
+                    if (i > ps_high_degree_powers) {
+                        return 0;
+                    }
+                    return (i == ps_high_degree_powers) ? degree % ps_high_degree : ps_low_degree;
+                };
+
+                for (size_t j = 1; j <= ps_low_degree; j++) {
+                    for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                        const BatchedPlaintextPolyn &polyn = polyns[polyn_idx].get();
+                        if (j > get_inner_degree(polyn) ||
+                            polyn.is_zero_coeff(i * ps_high_degree + j)) {
+                            continue;
+                        }
 
-                // Transform inner polynomial to coefficient form
-                evaluator->transform_from_ntt_inplace(temp_in);
-                evaluator->mod_switch_to_inplace(temp_in, high_powers_parms_id);
-
-                // The high powers are already in coefficient form
-                evaluator->multiply_inplace(temp_in, ciphertext_powers[i * ps_high_degree], pool);
-                evaluator->add_inplace(result, temp_in);
-            }
+                        const Plaintext &coeff =
+                            polyn.get_coeff(i * ps_high_degree + j, coeff_buffers[polyn_idx]);
+                        for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                            accs[polyn_idx * set_count + set_idx].multiply_plain_add(
+                                ciphertext_powers_sets[set_idx].get()[j], coeff);
+                        }
+                    }
+                }
 
-            // Calculate polynomial for i=ps_high_degree_powers.
-            // Done separately because here the degree of the inner poly is degree % ps_high_degree.
-            // Once again, the free term will only be added later on.
-            if (degree % ps_high_degree > 0) {
-                for (size_t j = 1; j <= degree % ps_high_degree; j++) {
-                    coeff.unsafe_load(
-                        *seal_context,
-                        reinterpret_cast<const seal_byte *>(
-                            batched_coeffs[ps_high_degree_powers * ps_high_degree + j].data()),
-                        batched_coeffs[ps_high_degree_powers * ps_high_degree + j].size());
+                for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                    vector<Ciphertext> &partial = partials[task_idx][polyn_idx];
+                    if (!accs[polyn_idx * set_count].empty()) {
+                        for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                            auto evaluator = eval_crypto_contexts[set_idx].get().evaluator();
+
+                            // Transform inner polynomial to coefficient form
+                            accs[polyn_idx * set_count + set_idx].finalize(temp);
+                            evaluator->transform_from_ntt_inplace(temp);
+                            evaluator->mod_switch_to_inplace(temp, high_powers_parms_id);
+
+                            // The high powers are already in coefficient form
+                            if (i) {
+                                const auto &ciphertext_powers =
+                                    ciphertext_powers_sets[set_idx].get();
+                                evaluator->multiply_inplace(
+                                    temp, ciphertext_powers[i * ps_high_degree], pool);
+                            }
+                            partial.push_back(move(temp));
+                            temp = Ciphertext(pool);
+                        }
+                    }
+                    if (i) {
+                        continue;
+                    }
 
-                    evaluator->multiply_plain(ciphertext_powers[j], coeff, temp, pool);
+                    // Add the constant coefficients of the inner polynomials multiplied by the
+                    // respective powers of high-degree
+                    const BatchedPlaintextPolyn &polyn = polyns[polyn_idx].get();
+                    size_t ps_high_degree_powers = (polyn.coeff_count() - 1) / ps_high_degree;
+                    for (size_t k = 1; k < ps_high_degree_powers + 1; k++) {
+                        if (polyn.is_zero_coeff(k * ps_high_degree)) {
+                            continue;
+                        }
 
-                    if (j == 1) {
-                        temp_in = temp;
-                    } else {
-                        evaluator->add_inplace(temp_in, temp);
+                        const Plaintext &coeff =
+                            polyn.get_coeff(k * ps_high_degree, coeff_buffers[polyn_idx]);
+                        for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                            auto evaluator = eval_crypto_contexts[set_idx].get().evaluator();
+                            const auto &ciphertext_powers = ciphertext_powers_sets[set_idx].get();
+                            evaluator->multiply_plain(
+                                ciphertext_powers[k * ps_high_degree], coeff, temp, pool);
+                            evaluator->mod_switch_to_inplace(temp, high_powers_parms_id);
+                            if (partial.size() == set_idx) {
+                                partial.push_back(move(temp));
+                                temp = Ciphertext(pool);
+                            } else {
+                                evaluator->add_inplace(partial[set_idx], temp);
+                            }
+                        }
                     }
                 }
+            };
+
+            ThreadPoolMgr tpm;
+            tpm.parallel_for(partials.size(), eval_partial);
+
+            // Sum the products with the high powers with a tree reduction
+            size_t product_count = max_ps_high_degree_powers;
+            for (size_t stride = 1; stride < product_count; stride *= 2) {
+                size_t pair_count = (product_count + 2 * stride - 1) / (2 * stride);
+                tpm.parallel_for(pair_count, [&](size_t pair_idx) {
+                    size_t dst_idx = 2 * stride * pair_idx;
+                    size_t src_idx = dst_idx + stride;
+                    if (src_idx >= product_count) {
+                        return;
+                    }
+                    for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                        vector<Ciphertext> &dst = partials[dst_idx][polyn_idx];
+                        vector<Ciphertext> &src = partials[src_idx][polyn_idx];
+                        if (src.empty()) {
+                            continue;
+                        }
+                        if (dst.empty()) {
+                            dst = move(src);
+                            continue;
+                        }
+                        for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                            eval_crypto_contexts[set_idx].get().evaluator()->add_inplace(
+                                dst[set_idx], src[set_idx]);
+                        }
+                    }
+                });
+            }
+
+            CoeffBuffer coeff_buffer(pool);
+            for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                const CryptoContext &eval_crypto_context = eval_crypto_contexts[set_idx].get();
+                auto evaluator = eval_crypto_context.evaluator();
+                for (size_t polyn_idx = 0; polyn_idx < polyn_count; polyn_idx++) {
+                    // We create a result ciphertext that is identically zero if there are no
+                    // products, so the additions below will work.
+                    vector<Ciphertext> &products = partials[0][polyn_idx];
+                    Ciphertext result(pool);
+                    if (products.empty()) {
+                        result.resize(*seal_context, high_powers_parms_id, 2);
+                        result.is_ntt_form() = false;
+                    } else {
+                        result = move(products[set_idx]);
 
-                // Transform inner polynomial to coefficient form
-                evaluator->transform_from_ntt_inplace(temp_in);
-                evaluator->mod_switch_to_inplace(temp_in, high_powers_parms_id);
+                        // Relinearize sum of ciphertext-ciphertext products if relinearization is
+                        // supported by the parameters.
+                        if (relinearize) {
+                            evaluator->relinearize_inplace(
+                                result, *eval_crypto_context.relin_keys(), pool);
+                        }
+                    }
 
-                // The high powers are already in coefficient form
-                evaluator->multiply_inplace(
-                    temp_in, ciphertext_powers[ps_high_degree_powers * ps_high_degree], pool);
-                evaluator->add_inplace(result, temp_in);
-            }
+                    // Add the inner polynomial for i=0 and the free terms
+                    const vector<Ciphertext> &low_partial =
+                        partials[max_ps_high_degree_powers][polyn_idx];
+                    if (!low_partial.empty()) {
+                        evaluator->add_inplace(result, low_partial[set_idx]);
+                    }
 
-            // Relinearize sum of ciphertext-ciphertext products if relinearization is supported by
-            // the parameters.
-            if (relinearize) {
-                evaluator->relinearize_inplace(result, *relin_keys, pool);
-            }
+                    // Add the constant coefficient
+                    const BatchedPlaintextPolyn &polyn = polyns[polyn_idx].get();
+                    if (!polyn.is_zero_coeff(0)) {
+                        evaluator->add_plain_inplace(result, polyn.get_coeff(0, coeff_buffer));
+                    }
 
-            // Calculate inner polynomial for i=0.
-            // Done separately since there is no multiplication with a power of high-degree
-            for (size_t j = 1; j < ps_high_degree; j++) {
-                coeff.unsafe_load(
-                    *seal_context,
-                    reinterpret_cast<const seal_byte *>(batched_coeffs[j].data()),
-                    batched_coeffs[j].size());
+                    // Make the result as small as possible by modulus switching and possibly
+                    // clearing irrelevant bits.
+                    while (result.parms_id() != seal_context->last_parms_id()) {
+                        evaluator->mod_switch_to_next_inplace(result, pool);
+                    }
+                    try_clear_irrelevant_bits(seal_context->last_context_data()->parms(), result);
 
-                evaluator->multiply_plain(ciphertext_powers[j], coeff, temp, pool);
-                evaluator->transform_from_ntt_inplace(temp);
-                evaluator->mod_switch_to_inplace(temp, high_powers_parms_id);
-                evaluator->add_inplace(result, temp);
+                    results[set_idx].push_back(move(result));
+                }
             }
 
-            // Add the constant coefficients of the inner polynomials multiplied by the respective
-            // powers of high-degree
-            for (size_t i = 1; i < ps_high_degree_powers + 1; i++) {
-                coeff.unsafe_load(
-                    *seal_context,
-                    reinterpret_cast<const seal_byte *>(batched_coeffs[i * ps_high_degree].data()),
-                    batched_coeffs[i * ps_high_degree].size());
+            return results;
+        }
 
-                evaluator->multiply_plain(ciphertext_powers[i * ps_high_degree], coeff, temp, pool);
-                evaluator->mod_switch_to_inplace(temp, high_powers_parms_id);
-                evaluator->add_inplace(result, temp);
-            }
+        BatchedPlaintextPolyn::BatchedPlaintextPolyn(BatchedPlaintextPolyn &&source)
+            : batched_coeffs(move(source.batched_coeffs)), packed(source.packed),
+              packed_felt_count(source.packed_felt_count), ps_low_degree(source.ps_low_degree),
+              plain_coeffs(move(source.plain_coeffs)), zero_coeffs(move(source.zero_coeffs)),
+              crypto_context(move(source.crypto_context)),
+              plaintext_cache_id(
+                  exchange(source.plaintext_cache_id, util::PlaintextCache::NewSourceId()))
+        {}
 
-            // Add the constant coefficient
-            coeff.unsafe_load(
-                *seal_context,
-                reinterpret_cast<const seal_byte *>(batched_coeffs[0].data()),
-                batched_coeffs[0].size());
+        BatchedPlaintextPolyn &BatchedPlaintextPolyn::operator=(BatchedPlaintextPolyn &&assign)
+        {
+            if (this == &assign) {
+                return *this;
+            }
+
+            // The coefficients cached for this polynomial are about to be replaced
+            util::PlaintextCache::Global().erase_source(plaintext_cache_id);
+
+            batched_coeffs = move(assign.batched_coeffs);
+            packed = assign.packed;
+            packed_felt_count = assign.packed_felt_count;
+            ps_low_degree = assign.ps_low_degree;
+            plain_coeffs = move(assign.plain_coeffs);
+            zero_coeffs = move(assign.zero_coeffs);
+            crypto_context = move(assign.crypto_context);
+            plaintext_cache_id =
+                exchange(assign.plaintext_cache_id, util::PlaintextCache::NewSourceId());
+            return *this;
+        }
 
-            evaluator->add_plain_inplace(result, coeff);
+        BatchedPlaintextPolyn::~BatchedPlaintextPolyn()
+        {
+            util::PlaintextCache::Global().erase_source(plaintext_cache_id);
+        }
 
-            // Make the result as small as possible by modulus switching and possibly clearing
-            // irrelevant bits.
-            while (result.parms_id() != seal_context->last_parms_id()) {
-                evaluator->mod_switch_to_next_inplace(result, pool);
-            }
-            try_clear_irrelevant_bits(seal_context->last_context_data()->parms(), result);
+        BatchedPlaintextPolyn BatchedPlaintextPolyn::clone() const
+        {
+            BatchedPlaintextPolyn result(crypto_context);
+            result.batched_coeffs = batched_coeffs;
+            result.packed = packed;
+            result.packed_felt_count = packed_felt_count;
+            result.ps_low_degree = ps_low_degree;
+            result.plain_coeffs = plain_coeffs;
+            result.zero_coeffs = zero_coeffs;
 
             return result;
         }
@@ -351,11 +695,10 @@ namespace apsi {
             const vector<FEltPolyn> &polyns,
             CryptoContext context,
             uint32_t ps_low_degree,
-            bool compressed)
-            : crypto_context(move(context))
+            bool compressed,
+            bool packed)
+            : packed(packed), ps_low_degree(ps_low_degree), crypto_context(move(context))
         {
-            compr_mode_type compr_mode = compressed ? compr_mode_type::zstd : compr_mode_type::none;
-
             // Find the highest degree polynomial in the list. The max degree determines how many
             // Plaintexts we need to make
             size_t max_deg = 0;
@@ -364,16 +707,23 @@ namespace apsi {
                 max_deg = max(p.size(), max_deg + 1) - 1;
             }
 
-            // We will encode with parameters that leave one or two levels, depending on whether
-            // Paterson-Stockmeyer is used.
-            size_t plain_coeffs_chain_idx = min<size_t>(
-                crypto_context.seal_context()->first_context_data()->chain_index(),
-                ps_low_degree ? 2 : 1);
             auto encode_parms_id =
-                get_parms_id_for_chain_idx(*crypto_context.seal_context(), plain_coeffs_chain_idx);
+                get_coeff_parms_id(*crypto_context.seal_context(), ps_low_degree);
+            int plain_modulus_bit_count = crypto_context.seal_context()
+                                              ->first_context_data()
+                                              ->parms()
+                                              .plain_modulus()
+                                              .bit_count();
 
             // Now make the Plaintexts. We let Plaintext i contain all bin coefficients of degree i.
             size_t num_polyns = polyns.size();
+            packed_felt_count = packed ? num_polyns : 0;
+            zero_coeffs.reserve(max_deg + 1);
+            if (compressed || packed) {
+                batched_coeffs.reserve(max_deg + 1);
+            } else {
+                plain_coeffs.reserve(max_deg + 1);
+            }
             for (size_t i = 0; i < max_deg + 1; i++) {
                 // Go through all the bins, collecting the coefficients at degree i
                 vector<felt_t> coeffs_of_deg_i;
@@ -388,31 +738,82 @@ namespace apsi {
                     coeffs_of_deg_i.push_back(coeff);
                 }
 
+                // Record whether this coefficient is identically zero so evaluation can skip it
+                zero_coeffs.push_back(all_of(
+                    coeffs_of_deg_i.begin(), coeffs_of_deg_i.end(), [](auto a) { return a == 0; }));
+
+                // Packed coefficients are encoded only when they are used
+                if (packed) {
+                    batched_coeffs.push_back(pack_felts(coeffs_of_deg_i, plain_modulus_bit_count));
+                    continue;
+                }
+
                 // Now let pt be the Plaintext consisting of all those degree i coefficients
                 Plaintext pt;
                 crypto_context.encoder()->encode(coeffs_of_deg_i, pt);
-
-                // When evaluating the match and interpolation polynomials on encrypted query data,
-                // we multiply each power of the encrypted query with a plaintext (pt here)
-                // corresponding to the polynomial coefficient, and add the results together. The
-                // constant coefficient is handled by simply adding to the result,  which requires
-                // that the plaintext is not in NTT form. When Paterson-Stockmeyer is used, this
-                // applies also to the constant coefficients for all inner polynomials, i.e., with
-                // i a multiple of the ps_high_degree == ps_low_degree + 1.
-                if ((!ps_low_degree && (i != 0)) || (ps_low_degree && (i % (ps_low_degree + 1)))) {
+                if (is_ntt_coeff(i, ps_low_degree)) {
                     crypto_context.evaluator()->transform_to_ntt_inplace(pt, encode_parms_id);
                 }
 
+                // Uncompressed Plaintexts are kept as they are so evaluation can read them in place
+                if (!compressed) {
+                    plain_coeffs.push_back(move(pt));
+                    continue;
+                }
+
                 // Push the new Plaintext
                 vector<unsigned char> pt_data;
-                pt_data.resize(safe_cast<size_t>(pt.save_size(compr_mode)));
+                pt_data.resize(safe_cast<size_t>(pt.save_size(compr_mode_type::zstd)));
                 size_t size = static_cast<size_t>(pt.save(
-                    reinterpret_cast<seal_byte *>(pt_data.data()), pt_data.size(), compr_mode));
+                    reinterpret_cast<seal_byte *>(pt_data.data()),
+                    pt_data.size(),
+                    compr_mode_type::zstd));
                 pt_data.resize(size);
                 batched_coeffs.push_back(move(pt_data));
             }
         }
 
+        const Plaintext &BatchedPlaintextPolyn::get_coeff(size_t deg, CoeffBuffer &buffer) const
+        {
+            if (!plain_coeffs.empty()) {
+                return plain_coeffs[deg];
+            }
+
+            auto load_coeff = [&](Plaintext &pt) {
+                if (!packed) {
+                    pt.unsafe_load(
+                        *crypto_context.seal_context(),
+                        reinterpret_cast<const seal_byte *>(batched_coeffs[deg].data()),
+                        batched_coeffs[deg].size());
+                    return;
+                }
+
+                // Unpack the field elements, then encode and transform to NTT form as the
+                // constructor would have done
+                const auto &seal_context = *crypto_context.seal_context();
+                vector<felt_t> felts(packed_felt_count);
+                unpack_felts(
+                    batched_coeffs[deg],
+                    seal_context.first_context_data()->parms().plain_modulus().bit_count(),
+                    felts);
+                crypto_context.encoder()->encode(felts, pt);
+                if (is_ntt_coeff(deg, ps_low_degree)) {
+                    crypto_context.evaluator()->transform_to_ntt_inplace(
+                        pt, get_coeff_parms_id(seal_context, ps_low_degree), pt.pool());
+                }
+            };
+
+            // Use the cache of decompressed plaintexts if it is enabled
+            auto &plaintext_cache = util::PlaintextCache::Global();
+            if (plaintext_cache.is_enabled()) {
+                buffer.cached = plaintext_cache.get(plaintext_cache_id, deg, load_coeff);
+                return *buffer.cached;
+            }
+
+            load_coeff(buffer.plain);
+            return buffer.plain;
+        }
+
         BinBundleCache::BinBundleCache(const CryptoContext &crypto_context, size_t label_size)
             : batched_matching_polyn(crypto_context)
         {
@@ -429,10 +830,12 @@ namespace apsi {
             size_t ps_low_degree,
             size_t num_bins,
             bool compressed,
-            bool stripped)
+            bool stripped,
+            bool packed)
             : cache_invalid_(true), crypto_context_(crypto_context), compressed_(compressed),
-              label_size_(label_size), max_bin_size_(max_bin_size), ps_low_degree_(ps_low_degree),
-              num_bins_(num_bins), cache_(crypto_context_, label_size_)
+              packed_(packed), label_size_(label_size), max_bin_size_(max_bin_size),
+              ps_low_degree_(ps_low_degree), num_bins_(num_bins),
+              cache_(crypto_context_, label_size_)
         {
             if (!crypto_context_.evaluator()) {
                 throw invalid_argument("evaluator is not set in crypto_context");
@@ -499,6 +902,7 @@ namespace apsi {
                     CuckooFilter &curr_filter = filters_[curr_bin_idx];
                     curr_bin.push_back(curr_item);
                     curr_filter.add(curr_item);
+                    bin_sizes_[curr_bin_idx]++;
 
                     // Indicate that the polynomials need to be recomputed
                     cache_invalid_ = true;
@@ -588,6 +992,7 @@ namespace apsi {
                     CuckooFilter &curr_filter = filters_[curr_bin_idx];
                     curr_bin.push_back(curr_item);
                     curr_filter.add(curr_item);
+                    bin_sizes_[curr_bin_idx]++;
 
                     // Insert the new label; loop over each label part
                     for (size_t label_idx = 0; label_idx < get_label_size(); label_idx++) {
@@ -606,6 +1011,151 @@ namespace apsi {
             return safe_cast<int>(max_bin_size);
         }
 
+        template <>
+        int32_t BinBundle::try_multi_insert(
+            const vector<felt_t> &items, size_t start_bin_idx, size_t max_bin_size)
+        {
+            if (stripped_) {
+                APSI_LOG_ERROR("Cannot insert data to a stripped BinBundle");
+                throw logic_error("failed to insert data");
+            }
+            if (items.empty()) {
+                APSI_LOG_ERROR("No item data to insert");
+                return -1;
+            }
+
+            // We are inserting items only; no labels. This BinBundle cannot have a non-zero label
+            // size.
+            if (get_label_size()) {
+                APSI_LOG_ERROR("Attempted to insert unlabeled data in a labeled BinBundle");
+                throw logic_error("failed to insert data");
+            }
+
+            // Return -1 if there isn't enough room in the BinBundle to insert at the given location
+            if (start_bin_idx >= get_num_bins() || items.size() > get_num_bins() - start_bin_idx) {
+                return -1;
+            }
+
+            // Without labels, only the bin sizes can prevent the insertion
+            size_t new_largest_bin_size = get_largest_bin_size(start_bin_idx, items.size()) + 1;
+            if (new_largest_bin_size >= max_bin_size) {
+                return -1;
+            }
+
+            size_t curr_bin_idx = start_bin_idx;
+            for (felt_t curr_item : items) {
+                item_bins_[curr_bin_idx].push_back(curr_item);
+                filters_[curr_bin_idx].add(curr_item);
+                bin_sizes_[curr_bin_idx]++;
+                curr_bin_idx++;
+            }
+
+            // Indicate that the polynomials need to be recomputed
+            cache_invalid_ = true;
+
+            return safe_cast<int32_t>(new_largest_bin_size);
+        }
+
+        template <>
+        int32_t BinBundle::try_multi_insert(
+            const vector<pair<felt_t, vector<felt_t>>> &item_labels,
+            size_t start_bin_idx,
+            size_t max_bin_size)
+        {
+            if (stripped_) {
+                APSI_LOG_ERROR("Cannot insert data to a stripped BinBundle");
+                throw logic_error("failed to insert data");
+            }
+            if (item_labels.empty()) {
+                APSI_LOG_ERROR("No item or label data to insert");
+                return -1;
+            }
+
+            // We are inserting item-labels. This BinBundle cannot have a zero label size.
+            size_t label_size = get_label_size();
+            if (!label_size) {
+                APSI_LOG_ERROR("Attempted to insert labeled data in an unlabeled BinBundle");
+                throw logic_error("failed to insert data");
+            }
+
+            // Check that item_labels has correct size
+            for (const auto &curr_item_label : item_labels) {
+                size_t curr_label_size = curr_item_label.second.size();
+                if (curr_label_size != label_size) {
+                    APSI_LOG_ERROR(
+                        "Attempted to insert item-label with incorrect label size "
+                        << curr_label_size << " (expected " << label_size << ")");
+                    throw invalid_argument("failed to insert data");
+                }
+            }
+
+            // Return -1 if there isn't enough room in the BinBundle to insert at the given location
+            if (start_bin_idx >= get_num_bins() ||
+                item_labels.size() > get_num_bins() - start_bin_idx) {
+                return -1;
+            }
+
+            // Check the bin sizes before touching the bins
+            size_t new_largest_bin_size =
+                get_largest_bin_size(start_bin_idx, item_labels.size()) + 1;
+            if (new_largest_bin_size >= max_bin_size) {
+                return -1;
+            }
+
+            // Insert the item parts, checking at the same time that they are not already in the
+            // bins. On a repeated item part, undo the insertion into the previous bins.
+            size_t curr_bin_idx = start_bin_idx;
+            for (auto &curr_item_label : item_labels) {
+                felt_t curr_item = curr_item_label.first;
+                vector<felt_t> &curr_bin = item_bins_[curr_bin_idx];
+                CuckooFilter &curr_filter = filters_[curr_bin_idx];
+
+                if (is_present(curr_bin, curr_filter, curr_item)) {
+                    while (curr_bin_idx-- > start_bin_idx) {
+                        filters_[curr_bin_idx].remove(item_bins_[curr_bin_idx].back());
+                        item_bins_[curr_bin_idx].pop_back();
+                        bin_sizes_[curr_bin_idx]--;
+                    }
+                    return -1;
+                }
+
+                curr_bin.push_back(curr_item);
+                curr_filter.add(curr_item);
+                bin_sizes_[curr_bin_idx]++;
+                curr_bin_idx++;
+            }
+
+            // All item parts were inserted; insert the label parts
+            for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
+                curr_bin_idx = start_bin_idx;
+                for (auto &curr_item_label : item_labels) {
+                    felt_t curr_label = curr_item_label.second[label_idx];
+                    label_bins_[label_idx][curr_bin_idx].push_back(curr_label);
+                    curr_bin_idx++;
+                }
+            }
+
+            // Indicate that the polynomials need to be recomputed
+            cache_invalid_ = true;
+
+            return safe_cast<int32_t>(new_largest_bin_size);
+        }
+
+        size_t BinBundle::get_largest_bin_size(size_t start_bin_idx, size_t bin_count) const
+        {
+            if (stripped_) {
+                APSI_LOG_ERROR("Cannot get the bin sizes of a stripped BinBundle");
+                throw logic_error("failed to get bin sizes");
+            }
+            if (start_bin_idx > num_bins_ || bin_count > num_bins_ - start_bin_idx) {
+                throw out_of_range("bin range is out of bounds");
+            }
+
+            auto bin_sizes_begin = bin_sizes_.begin() + static_cast<ptrdiff_t>(start_bin_idx);
+            auto bin_sizes_end = bin_sizes_begin + static_cast<ptrdiff_t>(bin_count);
+            return bin_count ? size_t(*max_element(bin_sizes_begin, bin_sizes_end)) : 0;
+        }
+
         template <>
         bool BinBundle::try_multi_overwrite(const vector<felt_t> &items, size_t start_bin_idx)
         {
@@ -789,6 +1339,7 @@ namespace apsi {
                 // Remove the item
                 filters_[curr_bin_idx].remove(*to_remove_item_it);
                 item_bins_[curr_bin_idx].erase(to_remove_item_it);
+                bin_sizes_[curr_bin_idx]--;
 
                 // Indicate that the polynomials need to be recomputed
                 cache_invalid_ = true;
@@ -862,6 +1413,123 @@ namespace apsi {
             return true;
         }
 
+        bool BinBundle::can_merge(
+            const BinBundle &other, size_t start_bin_idx, size_t bin_count) const
+        {
+            if (stripped_ || other.stripped_) {
+                APSI_LOG_ERROR("Cannot merge stripped BinBundles");
+                throw logic_error("failed to merge BinBundles");
+            }
+            if (label_size_ != other.label_size_ || num_bins_ != other.num_bins_) {
+                APSI_LOG_ERROR("Cannot merge BinBundles with different label sizes or bin counts");
+                throw invalid_argument("failed to merge BinBundles");
+            }
+
+            // Return false if the range of bins is not in the BinBundle
+            if (start_bin_idx > num_bins_ || bin_count > num_bins_ - start_bin_idx) {
+                return false;
+            }
+
+            // Check that every bin has room for the items of the other BinBundle
+            for (size_t bin_idx = start_bin_idx; bin_idx < start_bin_idx + bin_count; bin_idx++) {
+                if (size_t(bin_sizes_[bin_idx]) + other.bin_sizes_[bin_idx] >= max_bin_size_) {
+                    return false;
+                }
+
+                // With labels we cannot have repeated item parts in bins
+                if (label_size_) {
+                    const vector<felt_t> &curr_bin = item_bins_[bin_idx];
+                    const CuckooFilter &curr_filter = filters_[bin_idx];
+                    for (felt_t curr_item : other.item_bins_[bin_idx]) {
+                        if (is_present(curr_bin, curr_filter, curr_item)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        bool BinBundle::try_merge(const BinBundle &other, size_t start_bin_idx, size_t bin_count)
+        {
+            if (!can_merge(other, start_bin_idx, bin_count)) {
+                return false;
+            }
+
+            // If we're here, that means we can append to all bins
+            for (size_t bin_idx = start_bin_idx; bin_idx < start_bin_idx + bin_count; bin_idx++) {
+                const vector<felt_t> &other_bin = other.item_bins_[bin_idx];
+                if (other_bin.empty()) {
+                    continue;
+                }
+
+                vector<felt_t> &curr_bin = item_bins_[bin_idx];
+                CuckooFilter &curr_filter = filters_[bin_idx];
+                curr_bin.insert(curr_bin.end(), other_bin.begin(), other_bin.end());
+                for (felt_t curr_item : other_bin) {
+                    curr_filter.add(curr_item);
+                }
+                bin_sizes_[bin_idx] += other.bin_sizes_[bin_idx];
+
+                for (size_t label_idx = 0; label_idx < label_size_; label_idx++) {
+                    vector<felt_t> &curr_label_bin = label_bins_[label_idx][bin_idx];
+                    const vector<felt_t> &other_label_bin = other.label_bins_[label_idx][bin_idx];
+                    curr_label_bin.insert(
+                        curr_label_bin.end(), other_label_bin.begin(), other_label_bin.end());
+                }
+
+                // Indicate that the polynomials need to be recomputed
+                cache_invalid_ = true;
+            }
+
+            return true;
+        }
+
+        BinBundle BinBundle::clone() const
+        {
+            BinBundle result(
+                crypto_context_,
+                label_size_,
+                max_bin_size_,
+                ps_low_degree_,
+                num_bins_,
+                compressed_,
+                stripped_,
+                packed_);
+            result.item_bins_ = item_bins_;
+            result.label_bins_ = label_bins_;
+            result.filters_ = filters_;
+            result.bin_sizes_ = bin_sizes_;
+
+            return result;
+        }
+
+        BinBundle BinBundle::stripped_clone() const
+        {
+            if (cache_invalid_) {
+                throw logic_error("cannot make a stripped copy of a BinBundle with invalid cache");
+            }
+
+            BinBundle result(
+                crypto_context_,
+                label_size_,
+                max_bin_size_,
+                ps_low_degree_,
+                num_bins_,
+                compressed_,
+                /* stripped */ true,
+                packed_);
+            result.cache_.batched_matching_polyn = cache_.batched_matching_polyn.clone();
+            result.cache_.batched_interp_polyns.reserve(cache_.batched_interp_polyns.size());
+            for (const auto &interp_polyn : cache_.batched_interp_polyns) {
+                result.cache_.batched_interp_polyns.push_back(interp_polyn.clone());
+            }
+            result.cache_invalid_ = false;
+
+            return result;
+        }
+
         void BinBundle::clear(bool stripped)
         {
             // Set the stripped flag
@@ -891,6 +1559,12 @@ namespace apsi {
                 }
             }
 
+            // Clear bin sizes
+            bin_sizes_.clear();
+            if (!stripped_) {
+                bin_sizes_.resize(num_bins_, 0);
+            }
+
             // Clear the cache
             clear_cache();
         }
@@ -933,7 +1607,8 @@ namespace apsi {
                     cache_.felt_matching_polyns,
                     crypto_context_,
                     static_cast<uint32_t>(ps_low_degree_),
-                    compressed_);
+                    compressed_,
+                    packed_);
                 cache_.batched_matching_polyn = move(bmp);
             }));
 
@@ -945,7 +1620,8 @@ namespace apsi {
                         interp_polyn,
                         crypto_context_,
                         static_cast<uint32_t>(ps_low_degree_),
-                        compressed_);
+                        compressed_,
+                        packed_);
                     cache_.batched_interp_polyns[label_idx] = move(bip);
                 }));
             }
@@ -975,27 +1651,37 @@ namespace apsi {
 
             ThreadPoolMgr tpm;
 
-            vector<future<void>> futures;
-            // For each bin in the bundle, compute and cache the corresponding "matching
-            // polynomial"
-            for (size_t bin_idx = 0; bin_idx < num_bins; bin_idx++) {
-                futures.push_back(tpm.thread_pool().enqueue([&, bin_idx]() {
-                    // Compute and cache the matching polynomial
-                    FEltPolyn fmp = polyn_with_roots(item_bins_[bin_idx], mod);
-                    cache_.felt_matching_polyns[bin_idx] = move(fmp);
-                }));
-            }
+            // Each task processes a contiguous range of bins. Per-bin tasks are far too small,
+            // especially in unlabeled mode, and the pool overhead would dominate.
+            auto bin_ranges = partition_evenly(num_bins, ThreadPoolMgr::GetThreadCount());
 
-            // For each bin in the bundle, compute and cache the corresponding "label polynomials"
-            for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
-                for (size_t bin_idx = 0; bin_idx < num_bins; bin_idx++) {
-                    futures.push_back(tpm.thread_pool().enqueue([&, label_idx, bin_idx]() {
+            vector<future<void>> futures;
+            futures.reserve(bin_ranges.size());
+            for (auto &bin_range : bin_ranges) {
+                futures.push_back(tpm.thread_pool().enqueue([&, bin_range]() {
+                    vector<vector<felt_t>> label_values(label_size);
+                    for (size_t bin_idx = bin_range.first; bin_idx < bin_range.second; bin_idx++) {
                         // Compute and cache the matching polynomial
-                        FEltPolyn fip = newton_interpolate_polyn(
-                            item_bins_[bin_idx], label_bins_[label_idx][bin_idx], mod);
-                        cache_.felt_interp_polyns[label_idx][bin_idx] = move(fip);
-                    }));
-                }
+                        FEltPolyn fmp = polyn_with_roots(item_bins_[bin_idx], mod);
+                        cache_.felt_matching_polyns[bin_idx] = move(fmp);
+
+                        if (!label_size) {
+                            continue;
+                        }
+
+                        // Compute and cache the label polynomials. All label polynomials of a bin
+                        // are interpolated over the same points (the bin's items), so they share
+                        // one NewtonInterpolator and are computed together in lockstep.
+                        for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
+                            label_values[label_idx] = label_bins_[label_idx][bin_idx];
+                        }
+                        NewtonInterpolator interp(item_bins_[bin_idx], mod);
+                        auto fips = interp.interpolate_many(label_values);
+                        for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
+                            cache_.felt_interp_polyns[label_idx][bin_idx] = move(fips[label_idx]);
+                        }
+                    }
+                }));
             }
 
             // Wait for the tasks to finish
@@ -1017,7 +1703,7 @@ namespace apsi {
 
         bool BinBundle::empty() const
         {
-            return all_of(item_bins_.begin(), item_bins_.end(), [](auto &b) { return b.empty(); });
+            return all_of(bin_sizes_.begin(), bin_sizes_.end(), [](auto size) { return !size; });
         }
 
         void BinBundle::strip()
@@ -1030,6 +1716,7 @@ namespace apsi {
             item_bins_.clear();
             label_bins_.clear();
             filters_.clear();
+            bin_sizes_.clear();
 
             cache_.felt_matching_polyns.clear();
             cache_.felt_interp_polyns.clear();
@@ -1065,17 +1752,111 @@ namespace apsi {
             }
 
             flatbuffers::Offset<fbs::BatchedPlaintextPolyn> fbs_create_batched_plaintext_polyn(
-                flatbuffers::FlatBufferBuilder &fbs_builder,
-                const vector<vector<unsigned char>> &polyn)
+                flatbuffers::FlatBufferBuilder &fbs_builder, const BatchedPlaintextPolyn &polyn)
             {
                 auto polyn_data = fbs_builder.CreateVector([&]() {
                     vector<flatbuffers::Offset<fbs::Plaintext>> ret;
-                    for (const auto &coeff : polyn) {
+                    for (const auto &coeff : polyn.batched_coeffs) {
                         ret.push_back(fbs_create_plaintext(fbs_builder, coeff));
                     }
+
+                    // Uncompressed coefficients are serialized here; the format is the same
+                    for (const auto &coeff : polyn.plain_coeffs) {
+                        vector<unsigned char> pt_data;
+                        pt_data.resize(safe_cast<size_t>(coeff.save_size(compr_mode_type::none)));
+                        size_t size = static_cast<size_t>(coeff.save(
+                            reinterpret_cast<seal_byte *>(pt_data.data()),
+                            pt_data.size(),
+                            compr_mode_type::none));
+                        pt_data.resize(size);
+                        ret.push_back(fbs_create_plaintext(fbs_builder, pt_data));
+                    }
                     return ret;
                 }());
-                return fbs::CreateBatchedPlaintextPolyn(fbs_builder, polyn_data);
+
+                // The zero coefficient information is optional
+                flatbuffers::Offset<flatbuffers::Vector<uint8_t>> zero_coeffs_data;
+                if (!polyn.zero_coeffs.empty()) {
+                    zero_coeffs_data = fbs_builder.CreateVector(polyn.zero_coeffs);
+                }
+
+                return fbs::CreateBatchedPlaintextPolyn(fbs_builder, polyn_data, zero_coeffs_data);
+            }
+
+            void fbs_load_zero_coeffs(
+                const fbs::BatchedPlaintextPolyn &fbs_polyn, BatchedPlaintextPolyn &polyn)
+            {
+                // Data without zero coefficient information is valid; in that case no terms will
+                // be skipped in evaluation
+                auto zero_coeffs = fbs_polyn.zero_coeffs();
+                if (!zero_coeffs) {
+                    return;
+                }
+
+                if (zero_coeffs->size() != fbs_polyn.coeffs()->size()) {
+                    APSI_LOG_ERROR(
+                        "The loaded BinBundle cache contains zero coefficient information for "
+                        << zero_coeffs->size() << " coefficients (expected "
+                        << fbs_polyn.coeffs()->size() << ")");
+                    throw runtime_error("failed to load BinBundle");
+                }
+
+                polyn.zero_coeffs.assign(zero_coeffs->begin(), zero_coeffs->end());
+            }
+
+            void fbs_load_batched_plaintext_polyn(
+                const fbs::BatchedPlaintextPolyn &fbs_polyn,
+                BatchedPlaintextPolyn &polyn,
+                bool compressed,
+                bool packed,
+                uint32_t ps_low_degree,
+                size_t num_bins)
+            {
+                polyn.packed = packed;
+                polyn.packed_felt_count = packed ? num_bins : 0;
+                polyn.ps_low_degree = ps_low_degree;
+                size_t packed_byte_count = get_packed_byte_count(
+                    polyn.packed_felt_count,
+                    polyn.crypto_context.seal_context()
+                        ->first_context_data()
+                        ->parms()
+                        .plain_modulus()
+                        .bit_count());
+
+                const auto &coeffs = *fbs_polyn.coeffs();
+                for (flatbuffers::uoffset_t coeff_idx = 0; coeff_idx < coeffs.size(); coeff_idx++) {
+                    // Get the current coefficient data
+                    const auto &coeff_data = *coeffs[coeff_idx]->data();
+
+                    // Packed coefficients are used without further checks, so check the size here
+                    if (packed && (coeff_data.size() != packed_byte_count)) {
+                        APSI_LOG_ERROR(
+                            "The loaded BinBundle cache contains a packed coefficient of "
+                            << coeff_data.size() << " bytes (expected " << packed_byte_count
+                            << " bytes)");
+                        throw runtime_error("failed to load BinBundle");
+                    }
+
+                    if (!compressed && !packed) {
+                        // Load uncompressed coefficients directly into Plaintexts
+                        Plaintext pt;
+                        pt.load(
+                            *polyn.crypto_context.seal_context(),
+                            reinterpret_cast<const seal_byte *>(coeff_data.data()),
+                            coeff_data.size());
+                        polyn.plain_coeffs.push_back(move(pt));
+                        continue;
+                    }
+
+                    // Copy the data over to a local vector
+                    vector<unsigned char> pt_data(coeff_data.size());
+                    copy_bytes(coeff_data.data(), coeff_data.size(), pt_data.data());
+
+                    // Move the loaded data to the polynomial
+                    polyn.batched_coeffs.push_back(move(pt_data));
+                }
+
+                fbs_load_zero_coeffs(fbs_polyn, polyn);
             }
         } // namespace
 
@@ -1097,8 +1878,8 @@ namespace apsi {
             if (!cache_invalid_) {
                 auto felt_matching_polyns =
                     fbs_create_felt_matrix(fbs_builder, cache_.felt_matching_polyns);
-                auto batched_matching_polyn = fbs_create_batched_plaintext_polyn(
-                    fbs_builder, cache_.batched_matching_polyn.batched_coeffs);
+                auto batched_matching_polyn =
+                    fbs_create_batched_plaintext_polyn(fbs_builder, cache_.batched_matching_polyn);
 
                 auto felt_interp_polyns = fbs_builder.CreateVector([&]() {
                     vector<flatbuffers::Offset<fbs::FEltMatrix>> ret;
@@ -1111,8 +1892,7 @@ namespace apsi {
                 auto batched_interp_polyns = fbs_builder.CreateVector([&]() {
                     vector<flatbuffers::Offset<fbs::BatchedPlaintextPolyn>> ret;
                     for (const auto &bips : cache_.batched_interp_polyns) {
-                        ret.push_back(
-                            fbs_create_batched_plaintext_polyn(fbs_builder, bips.batched_coeffs));
+                        ret.push_back(fbs_create_batched_plaintext_polyn(fbs_builder, bips));
                     }
                     return ret;
                 }());
@@ -1225,6 +2005,7 @@ namespace apsi {
                         // Return to add the item to item_bins_[bin_idx]
                         return felt_item;
                     });
+                bin_sizes_[bin_idx] = safe_cast<uint32_t>(item_bins_[bin_idx].size());
             }
 
             // We are now done with the item data; next check that the label size is correct
@@ -1351,23 +2132,14 @@ namespace apsi {
                 // Create the batched matching polynomial; we load the data below
                 cache_.batched_matching_polyn = crypto_context_;
 
-                // The number of plaintexts is correct; copy them over
-                for (flatbuffers::uoffset_t coeff_idx = 0;
-                     coeff_idx < batched_matching_polyn.size();
-                     coeff_idx++) {
-                    // Get the current coefficient data
-                    auto &batched_matching_polyn_coeff = *batched_matching_polyn[coeff_idx]->data();
-
-                    // Copy the data over to a local vector
-                    vector<unsigned char> pt_data(batched_matching_polyn_coeff.size());
-                    copy_bytes(
-                        batched_matching_polyn_coeff.data(),
-                        batched_matching_polyn_coeff.size(),
-                        pt_data.data());
-
-                    // Move the loaded data to the cache
-                    cache_.batched_matching_polyn.batched_coeffs.push_back(move(pt_data));
-                }
+                // The number of plaintexts is correct; load them
+                fbs_load_batched_plaintext_polyn(
+                    *cache.batched_matching_polyn(),
+                    cache_.batched_matching_polyn,
+                    compressed_,
+                    packed_,
+                    static_cast<uint32_t>(ps_low_degree_),
+                    num_bins);
 
                 // We are now done with the item cache data; next check that the label cache size is
                 // correct
@@ -1489,24 +2261,15 @@ namespace apsi {
                     // Create a new batched interpolation polynomial; we load the data below
                     cache_.batched_interp_polyns.emplace_back(crypto_context_);
 
-                    // The number of plaintexts is correct; copy them over
-                    for (flatbuffers::uoffset_t coeff_idx = 0;
-                         coeff_idx < batched_interp_polyn_coeff_count;
-                         coeff_idx++) {
-                        // Get the current coefficient data
-                        auto &batched_interp_polyn_coeff = *batched_interp_polyn[coeff_idx]->data();
-
-                        // Copy the data over to a local vector
-                        vector<unsigned char> pt_data(batched_interp_polyn_coeff.size());
-                        copy_bytes(
-                            batched_interp_polyn_coeff.data(),
-                            batched_interp_polyn_coeff.size(),
-                            pt_data.data());
-
-                        // Move the loaded data to the cache
-                        cache_.batched_interp_polyns[label_idx].batched_coeffs.push_back(
-                            move(pt_data));
-                    }
+                    // The number of plaintexts is correct; load them
+                    fbs_load_batched_plaintext_polyn(
+                        *cache.batched_interp_polyns()->operator[](
+                            static_cast<flatbuffers::uoffset_t>(label_idx)),
+                        cache_.batched_interp_polyns[label_idx],
+                        compressed_,
+                        packed_,
+                        static_cast<uint32_t>(ps_low_degree_),
+                        num_bins);
                 }
 
                 // Mark the cache as valid
@@ -5,6 +5,8 @@
 
 // STD
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -12,8 +14,10 @@
 #include "apsi/crypto_context.h"
 #include "apsi/util/cuckoo_filter.h"
 #include "apsi/util/db_encoding.h"
+#include "apsi/util/plaintext_cache.h"
 
 // SEAL
+#include "seal/plaintext.h"
 #include "seal/util/uintarithsmallmod.h"
 #include "seal/util/uintcore.h"
 
@@ -52,22 +56,98 @@ namespace apsi {
         struct BatchedPlaintextPolyn {
             /**
             A sequence of coefficients represented as batched plaintexts. The length of this vector
-            is the degree of the highest-degree polynomial in the sequence.
+            is the degree of the highest-degree polynomial in the sequence. The plaintexts are
+            stored serialized and compressed; this is empty if the polynomial was created without
+            compression, in which case plain_coeffs holds the coefficients instead. If packed is
+            set, each entry instead holds the field elements of the batched coefficient, bit-packed
+            using the bit count of the plaintext modulus.
             */
             std::vector<std::vector<unsigned char>> batched_coeffs;
 
+            /**
+            Indicates whether batched_coeffs holds bit-packed field elements instead of serialized
+            plaintexts. Packed coefficients take several times less memory than plaintexts, but they
+            must be encoded and transformed to NTT form every time they are used.
+            */
+            bool packed = false;
+
+            /**
+            The number of field elements in each packed coefficient.
+            */
+            std::size_t packed_felt_count = 0;
+
+            /**
+            The Paterson-Stockmeyer low-degree the coefficients were created for. This determines
+            which coefficients are in NTT form and at which level they are encoded.
+            */
+            std::uint32_t ps_low_degree = 0;
+
+            /**
+            A sequence of coefficients represented as batched plaintexts, used instead of
+            batched_coeffs when the polynomial was created without compression. The plaintexts are
+            kept as they are, so evaluation can read them in place without first copying them out
+            of a serialized buffer.
+            */
+            std::vector<seal::Plaintext> plain_coeffs;
+
+            /**
+            For each degree, indicates whether the batched coefficient is identically zero. Such
+            terms contribute nothing to the result and are skipped by eval() and eval_patstock().
+            This can be empty (e.g., when loaded from data that does not record it), in which case
+            no terms are skipped.
+            */
+            std::vector<bool> zero_coeffs;
+
             /**
             We need this to compute eval()
             */
             CryptoContext crypto_context;
 
+            /**
+            Identifies this polynomial's coefficients in the global PlaintextCache. The cached
+            coefficients are erased when the polynomial is destroyed or assigned to.
+            */
+            std::uint64_t plaintext_cache_id = util::PlaintextCache::NewSourceId();
+
+            /**
+            Scratch space for get_coeff.
+            */
+            struct CoeffBuffer {
+                CoeffBuffer(seal::MemoryPoolHandle pool) : plain(std::move(pool))
+                {}
+
+                seal::Plaintext plain;
+
+                std::shared_ptr<const seal::Plaintext> cached;
+            };
+
             BatchedPlaintextPolyn(const BatchedPlaintextPolyn &copy) = delete;
 
-            BatchedPlaintextPolyn(BatchedPlaintextPolyn &&source) = default;
+            /**
+            Moves the coefficients and their identifier in the PlaintextCache from the source. The
+            source gets a new identifier.
+            */
+            BatchedPlaintextPolyn(BatchedPlaintextPolyn &&source);
 
             BatchedPlaintextPolyn &operator=(const BatchedPlaintextPolyn &assign) = delete;
 
-            BatchedPlaintextPolyn &operator=(BatchedPlaintextPolyn &&assign) = default;
+            /**
+            Erases the coefficients of this polynomial from the PlaintextCache and moves the
+            coefficients and their identifier in the PlaintextCache from the source. The source gets
+            a new identifier.
+            */
+            BatchedPlaintextPolyn &operator=(BatchedPlaintextPolyn &&assign);
+
+            /**
+            Erases the coefficients of this polynomial from the PlaintextCache.
+            */
+            ~BatchedPlaintextPolyn();
+
+            /**
+            Returns a copy of this polynomial. The copy has its own identifier in the
+            PlaintextCache.
+            */
+            BatchedPlaintextPolyn clone() const;
 
             /**
             Construct and empty BatchedPlaintextPolyn instance.
@@ -76,13 +156,15 @@ namespace apsi {
 
             /**
             Constructs a batched Plaintext polynomial from a list of polynomials. Takes an evaluator
-            and batch encoder to do encoding and NTT ops.
+            and batch encoder to do encoding and NTT ops. If packed is set, the coefficients are
+            stored as bit-packed field elements and compressed is ignored.
             */
             BatchedPlaintextPolyn(
                 const std::vector<FEltPolyn> &polyns,
                 CryptoContext context,
                 std::uint32_t ps_low_degree,
-                bool compressed);
+                bool compressed,
+                bool packed = false);
 
             /**
             Constructs an uninitialized Plaintext polynomial using the given crypto context
@@ -100,6 +182,30 @@ namespace apsi {
                 const std::vector<seal::Ciphertext> &ciphertext_powers,
                 seal::MemoryPoolHandle &pool) const;
 
+            /**
+            Evaluates several polynomials on the same ciphertext powers, as eval() would evaluate
+            each of them. The loop over the powers is outermost, so each power is read from memory
+            only once for all of the polynomials rather than once per polynomial. The results are
+            returned in the same order as the polynomials. All polynomials must use the same
+            CryptoContext.
+            */
+            static std::vector<seal::Ciphertext> EvalMany(
+                const std::vector<std::reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+                const std::vector<seal::Ciphertext> &ciphertext_powers,
+                seal::MemoryPoolHandle &pool);
+
+            /**
+            Evaluates several polynomials on several sets of ciphertext powers, e.g., from different
+            queries. Each coefficient is loaded only once and used for every set of powers. The
+            result for the i-th set of powers and the j-th polynomial is at index [i][j]. All sets
+            of powers must be at the same level.
+            */
+            static std::vector<std::vector<seal::Ciphertext>> EvalMany(
+                const std::vector<std::reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+                const std::vector<std::reference_wrapper<const std::vector<seal::Ciphertext>>>
+                    &ciphertext_powers_sets,
+                seal::MemoryPoolHandle &pool);
+
             /**
             Evaluates the polynomial on the given ciphertext using the Paterson-Stockmeyer
             algorithm, as long as it requires less computation than the standard evaluation function
@@ -115,6 +221,9 @@ namespace apsi {
 
             Low powers:  C^{1}, ..., C^{l-1}
             High powers: C^{1*l}, ..., C^{l*h}
+
+            The inner polynomials and their products with the high powers are computed in parallel
+            on the thread pool, and the products are summed with a tree reduction.
             */
             seal::Ciphertext eval_patstock(
                 const CryptoContext &eval_crypto_context,
@@ -122,12 +231,71 @@ namespace apsi {
                 std::size_t ps_low_degree,
                 seal::MemoryPoolHandle &pool) const;
 
+            /**
+            Evaluates several polynomials on several sets of ciphertext powers using the
+            Paterson-Stockmeyer algorithm, as eval_patstock() would evaluate each of them on each
+            set. The low powers are read only once for all of the polynomials, and each coefficient
+            is loaded only once for all sets of powers. The i-th set of powers is evaluated with the
+            relinearization keys of the i-th CryptoContext. The result for the i-th set of powers
+            and the j-th polynomial is at index [i][j].
+            */
+            static std::vector<std::vector<seal::Ciphertext>> EvalPatstockMany(
+                const std::vector<std::reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+                const std::vector<std::reference_wrapper<const CryptoContext>>
+                    &eval_crypto_contexts,
+                const std::vector<std::reference_wrapper<const std::vector<seal::Ciphertext>>>
+                    &ciphertext_powers_sets,
+                std::size_t ps_low_degree,
+                seal::MemoryPoolHandle &pool);
+
+            /**
+            Returns an estimate of the memory in bytes that EvalMany, or EvalPatstockMany when
+            Paterson-Stockmeyer applies, allocates from the memory pool for evaluating polyn_count
+            polynomials with at most coeff_count coefficients on set_count sets of powers. The
+            power is any of the low powers. For a positive polyn_count the estimate is a fixed
+            amount plus the same amount for each polynomial. It includes the accumulators and the
+            temporaries of the inner polynomials that EvalPatstockMany evaluates in parallel on the
+            thread pool, so it grows with the number of threads.
+            */
+            static std::size_t EstimateEvalBytes(
+                std::size_t polyn_count,
+                std::size_t set_count,
+                std::size_t coeff_count,
+                const seal::Ciphertext &power,
+                std::size_t ps_low_degree);
+
+            /**
+            Returns the number of batched coefficients, i.e., the degree plus one.
+            */
+            std::size_t coeff_count() const noexcept
+            {
+                return plain_coeffs.empty() ? batched_coeffs.size() : plain_coeffs.size();
+            }
+
+            /**
+            Returns the batched coefficient of the given degree. If the coefficients are stored
+            uncompressed, this returns a reference to the stored plaintext. Otherwise, the
+            coefficient is decompressed or, if packed, encoded. The result is taken from the global
+            PlaintextCache (when enabled) or written to the given buffer. The returned reference is
+            valid until the buffer is used again.
+            */
+            const seal::Plaintext &get_coeff(std::size_t deg, CoeffBuffer &buffer) const;
+
+            /**
+            Returns whether the batched coefficient of the given degree is known to be identically
+            zero.
+            */
+            bool is_zero_coeff(std::size_t deg) const noexcept
+            {
+                return deg < zero_coeffs.size() && zero_coeffs[deg];
+            }
+
             /**
             Returns whether this polynomial has non-zero size.
             */
             explicit operator bool() const noexcept
             {
-                return batched_coeffs.size();
+                return coeff_count();
             }
         };
 
@@ -208,11 +376,23 @@ namespace apsi {
             */
             std::vector<util::CuckooFilter> filters_;
 
+            /**
+            The number of items in each bin, kept in a compact array so that checking whether a
+            range of bins has room does not have to touch the bins themselves.
+            */
+            std::vector<std::uint32_t> bin_sizes_;
+
             /**
             Indicates whether SEAL plaintexts are compressed in memory.
             */
             bool compressed_;
 
+            /**
+            Indicates whether batched polynomial coefficients are stored as bit-packed field
+            elements instead of SEAL plaintexts.
+            */
+            bool packed_;
+
             /**
             Indicates whether the BinBundle has been stripped of all information not needed for
             serving a query.
@@ -270,7 +450,8 @@ namespace apsi {
                 std::size_t ps_low_degree,
                 std::size_t num_bins,
                 bool compressed,
-                bool stripped);
+                bool stripped,
+                bool packed = false);
 
             BinBundle(const BinBundle &copy) = delete;
 
@@ -280,6 +461,20 @@ namespace apsi {
 
             BinBundle &operator=(BinBundle &&assign) = default;
 
+            /**
+            Returns a copy of the items, labels, and filters of this BinBundle. The cache is not
+            copied: the copy must regenerate its cache before it can be used in a query. This is
+            used to modify a BinBundle while queries continue to use the original.
+            */
+            BinBundle clone() const;
+
+            /**
+            Returns a stripped copy of this BinBundle. The batched polynomials of the cache are
+            copied, so the copy can be used in a query right away. The cache of this BinBundle must
+            be valid. This is used to strip a BinBundle while queries continue to use the original.
+            */
+            BinBundle stripped_clone() const;
+
             /**
             Inserts item-label pairs into sequential bins, beginning at start_bin_idx. If dry_run is
             specified, no change is made to the BinBundle. On success, returns the size of the
@@ -298,9 +493,11 @@ namespace apsi {
             */
             template <typename T>
             std::int32_t multi_insert_dry_run(
-                const std::vector<T> &item_labels, std::size_t start_bin_idx)
+                const std::vector<T> &item_labels, std::size_t start_bin_idx) const
             {
-                return multi_insert(item_labels, start_bin_idx, true);
+                // A dry run only reads the bins
+                return const_cast<BinBundle *>(this)->multi_insert(
+                    item_labels, start_bin_idx, true);
             }
 
             /**
@@ -316,6 +513,28 @@ namespace apsi {
                 return multi_insert(item_labels, start_bin_idx, false);
             }
 
+            /**
+            Inserts item-label pairs into sequential bins, beginning at start_bin_idx, in a single
+            pass over the bins. The insertion fails if it would make any bin in the range hold
+            max_bin_size or more items, or in labeled mode if an item part is already in its bin;
+            the bins modified up to that point are then restored. On success, returns the size of
+            the largest bin in the modified range after insertion. On failed insertion, returns -1
+            and the BinBundle is unchanged.
+            */
+            template <typename T>
+            std::int32_t try_multi_insert(
+                const std::vector<T> &item_labels,
+                std::size_t start_bin_idx,
+                std::size_t max_bin_size);
+
+            /**
+            Returns the size of the largest bin among bin_count bins beginning at start_bin_idx.
+            This only reads the bin sizes, not the bins. Throws std::out_of_range if the bins are
+            not in the BinBundle.
+            */
+            std::size_t get_largest_bin_size(
+                std::size_t start_bin_idx, std::size_t bin_count) const;
+
             /**
             Attempts to overwrite the stored items' labels with the given labels. Returns true iff
             it found a contiguous sequence of given items. If no such sequence was found, this
@@ -344,6 +563,42 @@ namespace apsi {
                 std::size_t start_bin_idx,
                 std::vector<felt_t> &labels) const;
 
+            /**
+            Returns whether the items and labels in the bins of another BinBundle, beginning at
+            start_bin_idx, can be appended to the same bins of this one. As for insertion, every
+            bin must stay smaller than the maximum bin size, and in labeled mode no bin can hold a
+            repeated item part. Throws an exception if either BinBundle is stripped, or if they
+            differ in label size or number of bins.
+            */
+            bool can_merge(
+                const BinBundle &other, std::size_t start_bin_idx, std::size_t bin_count) const;
+
+            /**
+            Returns whether the items and labels of another BinBundle can be appended to the bins
+            of this one.
+            */
+            bool can_merge(const BinBundle &other) const
+            {
+                return can_merge(other, 0, get_num_bins());
+            }
+
+            /**
+            Appends the items and labels in the bins of another BinBundle, beginning at
+            start_bin_idx, to the same bins of this one. Returns false and does not modify this
+            BinBundle if BinBundle::can_merge returns false.
+            */
+            bool try_merge(
+                const BinBundle &other, std::size_t start_bin_idx, std::size_t bin_count);
+
+            /**
+            Appends the items and labels of another BinBundle to the bins of this one. Returns
+            false and does not modify this BinBundle if BinBundle::can_merge returns false.
+            */
+            bool try_merge(const BinBundle &other)
+            {
+                return try_merge(other, 0, get_num_bins());
+            }
+
             /**
             Clears the contents of the BinBundle and wipes out the cache.
             */
@@ -2,6 +2,8 @@
 // Licensed under the MIT license.
 
 // STD
+#include <algorithm>
+#include <atomic>
 #include <future>
 #include <sstream>
 
@@ -32,6 +34,118 @@ namespace apsi {
     using namespace network;
 
     namespace sender {
+        namespace {
+            /**
+            The number of BinBundles at the same bundle index that are evaluated together
+            */
+            atomic<size_t> bin_bundle_tile_size(1);
+
+            /**
+            The approximate amount of memory in bytes that a single evaluation of BinBundle
+            polynomials may use
+            */
+            atomic<size_t> eval_memory_limit(size_t(256) << 20);
+
+            /**
+            The number of bits of noise budget, on top of the estimated noise growth of one
+            ciphertext multiplication, that every prime in the coeff_modulus must provide before
+            the powers of a query are modulus switched down early
+            */
+            constexpr int early_switch_margin_bits = 4;
+
+            /**
+            Returns whether the powers of a query can be modulus switched down as planned by
+            PowersDag::plan_levels. The plan assumes that each multiplication consumes at most the
+            noise budget of one prime in the coeff_modulus. A multiplication grows the noise by
+            roughly log2(plain_modulus) + log2(poly_modulus_degree) bits, so this holds only if
+            every prime is larger than that by a margin.
+            */
+            bool can_switch_powers_early(const SEALContext &seal_context)
+            {
+                const EncryptionParameters &parms = seal_context.first_context_data()->parms();
+                int noise_growth_bits = parms.plain_modulus().bit_count() +
+                                        get_significant_bit_count(parms.poly_modulus_degree());
+                return all_of(
+                    parms.coeff_modulus().cbegin(),
+                    parms.coeff_modulus().cend(),
+                    [noise_growth_bits](const Modulus &prime) {
+                        return prime.bit_count() >= noise_growth_bits + early_switch_margin_bits;
+                    });
+            }
+
+            /**
+            Evaluates the given polynomials on the given sets of powers. Polynomials for which
+            Paterson-Stockmeyer is useful and the others are evaluated in two groups; within each
+            group the powers are read only once for all of the polynomials. Each coefficient is
+            loaded only once for all sets of powers. The result for the i-th set of powers and the
+            j-th polynomial is at index [i][j].
+            */
+            vector<vector<Ciphertext>> eval_polyns(
+                const vector<reference_wrapper<const BatchedPlaintextPolyn>> &polyns,
+                const vector<reference_wrapper<const CryptoContext>> &crypto_contexts,
+                const vector<reference_wrapper<const CiphertextPowers>> &powers_sets,
+                uint32_t ps_low_degree,
+                MemoryPoolHandle &pool)
+            {
+                size_t set_count = powers_sets.size();
+                vector<vector<Ciphertext>> results(set_count, vector<Ciphertext>(polyns.size()));
+                vector<reference_wrapper<const BatchedPlaintextPolyn>> ps_eval_polyns;
+                vector<size_t> ps_eval_indices;
+                vector<reference_wrapper<const BatchedPlaintextPolyn>> plain_eval_polyns;
+                vector<size_t> plain_eval_indices;
+                for (size_t polyn_idx = 0; polyn_idx < polyns.size(); polyn_idx++) {
+                    const BatchedPlaintextPolyn &polyn = polyns[polyn_idx].get();
+
+                    // Determine if we use Paterson-Stockmeyer or not
+                    uint32_t degree = safe_cast<uint32_t>(polyn.coeff_count()) - 1;
+                    bool using_ps = (ps_low_degree > 1) && (ps_low_degree < degree);
+                    if (using_ps) {
+                        ps_eval_polyns.push_back(polyns[polyn_idx]);
+                        ps_eval_indices.push_back(polyn_idx);
+                    } else {
+                        plain_eval_polyns.push_back(polyns[polyn_idx]);
+                        plain_eval_indices.push_back(polyn_idx);
+                    }
+                }
+
+                auto ps_eval_results = BatchedPlaintextPolyn::EvalPatstockMany(
+                    ps_eval_polyns, crypto_contexts, powers_sets, ps_low_degree, pool);
+                auto plain_eval_results =
+                    BatchedPlaintextPolyn::EvalMany(plain_eval_polyns, powers_sets, pool);
+                for (size_t set_idx = 0; set_idx < set_count; set_idx++) {
+                    for (size_t i = 0; i < ps_eval_indices.size(); i++) {
+                        results[set_idx][ps_eval_indices[i]] = move(ps_eval_results[set_idx][i]);
+                    }
+                    for (size_t i = 0; i < plain_eval_indices.size(); i++) {
+                        results[set_idx][plain_eval_indices[i]] =
+                            move(plain_eval_results[set_idx][i]);
+                    }
+                }
+
+                return results;
+            }
+        } // namespace
+
+        void Sender::SetBinBundleTileSize(size_t tile_size)
+        {
+            bin_bundle_tile_size = tile_size;
+        }
+
+        size_t Sender::GetBinBundleTileSize()
+        {
+            return bin_bundle_tile_size;
+        }
+
+        void Sender::SetEvalMemoryLimit(size_t memory_limit)
+        {
+            eval_memory_limit = memory_limit;
+        }
+
+        size_t Sender::GetEvalMemoryLimit()
+        {
+            return eval_memory_limit;
+        }
+
         void Sender::RunParams(
             const ParamsRequest &params_request,
             shared_ptr<SenderDB> sender_db,
@@ -114,31 +228,64 @@ namespace apsi {
             function<void(Channel &, Response)> send_fun,
             function<void(Channel &, ResultPart)> send_rp_fun)
         {
-            if (!query) {
-                APSI_LOG_ERROR("Failed to process query request: query is invalid");
-                throw invalid_argument("query is invalid");
+            RunQueries(
+                { cref(query) },
+                chl,
+                [&send_fun](Channel &c, Response response, size_t) {
+                    send_fun(c, move(response));
+                },
+                [&send_rp_fun](Channel &c, ResultPart rp, size_t) { send_rp_fun(c, move(rp)); });
+        }
+
+        void Sender::RunQueries(
+            const vector<reference_wrapper<const Query>> &queries,
+            Channel &chl,
+            function<void(Channel &, Response, size_t)> send_fun,
+            function<void(Channel &, ResultPart, size_t)> send_rp_fun)
+        {
+            if (queries.empty()) {
+                return;
+            }
+            for (const auto &query : queries) {
+                if (!query.get()) {
+                    APSI_LOG_ERROR("Failed to process query request: query is invalid");
+                    throw invalid_argument("query is invalid");
+                }
+                if (query.get().sender_db() != queries[0].get().sender_db()) {
+                    APSI_LOG_ERROR(
+                        "Failed to process query requests: queries are for different databases");
+                    throw invalid_argument("queries are for different databases");
+                }
             }
+            size_t query_count = queries.size();
 
-            // We use a custom SEAL memory that is freed after the query is done
+            // We use a custom SEAL memory that is freed after the queries are done
             auto pool = MemoryManager::GetPool(mm_force_new);
 
             ThreadPoolMgr tpm;
 
-            // Acquire read lock on SenderDB
-            auto sender_db = query.sender_db();
-            auto sender_db_lock = sender_db->get_reader_lock();
+            // Take a snapshot of the SenderDB; updates to the SenderDB while the queries are
+            // running do not affect the snapshot and are not blocked by it
+            auto sender_db = queries[0].get().sender_db();
+            auto snapshot = sender_db->get_snapshot();
 
             STOPWATCH(sender_stopwatch, "Sender::RunQuery");
             APSI_LOG_INFO(
-                "Start processing query request on database with " << sender_db->get_item_count()
-                                                                   << " items");
-
-            // Copy over the CryptoContext from SenderDB; set the Evaluator for this local instance.
-            // Relinearization keys may not have been included in the query. In that case
-            // query.relin_keys() simply holds an empty seal::RelinKeys instance. There is no
-            // problem with the below call to CryptoContext::set_evaluator.
-            CryptoContext crypto_context(sender_db->get_crypto_context());
-            crypto_context.set_evaluator(query.relin_keys());
+                "Start processing " << query_count << " query request(s) on database with "
+                                    << snapshot->get_item_count() << " items");
+
+            // Copy over the CryptoContext from SenderDB for each query; set the Evaluator for this
+            // local instance. Relinearization keys may not have been included in the query. In
+            // that case query.relin_keys() simply holds an empty seal::RelinKeys instance. There is
+            // no problem with the below call to CryptoContext::set_evaluator.
+            vector<CryptoContext> crypto_contexts;
+            crypto_contexts.reserve(query_count);
+            for (const auto &query : queries) {
+                crypto_contexts.emplace_back(sender_db->get_crypto_context());
+                crypto_contexts.back().set_evaluator(query.get().relin_keys());
+            }
+            vector<reference_wrapper<const CryptoContext>> crypto_context_refs(
+                crypto_contexts.begin(), crypto_contexts.end());
 
             // Get the PSIParams
             PSIParams params(sender_db->get_params());
@@ -146,85 +293,144 @@ namespace apsi {
             uint32_t bundle_idx_count = params.bundle_idx_count();
             uint32_t max_items_per_bin = params.table_params().max_items_per_bin;
 
-            // Extract the PowersDag
-            PowersDag pd = query.pd();
-
             // The query response only tells how many ResultPackages to expect; send this first
-            uint32_t package_count = safe_cast<uint32_t>(sender_db->get_bin_bundle_count());
-            QueryResponse response_query = make_unique<QueryResponse::element_type>();
-            response_query->package_count = package_count;
-
-            try {
-                send_fun(chl, move(response_query));
-            } catch (const exception &ex) {
-                APSI_LOG_ERROR(
-                    "Failed to send response to query request; function threw an exception: "
-                    << ex.what());
-                throw;
+            uint32_t package_count = safe_cast<uint32_t>(snapshot->get_bin_bundle_count());
+            for (size_t query_idx = 0; query_idx < query_count; query_idx++) {
+                QueryResponse response_query = make_unique<QueryResponse::element_type>();
+                response_query->package_count = package_count;
+
+                try {
+                    send_fun(chl, move(response_query), query_idx);
+                } catch (const exception &ex) {
+                    APSI_LOG_ERROR(
+                        "Failed to send response to query request; function threw an exception: "
+                        << ex.what());
+                    throw;
+                }
             }
 
-            // For each bundle index i, we need a vector of powers of the query Qᵢ. We need powers
-            // all the way up to Qᵢ^max_items_per_bin. We don't store the zeroth power. If
-            // Paterson-Stockmeyer is used, then only a subset of the powers will be populated.
-            vector<CiphertextPowers> all_powers(bundle_idx_count);
-
-            // Initialize powers
-            for (CiphertextPowers &powers : all_powers) {
-                // The + 1 is because we index by power. The 0th power is a dummy value. I promise
-                // this makes things easier to read.
-                size_t powers_size = static_cast<size_t>(max_items_per_bin) + 1;
-                powers.reserve(powers_size);
-                for (size_t i = 0; i < powers_size; i++) {
-                    powers.emplace_back(pool);
+            // For each query and each bundle index i, we need a vector of powers of the query Qᵢ.
+            // We need powers all the way up to Qᵢ^max_items_per_bin. We don't store the zeroth
+            // power. If Paterson-Stockmeyer is used, then only a subset of the powers will be
+            // populated.
+            vector<vector<CiphertextPowers>> all_powers(query_count);
+            for (size_t query_idx = 0; query_idx < query_count; query_idx++) {
+                const Query &query = queries[query_idx].get();
+                vector<CiphertextPowers> &query_powers = all_powers[query_idx];
+                query_powers.resize(bundle_idx_count);
+
+                // Initialize powers
+                for (CiphertextPowers &powers : query_powers) {
+                    // The + 1 is because we index by power. The 0th power is a dummy value. I
+                    // promise this makes things easier to read.
+                    size_t powers_size = static_cast<size_t>(max_items_per_bin) + 1;
+                    powers.reserve(powers_size);
+                    for (size_t i = 0; i < powers_size; i++) {
+                        powers.emplace_back(pool);
+                    }
                 }
-            }
 
-            // Load inputs provided in the query
-            for (auto &q : query.data()) {
-                // The exponent of all the query powers we're about to iterate through
-                size_t exponent = static_cast<size_t>(q.first);
+                // Load inputs provided in the query
+                for (auto &q : query.data()) {
+                    // The exponent of all the query powers we're about to iterate through
+                    size_t exponent = static_cast<size_t>(q.first);
+
+                    // Load Qᵢᵉ for all bundle indices i, where e is the exponent specified above
+                    for (size_t bundle_idx = 0; bundle_idx < query_powers.size(); bundle_idx++) {
+                        // Load input^power to query_powers[bundle_idx][exponent]
+                        APSI_LOG_DEBUG(
+                            "Extracting query ciphertext power " << exponent << " for bundle index "
+                                                                 << bundle_idx);
+                        query_powers[bundle_idx][exponent] = move(q.second[bundle_idx]);
+                    }
+                }
 
-                // Load Qᵢᵉ for all bundle indices i, where e is the exponent specified above
-                for (size_t bundle_idx = 0; bundle_idx < all_powers.size(); bundle_idx++) {
-                    // Load input^power to all_powers[bundle_idx][exponent]
+                // Plan the levels of the powers: the powers end up at the level used for
+                // evaluating the polynomials, so powers that are only needed for a few more
+                // multiplications can be modulus switched down early. If the primes in the
+                // coeff_modulus are too small for this to be safe, all powers are computed at the
+                // top level and only switched down once computed.
+                PowersDag pd = query.pd();
+                uint32_t ps_low_degree = params.query_params().ps_low_degree;
+                auto seal_context = crypto_contexts[query_idx].seal_context();
+                uint32_t max_level =
+                    safe_cast<uint32_t>(seal_context->first_context_data()->chain_index());
+                if (can_switch_powers_early(*seal_context)) {
+                    pd.plan_levels(max_level, [ps_low_degree](uint32_t power) -> uint32_t {
+                        return (ps_low_degree && power <= ps_low_degree) ? 2 : 1;
+                    });
+                } else {
                     APSI_LOG_DEBUG(
-                        "Extracting query ciphertext power " << exponent << " for bundle index "
-                                                             << bundle_idx);
-                    all_powers[bundle_idx][exponent] = move(q.second[bundle_idx]);
+                        "Primes in coeff_modulus are too small to switch query powers down early");
+                    pd.plan_levels(max_level, [max_level](uint32_t) { return max_level; });
                 }
-            }
 
-            // Compute query powers for the bundle indexes
-            for (size_t bundle_idx = 0; bundle_idx < bundle_idx_count; bundle_idx++) {
-                ComputePowers(
-                    sender_db,
-                    crypto_context,
-                    all_powers,
-                    pd,
-                    static_cast<uint32_t>(bundle_idx),
-                    pool);
+                // Compute query powers for the bundle indexes that have BinBundles
+                for (size_t bundle_idx = 0; bundle_idx < bundle_idx_count; bundle_idx++) {
+                    if (!snapshot->get_bin_bundle_count(static_cast<uint32_t>(bundle_idx))) {
+                        continue;
+                    }
+                    ComputePowers(
+                        sender_db,
+                        crypto_contexts[query_idx],
+                        query_powers,
+                        pd,
+                        static_cast<uint32_t>(bundle_idx),
+                        pool);
+                }
             }
 
             APSI_LOG_DEBUG("Finished computing powers for all bundle indices");
             APSI_LOG_DEBUG("Start processing bin bundle caches");
 
-            vector<future<void>> futures;
+            // The compression mode may differ between the queries
+            vector<compr_mode_type> compr_modes;
+            for (const auto &query : queries) {
+                compr_modes.push_back(query.get().compr_mode());
+            }
+
+            // Each task processes a tile of consecutive caches at the same bundle index for all
+            // queries
+            size_t tile_size = GetBinBundleTileSize();
+            vector<pair<uint32_t, vector<reference_wrapper<const BinBundleCache>>>> tiles;
             for (size_t bundle_idx = 0; bundle_idx < bundle_idx_count; bundle_idx++) {
-                auto bundle_caches = sender_db->get_cache_at(static_cast<uint32_t>(bundle_idx));
-                for (auto &cache : bundle_caches) {
-                    futures.push_back(tpm.thread_pool().enqueue([&, bundle_idx, cache]() {
-                        ProcessBinBundleCache(
-                            sender_db,
-                            crypto_context,
-                            cache,
-                            all_powers,
-                            chl,
-                            send_rp_fun,
-                            static_cast<uint32_t>(bundle_idx),
-                            query.compr_mode(),
-                            pool);
-                    }));
+                auto bundle_caches = snapshot->get_cache_at(static_cast<uint32_t>(bundle_idx));
+                size_t bundle_tile_size = tile_size ? tile_size : bundle_caches.size();
+                for (size_t tile_start = 0; tile_start < bundle_caches.size();
+                     tile_start += bundle_tile_size) {
+                    size_t tile_end = min(tile_start + bundle_tile_size, bundle_caches.size());
+                    tiles.emplace_back(
+                        static_cast<uint32_t>(bundle_idx),
+                        vector<reference_wrapper<const BinBundleCache>>(
+                            bundle_caches.begin() + static_cast<ptrdiff_t>(tile_start),
+                            bundle_caches.begin() + static_cast<ptrdiff_t>(tile_end)));
+                }
+            }
+
+            // If there are fewer tasks than threads, each task splits its polynomials further
+            size_t group_count =
+                tiles.empty() ? 1 : max<size_t>(ThreadPoolMgr::GetThreadCount() / tiles.size(), 1);
+
+            vector<future<void>> futures;
+            for (const auto &tile : tiles) {
+                vector<reference_wrapper<const CiphertextPowers>> powers_sets;
+                for (const auto &query_powers : all_powers) {
+                    powers_sets.push_back(cref(query_powers[tile.first]));
                 }
+
+                futures.push_back(tpm.thread_pool().enqueue([&, powers_sets]() {
+                    ProcessBinBundleCaches(
+                        sender_db,
+                        crypto_context_refs,
+                        tile.second,
+                        powers_sets,
+                        chl,
+                        send_rp_fun,
+                        tile.first,
+                        compr_modes,
+                        group_count,
+                        pool);
+                }));
             }
 
             // Wait until all bin bundle caches have been processed
@@ -232,7 +438,7 @@ namespace apsi {
                 f.get();
             }
 
-            APSI_LOG_INFO("Finished processing query request");
+            APSI_LOG_INFO("Finished processing " << query_count << " query request(s)");
         }
 
         void Sender::ComputePowers(
@@ -244,10 +450,6 @@ namespace apsi {
             MemoryPoolHandle &pool)
         {
             STOPWATCH(sender_stopwatch, "Sender::ComputePowers");
-            auto bundle_caches = sender_db->get_cache_at(bundle_idx);
-            if (!bundle_caches.size()) {
-                return;
-            }
 
             // Compute all powers of the query
             APSI_LOG_DEBUG("Computing all query ciphertext powers for bundle index " << bundle_idx);
@@ -256,25 +458,59 @@ namespace apsi {
             auto relin_keys = crypto_context.relin_keys();
 
             CiphertextPowers &powers_at_this_bundle_idx = all_powers[bundle_idx];
-            bool relinearize = crypto_context.seal_context()->using_keyswitching();
+            auto seal_context = crypto_context.seal_context();
+            bool relinearize = seal_context->using_keyswitching();
+            auto chain_idx = [&](const Ciphertext &encrypted) {
+                return seal_context->get_context_data(encrypted.parms_id())->chain_index();
+            };
+
+            // Each power is stored at the level planned for it in the PowersDag. A product is
+            // computed one level above the planned level of the result (or lower if a parent is
+            // already lower) and then modulus switched down to the planned level.
             pd.parallel_apply([&](const PowersDag::PowersNode &node) {
-                if (!node.is_source()) {
-                    auto parents = node.parents;
-                    Ciphertext prod(pool);
-                    if (parents.first == parents.second) {
-                        evaluator->square(powers_at_this_bundle_idx[parents.first], prod, pool);
-                    } else {
-                        evaluator->multiply(
-                            powers_at_this_bundle_idx[parents.first],
-                            powers_at_this_bundle_idx[parents.second],
-                            prod,
-                            pool);
+                auto node_parms_id = get_parms_id_for_chain_idx(*seal_context, node.level);
+                if (node.is_source()) {
+                    Ciphertext &source = powers_at_this_bundle_idx[node.power];
+                    if (chain_idx(source) > node.level) {
+                        evaluator->mod_switch_to_inplace(source, node_parms_id, pool);
                     }
-                    if (relinearize) {
-                        evaluator->relinearize_inplace(prod, *relin_keys, pool);
-                    }
-                    powers_at_this_bundle_idx[node.power] = move(prod);
+                    return;
+                }
+
+                auto parents = node.parents;
+                const Ciphertext &parent1 = powers_at_this_bundle_idx[parents.first];
+                const Ciphertext &parent2 = powers_at_this_bundle_idx[parents.second];
+                size_t mult_level = min<size_t>(
+                    { node.level + size_t(1), chain_idx(parent1), chain_idx(parent2) });
+                auto mult_parms_id = get_parms_id_for_chain_idx(*seal_context, mult_level);
+
+                // Switch copies of the parents down to the level of the multiplication if needed
+                Ciphertext parent1_switched(pool);
+                Ciphertext parent2_switched(pool);
+                const Ciphertext *in1 = &parent1;
+                const Ciphertext *in2 = &parent2;
+                if (chain_idx(parent1) > mult_level) {
+                    evaluator->mod_switch_to(parent1, mult_parms_id, parent1_switched, pool);
+                    in1 = &parent1_switched;
+                }
+                if (parents.first != parents.second && chain_idx(parent2) > mult_level) {
+                    evaluator->mod_switch_to(parent2, mult_parms_id, parent2_switched, pool);
+                    in2 = &parent2_switched;
+                }
+
+                Ciphertext prod(pool);
+                if (parents.first == parents.second) {
+                    evaluator->square(*in1, prod, pool);
+                } else {
+                    evaluator->multiply(*in1, *in2, prod, pool);
+                }
+                if (relinearize) {
+                    evaluator->relinearize_inplace(prod, *relin_keys, pool);
+                }
+                if (chain_idx(prod) > node.level) {
+                    evaluator->mod_switch_to_inplace(prod, node_parms_id, pool);
                 }
+                powers_at_this_bundle_idx[node.power] = move(prod);
             });
 
             // Now that all powers of the ciphertext have been computed, we need to transform them
@@ -330,60 +566,120 @@ namespace apsi {
             }
         }
 
-        void Sender::ProcessBinBundleCache(
+        void Sender::ProcessBinBundleCaches(
             const shared_ptr<SenderDB> &sender_db,
-            const CryptoContext &crypto_context,
-            reference_wrapper<const BinBundleCache> cache,
-            vector<CiphertextPowers> &all_powers,
+            const vector<reference_wrapper<const CryptoContext>> &crypto_contexts,
+            const vector<reference_wrapper<const BinBundleCache>> &caches,
+            const vector<reference_wrapper<const CiphertextPowers>> &powers_sets,
             Channel &chl,
-            function<void(Channel &, ResultPart)> send_rp_fun,
+            function<void(Channel &, ResultPart, size_t)> send_rp_fun,
             uint32_t bundle_idx,
-            compr_mode_type compr_mode,
+            const vector<compr_mode_type> &compr_modes,
+            size_t group_count,
             MemoryPoolHandle &pool)
         {
-            STOPWATCH(sender_stopwatch, "Sender::ProcessBinBundleCache");
-
-            // Package for the result data
-            auto rp = make_unique<ResultPackage>();
-            rp->compr_mode = compr_mode;
+            STOPWATCH(sender_stopwatch, "Sender::ProcessBinBundleCaches");
 
-            rp->bundle_idx = bundle_idx;
-            rp->nonce_byte_count = safe_cast<uint32_t>(sender_db->get_nonce_byte_count());
-            rp->label_byte_count = safe_cast<uint32_t>(sender_db->get_label_byte_count());
-
-            // Compute the matching result and move to rp
-            const BatchedPlaintextPolyn &matching_polyn = cache.get().batched_matching_polyn;
-
-            // Determine if we use Paterson-Stockmeyer or not
             uint32_t ps_low_degree = sender_db->get_params().query_params().ps_low_degree;
-            uint32_t degree = safe_cast<uint32_t>(matching_polyn.batched_coeffs.size()) - 1;
-            bool using_ps = (ps_low_degree > 1) && (ps_low_degree < degree);
-            if (using_ps) {
-                rp->psi_result = matching_polyn.eval_patstock(
-                    crypto_context, all_powers[bundle_idx], safe_cast<size_t>(ps_low_degree), pool);
-            } else {
-                rp->psi_result = matching_polyn.eval(all_powers[bundle_idx], pool);
+
+            // Compute the matching results and the label results for all caches and all queries.
+            // All of these polynomials are evaluated together, so the powers are read only once for
+            // the matching polynomials and all label components. The polynomials are indexed so
+            // that the matching polynomials come first, followed by each label component in turn.
+            size_t cache_count = caches.size();
+            size_t label_size = caches.empty() ? 0 : caches[0].get().batched_interp_polyns.size();
+            vector<reference_wrapper<const BatchedPlaintextPolyn>> polyns;
+            polyns.reserve(cache_count * (1 + label_size));
+            for (const auto &cache : caches) {
+                polyns.push_back(cref(cache.get().batched_matching_polyn));
+            }
+            for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
+                for (const auto &cache : caches) {
+                    polyns.push_back(cref(cache.get().batched_interp_polyns[label_idx]));
+                }
             }
 
-            for (const auto &interp_polyn : cache.get().batched_interp_polyns) {
-                // Compute the label result and move to rp
-                degree = safe_cast<uint32_t>(interp_polyn.batched_coeffs.size()) - 1;
-                using_ps = (ps_low_degree > 1) && (ps_low_degree < degree);
-                if (using_ps) {
-                    rp->label_result.push_back(interp_polyn.eval_patstock(
-                        crypto_context, all_powers[bundle_idx], ps_low_degree, pool));
-                } else {
-                    rp->label_result.push_back(interp_polyn.eval(all_powers[bundle_idx], pool));
+            // Evaluating all polynomials together needs memory for every polynomial and every
+            // set of powers at once. Bound the number of polynomials evaluated together so that
+            // this fits in the evaluation memory limit. The estimate is a fixed amount plus the
+            // same amount for each polynomial.
+            size_t chunk_size = polyns.size();
+            size_t memory_limit = GetEvalMemoryLimit();
+            if (memory_limit && !polyns.empty() && !powers_sets.empty()) {
+                size_t max_coeff_count = 0;
+                for (const auto &polyn : polyns) {
+                    max_coeff_count = max(max_coeff_count, polyn.get().coeff_count());
                 }
+                auto estimate_bytes = [&](size_t polyn_count) {
+                    return BatchedPlaintextPolyn::EstimateEvalBytes(
+                        polyn_count,
+                        powers_sets.size(),
+                        max_coeff_count,
+                        powers_sets[0].get()[1],
+                        ps_low_degree);
+                };
+                size_t one_polyn_bytes = estimate_bytes(1);
+                size_t polyn_bytes = estimate_bytes(2) - one_polyn_bytes;
+                size_t fixed_bytes = one_polyn_bytes - polyn_bytes;
+                chunk_size = (memory_limit > one_polyn_bytes)
+                                 ? (memory_limit - fixed_bytes) / polyn_bytes
+                                 : 1;
             }
 
-            // Send this result part
-            try {
-                send_rp_fun(chl, move(rp));
-            } catch (const exception &ex) {
-                APSI_LOG_ERROR(
-                    "Failed to send result part; function threw an exception: " << ex.what());
-                throw;
+            // When there are fewer tasks than threads, the polynomials are split into groups of
+            // whole components that are evaluated in parallel to keep the cores busy. Each group
+            // is evaluated in chunks of at most chunk_size polynomials.
+            auto groups = partition_evenly<size_t>(1 + label_size, max<size_t>(group_count, 1));
+            vector<vector<Ciphertext>> results(
+                powers_sets.size(), vector<Ciphertext>(polyns.size()));
+            ThreadPoolMgr tpm;
+            tpm.parallel_for(groups.size(), [&](size_t group_idx) {
+                size_t group_start = groups[group_idx].first * cache_count;
+                size_t group_end = groups[group_idx].second * cache_count;
+                for (size_t chunk_start = group_start; chunk_start < group_end;
+                     chunk_start += chunk_size) {
+                    size_t chunk_end = min(chunk_start + chunk_size, group_end);
+                    vector<reference_wrapper<const BatchedPlaintextPolyn>> chunk_polyns(
+                        polyns.begin() + static_cast<ptrdiff_t>(chunk_start),
+                        polyns.begin() + static_cast<ptrdiff_t>(chunk_end));
+
+                    auto chunk_results = eval_polyns(
+                        chunk_polyns, crypto_contexts, powers_sets, ps_low_degree, pool);
+                    for (size_t set_idx = 0; set_idx < chunk_results.size(); set_idx++) {
+                        move(
+                            chunk_results[set_idx].begin(),
+                            chunk_results[set_idx].end(),
+                            results[set_idx].begin() + static_cast<ptrdiff_t>(chunk_start));
+                    }
+                }
+            });
+
+            for (size_t query_idx = 0; query_idx < powers_sets.size(); query_idx++) {
+                for (size_t cache_idx = 0; cache_idx < caches.size(); cache_idx++) {
+                    // Package for the result data
+                    auto rp = make_unique<ResultPackage>();
+                    rp->compr_mode = compr_modes[query_idx];
+
+                    rp->bundle_idx = bundle_idx;
+                    rp->nonce_byte_count = safe_cast<uint32_t>(sender_db->get_nonce_byte_count());
+                    rp->label_byte_count = safe_cast<uint32_t>(sender_db->get_label_byte_count());
+
+                    rp->psi_result = move(results[query_idx][cache_idx]);
+                    for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
+                        rp->label_result.push_back(
+                            move(results[query_idx][(1 + label_idx) * cache_count + cache_idx]));
+                    }
+
+                    // Send this result part
+                    try {
+                        send_rp_fun(chl, move(rp), query_idx);
+                    } catch (const exception &ex) {
+                        APSI_LOG_ERROR(
+                            "Failed to send result part; function threw an exception: "
+                            << ex.what());
+                        throw;
+                    }
+                }
             }
         }
     } // namespace sender
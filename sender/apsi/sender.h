@@ -78,7 +78,8 @@ namespace apsi {
         Once a valid Query object is created, the RunQuery function can be used to perform the query
         and respond on the given channel. Optionally, two lambda functions can be given to RunQuery
         to provide custom logic for sending the QueryResponse and the ResultPart objects on the
-        channel.
+        channel. If several valid Query objects for the same SenderDB are waiting, they can instead
+        be processed together with the RunQueries function.
         */
         class Sender {
         private:
@@ -129,9 +130,62 @@ namespace apsi {
                 std::function<void(network::Channel &, ResultPart)> send_rp_fun =
                     BasicSend<ResultPart::element_type>);
 
+            /**
+            Generate and send responses to several queries for the same SenderDB at once. Each
+            BinBundle is evaluated for all of the queries together, so each of its plaintext
+            coefficients is loaded (and possibly decompressed) only once rather than once per query.
+            This increases throughput when several queries are waiting, at the cost of a slightly
+            higher latency for the individual queries. The last parameter of the send functions is
+            the index of the query in the given vector to which the response or the result part
+            belongs; the send functions must deliver it to the right receiver.
+            */
+            static void RunQueries(
+                const std::vector<std::reference_wrapper<const Query>> &queries,
+                network::Channel &chl,
+                std::function<void(network::Channel &, Response, std::size_t)> send_fun,
+                std::function<void(network::Channel &, ResultPart, std::size_t)> send_rp_fun);
+
+            /**
+            Sets the number of BinBundles at the same bundle index that RunQuery evaluates together
+            in a single task. Evaluating several BinBundles together reads each power of the query
+            from memory once for all of them, which reduces memory traffic when there are many
+            BinBundles per bundle index, but results in fewer tasks to run in parallel. The default
+            value 1 evaluates each BinBundle in a separate task; the value 0 evaluates all
+            BinBundles at a bundle index together.
+            */
+            static void SetBinBundleTileSize(std::size_t tile_size);
+
+            /**
+            Returns the number of BinBundles at the same bundle index that RunQuery evaluates
+            together in a single task.
+            */
+            static std::size_t GetBinBundleTileSize();
+
+            /**
+            Sets the approximate amount of memory in bytes that a single evaluation of BinBundle
+            polynomials in RunQuery and RunQueries may use for accumulators and intermediate
+            products. The polynomials of a task are evaluated together to read each power of the
+            queries only once, but this needs memory for every polynomial and every query at the
+            same time. Polynomials that do not fit in the limit are evaluated in consecutive
+            chunks, reading the powers once per chunk; a single polynomial is evaluated even if it
+            exceeds the limit. The limit covers the inner polynomials that Paterson-Stockmeyer
+            evaluates in parallel (see BatchedPlaintextPolyn::EstimateEvalBytes). Each evaluation
+            in progress runs on its own thread of the ThreadPoolMgr thread pool, so the memory for
+            evaluations is up to the limit times the number of evaluations in progress, which is
+            at most the number of threads. The query powers and the results of the tasks come on
+            top of that. The value 0 removes the limit. The default value is 256 MB.
+            */
+            static void SetEvalMemoryLimit(std::size_t memory_limit);
+
+            /**
+            Returns the approximate amount of memory in bytes that a single evaluation of BinBundle
+            polynomials may use.
+            */
+            static std::size_t GetEvalMemoryLimit();
+
         private:
             /**
-            Method that handles computing powers for a given bundle index
+            Method that handles computing powers for a given bundle index that has BinBundles
             */
             static void ComputePowers(
                 const std::shared_ptr<SenderDB> &sender_db,
@@ -142,18 +196,22 @@ namespace apsi {
                 seal::MemoryPoolHandle &pool);
 
             /**
-            Method that processes a single Bin Bundle cache.
-            Sends a result package through the given channel.
+            Method that processes a group of Bin Bundle caches at the same bundle index for one or
+            more queries. The matching and label polynomials are split into at most group_count
+            groups that are evaluated in parallel; each group is evaluated in chunks that fit in
+            the evaluation memory limit. Sends a result package for each cache and each query
+            through the given channel.
             */
-            static void ProcessBinBundleCache(
+            static void ProcessBinBundleCaches(
                 const std::shared_ptr<SenderDB> &sender_db,
-                const CryptoContext &crypto_context,
-                std::reference_wrapper<const BinBundleCache> cache,
-                std::vector<CiphertextPowers> &all_powers,
+                const std::vector<std::reference_wrapper<const CryptoContext>> &crypto_contexts,
+                const std::vector<std::reference_wrapper<const BinBundleCache>> &caches,
+                const std::vector<std::reference_wrapper<const CiphertextPowers>> &powers_sets,
                 network::Channel &chl,
-                std::function<void(network::Channel &, ResultPart)> send_rp_fun,
+                std::function<void(network::Channel &, ResultPart, std::size_t)> send_rp_fun,
                 std::uint32_t bundle_idx,
-                seal::compr_mode_type compr_mode,
+                const std::vector<seal::compr_mode_type> &compr_modes,
+                std::size_t group_count,
                 seal::MemoryPoolHandle &pool);
         }; // class Sender
     }      // namespace sender
@@ -3,11 +3,17 @@
 
 // STD
 #include <algorithm>
+#include <functional>
 #include <future>
 #include <iterator>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 
 // APSI
 #include "apsi/psi_params.h"
@@ -65,12 +71,17 @@ namespace apsi {
             }
 
             /**
-            Compute the label size in multiples of item-size chunks.
+            Returns whether any of the given sorted bundle indices is in the range
+            [bundle_idx_begin, bundle_idx_end).
             */
-            size_t compute_label_size(size_t label_byte_count, const PSIParams &params)
+            bool has_bundle_idx_in_range(
+                const vector<uint32_t> &bundle_indices,
+                uint32_t bundle_idx_begin,
+                uint32_t bundle_idx_end)
             {
-                return (label_byte_count * 8 + params.item_bit_count() - 1) /
-                       params.item_bit_count();
+                auto it =
+                    lower_bound(bundle_indices.begin(), bundle_indices.end(), bundle_idx_begin);
+                return it != bundle_indices.end() && *it < bundle_idx_end;
             }
 
             /**
@@ -202,26 +213,203 @@ namespace apsi {
                     item_singleton.begin(), item_singleton.end(), params);
             }
 
+            using util::BundleRemap;
+            using util::ItemLocations;
+            using util::no_bundle_pos;
+
+            /**
+            Provides copy-on-write access to the BinBundles at one bundle index during an update.
+            A BinBundle from the current snapshot is copied the first time it is modified, so
+            queries running on the current snapshot are not affected. BinBundles that are not
+            modified remain shared with the current snapshot.
+            */
+            class BinBundleSetWriter {
+            public:
+                BinBundleSetWriter(vector<shared_ptr<BinBundle>> &bundle_set)
+                    : bundle_set_(bundle_set), copied_(bundle_set.size(), false)
+                {}
+
+                size_t size() const
+                {
+                    return bundle_set_.size();
+                }
+
+                const BinBundle &get(size_t idx) const
+                {
+                    return *bundle_set_[idx];
+                }
+
+                BinBundle &get_mutable(size_t idx)
+                {
+                    if (!copied_[idx]) {
+                        bundle_set_[idx] = make_shared<BinBundle>(bundle_set_[idx]->clone());
+                        copied_[idx] = true;
+                    }
+                    return *bundle_set_[idx];
+                }
+
+                void push_back(BinBundle bin_bundle)
+                {
+                    bundle_set_.push_back(make_shared<BinBundle>(move(bin_bundle)));
+                    copied_.push_back(true);
+                }
+
+                /**
+                Adds a BinBundle that is not modified, so its cache is kept. It is copied if it is
+                modified later.
+                */
+                void push_back(shared_ptr<BinBundle> bin_bundle)
+                {
+                    bundle_set_.push_back(move(bin_bundle));
+                    copied_.push_back(false);
+                }
+
+                /**
+                Removes a BinBundle from the set. It must not be accessed afterwards.
+                */
+                void erase(size_t idx)
+                {
+                    bundle_set_[idx].reset();
+                }
+
+                bool erased(size_t idx) const
+                {
+                    return !bundle_set_[idx];
+                }
+
+                /**
+                Returns whether the BinBundle at the given index belongs to this update, i.e., it
+                was copied or added, so that modifying it does not copy it.
+                */
+                bool copied(size_t idx) const
+                {
+                    return copied_[idx];
+                }
+
+                /**
+                Removes the BinBundles that have been erased or have become empty. The caches of
+                the BinBundles that were modified are left invalid; see regen_caches. Returns the
+                new position of the BinBundle at each old position, or no_bundle_pos for the
+                removed BinBundles. Returns an empty vector if no BinBundle was removed.
+                */
+                vector<size_t> finish()
+                {
+                    vector<size_t> new_positions(bundle_set_.size(), no_bundle_pos);
+                    size_t kept_count = 0;
+                    for (size_t idx = 0; idx < bundle_set_.size(); idx++) {
+                        if (erased(idx) || (copied_[idx] && bundle_set_[idx]->empty())) {
+                            continue;
+                        }
+                        new_positions[idx] = kept_count;
+                        bundle_set_[kept_count++] = move(bundle_set_[idx]);
+                    }
+
+                    if (kept_count == bundle_set_.size()) {
+                        new_positions.clear();
+                    }
+                    bundle_set_.resize(kept_count);
+
+                    return new_positions;
+                }
+
+            private:
+                vector<shared_ptr<BinBundle>> &bundle_set_;
+
+                vector<bool> copied_;
+            };
+
+            /**
+            Regenerates the caches of the BinBundles modified by an update, so that they can be
+            published. BinBundle::regen_cache waits for tasks it queues on the thread pool, so this
+            runs on the calling thread once the update's own tasks have finished; called from a
+            thread pool task, it could wait for tasks that never start.
+            */
+            void regen_caches(vector<vector<shared_ptr<BinBundle>>> &bin_bundles)
+            {
+                STOPWATCH(sender_stopwatch, "regen_caches");
+
+                // The BinBundles shared with the current snapshot have valid caches
+                for (auto &bundle_set : bin_bundles) {
+                    for (auto &bundle : bundle_set) {
+                        if (bundle->cache_invalid()) {
+                            bundle->regen_cache();
+                        }
+                    }
+                }
+            }
+
+            /**
+            Returns the item parts of the given data.
+            */
+            const AlgItem &get_alg_item(const AlgItem &data)
+            {
+                return data;
+            }
+
+            /**
+            Returns the item parts of the given data.
+            */
+            AlgItem get_alg_item(const AlgItemLabel &data)
+            {
+                AlgItem result;
+                result.reserve(data.size());
+                for (const auto &item_label : data) {
+                    result.push_back(item_label.first);
+                }
+                return result;
+            }
+
+            /**
+            Returns the HashedItem of the given data.
+            */
+            const HashedItem &get_hashed_item(const HashedItem &data)
+            {
+                return data;
+            }
+
+            /**
+            Returns the HashedItem of the given data.
+            */
+            const HashedItem &get_hashed_item(const pair<HashedItem, EncryptedLabel> &data)
+            {
+                return data.first;
+            }
+
+            /**
+            Returns whether the given items appear in the given BinBundle, starting at bin_idx.
+            */
+            bool contains_alg_item(const BinBundle &bundle, const AlgItem &item, size_t bin_idx)
+            {
+                vector<felt_t> labels;
+                return bundle.try_get_multi_label(item, bin_idx, labels);
+            }
+
             /**
             Inserts the given items and corresponding labels into bin_bundles at their respective
             cuckoo indices. It will only insert the data with bundle index in the half-open range
-            range indicated by work_range. If inserting into a BinBundle would make the number of
-            items in a bin larger than max_bin_size, this function will create and insert a new
-            BinBundle. If overwrite is set, this will overwrite the labels if it finds an
-            AlgItemLabel that matches the input perfectly.
+            range indicated by work_range. New data is inserted into a BinBundle chosen according
+            to the placement policy among those where the largest bin stays below max_bin_size; if
+            there is none, this function will create and insert a new BinBundle. If overwrite is
+            set, this will overwrite the labels if it finds an AlgItemLabel that matches the input
+            perfectly. If bundle_positions is given, it holds for each entry of data_with_indices
+            the position of the BinBundle to try first when overwriting, and receives the position
+            of the BinBundle each entry at this bundle index was written to.
             */
             template <typename T>
             void insert_or_assign_worker(
                 const vector<pair<T, size_t>> &data_with_indices,
-                vector<vector<BinBundle>> &bin_bundles,
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
                 CryptoContext &crypto_context,
                 uint32_t bundle_index,
                 uint32_t bins_per_bundle,
                 size_t label_size,
                 size_t max_bin_size,
                 size_t ps_low_degree,
+                PlacementPolicy policy,
                 bool overwrite,
-                bool compressed)
+                bool compressed,
+                bool packed,
+                vector<size_t> *bundle_positions)
             {
                 STOPWATCH(sender_stopwatch, "insert_or_assign_worker");
                 APSI_LOG_DEBUG(
@@ -229,12 +417,14 @@ namespace apsi {
                     << bundle_index << "; mode of operation: "
                     << (overwrite ? "overwriting existing" : "inserting new"));
 
-                // Iteratively insert each item-label pair at the given cuckoo index
-                for (auto &data_with_idx : data_with_indices) {
-                    const T &data = data_with_idx.first;
+                // Get the bundle set at the given bundle index
+                BinBundleSetWriter bundle_set(bin_bundles[bundle_index]);
 
+                // Collect the entries at this bundle index along with the bin index of each item
+                vector<pair<size_t, size_t>> bundle_data;
+                for (size_t entry_idx = 0; entry_idx < data_with_indices.size(); entry_idx++) {
                     // Get the bundle index
-                    size_t cuckoo_idx = data_with_idx.second;
+                    size_t cuckoo_idx = data_with_indices[entry_idx].second;
                     size_t bin_idx, bundle_idx;
                     tie(bin_idx, bundle_idx) = unpack_cuckoo_idx(cuckoo_idx, bins_per_bundle);
 
@@ -245,45 +435,126 @@ namespace apsi {
                         continue;
                     }
 
-                    // Get the bundle set at the given bundle index
-                    vector<BinBundle> &bundle_set = bin_bundles[bundle_idx];
+                    bundle_data.emplace_back(bin_idx, entry_idx);
+                }
+
+                // New items in the most heavily loaded bins are placed first, so that they decide
+                // how many BinBundles are needed and the other items fill the remaining room
+                if (!overwrite && policy == PlacementPolicy::sorted_batch) {
+                    unordered_map<size_t, size_t> bin_loads;
+                    for (const auto &bin_data : bundle_data) {
+                        bin_loads[bin_data.first]++;
+                    }
+                    stable_sort(
+                        bundle_data.begin(), bundle_data.end(), [&](const auto &a, const auto &b) {
+                            size_t a_load = bin_loads[a.first];
+                            size_t b_load = bin_loads[b.first];
+                            return a_load != b_load ? a_load > b_load : a.first < b.first;
+                        });
+                }
+
+                // Overwriting must find the BinBundle that holds the item, so it ignores the policy
+                bool best_fit = !overwrite && policy != PlacementPolicy::first_fit;
+
+                // Iteratively insert each item-label pair at the given cuckoo index
+                for (const auto &bin_data : bundle_data) {
+                    size_t bin_idx = bin_data.first;
+                    size_t entry_idx = bin_data.second;
+                    const T &data = data_with_indices[entry_idx].first;
 
                     // Try to insert or overwrite these field elements in an existing BinBundle at
-                    // this bundle index. Keep track of whether or not we succeed.
+                    // this bundle index. Keep track of whether or not we succeed. A BinBundle is
+                    // copied only once we know it will be modified.
                     bool written = false;
-                    for (auto bundle_it = bundle_set.rbegin(); bundle_it != bundle_set.rend();
-                         bundle_it++) {
+                    size_t written_pos = no_bundle_pos;
+
+                    // The item index tells which BinBundle holds the item we're overwriting
+                    if (overwrite && bundle_positions) {
+                        size_t bundle_pos = (*bundle_positions)[entry_idx];
+                        if (bundle_pos < bundle_set.size() &&
+                            contains_alg_item(
+                                bundle_set.get(bundle_pos), get_alg_item(data), bin_idx)) {
+                            written = bundle_set.get_mutable(bundle_pos)
+                                          .try_multi_overwrite(data, bin_idx);
+                            written_pos = written ? bundle_pos : no_bundle_pos;
+                        }
+                    }
+
+                    size_t best_bundle_pos = bundle_set.size();
+                    size_t best_largest_bin_size = 0;
+                    for (size_t bundle_pos = bundle_set.size(); !written && bundle_pos-- > 0;) {
+                        const BinBundle &bundle = bundle_set.get(bundle_pos);
+
                         // If we're supposed to overwrite, try to overwrite. One of these BinBundles
                         // has to have the data we're trying to overwrite.
-                        if (overwrite) {
+                        if (overwrite && contains_alg_item(bundle, get_alg_item(data), bin_idx)) {
                             // If we successfully overwrote, we're done with this bundle
-                            written = bundle_it->try_multi_overwrite(data, bin_idx);
+                            written = bundle_set.get_mutable(bundle_pos)
+                                          .try_multi_overwrite(data, bin_idx);
                             if (written) {
+                                written_pos = bundle_pos;
                                 break;
                             }
                         }
 
-                        // Do a dry-run insertion and see if the new largest bin size in the range
-                        // exceeds the limit
-                        int32_t new_largest_bin_size =
-                            bundle_it->multi_insert_dry_run(data, bin_idx);
+                        // Check from the bin sizes alone whether inserting would violate the max
+                        // bin size constraint
+                        size_t new_largest_bin_size =
+                            bundle.get_largest_bin_size(bin_idx, data.size()) + 1;
+                        if (new_largest_bin_size >= max_bin_size ||
+                            (best_fit && new_largest_bin_size <= best_largest_bin_size)) {
+                            continue;
+                        }
 
-                        // Check if inserting would violate the max bin size constraint
-                        if (new_largest_bin_size > 0 &&
-                            safe_cast<size_t>(new_largest_bin_size) < max_bin_size) {
+                        // A BinBundle that belongs to this update is inserted into in a single
+                        // pass, which undoes itself if an item part is already in its bin
+                        if (!best_fit && bundle_set.copied(bundle_pos)) {
+                            written = bundle_set.get_mutable(bundle_pos)
+                                          .try_multi_insert(data, bin_idx, max_bin_size) > 0;
+                            if (written) {
+                                written_pos = bundle_pos;
+                                break;
+                            }
+                            continue;
+                        }
+
+                        // Other BinBundles are copied only once the data is known to fit. With
+                        // labels, item parts cannot repeat in a bin, which only the bins can tell.
+                        if (label_size && bundle.multi_insert_dry_run(data, bin_idx) < 0) {
+                            continue;
+                        }
+
+                        if (!best_fit) {
                             // All good
-                            bundle_it->multi_insert_for_real(data, bin_idx);
+                            bundle_set.get_mutable(bundle_pos)
+                                .try_multi_insert(data, bin_idx, max_bin_size);
                             written = true;
+                            written_pos = bundle_pos;
+                            break;
+                        }
+
+                        // Remember the BinBundle that would be the fullest; none can be fuller
+                        // than one bin short of the limit
+                        best_largest_bin_size = new_largest_bin_size;
+                        best_bundle_pos = bundle_pos;
+                        if (new_largest_bin_size + 1 == max_bin_size) {
                             break;
                         }
                     }
 
+                    if (!written && best_bundle_pos < bundle_set.size()) {
+                        bundle_set.get_mutable(best_bundle_pos)
+                            .try_multi_insert(data, bin_idx, max_bin_size);
+                        written = true;
+                        written_pos = best_bundle_pos;
+                    }
+
                     // We tried to overwrite an item that doesn't exist. This should never happen
                     if (overwrite && !written) {
                         APSI_LOG_ERROR(
                             "Insert-or-Assign worker: "
                             "failed to overwrite item at bundle index "
-                            << bundle_idx
+                            << bundle_index
                             << " "
                                "because the item was not found");
                         throw logic_error("tried to overwrite non-existent item");
@@ -300,7 +571,8 @@ namespace apsi {
                             ps_low_degree,
                             bins_per_bundle,
                             compressed,
-                            false);
+                            false,
+                            packed);
                         int res = new_bin_bundle.multi_insert_for_real(data, bin_idx);
 
                         // If even that failed, I don't know what could've happened
@@ -308,13 +580,27 @@ namespace apsi {
                             APSI_LOG_ERROR(
                                 "Insert-or-Assign worker: "
                                 "failed to insert item into a new BinBundle at bundle index "
-                                << bundle_idx);
+                                << bundle_index);
                             throw logic_error("failed to insert item into a new BinBundle");
                         }
 
                         // Push a new BinBundle to the set of BinBundles at this bundle index
+                        written_pos = bundle_set.size();
                         bundle_set.push_back(move(new_bin_bundle));
                     }
+
+                    if (bundle_positions) {
+                        (*bundle_positions)[entry_idx] = written_pos;
+                    }
+                }
+
+                // Drop any emptied BinBundles; the caches are generated once all workers are done
+                vector<size_t> new_positions = bundle_set.finish();
+                if (bundle_positions && !new_positions.empty()) {
+                    for (const auto &bin_data : bundle_data) {
+                        size_t &bundle_pos = (*bundle_positions)[bin_data.second];
+                        bundle_pos = new_positions[bundle_pos];
+                    }
                 }
 
                 APSI_LOG_DEBUG(
@@ -324,19 +610,24 @@ namespace apsi {
             /**
             Takes algebraized data to be inserted, splits it up, and distributes it so that
             thread_count many threads can all insert in parallel. If overwrite is set, this will
-            overwrite the labels if it finds an AlgItemLabel that matches the input perfectly.
+            overwrite the labels if it finds an AlgItemLabel that matches the input perfectly. If
+            bundle_positions is given, it is used as in insert_or_assign_worker and must have an
+            element for each entry of data_with_indices.
             */
             template <typename T>
             void dispatch_insert_or_assign(
                 vector<pair<T, size_t>> &data_with_indices,
-                vector<vector<BinBundle>> &bin_bundles,
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
                 CryptoContext &crypto_context,
                 uint32_t bins_per_bundle,
                 size_t label_size,
                 uint32_t max_bin_size,
                 uint32_t ps_low_degree,
+                PlacementPolicy policy,
                 bool overwrite,
-                bool compressed)
+                bool compressed,
+                bool packed,
+                vector<size_t> *bundle_positions)
             {
                 ThreadPoolMgr tpm;
 
@@ -378,8 +669,11 @@ namespace apsi {
                             label_size,
                             max_bin_size,
                             ps_low_degree,
+                            policy,
                             overwrite,
-                            compressed);
+                            compressed,
+                            packed,
+                            bundle_positions);
                     });
                 }
 
@@ -393,17 +687,21 @@ namespace apsi {
 
             /**
             Removes the given items and corresponding labels from bin_bundles at their respective
-            cuckoo indices.
+            cuckoo indices. If remap is given, it receives the new positions of the BinBundles.
             */
             void remove_worker(
                 const vector<pair<AlgItem, size_t>> &data_with_indices,
-                vector<vector<BinBundle>> &bin_bundles,
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
                 uint32_t bundle_index,
-                uint32_t bins_per_bundle)
+                uint32_t bins_per_bundle,
+                BundleRemap *remap)
             {
                 STOPWATCH(sender_stopwatch, "remove_worker");
                 APSI_LOG_INFO("Remove worker [" << bundle_index << "]");
 
+                // Get the bundle set at the given bundle index
+                BinBundleSetWriter bundle_set(bin_bundles[bundle_index]);
+
                 // Iteratively remove each item-label pair at the given cuckoo index
                 for (auto &data_with_idx : data_with_indices) {
                     // Get the bundle index
@@ -418,26 +716,23 @@ namespace apsi {
                         continue;
                     }
 
-                    // Get the bundle set at the given bundle index
-                    vector<BinBundle> &bundle_set = bin_bundles[bundle_idx];
-
                     // Try to remove these field elements from an existing BinBundle at this bundle
                     // index. Keep track of whether or not we succeed.
                     bool removed = false;
-                    for (BinBundle &bundle : bundle_set) {
+                    for (size_t bundle_pos = 0; bundle_pos < bundle_set.size(); bundle_pos++) {
+                        if (!contains_alg_item(
+                                bundle_set.get(bundle_pos), data_with_idx.first, bin_idx)) {
+                            continue;
+                        }
+
                         // If we successfully removed, we're done with this bundle
-                        removed = bundle.try_multi_remove(data_with_idx.first, bin_idx);
+                        removed = bundle_set.get_mutable(bundle_pos)
+                                      .try_multi_remove(data_with_idx.first, bin_idx);
                         if (removed) {
                             break;
                         }
                     }
 
-                    // We may have produced some empty BinBundles so just remove them all
-                    auto rem_it = remove_if(bundle_set.begin(), bundle_set.end(), [](auto &bundle) {
-                        return bundle.empty();
-                    });
-                    bundle_set.erase(rem_it, bundle_set.end());
-
                     // We tried to remove an item that doesn't exist. This should never happen
                     if (!removed) {
                         APSI_LOG_ERROR(
@@ -450,17 +745,26 @@ namespace apsi {
                     }
                 }
 
+                // Remove the BinBundles that became empty; the caches of the modified ones are
+                // generated once all workers are done
+                vector<size_t> new_positions = bundle_set.finish();
+                if (remap) {
+                    remap->new_positions = move(new_positions);
+                }
+
                 APSI_LOG_INFO("Remove worker: finished processing bundle index " << bundle_index);
             }
 
             /**
             Takes algebraized data to be removed, splits it up, and distributes it so that
-            thread_count many threads can all remove in parallel.
+            thread_count many threads can all remove in parallel. If remaps is given, it receives
+            how the BinBundles at each bundle index were moved.
             */
             void dispatch_remove(
                 const vector<pair<AlgItem, size_t>> &data_with_indices,
-                vector<vector<BinBundle>> &bin_bundles,
-                uint32_t bins_per_bundle)
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
+                uint32_t bins_per_bundle,
+                vector<BundleRemap> *remaps)
             {
                 ThreadPoolMgr tpm;
 
@@ -496,7 +800,8 @@ namespace apsi {
                             data_with_indices,
                             bin_bundles,
                             static_cast<uint32_t>(bundle_idx),
-                            bins_per_bundle);
+                            bins_per_bundle,
+                            remaps ? &(*remaps)[bundle_idx] : nullptr);
                     });
                 }
 
@@ -506,26 +811,379 @@ namespace apsi {
                 }
             }
 
+            /**
+            Merges the BinBundles of another SenderDB at the given bundle index into bin_bundles.
+            Each BinBundle is merged into the last BinBundle with room for it, as items are
+            inserted, or else added as it is. Stripped BinBundles are always added as they are. If
+            other_positions is given, it receives the position of the BinBundle each BinBundle of
+            the other SenderDB was merged into or added as.
+            */
+            void merge_worker(
+                const vector<shared_ptr<BinBundle>> &other_bundle_set,
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
+                uint32_t bundle_index,
+                vector<size_t> *other_positions)
+            {
+                STOPWATCH(sender_stopwatch, "merge_worker");
+                APSI_LOG_DEBUG("Merge worker [" << bundle_index << "]");
+
+                // Get the bundle set at the given bundle index
+                BinBundleSetWriter bundle_set(bin_bundles[bundle_index]);
+
+                for (const auto &other_bundle : other_bundle_set) {
+                    bool merged = false;
+                    size_t merged_pos = bundle_set.size();
+                    if (!other_bundle->is_stripped()) {
+                        for (size_t bundle_pos = bundle_set.size(); bundle_pos-- > 0;) {
+                            // A BinBundle is copied only once we know it will be modified
+                            if (bundle_set.get(bundle_pos).can_merge(*other_bundle)) {
+                                merged =
+                                    bundle_set.get_mutable(bundle_pos).try_merge(*other_bundle);
+                                merged_pos = bundle_pos;
+                                break;
+                            }
+                        }
+                    }
+
+                    // The BinBundle is shared with the other SenderDB, which will not modify it
+                    if (!merged) {
+                        merged_pos = bundle_set.size();
+                        bundle_set.push_back(other_bundle);
+                    }
+
+                    if (other_positions) {
+                        other_positions->push_back(merged_pos);
+                    }
+                }
+
+                // The caches of the BinBundles that were merged into are generated once all
+                // workers are done
+                vector<size_t> new_positions = bundle_set.finish();
+                if (other_positions && !new_positions.empty()) {
+                    for (auto &bundle_pos : *other_positions) {
+                        bundle_pos = new_positions[bundle_pos];
+                    }
+                }
+
+                APSI_LOG_DEBUG("Merge worker: finished processing bundle index " << bundle_index);
+            }
+
+            /**
+            Returns the number of item parts stored in the given BinBundle.
+            */
+            size_t get_felt_count(const BinBundle &bundle)
+            {
+                size_t result = 0;
+                for (const auto &bin : bundle.get_item_bins()) {
+                    result += bin.size();
+                }
+
+                return result;
+            }
+
+            /**
+            Compacts the BinBundles at the given bundle index. Starting from the sparsest, each
+            BinBundle is emptied and dropped if the items in it can all be moved to the other
+            BinBundles, preferring the fullest ones. Items are moved in groups of felts_per_item
+            bins, each holding complete items. A BinBundle that cannot be emptied is left as it is.
+            If remap is given, it receives where the items and BinBundles were moved.
+            */
+            void compact_worker(
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
+                uint32_t bundle_index,
+                size_t felts_per_item,
+                BundleRemap *remap)
+            {
+                STOPWATCH(sender_stopwatch, "compact_worker");
+                APSI_LOG_DEBUG("Compact worker [" << bundle_index << "]");
+
+                // Get the bundle set at the given bundle index
+                BinBundleSetWriter bundle_set(bin_bundles[bundle_index]);
+
+                vector<size_t> sources(bundle_set.size());
+                iota(sources.begin(), sources.end(), size_t(0));
+                stable_sort(sources.begin(), sources.end(), [&](size_t a, size_t b) {
+                    return get_felt_count(bundle_set.get(a)) < get_felt_count(bundle_set.get(b));
+                });
+
+                for (size_t source_pos : sources) {
+                    const BinBundle &source = bundle_set.get(source_pos);
+
+                    // The fullest BinBundles are tried first
+                    vector<pair<size_t, size_t>> targets;
+                    for (size_t bundle_pos = 0; bundle_pos < bundle_set.size(); bundle_pos++) {
+                        if (bundle_pos != source_pos && !bundle_set.erased(bundle_pos)) {
+                            targets.emplace_back(
+                                get_felt_count(bundle_set.get(bundle_pos)), bundle_pos);
+                        }
+                    }
+                    sort(targets.begin(), targets.end(), greater<pair<size_t, size_t>>());
+
+                    // Find a target for every group of bins holding items. The groups cover
+                    // different bins, so moving one does not affect where the others fit.
+                    vector<pair<size_t, size_t>> moves;
+                    bool movable = !targets.empty();
+                    for (size_t start_bin_idx = 0;
+                         movable && start_bin_idx < source.get_num_bins();
+                         start_bin_idx += felts_per_item) {
+                        const auto &item_bins = source.get_item_bins();
+                        if (all_of(
+                                item_bins.begin() + static_cast<ptrdiff_t>(start_bin_idx),
+                                item_bins.begin() +
+                                    static_cast<ptrdiff_t>(start_bin_idx + felts_per_item),
+                                [](const auto &bin) { return bin.empty(); })) {
+                            continue;
+                        }
+
+                        auto target_it =
+                            find_if(targets.begin(), targets.end(), [&](const auto &target) {
+                                return bundle_set.get(target.second)
+                                    .can_merge(source, start_bin_idx, felts_per_item);
+                            });
+                        if (target_it == targets.end()) {
+                            movable = false;
+                        } else {
+                            moves.emplace_back(start_bin_idx, target_it->second);
+                        }
+                    }
+                    if (!movable) {
+                        continue;
+                    }
+
+                    // Move the items and drop the emptied BinBundle
+                    vector<size_t> group_targets;
+                    if (remap) {
+                        group_targets.resize(source.get_num_bins() / felts_per_item, no_bundle_pos);
+                    }
+                    for (const auto &bin_move : moves) {
+                        bundle_set.get_mutable(bin_move.second)
+                            .try_merge(source, bin_move.first, felts_per_item);
+                        if (remap) {
+                            group_targets[bin_move.first / felts_per_item] = bin_move.second;
+                        }
+                    }
+                    bundle_set.erase(source_pos);
+                    if (remap) {
+                        remap->moved_groups[source_pos] = move(group_targets);
+                    }
+                }
+
+                // The caches of the BinBundles that items were moved to are generated once all
+                // workers are done
+                vector<size_t> new_positions = bundle_set.finish();
+                if (remap) {
+                    remap->new_positions = move(new_positions);
+                }
+
+                APSI_LOG_DEBUG("Compact worker: finished processing bundle index " << bundle_index);
+            }
+
+            /**
+            Compacts the BinBundles at every bundle index that has more than one BinBundle, using
+            the thread pool. If remaps is given, it receives how the BinBundles at each bundle index
+            were moved.
+            */
+            void dispatch_compact(
+                vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
+                size_t felts_per_item,
+                vector<BundleRemap> *remaps)
+            {
+                ThreadPoolMgr tpm;
+
+                vector<future<void>> futures;
+                for (size_t bundle_idx = 0; bundle_idx < bin_bundles.size(); bundle_idx++) {
+                    if (bin_bundles[bundle_idx].size() < 2) {
+                        continue;
+                    }
+                    futures.push_back(tpm.thread_pool().enqueue([&, bundle_idx]() {
+                        compact_worker(
+                            bin_bundles,
+                            static_cast<uint32_t>(bundle_idx),
+                            felts_per_item,
+                            remaps ? &(*remaps)[bundle_idx] : nullptr);
+                    }));
+                }
+
+                APSI_LOG_INFO("Launched " << futures.size() << " compact worker tasks");
+
+                // Wait for the tasks to finish
+                for (auto &f : futures) {
+                    f.get();
+                }
+            }
+
+            /**
+            Computes the packing rate of the given snapshot; see SenderDB::get_packing_rate.
+            */
+            double compute_packing_rate(const SenderDBSnapshot &snapshot, const PSIParams &params)
+            {
+                uint64_t item_count = mul_safe(
+                    static_cast<uint64_t>(snapshot.get_item_count()),
+                    static_cast<uint64_t>(params.table_params().hash_func_count));
+                uint64_t max_item_count = mul_safe(
+                    static_cast<uint64_t>(snapshot.get_bin_bundle_count()),
+                    static_cast<uint64_t>(params.items_per_bundle()),
+                    static_cast<uint64_t>(params.table_params().max_items_per_bin));
+
+                return max_item_count
+                           ? static_cast<double>(item_count) / static_cast<double>(max_item_count)
+                           : 0.0;
+            }
+
+            /**
+            Searches the BinBundles for the given item and returns the position of the BinBundle
+            holding it at each of its cuckoo table locations.
+            */
+            ItemLocations locate_item(
+                const HashedItem &item,
+                const vector<LocFunc> &hash_funcs,
+                const vector<vector<shared_ptr<BinBundle>>> &bin_bundles,
+                const PSIParams &params)
+            {
+                size_t bins_per_item = params.item_params().felts_per_item;
+                uint32_t bins_per_bundle = params.bins_per_bundle();
+                AlgItem alg_item = algebraize_item(
+                    item, params.item_bit_count(), params.seal_params().plain_modulus());
+
+                ItemLocations result;
+                for (auto location : all_locations(hash_funcs, item)) {
+                    size_t cuckoo_idx = location * bins_per_item;
+                    size_t bin_idx, bundle_idx;
+                    tie(bin_idx, bundle_idx) = unpack_cuckoo_idx(cuckoo_idx, bins_per_bundle);
+
+                    const vector<shared_ptr<BinBundle>> &bundle_set = bin_bundles[bundle_idx];
+                    size_t bundle_pos = 0;
+                    while (bundle_pos < bundle_set.size() &&
+                           !contains_alg_item(*bundle_set[bundle_pos], alg_item, bin_idx)) {
+                        bundle_pos++;
+                    }
+                    result.push_back(
+                        { static_cast<uint32_t>(cuckoo_idx),
+                          static_cast<uint32_t>(bundle_pos),
+                          0 });
+                }
+
+                return result;
+            }
+
+            /**
+            Returns the position of the BinBundle recorded in the item index for each entry of
+            data_with_indices, which holds the entries of the given items as computed by
+            preprocess_labeled_data or preprocess_unlabeled_data.
+            */
+            template <typename ItemIt, typename T>
+            vector<size_t> find_bundle_positions(
+                ItemIt begin,
+                ItemIt end,
+                const vector<pair<T, size_t>> &data_with_indices,
+                const util::ItemIndex &item_index,
+                const PSIParams &params)
+            {
+                auto hash_funcs = hash_functions(params);
+
+                // The entries of each item are consecutive, one for each of its distinct locations
+                vector<size_t> result;
+                result.reserve(data_with_indices.size());
+                for (auto it = begin; it != end; it++) {
+                    const HashedItem &item = get_hashed_item(*it);
+                    size_t location_count = all_locations(hash_funcs, item).size();
+                    while (location_count--) {
+                        size_t cuckoo_idx = data_with_indices[result.size()].second;
+                        result.push_back(item_index.find_bundle_pos(item, cuckoo_idx));
+                    }
+                }
+
+                return result;
+            }
+
+            /**
+            Pairs each of the given items with the locations its entries of data_with_indices were
+            written to, as given by bundle_positions.
+            */
+            template <typename ItemIt, typename T>
+            vector<pair<HashedItem, ItemLocations>> collect_item_locations(
+                ItemIt begin,
+                ItemIt end,
+                const vector<pair<T, size_t>> &data_with_indices,
+                const vector<size_t> &bundle_positions,
+                const PSIParams &params)
+            {
+                auto hash_funcs = hash_functions(params);
+
+                vector<pair<HashedItem, ItemLocations>> result;
+                size_t entry_idx = 0;
+                for (auto it = begin; it != end; it++) {
+                    const HashedItem &item = get_hashed_item(*it);
+                    size_t location_count = all_locations(hash_funcs, item).size();
+                    ItemLocations locations;
+                    for (; location_count--; entry_idx++) {
+                        locations.push_back(
+                            { static_cast<uint32_t>(data_with_indices[entry_idx].second),
+                              static_cast<uint32_t>(bundle_positions[entry_idx]),
+                              0 });
+                    }
+                    result.emplace_back(item, locations);
+                }
+
+                return result;
+            }
+
             /**
             Returns a set of DB cache references corresponding to the bundles in the given set
             */
             vector<reference_wrapper<const BinBundleCache>> collect_caches(
-                vector<BinBundle> &bin_bundles)
+                const vector<shared_ptr<BinBundle>> &bin_bundles)
             {
                 vector<reference_wrapper<const BinBundleCache>> result;
                 for (const auto &bundle : bin_bundles) {
-                    result.emplace_back(cref(bundle.get_cache()));
+                    result.emplace_back(cref(bundle->get_cache()));
                 }
 
                 return result;
             }
         } // namespace
 
+        SenderDBSnapshot::SenderDBSnapshot(uint32_t bundle_idx_count)
+            : bin_bundles_(safe_cast<size_t>(bundle_idx_count))
+        {}
+
+        size_t SenderDBSnapshot::get_bin_bundle_count() const
+        {
+            // Compute the total number of BinBundles
+            return accumulate(
+                bin_bundles_.cbegin(), bin_bundles_.cend(), size_t(0), [&](auto &a, auto &b) {
+                    return a + b.size();
+                });
+        }
+
+        size_t SenderDBSnapshot::get_item_count(
+            uint32_t bundle_idx_begin, uint32_t bundle_idx_end) const
+        {
+            size_t item_count = 0;
+            for (const auto &set_count : bundle_idx_set_item_counts_) {
+                if (has_bundle_idx_in_range(set_count.first, bundle_idx_begin, bundle_idx_end)) {
+                    item_count += set_count.second;
+                }
+            }
+
+            return item_count;
+        }
+
+        vector<reference_wrapper<const BinBundleCache>> SenderDBSnapshot::get_cache_at(
+            uint32_t bundle_idx) const
+        {
+            return collect_caches(bin_bundles_.at(safe_cast<size_t>(bundle_idx)));
+        }
+
         SenderDB::SenderDB(
-            PSIParams params, size_t label_byte_count, size_t nonce_byte_count, bool compressed)
+            PSIParams params,
+            size_t label_byte_count,
+            size_t nonce_byte_count,
+            bool compressed,
+            bool packed)
             : params_(params), crypto_context_(params_), label_byte_count_(label_byte_count),
-              nonce_byte_count_(label_byte_count_ ? nonce_byte_count : 0), item_count_(0),
-              compressed_(compressed)
+              nonce_byte_count_(label_byte_count_ ? nonce_byte_count : 0),
+              compressed_(compressed), packed_(packed), item_index_(params_)
         {
             // The labels cannot be more than 1 KB.
             if (label_byte_count_ > 1024) {
@@ -566,8 +1224,9 @@ namespace apsi {
             OPRFKey oprf_key,
             size_t label_byte_count,
             size_t nonce_byte_count,
-            bool compressed)
-            : SenderDB(params, label_byte_count, nonce_byte_count, compressed)
+            bool compressed,
+            bool packed)
+            : SenderDB(params, label_byte_count, nonce_byte_count, compressed, packed)
         {
             // Initialize oprf key with the one given to this constructor
             oprf_key_ = move(oprf_key);
@@ -576,14 +1235,20 @@ namespace apsi {
         SenderDB::SenderDB(SenderDB &&source)
             : params_(source.params_), crypto_context_(source.crypto_context_),
               label_byte_count_(source.label_byte_count_),
-              nonce_byte_count_(source.nonce_byte_count_), item_count_(source.item_count_),
-              compressed_(source.compressed_), stripped_(source.stripped_)
+              nonce_byte_count_(source.nonce_byte_count_), compressed_(source.compressed_),
+              packed_(source.packed_), stripped_(source.stripped_),
+              bundle_idx_begin_(source.bundle_idx_begin_), bundle_idx_end_(source.bundle_idx_end_),
+              compaction_threshold_(source.compaction_threshold_),
+              placement_policy_(source.placement_policy_),
+              item_index_enabled_(source.item_index_enabled_)
         {
             // Lock the source before moving stuff over
+            lock_guard<mutex> update_lock(source.update_mtx_);
             auto lock = source.get_writer_lock();
 
             hashed_items_ = move(source.hashed_items_);
-            bin_bundles_ = move(source.bin_bundles_);
+            item_index_ = move(source.item_index_);
+            snapshot_ = source.get_snapshot();
             oprf_key_ = move(source.oprf_key_);
             source.oprf_key_ = OPRFKey();
 
@@ -599,21 +1264,29 @@ namespace apsi {
             }
 
             // Lock the current SenderDB
+            lock_guard<mutex> this_update_lock(update_mtx_);
             auto this_lock = get_writer_lock();
 
             params_ = source.params_;
             crypto_context_ = source.crypto_context_;
             label_byte_count_ = source.label_byte_count_;
             nonce_byte_count_ = source.nonce_byte_count_;
-            item_count_ = source.item_count_;
             compressed_ = source.compressed_;
+            packed_ = source.packed_;
             stripped_ = source.stripped_;
+            bundle_idx_begin_ = source.bundle_idx_begin_;
+            bundle_idx_end_ = source.bundle_idx_end_;
+            compaction_threshold_ = source.compaction_threshold_;
+            placement_policy_ = source.placement_policy_;
+            item_index_enabled_ = source.item_index_enabled_;
 
             // Lock the source before moving stuff over
+            lock_guard<mutex> source_update_lock(source.update_mtx_);
             auto source_lock = source.get_writer_lock();
 
             hashed_items_ = move(source.hashed_items_);
-            bin_bundles_ = move(source.bin_bundles_);
+            item_index_ = move(source.item_index_);
+            publish(source.get_snapshot());
             oprf_key_ = move(source.oprf_key_);
             source.oprf_key_ = OPRFKey();
 
@@ -623,42 +1296,37 @@ namespace apsi {
             return *this;
         }
 
-        size_t SenderDB::get_bin_bundle_count(uint32_t bundle_idx) const
+        shared_ptr<const SenderDBSnapshot> SenderDB::get_snapshot() const
         {
-            // Lock the database for reading
-            auto lock = get_reader_lock();
+            lock_guard<mutex> snapshot_lock(snapshot_mtx_);
+            return snapshot_;
+        }
 
-            return bin_bundles_.at(safe_cast<size_t>(bundle_idx)).size();
+        void SenderDB::publish(shared_ptr<const SenderDBSnapshot> snapshot)
+        {
+            lock_guard<mutex> snapshot_lock(snapshot_mtx_);
+            snapshot_ = move(snapshot);
         }
 
-        size_t SenderDB::get_bin_bundle_count() const
+        size_t SenderDB::get_item_count() const
         {
-            // Lock the database for reading
-            auto lock = get_reader_lock();
+            return get_snapshot()->get_item_count();
+        }
 
-            // Compute the total number of BinBundles
-            return accumulate(
-                bin_bundles_.cbegin(), bin_bundles_.cend(), size_t(0), [&](auto &a, auto &b) {
-                    return a + b.size();
-                });
+        size_t SenderDB::get_bin_bundle_count(uint32_t bundle_idx) const
+        {
+            return get_snapshot()->get_bin_bundle_count(bundle_idx);
         }
 
-        double SenderDB::get_packing_rate() const
+        size_t SenderDB::get_bin_bundle_count() const
         {
-            // Lock the database for reading
-            auto lock = get_reader_lock();
+            return get_snapshot()->get_bin_bundle_count();
+        }
 
-            uint64_t item_count = mul_safe(
-                static_cast<uint64_t>(get_item_count()),
-                static_cast<uint64_t>(params_.table_params().hash_func_count));
-            uint64_t max_item_count = mul_safe(
-                static_cast<uint64_t>(get_bin_bundle_count()),
-                static_cast<uint64_t>(params_.items_per_bundle()),
-                static_cast<uint64_t>(params_.table_params().max_items_per_bin));
-
-            return max_item_count
-                       ? static_cast<double>(item_count) / static_cast<double>(max_item_count)
-                       : 0.0;
+        double SenderDB::get_packing_rate() const
+        {
+            // Use a single snapshot for both counts
+            return compute_packing_rate(*get_snapshot(), params_);
         }
 
         void SenderDB::clear_internal()
@@ -667,14 +1335,17 @@ namespace apsi {
 
             // Clear the set of inserted items
             hashed_items_.clear();
-            item_count_ = 0;
+            item_index_.clear();
 
-            // Clear the BinBundles
-            bin_bundles_.clear();
-            bin_bundles_.resize(params_.bundle_idx_count());
+            // Publish an empty snapshot; queries running on the previous one are not affected
+            publish(make_shared<SenderDBSnapshot>(params_.bundle_idx_count()));
 
             // Reset the stripped_ flag
             stripped_ = false;
+
+            // The SenderDB again holds all bundle indices
+            bundle_idx_begin_ = 0;
+            bundle_idx_end_ = params_.bundle_idx_count();
         }
 
         void SenderDB::clear()
@@ -684,6 +1355,7 @@ namespace apsi {
             }
 
             // Lock the database for writing
+            lock_guard<mutex> update_lock(update_mtx_);
             auto lock = get_writer_lock();
 
             clear_internal();
@@ -694,9 +1366,10 @@ namespace apsi {
             STOPWATCH(sender_stopwatch, "SenderDB::generate_caches");
             APSI_LOG_INFO("Start generating bin bundle caches");
 
-            for (auto &bundle_idx : bin_bundles_) {
+            // This is called only before the snapshot is used by any query
+            for (auto &bundle_idx : snapshot_->bin_bundles_) {
                 for (auto &bb : bundle_idx) {
-                    bb.regen_cache();
+                    bb->regen_cache();
                 }
             }
 
@@ -705,26 +1378,25 @@ namespace apsi {
 
         vector<reference_wrapper<const BinBundleCache>> SenderDB::get_cache_at(uint32_t bundle_idx)
         {
-            return collect_caches(bin_bundles_.at(safe_cast<size_t>(bundle_idx)));
+            return get_snapshot()->get_cache_at(bundle_idx);
         }
 
         OPRFKey SenderDB::strip()
         {
-            // Lock the database for writing
-            auto lock = get_writer_lock();
-
-            stripped_ = true;
-
-            OPRFKey oprf_key_copy = move(oprf_key_);
-            oprf_key_.clear();
-            hashed_items_.clear();
+            lock_guard<mutex> update_lock(update_mtx_);
 
+            // Queries may still use the BinBundles of the current snapshot, so stripped copies of
+            // them go into a new snapshot. The caches of a published snapshot are always valid.
             ThreadPoolMgr tpm;
-
+            auto snapshot = make_shared<SenderDBSnapshot>(*get_snapshot());
             vector<future<void>> futures;
-            for (auto &bundle_idx : bin_bundles_) {
+            for (auto &bundle_idx : snapshot->bin_bundles_) {
                 for (auto &bb : bundle_idx) {
-                    futures.push_back(tpm.thread_pool().enqueue([&bb]() { bb.strip(); }));
+                    if (bb->is_stripped()) {
+                        continue;
+                    }
+                    futures.push_back(tpm.thread_pool().enqueue(
+                        [&bb]() { bb = make_shared<BinBundle>(bb->stripped_clone()); }));
                 }
             }
 
@@ -733,6 +1405,40 @@ namespace apsi {
                 f.get();
             }
 
+            // Remember which bundle indices the items are at, so the items of a shard can still be
+            // counted without the items
+            if (!stripped_) {
+                auto hash_funcs = hash_functions(params_);
+                uint32_t bins_per_bundle = params_.bins_per_bundle();
+                for (const auto &item : hashed_items_) {
+                    vector<uint32_t> bundle_indices;
+                    for (auto location : all_locations(hash_funcs, item)) {
+                        bundle_indices.push_back(static_cast<uint32_t>(
+                            unpack_cuckoo_idx(location, bins_per_bundle).second));
+                    }
+                    sort(bundle_indices.begin(), bundle_indices.end());
+                    bundle_indices.erase(
+                        unique(bundle_indices.begin(), bundle_indices.end()),
+                        bundle_indices.end());
+                    snapshot->bundle_idx_set_item_counts_[bundle_indices]++;
+                }
+            }
+
+            // Lock the database for writing
+            auto lock = get_writer_lock();
+
+            stripped_ = true;
+
+            OPRFKey oprf_key_copy = move(oprf_key_);
+            oprf_key_.clear();
+            hashed_items_.clear();
+
+            // A stripped SenderDB cannot look up items
+            item_index_.clear();
+            item_index_enabled_ = false;
+
+            publish(move(snapshot));
+
             APSI_LOG_INFO("SenderDB has been stripped");
 
             return oprf_key_copy;
@@ -766,83 +1472,133 @@ namespace apsi {
             auto hashed_data =
                 OPRFSender::ComputeHashes(data, oprf_key_, label_byte_count_, nonce_byte_count_);
 
-            // Lock the database for writing
-            auto lock = get_writer_lock();
+            // Only one update can run at a time; queries are not blocked
+            lock_guard<mutex> update_lock(update_mtx_);
 
             // We need to know which items are new and which are old, since we have to tell
             // dispatch_insert_or_assign when to have an overwrite-on-collision versus
-            // add-binbundle-on-collision policy.
-            auto new_data_end =
-                remove_if(hashed_data.begin(), hashed_data.end(), [&](const auto &item_label_pair) {
-                    bool found = hashed_items_.find(item_label_pair.first) != hashed_items_.end();
-                    if (!found) {
-                        // Add to hashed_items_ already at this point!
-                        hashed_items_.insert(item_label_pair.first);
-                        item_count_++;
-                    }
-
-                    // Remove those that were found
-                    return found;
+            // add-binbundle-on-collision policy. An item that appears more than once in the input
+            // is new only the first time. The new items are added to hashed_items_ only when the
+            // update is published.
+            util::HashedItemSet new_items;
+            new_items.reserve(hashed_data.size());
+            auto new_data_end = stable_partition(
+                hashed_data.begin(), hashed_data.end(), [&](const auto &item_label_pair) {
+                    const HashedItem &item = item_label_pair.first;
+                    return !hashed_items_.contains(item) && new_items.insert(item);
                 });
 
             // Dispatch the insertion, first for the new data, then for the data we're gonna
-            // overwrite
+            // overwrite. The BinBundles are modified in a copy of the current snapshot.
             uint32_t bins_per_bundle = params_.bins_per_bundle();
             uint32_t max_bin_size = params_.table_params().max_items_per_bin;
             uint32_t ps_low_degree = params_.query_params().ps_low_degree;
+            auto snapshot = make_shared<SenderDBSnapshot>(*get_snapshot());
 
             // Compute the label size; this ceil(effective_label_bit_count / item_bit_count)
-            size_t label_size = compute_label_size(nonce_byte_count_ + label_byte_count_, params_);
+            size_t label_size = params_.label_size(nonce_byte_count_ + label_byte_count_);
 
             auto new_item_count = distance(hashed_data.begin(), new_data_end);
             auto existing_item_count = distance(new_data_end, hashed_data.end());
 
-            if (existing_item_count) {
-                APSI_LOG_INFO(
-                    "Found " << existing_item_count << " existing items to replace in SenderDB");
+            // With the item index, the workers report where they wrote each item
+            vector<pair<HashedItem, ItemLocations>> item_locations;
 
-                // Break the data into field element representation. Also compute the items' cuckoo
-                // indices.
+            if (new_item_count) {
+                APSI_LOG_INFO("Found " << new_item_count << " new items to insert in SenderDB");
+
+                // Process and add the new data. Break the data into field element representation.
+                // Also compute the items' cuckoo indices.
                 vector<pair<AlgItemLabel, size_t>> data_with_indices =
-                    preprocess_labeled_data(new_data_end, hashed_data.end(), params_);
+                    preprocess_labeled_data(hashed_data.begin(), new_data_end, params_);
+
+                vector<size_t> bundle_positions;
+                if (item_index_enabled_) {
+                    bundle_positions.resize(data_with_indices.size(), no_bundle_pos);
+                }
 
                 dispatch_insert_or_assign(
                     data_with_indices,
-                    bin_bundles_,
+                    snapshot->bin_bundles_,
                     crypto_context_,
                     bins_per_bundle,
                     label_size,
                     max_bin_size,
                     ps_low_degree,
-                    true, /* overwrite items */
-                    compressed_);
-
-                // Release memory that is no longer needed
-                hashed_data.erase(new_data_end, hashed_data.end());
+                    placement_policy_,
+                    false, /* don't overwrite items */
+                    compressed_,
+                    packed_,
+                    item_index_enabled_ ? &bundle_positions : nullptr);
+
+                if (item_index_enabled_) {
+                    item_locations = collect_item_locations(
+                        hashed_data.begin(),
+                        new_data_end,
+                        data_with_indices,
+                        bundle_positions,
+                        params_);
+                }
             }
 
-            if (new_item_count) {
-                APSI_LOG_INFO("Found " << new_item_count << " new items to insert in SenderDB");
+            if (existing_item_count) {
+                APSI_LOG_INFO(
+                    "Found " << existing_item_count << " existing items to replace in SenderDB");
 
-                // Process and add the new data. Break the data into field element representation.
-                // Also compute the items' cuckoo indices.
+                // Break the data into field element representation. Also compute the items' cuckoo
+                // indices.
                 vector<pair<AlgItemLabel, size_t>> data_with_indices =
-                    preprocess_labeled_data(hashed_data.begin(), hashed_data.end(), params_);
+                    preprocess_labeled_data(new_data_end, hashed_data.end(), params_);
+
+                // The item index tells which BinBundles hold the items
+                vector<size_t> bundle_positions;
+                if (item_index_enabled_) {
+                    bundle_positions = find_bundle_positions(
+                        new_data_end,
+                        hashed_data.end(),
+                        data_with_indices,
+                        item_index_,
+                        params_);
+                }
 
                 dispatch_insert_or_assign(
                     data_with_indices,
-                    bin_bundles_,
+                    snapshot->bin_bundles_,
                     crypto_context_,
                     bins_per_bundle,
                     label_size,
                     max_bin_size,
                     ps_low_degree,
-                    false, /* don't overwrite items */
-                    compressed_);
+                    placement_policy_,
+                    true, /* overwrite items */
+                    compressed_,
+                    packed_,
+                    item_index_enabled_ ? &bundle_positions : nullptr);
+
+                if (item_index_enabled_) {
+                    auto existing_item_locations = collect_item_locations(
+                        new_data_end,
+                        hashed_data.end(),
+                        data_with_indices,
+                        bundle_positions,
+                        params_);
+                    move(
+                        existing_item_locations.begin(),
+                        existing_item_locations.end(),
+                        back_inserter(item_locations));
+                }
             }
 
-            // Generate the BinBundle caches
-            generate_caches();
+            // Generate the caches of the new and modified BinBundles; publish the new snapshot
+            // together with the new items
+            regen_caches(snapshot->bin_bundles_);
+            snapshot->item_count_ += new_items.size();
+            auto lock = get_writer_lock();
+            hashed_items_.insert(new_items.begin(), new_items.end());
+            for (const auto &locations : item_locations) {
+                item_index_.insert_or_assign(locations.first, locations.second);
+            }
+            publish(move(snapshot));
 
             APSI_LOG_INFO("Finished inserting " << data.size() << " items in SenderDB");
         }
@@ -864,21 +1620,17 @@ namespace apsi {
             // First compute the hashes for the input data
             auto hashed_data = OPRFSender::ComputeHashes(data, oprf_key_);
 
-            // Lock the database for writing
-            auto lock = get_writer_lock();
+            // Only one update can run at a time; queries are not blocked
+            lock_guard<mutex> update_lock(update_mtx_);
 
-            // We are not going to insert items that already appear in the database.
+            // We are not going to insert items that already appear in the database, or that appear
+            // more than once in the input. The new items are added to hashed_items_ only when the
+            // update is published.
+            util::HashedItemSet new_items;
+            new_items.reserve(hashed_data.size());
             auto new_data_end =
                 remove_if(hashed_data.begin(), hashed_data.end(), [&](const auto &item) {
-                    bool found = hashed_items_.find(item) != hashed_items_.end();
-                    if (!found) {
-                        // Add to hashed_items_ already at this point!
-                        hashed_items_.insert(item);
-                        item_count_++;
-                    }
-
-                    // Remove those that were found
-                    return found;
+                    return hashed_items_.contains(item) || !new_items.insert(item);
                 });
 
             // Erase the previously existing items from hashed_data; in unlabeled case there is
@@ -892,24 +1644,53 @@ namespace apsi {
             vector<pair<AlgItem, size_t>> data_with_indices =
                 preprocess_unlabeled_data(hashed_data.begin(), hashed_data.end(), params_);
 
-            // Dispatch the insertion
+            // Dispatch the insertion. The BinBundles are modified in a copy of the current
+            // snapshot.
             uint32_t bins_per_bundle = params_.bins_per_bundle();
             uint32_t max_bin_size = params_.table_params().max_items_per_bin;
             uint32_t ps_low_degree = params_.query_params().ps_low_degree;
+            auto snapshot = make_shared<SenderDBSnapshot>(*get_snapshot());
+
+            // With the item index, the workers report where they wrote each item
+            vector<size_t> bundle_positions;
+            if (item_index_enabled_) {
+                bundle_positions.resize(data_with_indices.size(), no_bundle_pos);
+            }
 
             dispatch_insert_or_assign(
                 data_with_indices,
-                bin_bundles_,
+                snapshot->bin_bundles_,
                 crypto_context_,
                 bins_per_bundle,
                 0, /* label size */
                 max_bin_size,
                 ps_low_degree,
+                placement_policy_,
                 false, /* don't overwrite items */
-                compressed_);
+                compressed_,
+                packed_,
+                item_index_enabled_ ? &bundle_positions : nullptr);
+
+            vector<pair<HashedItem, ItemLocations>> item_locations;
+            if (item_index_enabled_) {
+                item_locations = collect_item_locations(
+                    hashed_data.cbegin(),
+                    hashed_data.cend(),
+                    data_with_indices,
+                    bundle_positions,
+                    params_);
+            }
 
-            // Generate the BinBundle caches
-            generate_caches();
+            // Generate the caches of the new and modified BinBundles; publish the new snapshot
+            // together with the new items
+            regen_caches(snapshot->bin_bundles_);
+            snapshot->item_count_ += new_items.size();
+            auto lock = get_writer_lock();
+            hashed_items_.insert(new_items.begin(), new_items.end());
+            for (const auto &locations : item_locations) {
+                item_index_.insert_or_assign(locations.first, locations.second);
+            }
+            publish(move(snapshot));
 
             APSI_LOG_INFO("Finished inserting " << data.size() << " items in SenderDB");
         }
@@ -927,21 +1708,15 @@ namespace apsi {
             // First compute the hashes for the input data
             auto hashed_data = OPRFSender::ComputeHashes(data, oprf_key_);
 
-            // Lock the database for writing
-            auto lock = get_writer_lock();
+            // Only one update can run at a time; queries are not blocked
+            lock_guard<mutex> update_lock(update_mtx_);
 
-            // Remove items that do not exist in the database.
+            // Remove items that do not exist in the database, or that appear more than once in the
+            // input. The items are removed from hashed_items_ only when the update is published.
+            util::HashedItemSet removed_items;
             auto existing_data_end =
                 remove_if(hashed_data.begin(), hashed_data.end(), [&](const auto &item) {
-                    bool found = hashed_items_.find(item) != hashed_items_.end();
-                    if (found) {
-                        // Remove from hashed_items_ already at this point!
-                        hashed_items_.erase(item);
-                        item_count_--;
-                    }
-
-                    // Remove those that were not found
-                    return !found;
+                    return !hashed_items_.contains(item) || !removed_items.insert(item);
                 });
 
             // This distance is always non-negative
@@ -952,22 +1727,293 @@ namespace apsi {
                     "Ignoring " << existing_item_count
                                 << " items that are not present in the SenderDB");
             }
+            hashed_data.erase(existing_data_end, hashed_data.end());
 
             // Break the data down into its field element representation. Also compute the items'
             // cuckoo indices.
             vector<pair<AlgItem, size_t>> data_with_indices =
                 preprocess_unlabeled_data(hashed_data.begin(), hashed_data.end(), params_);
 
-            // Dispatch the removal
+            // Dispatch the removal. The BinBundles are modified in a copy of the current snapshot.
+            // With the item index, the workers report how the BinBundles moved.
             uint32_t bins_per_bundle = params_.bins_per_bundle();
-            dispatch_remove(data_with_indices, bin_bundles_, bins_per_bundle);
+            auto snapshot = make_shared<SenderDBSnapshot>(*get_snapshot());
+            vector<BundleRemap> remove_remaps;
+            if (item_index_enabled_) {
+                remove_remaps.resize(snapshot->bin_bundles_.size());
+            }
+            dispatch_remove(
+                data_with_indices,
+                snapshot->bin_bundles_,
+                bins_per_bundle,
+                item_index_enabled_ ? &remove_remaps : nullptr);
+            snapshot->item_count_ -= removed_items.size();
+
+            // Compact the new snapshot if the removal left it too sparse
+            vector<BundleRemap> compact_remaps;
+            if (compaction_threshold_ > 0.0 &&
+                compute_packing_rate(*snapshot, params_) < compaction_threshold_) {
+                APSI_LOG_INFO("Packing rate fell below the compaction threshold; compacting");
+                if (item_index_enabled_) {
+                    compact_remaps.resize(snapshot->bin_bundles_.size());
+                }
+                dispatch_compact(
+                    snapshot->bin_bundles_,
+                    params_.item_params().felts_per_item,
+                    item_index_enabled_ ? &compact_remaps : nullptr);
+            }
 
-            // Generate the BinBundle caches
-            generate_caches();
+            // Generate the caches of the modified BinBundles; publish the new snapshot together
+            // with the removed items
+            regen_caches(snapshot->bin_bundles_);
+            auto lock = get_writer_lock();
+            for (const auto &item : removed_items) {
+                hashed_items_.erase(item);
+                item_index_.erase(item);
+            }
+            item_index_.remap(remove_remaps);
+            item_index_.remap(compact_remaps);
+            publish(move(snapshot));
 
             APSI_LOG_INFO("Finished removing " << data.size() << " items from SenderDB");
         }
 
+        void SenderDB::merge(SenderDB &&other)
+        {
+            if (&other == this) {
+                throw invalid_argument("cannot merge a SenderDB with itself");
+            }
+
+            STOPWATCH(sender_stopwatch, "SenderDB::merge");
+
+            // Only one update can run at a time on either SenderDB; queries are not blocked
+            std::lock(update_mtx_, other.update_mtx_);
+            lock_guard<mutex> update_lock(update_mtx_, adopt_lock);
+            lock_guard<mutex> other_update_lock(other.update_mtx_, adopt_lock);
+
+            if (params_.to_string() != other.params_.to_string() ||
+                label_byte_count_ != other.label_byte_count_ ||
+                nonce_byte_count_ != other.nonce_byte_count_ || compressed_ != other.compressed_ ||
+                packed_ != other.packed_) {
+                APSI_LOG_ERROR(
+                    "Cannot merge SenderDBs with different parameters, label or nonce byte "
+                    "counts, or compression or packing settings");
+                throw invalid_argument("failed to merge SenderDBs");
+            }
+            if (bundle_idx_begin_ != other.bundle_idx_begin_ ||
+                bundle_idx_end_ != other.bundle_idx_end_) {
+                APSI_LOG_ERROR("Cannot merge SenderDBs with different bundle index ranges");
+                throw invalid_argument("failed to merge SenderDBs");
+            }
+            if (stripped_ != other.stripped_) {
+                APSI_LOG_ERROR("Cannot merge a stripped SenderDB with one that is not stripped");
+                throw logic_error("failed to merge SenderDBs");
+            }
+            if (!stripped_) {
+                if (oprf_key_ != other.oprf_key_) {
+                    APSI_LOG_ERROR("Cannot merge SenderDBs with different OPRF keys");
+                    throw invalid_argument("failed to merge SenderDBs");
+                }
+                for (const auto &item : other.hashed_items_) {
+                    if (hashed_items_.find(item) != hashed_items_.end()) {
+                        APSI_LOG_ERROR("Cannot merge SenderDBs that have items in common");
+                        throw invalid_argument("failed to merge SenderDBs");
+                    }
+                }
+            }
+
+            auto other_snapshot = other.get_snapshot();
+            APSI_LOG_INFO(
+                "Start merging " << other_snapshot->get_item_count() << " items ("
+                                 << other_snapshot->get_bin_bundle_count()
+                                 << " bin bundles) in SenderDB");
+
+            // Dispatch the merge. The BinBundles are modified in a copy of the current snapshot.
+            // With the item index, the workers report where the other BinBundles ended up.
+            bool index_items = item_index_enabled_ && !stripped_;
+            auto snapshot = make_shared<SenderDBSnapshot>(*get_snapshot());
+            vector<vector<size_t>> other_positions;
+            if (index_items) {
+                other_positions.resize(snapshot->bin_bundles_.size());
+            }
+            ThreadPoolMgr tpm;
+            vector<future<void>> futures;
+            for (uint32_t bundle_idx = bundle_idx_begin_; bundle_idx < bundle_idx_end_;
+                 bundle_idx++) {
+                const auto &other_bundle_set = other_snapshot->bin_bundles_[bundle_idx];
+                if (other_bundle_set.empty()) {
+                    continue;
+                }
+                futures.push_back(tpm.thread_pool().enqueue([&, bundle_idx]() {
+                    merge_worker(
+                        other_bundle_set,
+                        snapshot->bin_bundles_,
+                        bundle_idx,
+                        index_items ? &other_positions[bundle_idx] : nullptr);
+                }));
+            }
+
+            // Wait for the tasks to finish
+            for (auto &f : futures) {
+                f.get();
+            }
+
+            // Index the other items. If the other SenderDB has an item index, its entries only
+            // need to follow the BinBundles; otherwise the items are searched for.
+            vector<pair<HashedItem, ItemLocations>> item_locations;
+            if (index_items && other.item_index_enabled_) {
+                uint32_t bins_per_bundle = params_.bins_per_bundle();
+                item_locations.reserve(other.item_index_.size());
+                for (const auto &other_entry : other.item_index_) {
+                    ItemLocations locations = other.item_index_.get_locations(other_entry);
+                    for (auto &location : locations) {
+                        size_t bundle_idx = location.cuckoo_idx / bins_per_bundle;
+                        const vector<size_t> &positions = other_positions[bundle_idx];
+                        if (location.bundle_pos < positions.size()) {
+                            location.bundle_pos =
+                                static_cast<uint32_t>(positions[location.bundle_pos]);
+                        }
+                    }
+                    item_locations.emplace_back(other_entry.item, locations);
+                }
+            } else if (index_items) {
+                auto hash_funcs = hash_functions(params_);
+                item_locations.reserve(other.hashed_items_.size());
+                for (const auto &item : other.hashed_items_) {
+                    item_locations.emplace_back(
+                        item, locate_item(item, hash_funcs, snapshot->bin_bundles_, params_));
+                }
+            }
+
+            // Generate the caches of the BinBundles that were merged into; publish the new snapshot
+            // together with the new items
+            regen_caches(snapshot->bin_bundles_);
+            snapshot->item_count_ += other_snapshot->get_item_count();
+            {
+                auto lock = get_writer_lock();
+                hashed_items_.reserve(hashed_items_.size() + other.hashed_items_.size());
+                hashed_items_.insert(other.hashed_items_.begin(), other.hashed_items_.end());
+                for (const auto &locations : item_locations) {
+                    item_index_.insert_or_assign(locations.first, locations.second);
+                }
+                publish(move(snapshot));
+            }
+
+            // Clear the other SenderDB so it no longer refers to the BinBundles that are now
+            // shared; queries running on its snapshots are not affected
+            {
+                auto other_lock = other.get_writer_lock();
+                other.clear_internal();
+            }
+
+            APSI_LOG_INFO("Finished merging SenderDBs; the SenderDB now holds "
+                          << get_item_count() << " items");
+        }
+
+        void SenderDB::compact()
+        {
+            if (stripped_) {
+                APSI_LOG_ERROR("Cannot compact a stripped SenderDB");
+                throw logic_error("failed to compact SenderDB");
+            }
+
+            STOPWATCH(sender_stopwatch, "SenderDB::compact");
+
+            // Only one update can run at a time; queries are not blocked
+            lock_guard<mutex> update_lock(update_mtx_);
+
+            // The BinBundles are compacted in a copy of the current snapshot. With the item index,
+            // the workers report where the items moved.
+            auto snapshot = make_shared<SenderDBSnapshot>(*get_snapshot());
+            size_t bin_bundle_count = snapshot->get_bin_bundle_count();
+            vector<BundleRemap> remaps;
+            if (item_index_enabled_) {
+                remaps.resize(snapshot->bin_bundles_.size());
+            }
+            dispatch_compact(
+                snapshot->bin_bundles_,
+                params_.item_params().felts_per_item,
+                item_index_enabled_ ? &remaps : nullptr);
+
+            APSI_LOG_INFO(
+                "Compacted SenderDB from " << bin_bundle_count << " to "
+                                           << snapshot->get_bin_bundle_count() << " bin bundles");
+
+            // Generate the caches of the BinBundles that items were moved to
+            regen_caches(snapshot->bin_bundles_);
+            auto lock = get_writer_lock();
+            item_index_.remap(remaps);
+            publish(move(snapshot));
+        }
+
+        void SenderDB::set_compaction_threshold(double packing_rate)
+        {
+            if (!(packing_rate >= 0.0 && packing_rate <= 1.0)) {
+                APSI_LOG_ERROR(
+                    "Compaction threshold " << packing_rate << " is not in the range [0, 1]");
+                throw invalid_argument("invalid compaction threshold");
+            }
+
+            lock_guard<mutex> update_lock(update_mtx_);
+            compaction_threshold_ = packing_rate;
+        }
+
+        void SenderDB::set_placement_policy(PlacementPolicy policy)
+        {
+            switch (policy) {
+            case PlacementPolicy::first_fit:
+            case PlacementPolicy::best_fit:
+            case PlacementPolicy::sorted_batch:
+                break;
+
+            default:
+                APSI_LOG_ERROR("Unknown placement policy " << static_cast<int>(policy));
+                throw invalid_argument("invalid placement policy");
+            }
+
+            lock_guard<mutex> update_lock(update_mtx_);
+            placement_policy_ = policy;
+        }
+
+        void SenderDB::set_item_index_enabled(bool enabled)
+        {
+            if (enabled && stripped_) {
+                APSI_LOG_ERROR("Cannot enable the item index of a stripped SenderDB");
+                throw logic_error("failed to enable item index");
+            }
+
+            lock_guard<mutex> update_lock(update_mtx_);
+            if (enabled == item_index_enabled_) {
+                return;
+            }
+
+            if (!enabled) {
+                auto lock = get_writer_lock();
+                item_index_.clear();
+                item_index_enabled_ = false;
+                return;
+            }
+
+            STOPWATCH(sender_stopwatch, "SenderDB::set_item_index_enabled");
+            APSI_LOG_INFO("Start indexing " << hashed_items_.size() << " items in SenderDB");
+
+            // Search for every item once; updates keep the index up to date from now on
+            auto snapshot = get_snapshot();
+            auto hash_funcs = hash_functions(params_);
+            util::ItemIndex item_index(params_);
+            item_index.reserve(hashed_items_.size());
+            for (const auto &item : hashed_items_) {
+                item_index.insert_or_assign(
+                    item, locate_item(item, hash_funcs, snapshot->bin_bundles_, params_));
+            }
+
+            auto lock = get_writer_lock();
+            item_index_ = move(item_index);
+            item_index_enabled_ = true;
+
+            APSI_LOG_INFO("Finished indexing " << hashed_items_.size() << " items in SenderDB");
+        }
+
         bool SenderDB::has_item(const Item &item) const
         {
             if (stripped_) {
@@ -1023,15 +2069,24 @@ namespace apsi {
             tie(bin_idx, bundle_idx) = unpack_cuckoo_idx(cuckoo_idx, bins_per_bundle);
 
             // Retrieve the algebraic labels from one of the BinBundles at this index
-            const vector<BinBundle> &bundle_set = bin_bundles_[bundle_idx];
+            auto snapshot = get_snapshot();
+            const vector<shared_ptr<BinBundle>> &bundle_set = snapshot->bin_bundles_[bundle_idx];
             vector<felt_t> alg_label;
             bool got_labels = false;
-            for (const BinBundle &bundle : bundle_set) {
+
+            // The item index tells which BinBundle holds the item
+            if (item_index_enabled_) {
+                size_t bundle_pos = item_index_.find_bundle_pos(hashed_item, cuckoo_idx);
+                got_labels = bundle_pos < bundle_set.size() &&
+                             bundle_set[bundle_pos]->try_get_multi_label(
+                                 alg_item, bin_idx, alg_label);
+            }
+
+            for (size_t bundle_pos = 0; !got_labels && bundle_pos < bundle_set.size();
+                 bundle_pos++) {
                 // Try to retrieve the contiguous labels from this BinBundle
-                if (bundle.try_get_multi_label(alg_item, bin_idx, alg_label)) {
-                    got_labels = true;
-                    break;
-                }
+                got_labels =
+                    bundle_set[bundle_pos]->try_get_multi_label(alg_item, bin_idx, alg_label);
             }
 
             // It shouldn't be possible to have items in your set but be unable to retrieve the
@@ -1057,12 +2112,48 @@ namespace apsi {
 
         size_t SenderDB::save(ostream &out) const
         {
-            // Lock the database for reading
+            return save_shard(out, bundle_idx_begin_, bundle_idx_end_);
+        }
+
+        size_t SenderDB::save_shard(
+            ostream &out, uint32_t bundle_idx_begin, uint32_t bundle_idx_end) const
+        {
+            // Lock the database for reading; the snapshot matches hashed_items_ while the lock is
+            // held
             auto lock = get_reader_lock();
+            auto snapshot = get_snapshot();
 
             STOPWATCH(sender_stopwatch, "SenderDB::save");
             APSI_LOG_DEBUG("Start saving SenderDB");
 
+            if (bundle_idx_begin < bundle_idx_begin_ || bundle_idx_end > bundle_idx_end_ ||
+                bundle_idx_begin >= bundle_idx_end) {
+                APSI_LOG_ERROR(
+                    "Cannot save bundle indices [" << bundle_idx_begin << ", " << bundle_idx_end
+                                                   << "); the SenderDB holds bundle indices ["
+                                                   << bundle_idx_begin_ << ", " << bundle_idx_end_
+                                                   << ")");
+                throw invalid_argument("invalid bundle index range");
+            }
+            bool full_range =
+                bundle_idx_begin == 0 && bundle_idx_end == params_.bundle_idx_count();
+            if (!full_range && !stripped_) {
+                APSI_LOG_ERROR("Cannot save a shard of a SenderDB that is not stripped");
+                throw logic_error("failed to save SenderDB shard");
+            }
+
+            // A shard holds the items with a location at one of its bundle indices
+            size_t item_count = snapshot->get_item_count();
+            if (!full_range) {
+                if (snapshot->bundle_idx_set_item_counts_.empty() && item_count) {
+                    APSI_LOG_WARNING(
+                        "The SenderDB does not record the bundle indices of its items; the shard "
+                        "is saved with the item count of the whole SenderDB");
+                } else {
+                    item_count = snapshot->get_item_count(bundle_idx_begin, bundle_idx_end);
+                }
+            }
+
             // First save the PSIParam
             stringstream ss;
             params_.save(ss);
@@ -1075,24 +2166,38 @@ namespace apsi {
             fbs::SenderDBInfo info(
                 safe_cast<uint32_t>(label_byte_count_),
                 safe_cast<uint32_t>(nonce_byte_count_),
-                safe_cast<uint32_t>(item_count_),
+                safe_cast<uint32_t>(item_count),
                 compressed_,
                 stripped_);
             auto oprf_key_span = oprf_key_.key_span();
             auto oprf_key = fbs_builder.CreateVector(oprf_key_span.data(), oprf_key_span.size());
-            auto hashed_items = fbs_builder.CreateVectorOfStructs([&]() {
-                // The HashedItems vector is populated with an immediately-invoked lambda
-                vector<fbs::HashedItem> ret;
-                ret.reserve(get_hashed_items().size());
-                for (const auto &it : get_hashed_items()) {
-                    // Then create the vector of bytes for this hashed item
-                    auto item_data = it.get_as<uint64_t>();
-                    ret.emplace_back(item_data[0], item_data[1]);
+
+            // The hashed items are written directly into the buffer as a single block of structs
+            fbs::HashedItem *hashed_items_data = nullptr;
+            auto hashed_items = fbs_builder.CreateUninitializedVectorOfStructs(
+                hashed_items_.size(), &hashed_items_data);
+            for (const auto &it : hashed_items_) {
+                auto item_data = it.get_as<uint64_t>();
+                *hashed_items_data++ = fbs::HashedItem(item_data[0], item_data[1]);
+            }
+
+            // Only the sets of bundle indices with one in the shard are relevant to it
+            vector<flatbuffers::Offset<fbs::BundleIdxSetItemCount>> set_counts;
+            for (const auto &set_count : snapshot->bundle_idx_set_item_counts_) {
+                if (has_bundle_idx_in_range(set_count.first, bundle_idx_begin, bundle_idx_end)) {
+                    set_counts.push_back(fbs::CreateBundleIdxSetItemCount(
+                        fbs_builder,
+                        fbs_builder.CreateVector(set_count.first),
+                        static_cast<uint64_t>(set_count.second)));
                 }
-                return ret;
-            }());
+            }
+            auto bundle_idx_set_item_counts = fbs_builder.CreateVector(set_counts);
 
-            auto bin_bundle_count = get_bin_bundle_count();
+            size_t bin_bundle_count = 0;
+            for (uint32_t bundle_idx = bundle_idx_begin; bundle_idx < bundle_idx_end;
+                 bundle_idx++) {
+                bin_bundle_count += snapshot->get_bin_bundle_count(bundle_idx);
+            }
 
             fbs::SenderDBBuilder sender_db_builder(fbs_builder);
             sender_db_builder.add_params(params);
@@ -1100,6 +2205,10 @@ namespace apsi {
             sender_db_builder.add_oprf_key(oprf_key);
             sender_db_builder.add_hashed_items(hashed_items);
             sender_db_builder.add_bin_bundle_count(safe_cast<uint32_t>(bin_bundle_count));
+            sender_db_builder.add_packed(packed_);
+            sender_db_builder.add_bundle_idx_begin(bundle_idx_begin);
+            sender_db_builder.add_bundle_idx_end(bundle_idx_end);
+            sender_db_builder.add_bundle_idx_set_item_counts(bundle_idx_set_item_counts);
             auto sdb = sender_db_builder.Finish();
             fbs_builder.FinishSizePrefixed(sdb);
 
@@ -1110,9 +2219,9 @@ namespace apsi {
 
             // Finally write the BinBundles
             size_t bin_bundle_data_size = 0;
-            for (size_t bundle_idx = 0; bundle_idx < bin_bundles_.size(); bundle_idx++) {
-                for (auto &bb : bin_bundles_[bundle_idx]) {
-                    auto size = bb.save(out, static_cast<uint32_t>(bundle_idx));
+            for (size_t bundle_idx = bundle_idx_begin; bundle_idx < bundle_idx_end; bundle_idx++) {
+                for (auto &bb : snapshot->bin_bundles_[bundle_idx]) {
+                    auto size = bb->save(out, static_cast<uint32_t>(bundle_idx));
                     APSI_LOG_DEBUG(
                         "Saved BinBundle at bundle index " << bundle_idx << " (" << size
                                                            << " bytes)");
@@ -1122,8 +2231,7 @@ namespace apsi {
 
             total_size += bin_bundle_data_size;
             APSI_LOG_DEBUG(
-                "Saved SenderDB with " << get_item_count() << " items (" << total_size
-                                       << " bytes)");
+                "Saved SenderDB with " << item_count << " items (" << total_size << " bytes)");
 
             APSI_LOG_DEBUG("Finished saving SenderDB");
 
@@ -1167,6 +2275,23 @@ namespace apsi {
 
             bool compressed = sdb->info()->compressed();
             bool stripped = sdb->info()->stripped();
+            bool packed = sdb->packed();
+
+            // A SenderDB saved without a bundle index range holds all bundle indices
+            uint32_t bundle_idx_begin = sdb->bundle_idx_begin();
+            uint32_t bundle_idx_end =
+                sdb->bundle_idx_end() ? sdb->bundle_idx_end() : params->bundle_idx_count();
+            if (bundle_idx_begin >= bundle_idx_end || bundle_idx_end > params->bundle_idx_count()) {
+                APSI_LOG_ERROR(
+                    "The loaded SenderDB has an invalid bundle index range ["
+                    << bundle_idx_begin << ", " << bundle_idx_end << ")");
+                throw runtime_error("failed to load SenderDB");
+            }
+            if ((bundle_idx_begin != 0 || bundle_idx_end != params->bundle_idx_count()) &&
+                !stripped) {
+                APSI_LOG_ERROR("The loaded SenderDB is a shard but is not stripped");
+                throw runtime_error("failed to load SenderDB");
+            }
 
             APSI_LOG_DEBUG(
                 "Loaded SenderDB properties: "
@@ -1183,15 +2308,22 @@ namespace apsi {
                 << boolalpha << compressed
                 << "; "
                    "stripped: "
-                << boolalpha << stripped);
+                << boolalpha << stripped
+                << "; "
+                   "packed: "
+                << boolalpha << packed
+                << "; "
+                   "bundle indices: ["
+                << bundle_idx_begin << ", " << bundle_idx_end << ")");
 
             // Create the correct kind of SenderDB
             unique_ptr<SenderDB> sender_db;
             try {
-                sender_db =
-                    make_unique<SenderDB>(*params, label_byte_count, nonce_byte_count, compressed);
+                sender_db = make_unique<SenderDB>(
+                    *params, label_byte_count, nonce_byte_count, compressed, packed);
                 sender_db->stripped_ = stripped;
-                sender_db->item_count_ = item_count;
+                sender_db->bundle_idx_begin_ = bundle_idx_begin;
+                sender_db->bundle_idx_end_ = bundle_idx_end;
             } catch (const invalid_argument &ex) {
                 APSI_LOG_ERROR("APSI threw an exception creating SenderDB: " << ex.what());
                 throw runtime_error("failed to load SenderDB");
@@ -1228,12 +2360,34 @@ namespace apsi {
                 }
             }
 
+            // Load the bundle indices of the items if they were recorded when stripping
+            map<vector<uint32_t>, size_t> bundle_idx_set_item_counts;
+            if (sdb->bundle_idx_set_item_counts()) {
+                size_t recorded_item_count = 0;
+                for (const auto &set_count : *sdb->bundle_idx_set_item_counts()) {
+                    vector<uint32_t> bundle_indices(
+                        set_count->bundle_indices()->begin(), set_count->bundle_indices()->end());
+                    size_t set_item_count = static_cast<size_t>(set_count->item_count());
+                    bundle_idx_set_item_counts[move(bundle_indices)] += set_item_count;
+                    recorded_item_count += set_item_count;
+                }
+
+                // Check that item_count matches the number of recorded items
+                if (!bundle_idx_set_item_counts.empty() && item_count != recorded_item_count) {
+                    APSI_LOG_ERROR(
+                        "The item count indicated in the loaded SenderDB ("
+                        << item_count << ") does not match the number of items at its bundle "
+                        << "indices (" << recorded_item_count << ")");
+                    throw runtime_error("failed to load SenderDB");
+                }
+            }
+
             uint32_t bin_bundle_count = sdb->bin_bundle_count();
             size_t bin_bundle_data_size = 0;
             uint32_t max_bin_size = params->table_params().max_items_per_bin;
             uint32_t ps_low_degree = params->query_params().ps_low_degree;
             uint32_t bins_per_bundle = params->bins_per_bundle();
-            size_t label_size = compute_label_size(nonce_byte_count + label_byte_count, *params);
+            size_t label_size = params->label_size(nonce_byte_count + label_byte_count);
 
             // Load all BinBundle data
             vector<vector<unsigned char>> bin_bundle_data;
@@ -1242,10 +2396,14 @@ namespace apsi {
                 bin_bundle_data.push_back(read_from_stream(in));
             }
 
-            // Use multiple threads to recreate the BinBundles
+            // Use multiple threads to recreate the BinBundles. They are added to a new snapshot
+            // that is published when all are loaded.
             ThreadPoolMgr tpm;
 
-            vector<mutex> bundle_idx_mtxs(sender_db->bin_bundles_.size());
+            auto snapshot = make_shared<SenderDBSnapshot>(params->bundle_idx_count());
+            snapshot->item_count_ = item_count;
+            snapshot->bundle_idx_set_item_counts_ = move(bundle_idx_set_item_counts);
+            vector<mutex> bundle_idx_mtxs(snapshot->bin_bundles_.size());
             mutex bin_bundle_data_size_mtx;
             vector<future<void>> futures;
             for (size_t i = 0; i < bin_bundle_data.size(); i++) {
@@ -1257,24 +2415,26 @@ namespace apsi {
                         ps_low_degree,
                         bins_per_bundle,
                         compressed,
-                        stripped);
+                        stripped,
+                        packed);
                     auto bb_data = bb.load(bin_bundle_data[i]);
 
                     // Clear the data buffer since we have now loaded the BinBundle
                     bin_bundle_data[i].clear();
 
                     // Check that the loaded bundle index is not out of range
-                    if (bb_data.first >= sender_db->bin_bundles_.size()) {
+                    if (bb_data.first < bundle_idx_begin || bb_data.first >= bundle_idx_end) {
                         APSI_LOG_ERROR(
                             "The bundle index of the loaded BinBundle ("
-                            << bb_data.first << ") exceeds the maximum ("
-                            << params->bundle_idx_count() - 1 << ")");
+                            << bb_data.first << ") is outside the range [" << bundle_idx_begin
+                            << ", " << bundle_idx_end << ")");
                         throw runtime_error("failed to load SenderDB");
                     }
 
-                    // Add the loaded BinBundle to the correct location in bin_bundles_
+                    // Add the loaded BinBundle to the correct location in the snapshot
                     bundle_idx_mtxs[bb_data.first].lock();
-                    sender_db->bin_bundles_[bb_data.first].push_back(move(bb));
+                    snapshot->bin_bundles_[bb_data.first].push_back(
+                        make_shared<BinBundle>(move(bb)));
                     bundle_idx_mtxs[bb_data.first].unlock();
 
                     APSI_LOG_DEBUG(
@@ -1293,10 +2453,10 @@ namespace apsi {
 
             size_t total_size = in_data.size() + bin_bundle_data_size;
             APSI_LOG_DEBUG(
-                "Loaded SenderDB with " << sender_db->get_item_count() << " items (" << total_size
-                                        << " bytes)");
+                "Loaded SenderDB with " << item_count << " items (" << total_size << " bytes)");
 
-            // Make sure the BinBundle caches are valid
+            // Make sure the BinBundle caches are valid before publishing the BinBundles
+            sender_db->publish(move(snapshot));
             sender_db->generate_caches();
 
             APSI_LOG_DEBUG("Finished loading SenderDB");
@@ -8,8 +8,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <functional>
+#include <map>
 #include <memory>
-#include <unordered_set>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -22,6 +24,8 @@
 #include "apsi/item.h"
 #include "apsi/oprf/oprf_sender.h"
 #include "apsi/psi_params.h"
+#include "apsi/util/hashed_item_set.h"
+#include "apsi/util/item_index.h"
 
 // SEAL
 #include "seal/plaintext.h"
@@ -29,6 +33,109 @@
 
 namespace apsi {
     namespace sender {
+        /**
+        An immutable version of the BinBundles in a SenderDB. An update to a SenderDB never modifies
+        the BinBundles of an existing snapshot. Instead, it builds new versions of the BinBundles it
+        changes and publishes a new snapshot that shares all other BinBundles with the previous one.
+        A query holds on to the snapshot it started with, so queries and updates never wait for
+        each other.
+        */
+        class SenderDBSnapshot {
+        public:
+            /**
+            Creates a snapshot with no BinBundles at each of the given number of bundle indices.
+            */
+            SenderDBSnapshot(std::uint32_t bundle_idx_count);
+
+            /**
+            Returns the number of items in the SenderDB at the time of this snapshot.
+            */
+            std::size_t get_item_count() const
+            {
+                return item_count_;
+            }
+
+            /**
+            Returns the number of items with a cuckoo table location at one of the bundle indices
+            in the range [bundle_idx_begin, bundle_idx_end), i.e., the items a shard holding these
+            bundle indices answers for. This is known only for a stripped SenderDB.
+            */
+            std::size_t get_item_count(
+                std::uint32_t bundle_idx_begin, std::uint32_t bundle_idx_end) const;
+
+            /**
+            Returns the number of bundle indices.
+            */
+            std::uint32_t get_bundle_idx_count() const
+            {
+                return static_cast<std::uint32_t>(bin_bundles_.size());
+            }
+
+            /**
+            Returns the total number of bin bundles at a specific bundle index.
+            */
+            std::size_t get_bin_bundle_count(std::uint32_t bundle_idx) const
+            {
+                return bin_bundles_.at(static_cast<std::size_t>(bundle_idx)).size();
+            }
+
+            /**
+            Returns the total number of bin bundles.
+            */
+            std::size_t get_bin_bundle_count() const;
+
+            /**
+            Returns a set of cache references corresponding to the bundles at the given bundle
+            index. The references are valid for as long as this snapshot exists.
+            */
+            auto get_cache_at(std::uint32_t bundle_idx) const
+                -> std::vector<std::reference_wrapper<const BinBundleCache>>;
+
+        private:
+            /**
+            The BinBundles, indexed by bundle index. The BinBundles are shared with other snapshots
+            and must not be modified once the snapshot is published.
+            */
+            std::vector<std::vector<std::shared_ptr<BinBundle>>> bin_bundles_;
+
+            std::size_t item_count_ = 0;
+
+            /**
+            For a stripped SenderDB, the number of items whose cuckoo table locations fall in each
+            set of bundle indices. The items themselves are gone, so this is what tells how many
+            of them a shard holds.
+            */
+            std::map<std::vector<std::uint32_t>, std::size_t> bundle_idx_set_item_counts_;
+
+            friend class SenderDB;
+        }; // class SenderDBSnapshot
+
+        /**
+        Policies for choosing the BinBundle a new item is inserted into when several BinBundles at
+        its bundle index have room for it. A new BinBundle is created only when none of them does.
+        Fewer BinBundles mean fewer polynomial evaluations and ResultParts per query.
+        */
+        enum class PlacementPolicy : std::uint8_t {
+            /**
+            Inserts the item into the most recently created BinBundle that has room for it. This
+            is the default.
+            */
+            first_fit = 0,
+
+            /**
+            Inserts the item into the BinBundle whose largest bin in the item's range would be the
+            fullest after the insertion, keeping room in the other BinBundles for later items.
+            */
+            best_fit = 1,
+
+            /**
+            Like best_fit, but the items of each update are first sorted so that the items in the
+            most heavily loaded bins are placed first. This helps most for bulk loads with
+            SenderDB::set_data.
+            */
+            sorted_batch = 2
+        };
+
         /**
         A SenderDB maintains an in-memory representation of the sender's set of items and labels (in
         labeled mode). This data is not simply copied into the SenderDB data structures, but also
@@ -48,6 +155,17 @@ namespace apsi {
         and can be disabled when constructing the SenderDB. The downside of in-memory compression is
         a performance reduction from decompressing parts of the data when they are used, and
         recompressing them if they are updated.
+
+        Alternatively, the SenderDB can be created in packed mode, which stores the batched
+        polynomial coefficients as bit-packed field elements instead of SEAL plaintexts. This
+        reduces the memory footprint several times more than compression, but the coefficients must
+        be encoded into SEAL plaintexts every time a query is processed. The in-memory compression
+        setting has no effect in packed mode.
+
+        Updates do not block queries, and queries do not block updates. A query runs on a snapshot
+        of the SenderDB taken when it starts (see SenderDB::get_snapshot). An update copies the
+        BinBundles it needs to change, regenerates their caches, and then atomically publishes a
+        new snapshot for subsequent queries. Concurrent updates are serialized.
         */
         class SenderDB {
         public:
@@ -58,7 +176,8 @@ namespace apsi {
                 PSIParams params,
                 std::size_t label_byte_count = 0,
                 std::size_t nonce_byte_count = 16,
-                bool compressed = true);
+                bool compressed = true,
+                bool packed = false);
 
             /**
             Creates a new SenderDB.
@@ -68,7 +187,8 @@ namespace apsi {
                 oprf::OPRFKey oprf_key,
                 std::size_t label_byte_count = 0,
                 std::size_t nonce_byte_count = 16,
-                bool compressed = true);
+                bool compressed = true,
+                bool packed = false);
 
             /**
             Creates a new SenderDB by moving from an existing one.
@@ -117,6 +237,15 @@ namespace apsi {
                 return compressed_;
             }
 
+            /**
+            Indicates whether batched polynomial coefficients are stored as bit-packed field
+            elements instead of SEAL plaintexts.
+            */
+            bool is_packed() const
+            {
+                return packed_;
+            }
+
             /**
             Indicates whether the SenderDB has been stripped of all information not needed for
             serving a query.
@@ -126,6 +255,31 @@ namespace apsi {
                 return stripped_;
             }
 
+            /**
+            Indicates whether the SenderDB is a shard, i.e., holds the BinBundles of only some of
+            the bundle indices. A shard is created by loading the output of SenderDB::save_shard.
+            */
+            bool is_shard() const
+            {
+                return bundle_idx_begin_ != 0 || bundle_idx_end_ != params_.bundle_idx_count();
+            }
+
+            /**
+            Returns the first bundle index held by the SenderDB.
+            */
+            std::uint32_t get_bundle_idx_begin() const
+            {
+                return bundle_idx_begin_;
+            }
+
+            /**
+            Returns one past the last bundle index held by the SenderDB.
+            */
+            std::uint32_t get_bundle_idx_end() const
+            {
+                return bundle_idx_end_;
+            }
+
             /**
             Strips the SenderDB of all information not needed for serving a query. Returns a copy of
             the OPRF key and clears it from the SenderDB.
@@ -205,6 +359,82 @@ namespace apsi {
                 remove(data_singleton);
             }
 
+            /**
+            Moves the items and labels of another SenderDB into this one, leaving the other
+            SenderDB empty as after SenderDB::clear. This allows a large SenderDB to be built in
+            parts, e.g., by separate processes from disjoint slices of the input, and then
+            combined. The items are not hashed again: the BinBundles of the other SenderDB are
+            merged into the BinBundles at the same bundle index where the bins have room, and are
+            otherwise added as they are. Only the caches of the BinBundles that were merged into
+            are regenerated.
+
+            Both SenderDBs must have the same parameters, label and nonce byte counts, compression
+            and packing settings, and bundle index range. If neither is stripped, they must have the
+            same OPRF key and no items in common. Stripped SenderDBs can only be merged with each
+            other; their BinBundles are then added as they are, and the caller must ensure that the
+            SenderDBs have no items in common.
+            */
+            void merge(SenderDB &&other);
+
+            /**
+            Moves items out of sparsely filled BinBundles into other BinBundles at the same bundle
+            index, and drops the BinBundles that become empty. Removing items only leaves holes in
+            the BinBundles, so after many removals queries process more BinBundles than the items
+            need. Only the caches of the BinBundles that received items are regenerated. Like other
+            updates, compaction runs on a copy of the current snapshot, so queries are not blocked.
+            Throws std::logic_error if the SenderDB is stripped.
+            */
+            void compact();
+
+            /**
+            Sets the packing rate (see SenderDB::get_packing_rate) below which SenderDB::remove
+            compacts the SenderDB before publishing the removal. A value of zero, which is the
+            default, disables automatic compaction. Throws std::invalid_argument if the value is
+            not in the range [0, 1].
+            */
+            void set_compaction_threshold(double packing_rate);
+
+            /**
+            Returns the packing rate below which SenderDB::remove compacts the SenderDB.
+            */
+            double get_compaction_threshold() const noexcept
+            {
+                return compaction_threshold_;
+            }
+
+            /**
+            Sets the policy for choosing the BinBundle new items are inserted into. Existing items
+            are not moved; see SenderDB::compact.
+            */
+            void set_placement_policy(PlacementPolicy policy);
+
+            /**
+            Returns the policy for choosing the BinBundle new items are inserted into.
+            */
+            PlacementPolicy get_placement_policy() const noexcept
+            {
+                return placement_policy_;
+            }
+
+            /**
+            Enables or disables the item index, which records for every item the position of the
+            BinBundle holding it at each of its bundle indices. With the index,
+            SenderDB::get_label and updates that overwrite labels go directly to the BinBundle
+            holding the item instead of searching all BinBundles at its bundle index. The index is
+            kept up to date by every update and costs memory for every item. Enabling the index
+            searches for every item once. The index is not saved with the SenderDB. Throws
+            std::logic_error if the index is enabled for a stripped SenderDB.
+            */
+            void set_item_index_enabled(bool enabled);
+
+            /**
+            Returns whether the item index is enabled.
+            */
+            bool is_item_index_enabled() const noexcept
+            {
+                return item_index_enabled_;
+            }
+
             /**
             Returns whether the given item has been inserted in the SenderDB.
             */
@@ -218,12 +448,20 @@ namespace apsi {
 
             /**
             Returns a set of cache references corresponding to the bundles at the given bundle
-            index. Even though this function returns a vector, the order has no significance. This
-            function is meant for internal use.
+            index. Even though this function returns a vector, the order has no significance. The
+            references are valid only until the SenderDB is next modified; use
+            SenderDB::get_snapshot to hold on to the caches instead. This function is meant for
+            internal use.
             */
             auto get_cache_at(std::uint32_t bundle_idx)
                 -> std::vector<std::reference_wrapper<const BinBundleCache>>;
 
+            /**
+            Returns the current snapshot of the BinBundles. The snapshot does not change when the
+            SenderDB is updated afterwards.
+            */
+            std::shared_ptr<const SenderDBSnapshot> get_snapshot() const;
+
             /**
             Returns a reference to the PSI parameters for this SenderDB.
             */
@@ -251,7 +489,7 @@ namespace apsi {
             /**
             Returns a reference to a set of item hashes already existing in the SenderDB.
             */
-            const std::unordered_set<HashedItem> &get_hashed_items() const
+            const util::HashedItemSet &get_hashed_items() const
             {
                 return hashed_items_;
             }
@@ -259,10 +497,7 @@ namespace apsi {
             /**
             Returns the number of items in this SenderDB.
             */
-            size_t get_item_count() const
-            {
-                return item_count_;
-            }
+            std::size_t get_item_count() const;
 
             /**
             Returns the total number of bin bundles at a specific bundle index.
@@ -281,7 +516,8 @@ namespace apsi {
             double get_packing_rate() const;
 
             /**
-            Obtains a scoped lock preventing the SenderDB from being changed.
+            Obtains a scoped lock preventing changes to the SenderDB from being published. Queries
+            do not need this lock, since they run on a snapshot.
             */
             seal::util::ReaderLock get_reader_lock() const
             {
@@ -293,6 +529,20 @@ namespace apsi {
             */
             std::size_t save(std::ostream &out) const;
 
+            /**
+            Writes a shard of the SenderDB to a stream: the SenderDB is written as usual, but only
+            with the BinBundles at bundle indices in the range [bundle_idx_begin, bundle_idx_end).
+            A Sender serving a query with the loaded shard returns the ResultParts for these bundle
+            indices only, so the shards of a large SenderDB can be served by separate processes and
+            their ResultParts combined. Only a stripped SenderDB can be sharded, because a shard
+            cannot hold the items of the other bundle indices. The item count of the shard is the
+            number of items with a cuckoo table location at one of its bundle indices.
+            */
+            std::size_t save_shard(
+                std::ostream &out,
+                std::uint32_t bundle_idx_begin,
+                std::uint32_t bundle_idx_end) const;
+
             /**
             Reads the SenderDB from a stream.
             */
@@ -310,10 +560,15 @@ namespace apsi {
 
             void generate_caches();
 
+            /**
+            Replaces the current snapshot. Assumes the SenderDB is locked for writing.
+            */
+            void publish(std::shared_ptr<const SenderDBSnapshot> snapshot);
+
             /**
             The set of all items that have been inserted into the database
             */
-            std::unordered_set<HashedItem> hashed_items_;
+            util::HashedItemSet hashed_items_;
 
             /**
             The PSI parameters define the SEAL parameters, base field, item size, table size, etc.
@@ -326,10 +581,21 @@ namespace apsi {
             CryptoContext crypto_context_;
 
             /**
-            A read-write lock to protect the database from modification while in use.
+            A read-write lock to protect the database from modification while in use. Updates hold
+            it for writing only while publishing their changes.
             */
             mutable seal::util::ReaderWriterLocker db_lock_;
 
+            /**
+            Serializes updates to the database. An update holds this for its whole duration.
+            */
+            std::mutex update_mtx_;
+
+            /**
+            Protects snapshot_ so it can be replaced atomically.
+            */
+            mutable std::mutex snapshot_mtx_;
+
             /**
             Indicates the size of the label in bytes. A zero value indicates an unlabeled SenderDB.
             */
@@ -344,14 +610,15 @@ namespace apsi {
             std::size_t nonce_byte_count_;
 
             /**
-            The number of items currently in the SenderDB.
+            Indicates whether SEAL plaintexts are compressed in memory.
             */
-            std::size_t item_count_;
+            bool compressed_;
 
             /**
-            Indicates whether SEAL plaintexts are compressed in memory.
+            Indicates whether batched polynomial coefficients are stored as bit-packed field
+            elements instead of SEAL plaintexts.
             */
-            bool compressed_;
+            bool packed_;
 
             /**
             Indicates whether the SenderDB has been stripped of all information not needed for
@@ -360,10 +627,39 @@ namespace apsi {
             bool stripped_;
 
             /**
-            All the BinBundles in the database, indexed by bundle index. The set (represented by a
-            vector internally) at bundle index i contains all the BinBundles with bundle index i.
+            The range of bundle indices held by the SenderDB. This is the full range unless the
+            SenderDB is a shard.
+            */
+            std::uint32_t bundle_idx_begin_;
+
+            std::uint32_t bundle_idx_end_;
+
+            /**
+            The packing rate below which removals trigger compaction; zero disables compaction.
+            */
+            double compaction_threshold_ = 0.0;
+
+            /**
+            The policy for choosing the BinBundle new items are inserted into.
+            */
+            PlacementPolicy placement_policy_ = PlacementPolicy::first_fit;
+
+            /**
+            Indicates whether item_index_ is maintained.
+            */
+            bool item_index_enabled_ = false;
+
+            /**
+            The locations of the BinBundles holding each item in the current snapshot, if the item
+            index is enabled. It is modified together with hashed_items_.
+            */
+            util::ItemIndex item_index_;
+
+            /**
+            The current snapshot holds all the BinBundles in the database, indexed by bundle index,
+            and the number of items.
             */
-            std::vector<std::vector<BinBundle>> bin_bundles_;
+            std::shared_ptr<const SenderDBSnapshot> snapshot_;
 
             /**
             Holds the OPRF key for this SenderDB.
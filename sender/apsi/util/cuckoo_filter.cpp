@@ -43,6 +43,21 @@ CuckooFilter::CuckooFilter(size_t key_count_max, size_t bits_per_tag) : num_item
     table_ = make_unique<CuckooFilterTable>(key_count_max, bits_per_tag);
 }
 
+CuckooFilter::CuckooFilter(const CuckooFilter &copy)
+    : num_items_(copy.num_items_), overflow_(copy.overflow_),
+      table_(make_unique<CuckooFilterTable>(*copy.table_))
+{}
+
+CuckooFilter &CuckooFilter::operator=(const CuckooFilter &assign)
+{
+    if (&assign != this) {
+        num_items_ = assign.num_items_;
+        overflow_ = assign.overflow_;
+        table_ = make_unique<CuckooFilterTable>(*assign.table_);
+    }
+    return *this;
+}
+
 bool CuckooFilter::contains(gsl::span<const uint64_t> item) const
 {
     size_t idx1, idx2;
@@ -29,6 +29,20 @@ namespace apsi {
                 */
                 CuckooFilter(std::size_t key_count_max, std::size_t bits_per_tag);
 
+                /**
+                Creates a copy of an existing Cuckoo Filter.
+                */
+                CuckooFilter(const CuckooFilter &copy);
+
+                CuckooFilter(CuckooFilter &&source) = default;
+
+                /**
+                Copies an existing Cuckoo Filter to the current one.
+                */
+                CuckooFilter &operator=(const CuckooFilter &assign);
+
+                CuckooFilter &operator=(CuckooFilter &&assign) = default;
+
                 /**
                 Indicates whether the given item is contained in the filter
                 */
@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+
+// APSI
+#include "apsi/util/flat_table.h"
+
+using namespace std;
+
+namespace apsi {
+    namespace sender {
+        namespace util {
+            namespace flat_table {
+                size_t slot_count_for(size_t item_count)
+                {
+                    size_t slot_count = group_size;
+                    while (slot_count / 8 * 7 < item_count) {
+                        slot_count *= 2;
+                    }
+                    return slot_count;
+                }
+
+                size_t rehash_slot_count(size_t slot_count, size_t item_count, size_t deleted_count)
+                {
+                    if (item_count + deleted_count + 1 > slot_count / 8 * 7) {
+                        return max(slot_count, slot_count_for(2 * (item_count + 1)));
+                    }
+                    return 0;
+                }
+
+                size_t find_free_slot(const vector<uint8_t> &ctrl, uint64_t hash)
+                {
+                    size_t group_mask = ctrl.size() / group_size - 1;
+                    size_t group_idx = static_cast<size_t>(hash >> 7) & group_mask;
+                    for (size_t probe = 1;; probe++) {
+                        size_t group_start = group_idx * group_size;
+                        uint64_t match =
+                            match_empty_or_deleted(load_group(ctrl.data() + group_start));
+                        if (match) {
+                            return group_start + lowest_match(match);
+                        }
+                        group_idx = (group_idx + probe) & group_mask;
+                    }
+                }
+
+                uint8_t erased_ctrl(const vector<uint8_t> &ctrl, size_t slot_idx)
+                {
+                    // A group with an empty slot has never been full, so no lookup has probed past
+                    // it, and the slot can be marked empty instead of deleted
+                    const uint8_t *group_ctrl = ctrl.data() + (slot_idx - slot_idx % group_size);
+                    return match_empty(load_group(group_ctrl)) ? ctrl_empty : ctrl_deleted;
+                }
+
+                size_t next_full_slot(const vector<uint8_t> &ctrl, size_t slot_idx)
+                {
+                    while (slot_idx < ctrl.size() && !is_full(ctrl[slot_idx])) {
+                        slot_idx++;
+                    }
+                    return slot_idx;
+                }
+            } // namespace flat_table
+        }     // namespace util
+    }         // namespace sender
+} // namespace apsi
@@ -0,0 +1,206 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// APSI
+#include "apsi/item.h"
+
+namespace apsi {
+    namespace sender {
+        namespace util {
+            /**
+            The control bytes and probing shared by the flat open-addressing hash tables keyed by
+            HashedItem, i.e., HashedItemSet and ItemIndex. A table stores its slots in one array and
+            one control byte per slot in a parallel array. A control byte marks the slot as empty,
+            as deleted, or as full; a full slot's control byte holds 7 bits of the item's hash.
+            Lookups compare the control bytes of a group of 8 slots at a time with bit-parallel
+            operations on a 64-bit word, and compare items only for slots whose control byte
+            matches. The number of slots is a power of two and at least 8/7 times the number of
+            full and deleted slots.
+            */
+            namespace flat_table {
+                /**
+                Control bytes of slots that do not hold an item. A full slot's control byte is the
+                low 7 bits of the item's hash, so its high bit is zero.
+                */
+                constexpr std::uint8_t ctrl_empty = 0x80;
+
+                constexpr std::uint8_t ctrl_deleted = 0xFE;
+
+                /**
+                The number of slots whose control bytes are compared at once.
+                */
+                constexpr std::size_t group_size = 8;
+
+                constexpr std::uint64_t group_lsbs = 0x0101010101010101ULL;
+
+                constexpr std::uint64_t group_msbs = 0x8080808080808080ULL;
+
+                /**
+                Mixes both words of a HashedItem into a 64-bit hash. The items are normally outputs
+                of the OPRF and therefore uniformly random, but the mixing keeps the table
+                efficient for any items.
+                */
+                inline std::uint64_t hash_item(const HashedItem &item)
+                {
+                    auto words = item.get_as<std::uint64_t>();
+                    std::uint64_t hash = words[0] ^ (words[1] * 0x9E3779B97F4A7C15ULL);
+                    hash ^= hash >> 32;
+                    hash *= 0xD6E8FEB86659FD93ULL;
+                    hash ^= hash >> 32;
+                    return hash;
+                }
+
+                inline std::uint8_t hash_ctrl(std::uint64_t hash)
+                {
+                    return static_cast<std::uint8_t>(hash & 0x7F);
+                }
+
+                inline bool is_full(std::uint8_t ctrl)
+                {
+                    return !(ctrl & 0x80);
+                }
+
+                /**
+                Loads the control bytes of a group into a word, the control byte of the first slot
+                being the least significant byte.
+                */
+                inline std::uint64_t load_group(const std::uint8_t *ctrl)
+                {
+                    std::uint64_t group = 0;
+                    for (std::size_t i = group_size; i-- > 0;) {
+                        group = (group << 8) | ctrl[i];
+                    }
+                    return group;
+                }
+
+                /**
+                Returns a word whose bytes have the high bit set for the control bytes equal to the
+                given full-slot control byte. This may also set a few bits for other bytes, so the
+                items in the matched slots must still be compared.
+                */
+                inline std::uint64_t match_ctrl(std::uint64_t group, std::uint8_t ctrl)
+                {
+                    std::uint64_t x = group ^ (group_lsbs * ctrl);
+                    return (x - group_lsbs) & ~x & group_msbs;
+                }
+
+                /**
+                Returns a word whose bytes have the high bit set exactly for the empty control
+                bytes.
+                */
+                inline std::uint64_t match_empty(std::uint64_t group)
+                {
+                    return group & (~group << 6) & group_msbs;
+                }
+
+                /**
+                Returns a word whose bytes have the high bit set exactly for the empty or deleted
+                control bytes.
+                */
+                inline std::uint64_t match_empty_or_deleted(std::uint64_t group)
+                {
+                    return group & ~(group << 7) & group_msbs;
+                }
+
+                /**
+                Returns the index of the lowest byte with the high bit set in a non-zero match
+                word.
+                */
+                inline std::size_t lowest_match(std::uint64_t match)
+                {
+                    std::size_t byte_idx = 0;
+                    while (!(match & 0x80)) {
+                        match >>= 8;
+                        byte_idx++;
+                    }
+                    return byte_idx;
+                }
+
+                /**
+                Returns the smallest number of slots that can hold the given number of items.
+                */
+                std::size_t slot_count_for(std::size_t item_count);
+
+                /**
+                Returns the number of slots to rehash a table to before one more item is inserted,
+                given its number of slots, items, and deleted slots, or zero if no rehash is
+                needed. Full and deleted slots may take up at most 7/8 of the table. When that
+                limit is reached, the table is doubled if it is at least half full of items;
+                otherwise rehashing at the same size only clears the deleted slots.
+                */
+                std::size_t rehash_slot_count(
+                    std::size_t slot_count, std::size_t item_count, std::size_t deleted_count);
+
+                /**
+                Finds the slot holding the given item, whose hash is given. The item in a full slot
+                is returned by item_at for the slot index. Returns the number of slots if the item
+                is not in the table.
+                */
+                template <typename ItemAt>
+                std::size_t find_slot(
+                    const std::vector<std::uint8_t> &ctrl,
+                    const HashedItem &item,
+                    std::uint64_t hash,
+                    ItemAt &&item_at)
+                {
+                    std::size_t group_count = ctrl.size() / group_size;
+                    if (!group_count) {
+                        return ctrl.size();
+                    }
+
+                    // Probe the groups in triangular order, which visits every group since the
+                    // number of groups is a power of two. The probe ends at a group with an empty
+                    // slot.
+                    std::size_t group_mask = group_count - 1;
+                    std::size_t group_idx = static_cast<std::size_t>(hash >> 7) & group_mask;
+                    std::uint8_t item_ctrl = hash_ctrl(hash);
+                    for (std::size_t probe = 1; probe <= group_count; probe++) {
+                        std::size_t group_start = group_idx * group_size;
+                        std::uint64_t group = load_group(ctrl.data() + group_start);
+                        for (std::uint64_t match = match_ctrl(group, item_ctrl); match;
+                             match &= match - 1) {
+                            std::size_t slot_idx = group_start + lowest_match(match);
+                            if (item_at(slot_idx) == item) {
+                                return slot_idx;
+                            }
+                        }
+                        if (match_empty(group)) {
+                            break;
+                        }
+                        group_idx = (group_idx + probe) & group_mask;
+                    }
+
+                    return ctrl.size();
+                }
+
+                /**
+                Returns the first empty or deleted slot in the probe sequence of the given hash.
+                The table must have such a slot.
+                */
+                std::size_t find_free_slot(
+                    const std::vector<std::uint8_t> &ctrl, std::uint64_t hash);
+
+                /**
+                Returns the control byte for the slot with the given index when its item is erased:
+                empty if no lookup can have probed past the slot, and deleted otherwise.
+                */
+                std::uint8_t erased_ctrl(
+                    const std::vector<std::uint8_t> &ctrl, std::size_t slot_idx);
+
+                /**
+                Returns the index of the first full slot at or after the given index, or the number
+                of slots if there is none.
+                */
+                std::size_t next_full_slot(
+                    const std::vector<std::uint8_t> &ctrl, std::size_t slot_idx);
+            } // namespace flat_table
+        }     // namespace util
+    }         // namespace sender
+} // namespace apsi
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <utility>
+
+// APSI
+#include "apsi/util/flat_table.h"
+#include "apsi/util/hashed_item_set.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::sender::util;
+using namespace apsi::sender::util::flat_table;
+
+HashedItemSet::const_iterator HashedItemSet::find(const HashedItem &item) const
+{
+    return const_iterator(this, find_slot(item, hash_item(item)));
+}
+
+bool HashedItemSet::insert(const HashedItem &item)
+{
+    uint64_t hash = hash_item(item);
+    if (find_slot(item, hash) != slots_.size()) {
+        return false;
+    }
+
+    size_t slot_count = rehash_slot_count(slots_.size(), size_, deleted_count_);
+    if (slot_count) {
+        rehash(slot_count);
+    }
+
+    insert_new(item, hash);
+    return true;
+}
+
+size_t HashedItemSet::erase(const HashedItem &item)
+{
+    size_t slot_idx = find_slot(item, hash_item(item));
+    if (slot_idx == slots_.size()) {
+        return 0;
+    }
+
+    ctrl_[slot_idx] = erased_ctrl(ctrl_, slot_idx);
+    if (ctrl_[slot_idx] == ctrl_deleted) {
+        deleted_count_++;
+    }
+    size_--;
+
+    return 1;
+}
+
+void HashedItemSet::clear()
+{
+    slots_ = vector<HashedItem>();
+    ctrl_ = vector<uint8_t>();
+    size_ = 0;
+    deleted_count_ = 0;
+}
+
+void HashedItemSet::reserve(size_t item_count)
+{
+    size_t slot_count = slot_count_for(item_count);
+    if (slot_count > slots_.size()) {
+        rehash(slot_count);
+    }
+}
+
+size_t HashedItemSet::find_slot(const HashedItem &item, uint64_t hash) const
+{
+    return flat_table::find_slot(
+        ctrl_, item, hash, [this](size_t slot_idx) -> const HashedItem & {
+            return slots_[slot_idx];
+        });
+}
+
+size_t HashedItemSet::next_full_slot(size_t slot_idx) const
+{
+    return flat_table::next_full_slot(ctrl_, slot_idx);
+}
+
+void HashedItemSet::rehash(size_t slot_count)
+{
+    vector<HashedItem> old_slots(slot_count);
+    vector<uint8_t> old_ctrl(slot_count, ctrl_empty);
+    swap(old_slots, slots_);
+    swap(old_ctrl, ctrl_);
+    size_ = 0;
+    deleted_count_ = 0;
+
+    for (size_t slot_idx = 0; slot_idx < old_ctrl.size(); slot_idx++) {
+        if (is_full(old_ctrl[slot_idx])) {
+            insert_new(old_slots[slot_idx], hash_item(old_slots[slot_idx]));
+        }
+    }
+}
+
+void HashedItemSet::insert_new(const HashedItem &item, uint64_t hash)
+{
+    size_t slot_idx = find_free_slot(ctrl_, hash);
+    if (ctrl_[slot_idx] == ctrl_deleted) {
+        deleted_count_--;
+    }
+    ctrl_[slot_idx] = hash_ctrl(hash);
+    slots_[slot_idx] = item;
+    size_++;
+}
@@ -0,0 +1,242 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// APSI
+#include "apsi/item.h"
+
+namespace apsi {
+    namespace sender {
+        namespace util {
+            /**
+            A set of HashedItems stored in a flat open-addressing hash table. Unlike
+            std::unordered_set, which allocates a node for every item, the items are stored in a
+            single array of slots, with a parallel array holding one control byte per slot. A
+            control byte marks the slot as empty, as deleted, or as full; a full slot's control
+            byte holds 7 bits of the item's hash. Lookups compare the control bytes of a group of
+            8 slots at a time with bit-parallel operations on a 64-bit word, and compare items
+            only for slots whose control byte matches.
+
+            The number of slots is a power of two and at least 8/7 times the number of full and
+            deleted slots. The iteration order is unspecified. Iterators are invalidated by
+            insertions and erasures.
+            */
+            class HashedItemSet {
+            public:
+                /**
+                A forward iterator over the items in a HashedItemSet.
+                */
+                class const_iterator {
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = HashedItem;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = const HashedItem *;
+                    using reference = const HashedItem &;
+
+                    const_iterator() = default;
+
+                    reference operator*() const
+                    {
+                        return set_->slots_[slot_idx_];
+                    }
+
+                    pointer operator->() const
+                    {
+                        return &set_->slots_[slot_idx_];
+                    }
+
+                    const_iterator &operator++()
+                    {
+                        slot_idx_ = set_->next_full_slot(slot_idx_ + 1);
+                        return *this;
+                    }
+
+                    const_iterator operator++(int)
+                    {
+                        const_iterator result = *this;
+                        ++*this;
+                        return result;
+                    }
+
+                    bool operator==(const const_iterator &other) const
+                    {
+                        return set_ == other.set_ && slot_idx_ == other.slot_idx_;
+                    }
+
+                    bool operator!=(const const_iterator &other) const
+                    {
+                        return !(*this == other);
+                    }
+
+                private:
+                    const_iterator(const HashedItemSet *set, std::size_t slot_idx)
+                        : set_(set), slot_idx_(slot_idx)
+                    {}
+
+                    const HashedItemSet *set_ = nullptr;
+
+                    std::size_t slot_idx_ = 0;
+
+                    friend class HashedItemSet;
+                };
+
+                using iterator = const_iterator;
+
+                HashedItemSet() = default;
+
+                HashedItemSet(const HashedItemSet &copy) = default;
+
+                /**
+                Creates a HashedItemSet by moving from an existing one, which is left empty.
+                */
+                HashedItemSet(HashedItemSet &&source) noexcept
+                    : slots_(std::move(source.slots_)), ctrl_(std::move(source.ctrl_)),
+                      size_(std::exchange(source.size_, 0)),
+                      deleted_count_(std::exchange(source.deleted_count_, 0))
+                {
+                    source.slots_.clear();
+                    source.ctrl_.clear();
+                }
+
+                HashedItemSet &operator=(const HashedItemSet &assign) = default;
+
+                /**
+                Moves an existing HashedItemSet to the current one, leaving it empty.
+                */
+                HashedItemSet &operator=(HashedItemSet &&assign) noexcept
+                {
+                    if (&assign != this) {
+                        slots_ = std::move(assign.slots_);
+                        ctrl_ = std::move(assign.ctrl_);
+                        size_ = std::exchange(assign.size_, 0);
+                        deleted_count_ = std::exchange(assign.deleted_count_, 0);
+                        assign.slots_.clear();
+                        assign.ctrl_.clear();
+                    }
+                    return *this;
+                }
+
+                /**
+                Returns the number of items in the set.
+                */
+                std::size_t size() const noexcept
+                {
+                    return size_;
+                }
+
+                /**
+                Returns whether the set is empty.
+                */
+                bool empty() const noexcept
+                {
+                    return !size_;
+                }
+
+                /**
+                Returns the number of slots in the table.
+                */
+                std::size_t capacity() const noexcept
+                {
+                    return slots_.size();
+                }
+
+                const_iterator begin() const
+                {
+                    return const_iterator(this, next_full_slot(0));
+                }
+
+                const_iterator end() const
+                {
+                    return const_iterator(this, slots_.size());
+                }
+
+                /**
+                Returns an iterator to the given item, or end() if the item is not in the set.
+                */
+                const_iterator find(const HashedItem &item) const;
+
+                /**
+                Returns whether the given item is in the set.
+                */
+                bool contains(const HashedItem &item) const
+                {
+                    return find(item) != end();
+                }
+
+                /**
+                Inserts the given item. Returns true if the item was inserted, and false if it was
+                already in the set.
+                */
+                bool insert(const HashedItem &item);
+
+                /**
+                Inserts the items in the given range.
+                */
+                template <typename InputIt>
+                void insert(InputIt first, InputIt last)
+                {
+                    for (; first != last; ++first) {
+                        insert(*first);
+                    }
+                }
+
+                /**
+                Removes the given item. Returns the number of items removed.
+                */
+                std::size_t erase(const HashedItem &item);
+
+                /**
+                Removes all items and releases the table.
+                */
+                void clear();
+
+                /**
+                Grows the table so that the given number of items can be held without rehashing.
+                */
+                void reserve(std::size_t item_count);
+
+            private:
+                /**
+                Finds the slot holding the given item. Returns the number of slots if the item is
+                not in the set.
+                */
+                std::size_t find_slot(const HashedItem &item, std::uint64_t hash) const;
+
+                /**
+                Returns the index of the first full slot at or after the given index, or the number
+                of slots if there is none.
+                */
+                std::size_t next_full_slot(std::size_t slot_idx) const;
+
+                /**
+                Moves all items to a new table with the given number of slots, which must be a
+                power of two, at least 8, and large enough to hold the items.
+                */
+                void rehash(std::size_t slot_count);
+
+                /**
+                Stores the given item, which must not be in the set, in the first empty or deleted
+                slot in its probe sequence.
+                */
+                void insert_new(const HashedItem &item, std::uint64_t hash);
+
+                std::vector<HashedItem> slots_;
+
+                std::vector<std::uint8_t> ctrl_;
+
+                std::size_t size_ = 0;
+
+                std::size_t deleted_count_ = 0;
+            }; // class HashedItemSet
+        }      // namespace util
+    }          // namespace sender
+} // namespace apsi
@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <stdexcept>
+#include <utility>
+
+// APSI
+#include "apsi/util/flat_table.h"
+#include "apsi/util/item_index.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::sender::util;
+using namespace apsi::sender::util::flat_table;
+
+void ItemLocations::push_back(const ItemLocation &location)
+{
+    if (size_ == max_size) {
+        throw length_error("too many item locations");
+    }
+    locations_[size_++] = location;
+}
+
+size_t BundleRemap::remap(size_t bundle_pos, size_t bin_idx, size_t felts_per_item) const
+{
+    // Compaction may have moved the item more than once
+    auto moved_it = moved_groups.find(bundle_pos);
+    while (moved_it != moved_groups.end()) {
+        bundle_pos = moved_it->second[bin_idx / felts_per_item];
+        moved_it = moved_groups.find(bundle_pos);
+    }
+
+    if (new_positions.empty()) {
+        return bundle_pos;
+    }
+    return bundle_pos < new_positions.size() ? new_positions[bundle_pos] : no_bundle_pos;
+}
+
+ItemIndex::ItemIndex(const PSIParams &params)
+    : bundle_idx_count_(params.bundle_idx_count()), bins_per_bundle_(params.bins_per_bundle()),
+      felts_per_item_(params.item_params().felts_per_item), pending_remaps_(bundle_idx_count_),
+      remap_counts_(bundle_idx_count_, 0)
+{}
+
+size_t ItemIndex::find_bundle_pos(const HashedItem &item, size_t cuckoo_idx) const
+{
+    size_t slot_idx = find_slot(item, hash_item(item));
+    if (slot_idx == slots_.size()) {
+        return no_bundle_pos;
+    }
+
+    for (ItemLocation location : slots_[slot_idx].locations) {
+        if (location.cuckoo_idx == cuckoo_idx) {
+            apply_remaps(location);
+            return location.bundle_pos;
+        }
+    }
+
+    return no_bundle_pos;
+}
+
+ItemLocations ItemIndex::get_locations(const Entry &entry) const
+{
+    ItemLocations result = entry.locations;
+    for (auto &location : result) {
+        apply_remaps(location);
+    }
+
+    return result;
+}
+
+void ItemIndex::insert_or_assign(const HashedItem &item, const ItemLocations &locations)
+{
+    // The positions reflect all remaps so far
+    Entry entry{ item, locations };
+    for (auto &location : entry.locations) {
+        location.remap_count = remap_counts_[get_bundle_idx(location)];
+    }
+
+    uint64_t hash = hash_item(item);
+    size_t slot_idx = find_slot(item, hash);
+    if (slot_idx != slots_.size()) {
+        slots_[slot_idx] = entry;
+        return;
+    }
+
+    size_t slot_count = rehash_slot_count(slots_.size(), size_, deleted_count_);
+    if (slot_count) {
+        rehash(slot_count);
+    }
+
+    insert_new(entry, hash);
+}
+
+size_t ItemIndex::erase(const HashedItem &item)
+{
+    size_t slot_idx = find_slot(item, hash_item(item));
+    if (slot_idx == slots_.size()) {
+        return 0;
+    }
+
+    ctrl_[slot_idx] = erased_ctrl(ctrl_, slot_idx);
+    if (ctrl_[slot_idx] == ctrl_deleted) {
+        deleted_count_++;
+    }
+    size_--;
+
+    return 1;
+}
+
+void ItemIndex::remap(const vector<BundleRemap> &remaps)
+{
+    bool flush = false;
+    for (size_t bundle_idx = 0; bundle_idx < remaps.size(); bundle_idx++) {
+        if (remaps[bundle_idx].empty()) {
+            continue;
+        }
+
+        pending_remaps_[bundle_idx].push_back(remaps[bundle_idx]);
+        remap_counts_[bundle_idx]++;
+        flush = flush || pending_remaps_[bundle_idx].size() > max_pending_remaps;
+    }
+
+    if (flush) {
+        flush_remaps();
+    }
+}
+
+void ItemIndex::clear()
+{
+    slots_ = vector<Entry>();
+    ctrl_ = vector<uint8_t>();
+    size_ = 0;
+    deleted_count_ = 0;
+    pending_remaps_ = vector<vector<BundleRemap>>(bundle_idx_count_);
+    remap_counts_.assign(bundle_idx_count_, 0);
+}
+
+void ItemIndex::reserve(size_t item_count)
+{
+    size_t slot_count = slot_count_for(item_count);
+    if (slot_count > slots_.size()) {
+        rehash(slot_count);
+    }
+}
+
+size_t ItemIndex::find_slot(const HashedItem &item, uint64_t hash) const
+{
+    return flat_table::find_slot(
+        ctrl_, item, hash, [this](size_t slot_idx) -> const HashedItem & {
+            return slots_[slot_idx].item;
+        });
+}
+
+size_t ItemIndex::next_full_slot(size_t slot_idx) const
+{
+    return flat_table::next_full_slot(ctrl_, slot_idx);
+}
+
+void ItemIndex::rehash(size_t slot_count)
+{
+    vector<Entry> old_slots(slot_count);
+    vector<uint8_t> old_ctrl(slot_count, ctrl_empty);
+    swap(old_slots, slots_);
+    swap(old_ctrl, ctrl_);
+    size_ = 0;
+    deleted_count_ = 0;
+
+    for (size_t slot_idx = 0; slot_idx < old_ctrl.size(); slot_idx++) {
+        if (is_full(old_ctrl[slot_idx])) {
+            insert_new(old_slots[slot_idx], hash_item(old_slots[slot_idx].item));
+        }
+    }
+}
+
+void ItemIndex::insert_new(const Entry &entry, uint64_t hash)
+{
+    size_t slot_idx = find_free_slot(ctrl_, hash);
+    if (ctrl_[slot_idx] == ctrl_deleted) {
+        deleted_count_--;
+    }
+    ctrl_[slot_idx] = hash_ctrl(hash);
+    slots_[slot_idx] = entry;
+    size_++;
+}
+
+size_t ItemIndex::get_bundle_idx(const ItemLocation &location) const
+{
+    return static_cast<size_t>(location.cuckoo_idx / bins_per_bundle_);
+}
+
+void ItemIndex::apply_remaps(ItemLocation &location) const
+{
+    size_t bundle_idx = get_bundle_idx(location);
+    const vector<BundleRemap> &pending = pending_remaps_[bundle_idx];
+
+    // The pending remaps are the last ones recorded for the bundle index
+    size_t first_pending = remap_counts_[bundle_idx] - pending.size();
+    size_t bin_idx = static_cast<size_t>(location.cuckoo_idx % bins_per_bundle_);
+    size_t bundle_pos = location.bundle_pos;
+    for (size_t i = location.remap_count - first_pending; i < pending.size(); i++) {
+        bundle_pos = pending[i].remap(bundle_pos, bin_idx, felts_per_item_);
+    }
+    location.bundle_pos = static_cast<uint32_t>(bundle_pos);
+    location.remap_count = remap_counts_[bundle_idx];
+}
+
+void ItemIndex::flush_remaps()
+{
+    for (size_t slot_idx = 0; slot_idx < slots_.size(); slot_idx++) {
+        if (is_full(ctrl_[slot_idx])) {
+            for (auto &location : slots_[slot_idx].locations) {
+                apply_remaps(location);
+            }
+        }
+    }
+
+    for (auto &pending : pending_remaps_) {
+        pending.clear();
+    }
+}
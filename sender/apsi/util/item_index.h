@@ -0,0 +1,364 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+// APSI
+#include "apsi/item.h"
+#include "apsi/psi_params.h"
+
+namespace apsi {
+    namespace sender {
+        namespace util {
+            /**
+            Marks a BinBundle position that is not known or no longer exists.
+            */
+            constexpr std::size_t no_bundle_pos = std::numeric_limits<std::size_t>::max();
+
+            /**
+            The position of the BinBundle holding an item at one of the item's cuckoo table
+            locations, as recorded by an ItemIndex.
+            */
+            struct ItemLocation {
+                /**
+                The index of the first bin the item occupies, counting past bundle boundaries.
+                */
+                std::uint32_t cuckoo_idx;
+
+                /**
+                The position of the BinBundle among the BinBundles at the bundle index. A position
+                past the last BinBundle means the position is not known.
+                */
+                std::uint32_t bundle_pos;
+
+                /**
+                The number of remaps of the BinBundles at the bundle index that bundle_pos
+                reflects; see ItemIndex::remap.
+                */
+                std::uint32_t remap_count;
+            };
+
+            /**
+            The locations of an item, stored inline. An item has one location for each distinct
+            cuckoo table location, so at most hash_func_count_max.
+            */
+            class ItemLocations {
+            public:
+                static constexpr std::size_t max_size =
+                    PSIParams::TableParams::hash_func_count_max;
+
+                std::size_t size() const noexcept
+                {
+                    return size_;
+                }
+
+                bool empty() const noexcept
+                {
+                    return !size_;
+                }
+
+                const ItemLocation *begin() const noexcept
+                {
+                    return locations_.data();
+                }
+
+                const ItemLocation *end() const noexcept
+                {
+                    return locations_.data() + size_;
+                }
+
+                ItemLocation *begin() noexcept
+                {
+                    return locations_.data();
+                }
+
+                ItemLocation *end() noexcept
+                {
+                    return locations_.data() + size_;
+                }
+
+                /**
+                Appends a location. Throws std::length_error if there are already max_size
+                locations.
+                */
+                void push_back(const ItemLocation &location);
+
+            private:
+                std::array<ItemLocation, max_size> locations_{};
+
+                std::uint8_t size_ = 0;
+            };
+
+            /**
+            Describes how the BinBundles at one bundle index were moved by an update that removed
+            BinBundles, so that an ItemIndex can follow the items.
+            */
+            struct BundleRemap {
+                /**
+                The new position of the BinBundle at each old position, or no_bundle_pos if the
+                BinBundle was removed. Empty if no BinBundle was removed.
+                */
+                std::vector<std::size_t> new_positions;
+
+                /**
+                For each BinBundle emptied by compaction, the position of the BinBundle each group
+                of felts_per_item bins was moved to.
+                */
+                std::unordered_map<std::size_t, std::vector<std::size_t>> moved_groups;
+
+                bool empty() const
+                {
+                    return new_positions.empty() && moved_groups.empty();
+                }
+
+                /**
+                Returns the new position of the BinBundle holding an item that was held by the
+                BinBundle at the given position, starting at the given bin index.
+                */
+                std::size_t remap(
+                    std::size_t bundle_pos, std::size_t bin_idx, std::size_t felts_per_item) const;
+            };
+
+            /**
+            Maps each item of a SenderDB to its locations, stored in a flat open-addressing hash
+            table like HashedItemSet, with the locations inline in the slots.
+
+            Updates that remove BinBundles move the BinBundles after them. Instead of updating the
+            locations of all items right away, the index records the BundleRemap of each bundle
+            index, and each location records how many remaps of its bundle index it reflects. A
+            lookup applies the remaps the location has not seen yet. Once a bundle index has more
+            than max_pending_remaps remaps that not all locations have seen, the remaps are applied
+            to all locations in one pass, so that lookups stay fast.
+            */
+            class ItemIndex {
+            public:
+                /**
+                The number of remaps of a bundle index that lookups may have to apply.
+                */
+                static constexpr std::size_t max_pending_remaps = 8;
+
+                /**
+                An item and its locations as last recorded. Use ItemIndex::get_locations for the
+                current positions. The item is aligned so that it can be read as 64-bit words.
+                */
+                struct alignas(std::uint64_t) Entry {
+                    HashedItem item;
+
+                    ItemLocations locations;
+                };
+
+                /**
+                A forward iterator over the entries in an ItemIndex.
+                */
+                class const_iterator {
+                public:
+                    using iterator_category = std::forward_iterator_tag;
+                    using value_type = Entry;
+                    using difference_type = std::ptrdiff_t;
+                    using pointer = const Entry *;
+                    using reference = const Entry &;
+
+                    const_iterator() = default;
+
+                    reference operator*() const
+                    {
+                        return index_->slots_[slot_idx_];
+                    }
+
+                    pointer operator->() const
+                    {
+                        return &index_->slots_[slot_idx_];
+                    }
+
+                    const_iterator &operator++()
+                    {
+                        slot_idx_ = index_->next_full_slot(slot_idx_ + 1);
+                        return *this;
+                    }
+
+                    const_iterator operator++(int)
+                    {
+                        const_iterator result = *this;
+                        ++*this;
+                        return result;
+                    }
+
+                    bool operator==(const const_iterator &other) const
+                    {
+                        return index_ == other.index_ && slot_idx_ == other.slot_idx_;
+                    }
+
+                    bool operator!=(const const_iterator &other) const
+                    {
+                        return !(*this == other);
+                    }
+
+                private:
+                    const_iterator(const ItemIndex *index, std::size_t slot_idx)
+                        : index_(index), slot_idx_(slot_idx)
+                    {}
+
+                    const ItemIndex *index_ = nullptr;
+
+                    std::size_t slot_idx_ = 0;
+
+                    friend class ItemIndex;
+                };
+
+                using iterator = const_iterator;
+
+                ItemIndex() = default;
+
+                /**
+                Creates an empty ItemIndex for a SenderDB with the given PSIParams.
+                */
+                ItemIndex(const PSIParams &params);
+
+                /**
+                Returns the number of items in the index.
+                */
+                std::size_t size() const noexcept
+                {
+                    return size_;
+                }
+
+                /**
+                Returns whether the index is empty.
+                */
+                bool empty() const noexcept
+                {
+                    return !size_;
+                }
+
+                /**
+                Returns the number of slots in the table.
+                */
+                std::size_t capacity() const noexcept
+                {
+                    return slots_.size();
+                }
+
+                const_iterator begin() const
+                {
+                    return const_iterator(this, next_full_slot(0));
+                }
+
+                const_iterator end() const
+                {
+                    return const_iterator(this, slots_.size());
+                }
+
+                /**
+                Returns the current position of the BinBundle holding the given item at the given
+                cuckoo index, or no_bundle_pos if the item or the location is not in the index.
+                */
+                std::size_t find_bundle_pos(const HashedItem &item, std::size_t cuckoo_idx) const;
+
+                /**
+                Returns the locations of the given entry with their current positions.
+                */
+                ItemLocations get_locations(const Entry &entry) const;
+
+                /**
+                Sets the locations of the given item. The positions must be those in the
+                BinBundles after all remaps recorded so far.
+                */
+                void insert_or_assign(const HashedItem &item, const ItemLocations &locations);
+
+                /**
+                Removes the given item. Returns the number of items removed.
+                */
+                std::size_t erase(const HashedItem &item);
+
+                /**
+                Records how the BinBundles were moved by an update. The given vector holds an
+                element for each bundle index.
+                */
+                void remap(const std::vector<BundleRemap> &remaps);
+
+                /**
+                Removes all items and remaps and releases the table.
+                */
+                void clear();
+
+                /**
+                Grows the table so that the given number of items can be held without rehashing.
+                */
+                void reserve(std::size_t item_count);
+
+            private:
+                /**
+                Finds the slot holding the given item. Returns the number of slots if the item is
+                not in the index.
+                */
+                std::size_t find_slot(const HashedItem &item, std::uint64_t hash) const;
+
+                /**
+                Returns the index of the first full slot at or after the given index, or the number
+                of slots if there is none.
+                */
+                std::size_t next_full_slot(std::size_t slot_idx) const;
+
+                /**
+                Moves all entries to a new table with the given number of slots, which must be a
+                power of two, at least 8, and large enough to hold the entries.
+                */
+                void rehash(std::size_t slot_count);
+
+                /**
+                Stores the given entry, whose item must not be in the index, in the first empty or
+                deleted slot in its probe sequence.
+                */
+                void insert_new(const Entry &entry, std::uint64_t hash);
+
+                /**
+                Returns the bundle index of the given location.
+                */
+                std::size_t get_bundle_idx(const ItemLocation &location) const;
+
+                /**
+                Applies the remaps of its bundle index that the given location has not seen.
+                */
+                void apply_remaps(ItemLocation &location) const;
+
+                /**
+                Applies all pending remaps to all locations.
+                */
+                void flush_remaps();
+
+                std::vector<Entry> slots_;
+
+                std::vector<std::uint8_t> ctrl_;
+
+                std::size_t size_ = 0;
+
+                std::size_t deleted_count_ = 0;
+
+                std::uint32_t bundle_idx_count_ = 0;
+
+                std::uint32_t bins_per_bundle_ = 0;
+
+                std::size_t felts_per_item_ = 0;
+
+                /**
+                The remaps of each bundle index that not all locations have seen.
+                */
+                std::vector<std::vector<BundleRemap>> pending_remaps_;
+
+                /**
+                The number of remaps recorded for each bundle index.
+                */
+                std::vector<std::uint32_t> remap_counts_;
+            }; // class ItemIndex
+        }      // namespace util
+    }          // namespace sender
+} // namespace apsi
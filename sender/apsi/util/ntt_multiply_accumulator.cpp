@@ -0,0 +1,135 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+// APSI
+#include "apsi/util/ntt_multiply_accumulator.h"
+
+// SEAL
+#include "seal/util/common.h"
+#include "seal/util/uintarith.h"
+#include "seal/util/uintarithsmallmod.h"
+#include "seal/util/uintcore.h"
+
+using namespace std;
+using namespace seal;
+using namespace seal::util;
+using namespace apsi::sender::util;
+
+NTTMultiplyAccumulator::NTTMultiplyAccumulator(
+    const SEALContext &context, parms_id_type parms_id, MemoryPoolHandle pool)
+    : context_(context), parms_id_(parms_id), pool_(move(pool))
+{
+    auto context_data = context_.get_context_data(parms_id_);
+    if (!context_data) {
+        throw invalid_argument("parms_id is not valid for the SEALContext");
+    }
+
+    const auto &parms = context_data->parms();
+    coeff_modulus_ = parms.coeff_modulus();
+    poly_modulus_degree_ = parms.poly_modulus_degree();
+
+    // Each product is less than 2^(2 * max_bit_count), so we can add up to
+    // 2^(128 - 2 * max_bit_count) of them before the 128-bit accumulators could overflow.
+    int max_bit_count = 0;
+    for (const auto &mod : coeff_modulus_) {
+        max_bit_count = max(max_bit_count, mod.bit_count());
+    }
+    int headroom_bit_count = 128 - 2 * max_bit_count;
+    max_lazy_term_count_ = headroom_bit_count >= numeric_limits<size_t>::digits
+                               ? numeric_limits<size_t>::max()
+                               : size_t(1) << headroom_bit_count;
+}
+
+void NTTMultiplyAccumulator::multiply_plain_add(const Ciphertext &encrypted, const Plaintext &plain)
+{
+    if (!encrypted.is_ntt_form() || encrypted.parms_id() != parms_id_) {
+        throw invalid_argument("encrypted is not valid for the accumulator");
+    }
+    if (!plain.is_ntt_form() || plain.parms_id() != parms_id_) {
+        throw invalid_argument("plain is not valid for the accumulator");
+    }
+
+    size_t coeff_modulus_size = coeff_modulus_.size();
+    size_t poly_size = coeff_modulus_size * poly_modulus_degree_;
+
+    // Grow the accumulator if the ciphertext has more components than seen so far
+    if (encrypted.size() > size_) {
+        auto new_acc = allocate_zero_uint(mul_safe(encrypted.size(), poly_size, size_t(2)), pool_);
+        copy_n(acc_.get(), size_ * poly_size * 2, new_acc.get());
+        acc_ = move(new_acc);
+        size_ = encrypted.size();
+    }
+
+    if (term_count_ == max_lazy_term_count_) {
+        reduce();
+    }
+
+    for (size_t poly_idx = 0; poly_idx < encrypted.size(); poly_idx++) {
+        const uint64_t *ct_ptr = encrypted.data(poly_idx);
+        const uint64_t *pt_ptr = plain.data();
+        uint64_t *acc_ptr = acc_.get() + poly_idx * poly_size * 2;
+        for (size_t i = 0; i < poly_size; i++) {
+            unsigned long long prod[2];
+            multiply_uint64(ct_ptr[i], pt_ptr[i], prod);
+            unsigned char carry = add_uint64(acc_ptr[2 * i], prod[0], acc_ptr + 2 * i);
+            acc_ptr[2 * i + 1] += prod[1] + carry;
+        }
+    }
+
+    term_count_++;
+}
+
+void NTTMultiplyAccumulator::finalize(Ciphertext &destination) const
+{
+    destination.resize(context_, parms_id_, max<size_t>(size_, 2));
+    destination.is_ntt_form() = true;
+
+    size_t coeff_modulus_size = coeff_modulus_.size();
+    size_t poly_size = coeff_modulus_size * poly_modulus_degree_;
+    for (size_t poly_idx = 0; poly_idx < destination.size(); poly_idx++) {
+        uint64_t *dest_ptr = destination.data(poly_idx);
+        if (poly_idx >= size_) {
+            fill_n(dest_ptr, poly_size, uint64_t(0));
+            continue;
+        }
+
+        const uint64_t *acc_ptr = acc_.get() + poly_idx * poly_size * 2;
+        for (size_t j = 0; j < coeff_modulus_size; j++) {
+            const Modulus &mod = coeff_modulus_[j];
+            for (size_t i = j * poly_modulus_degree_; i < (j + 1) * poly_modulus_degree_; i++) {
+                dest_ptr[i] = barrett_reduce_128(acc_ptr + 2 * i, mod);
+            }
+        }
+    }
+}
+
+void NTTMultiplyAccumulator::reset()
+{
+    fill_n(acc_.get(), size_ * coeff_modulus_.size() * poly_modulus_degree_ * 2, uint64_t(0));
+    term_count_ = 0;
+}
+
+void NTTMultiplyAccumulator::reduce()
+{
+    size_t coeff_modulus_size = coeff_modulus_.size();
+    size_t poly_size = coeff_modulus_size * poly_modulus_degree_;
+    for (size_t poly_idx = 0; poly_idx < size_; poly_idx++) {
+        uint64_t *acc_ptr = acc_.get() + poly_idx * poly_size * 2;
+        for (size_t j = 0; j < coeff_modulus_size; j++) {
+            const Modulus &mod = coeff_modulus_[j];
+            for (size_t i = j * poly_modulus_degree_; i < (j + 1) * poly_modulus_degree_; i++) {
+                acc_ptr[2 * i] = barrett_reduce_128(acc_ptr + 2 * i, mod);
+                acc_ptr[2 * i + 1] = 0;
+            }
+        }
+    }
+
+    // The reduced values are less than any single product
+    term_count_ = 1;
+}
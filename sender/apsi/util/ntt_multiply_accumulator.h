@@ -0,0 +1,109 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// SEAL
+#include "seal/ciphertext.h"
+#include "seal/context.h"
+#include "seal/memorymanager.h"
+#include "seal/modulus.h"
+#include "seal/plaintext.h"
+#include "seal/util/pointer.h"
+
+namespace apsi {
+    namespace sender {
+        namespace util {
+            /**
+            Computes sums of products of NTT-form ciphertexts and NTT-form plaintexts, i.e., inner
+            products of the form Σ ctᵢ * ptᵢ. This is what the polynomial evaluation functions spend
+            most of their time on. Evaluator::multiply_plain followed by Evaluator::add_inplace
+            would fully reduce every product and every sum, and write each product out to a
+            temporary ciphertext. Instead, we accumulate the unreduced 128-bit products for every
+            RNS component and reduce only once at the end. The accumulators are reduced early only
+            if they could otherwise overflow. They are allocated from the given memory pool.
+            */
+            class NTTMultiplyAccumulator {
+            public:
+                /**
+                Creates an empty accumulator for ciphertexts and plaintexts at the given parms_id.
+                The SEALContext must outlive the accumulator. Throws std::invalid_argument if the
+                parms_id is not valid for the SEALContext.
+                */
+                NTTMultiplyAccumulator(
+                    const seal::SEALContext &context,
+                    seal::parms_id_type parms_id,
+                    seal::MemoryPoolHandle pool);
+
+                /**
+                Adds the product of the given NTT-form ciphertext and NTT-form plaintext to the
+                accumulated sum. Throws std::invalid_argument if either is not in NTT form or not
+                at the parms_id of the accumulator.
+                */
+                void multiply_plain_add(
+                    const seal::Ciphertext &encrypted, const seal::Plaintext &plain);
+
+                /**
+                Returns whether no products have been accumulated since the last reset.
+                */
+                bool empty() const noexcept
+                {
+                    return !term_count_;
+                }
+
+                /**
+                Returns the number of products that can be accumulated before the accumulators
+                must be reduced to avoid overflow.
+                */
+                std::size_t get_max_lazy_term_count() const noexcept
+                {
+                    return max_lazy_term_count_;
+                }
+
+                /**
+                Writes the fully reduced accumulated sum to the given ciphertext. The result is in
+                NTT form and has at least two components. If nothing has been accumulated, the
+                result is identically zero.
+                */
+                void finalize(seal::Ciphertext &destination) const;
+
+                /**
+                Clears the accumulated sum.
+                */
+                void reset();
+
+            private:
+                /**
+                Reduces all accumulators modulo their RNS primes so more products can be added.
+                */
+                void reduce();
+
+                const seal::SEALContext &context_;
+
+                seal::parms_id_type parms_id_;
+
+                std::vector<seal::Modulus> coeff_modulus_;
+
+                std::size_t poly_modulus_degree_ = 0;
+
+                std::size_t max_lazy_term_count_ = 0;
+
+                // Number of ciphertext components covered by the accumulator
+                std::size_t size_ = 0;
+
+                // Number of products accumulated since the last reduction
+                std::size_t term_count_ = 0;
+
+                seal::MemoryPoolHandle pool_;
+
+                // Interleaved low and high words of the 128-bit accumulators
+                seal::util::Pointer<std::uint64_t> acc_;
+            }; // class NTTMultiplyAccumulator
+        }      // namespace util
+    }          // namespace sender
+} // namespace apsi
@@ -0,0 +1,273 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+// APSI
+#include "apsi/util/plaintext_cache.h"
+
+using namespace std;
+using namespace seal;
+using namespace apsi::sender::util;
+
+namespace {
+    /**
+    Approximates the memory used by a Plaintext.
+    */
+    size_t plaintext_byte_count(const Plaintext &plain)
+    {
+        return sizeof(Plaintext) + plain.coeff_count() * sizeof(Plaintext::pt_coeff_type);
+    }
+} // namespace
+
+PlaintextCache::PlaintextCache(size_t memory_budget) : memory_budget_(memory_budget)
+{}
+
+shared_ptr<const Plaintext> PlaintextCache::get(
+    uint64_t source_id, uint64_t index, const function<void(Plaintext &)> &loader)
+{
+    key_type key(source_id, index);
+    uint32_t frequency = 0;
+    {
+        unique_lock<mutex> lock(mtx_);
+        if (!memory_budget_) {
+            miss_count_++;
+        } else {
+            // Age the frequencies once the number of accesses is large compared to the number of
+            // tracked keys
+            access_count_++;
+            if (access_count_ >= 8 * (cached_.size() + uncached_frequencies_.size() + 128)) {
+                age();
+            }
+
+            auto it = cached_.find(key);
+            if (it != cached_.end()) {
+                hit_count_++;
+                if (it->second.frequency < numeric_limits<uint32_t>::max()) {
+                    it->second.frequency++;
+                }
+                return it->second.plain;
+            }
+
+            miss_count_++;
+            frequency = touch_uncached(key);
+        }
+    }
+
+    // Load outside the lock; this is the expensive part
+    auto plain = make_shared<Plaintext>();
+    loader(*plain);
+    if (!frequency) {
+        // Caching is disabled
+        return plain;
+    }
+
+    size_t byte_count = plaintext_byte_count(*plain);
+
+    unique_lock<mutex> lock(mtx_);
+
+    // Another thread may have cached the same key while we were loading
+    auto it = cached_.find(key);
+    if (it != cached_.end()) {
+        return it->second.plain;
+    }
+
+    if (!make_room(byte_count, frequency)) {
+        return plain;
+    }
+
+    // The frequency now lives in the cached entry
+    auto uncached_it = uncached_frequencies_.find(key);
+    if (uncached_it != uncached_frequencies_.end()) {
+        frequency = max(frequency, uncached_it->second);
+        uncached_frequencies_.erase(uncached_it);
+    }
+
+    cached_keys_.push_back(key);
+    cached_.emplace(key, Entry{ plain, byte_count, frequency, cached_keys_.size() - 1 });
+    byte_count_ += byte_count;
+
+    return plain;
+}
+
+uint32_t PlaintextCache::touch_uncached(const key_type &key)
+{
+    uint64_t &index_count = source_index_counts_[key.first];
+    index_count = max(index_count, key.second + 1);
+
+    uint32_t &frequency = uncached_frequencies_[key];
+    if (frequency < numeric_limits<uint32_t>::max()) {
+        frequency++;
+    }
+    return frequency;
+}
+
+bool PlaintextCache::make_room(size_t byte_count, uint32_t frequency)
+{
+    if (byte_count > memory_budget_) {
+        return false;
+    }
+
+    while (byte_count_ + byte_count > memory_budget_) {
+        // Sample a few cached entries and find the least frequently used one
+        uniform_int_distribution<size_t> dist(0, cached_keys_.size() - 1);
+        const key_type *victim = nullptr;
+        uint32_t victim_frequency = numeric_limits<uint32_t>::max();
+        for (size_t i = 0; i < eviction_sample_count_; i++) {
+            const key_type &candidate = cached_keys_[dist(rng_)];
+            uint32_t candidate_frequency = cached_.at(candidate).frequency;
+            if (!victim || candidate_frequency < victim_frequency) {
+                victim = &candidate;
+                victim_frequency = candidate_frequency;
+            }
+        }
+
+        // Only replace less frequently used data
+        if (victim_frequency >= frequency) {
+            return false;
+        }
+
+        evict(key_type(*victim));
+    }
+
+    return true;
+}
+
+void PlaintextCache::evict(const key_type &key)
+{
+    auto it = cached_.find(key);
+    if (it == cached_.end()) {
+        return;
+    }
+
+    // Remember the frequency so the key does not have to start from scratch
+    uncached_frequencies_[key] = it->second.frequency;
+
+    // Remove the key from cached_keys_ by moving the last key into its place
+    size_t key_idx = it->second.key_idx;
+    byte_count_ -= it->second.byte_count;
+    cached_.erase(it);
+    if (key_idx != cached_keys_.size() - 1) {
+        cached_keys_[key_idx] = cached_keys_.back();
+        cached_.at(cached_keys_[key_idx]).key_idx = key_idx;
+    }
+    cached_keys_.pop_back();
+}
+
+void PlaintextCache::age()
+{
+    for (auto &entry : cached_) {
+        entry.second.frequency /= 2;
+    }
+    for (auto it = uncached_frequencies_.begin(); it != uncached_frequencies_.end();) {
+        it->second /= 2;
+        if (!it->second) {
+            it = uncached_frequencies_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    access_count_ = 0;
+}
+
+void PlaintextCache::set_memory_budget(size_t memory_budget)
+{
+    unique_lock<mutex> lock(mtx_);
+    memory_budget_ = memory_budget;
+    if (!memory_budget_) {
+        cached_.clear();
+        cached_keys_.clear();
+        uncached_frequencies_.clear();
+        source_index_counts_.clear();
+        byte_count_ = 0;
+        return;
+    }
+
+    // Evict the least frequently used entries until we are within the budget
+    while (byte_count_ > memory_budget_) {
+        auto victim = min_element(cached_.begin(), cached_.end(), [](auto &a, auto &b) {
+            return a.second.frequency < b.second.frequency;
+        });
+        evict(key_type(victim->first));
+    }
+}
+
+size_t PlaintextCache::get_memory_budget() const
+{
+    return memory_budget_;
+}
+
+void PlaintextCache::clear()
+{
+    unique_lock<mutex> lock(mtx_);
+    cached_.clear();
+    cached_keys_.clear();
+    uncached_frequencies_.clear();
+    source_index_counts_.clear();
+    byte_count_ = 0;
+    access_count_ = 0;
+}
+
+void PlaintextCache::erase_source(uint64_t source_id)
+{
+    // Nothing is tracked while caching is disabled; this avoids locking when sources are destroyed
+    if (!memory_budget_) {
+        return;
+    }
+
+    unique_lock<mutex> lock(mtx_);
+    auto count_it = source_index_counts_.find(source_id);
+    if (count_it == source_index_counts_.end()) {
+        return;
+    }
+
+    for (uint64_t index = 0; index < count_it->second; index++) {
+        key_type key(source_id, index);
+        evict(key);
+        uncached_frequencies_.erase(key);
+    }
+    source_index_counts_.erase(count_it);
+}
+
+size_t PlaintextCache::get_byte_count() const
+{
+    unique_lock<mutex> lock(mtx_);
+    return byte_count_;
+}
+
+size_t PlaintextCache::get_entry_count() const
+{
+    unique_lock<mutex> lock(mtx_);
+    return cached_.size();
+}
+
+uint64_t PlaintextCache::get_hit_count() const
+{
+    unique_lock<mutex> lock(mtx_);
+    return hit_count_;
+}
+
+uint64_t PlaintextCache::get_miss_count() const
+{
+    unique_lock<mutex> lock(mtx_);
+    return miss_count_;
+}
+
+uint64_t PlaintextCache::NewSourceId()
+{
+    // Sources erase their entries from the global cache when they are destroyed, so the global
+    // cache must be constructed first to outlive every source
+    Global();
+
+    static atomic<uint64_t> next_source_id(0);
+    return next_source_id.fetch_add(1);
+}
+
+PlaintextCache &PlaintextCache::Global()
+{
+    static PlaintextCache global_cache;
+    return global_cache;
+}
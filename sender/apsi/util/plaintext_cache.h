@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// SEAL
+#include "seal/plaintext.h"
+
+namespace apsi {
+    namespace sender {
+        namespace util {
+            /**
+            A thread-safe cache of loaded (e.g., decompressed) SEAL Plaintexts with a bounded memory
+            budget. Each cached Plaintext is identified by a source identifier, obtained from
+            PlaintextCache::NewSourceId, and an index within that source.
+
+            Eviction is driven by access frequency. The cache counts accesses to every key it has
+            seen recently, whether or not the key is currently cached. When a new Plaintext does not
+            fit in the budget, a few cached entries are sampled at random and the least frequently
+            used one is evicted, but only if it is used strictly less frequently than the new one.
+            Otherwise the new Plaintext is not cached. All frequencies are periodically halved, so
+            the cache adapts when the access pattern changes. When a source no longer exists, its
+            entries and frequencies must be removed with erase_source.
+            */
+            class PlaintextCache {
+            public:
+                /**
+                Creates a PlaintextCache with the given memory budget in bytes. A zero budget
+                disables caching.
+                */
+                explicit PlaintextCache(std::size_t memory_budget = 0);
+
+                /**
+                Returns the Plaintext for the given key. If it is not cached, it is created by
+                calling the given loader function, and cached if the eviction policy allows it.
+                */
+                std::shared_ptr<const seal::Plaintext> get(
+                    std::uint64_t source_id,
+                    std::uint64_t index,
+                    const std::function<void(seal::Plaintext &)> &loader);
+
+                /**
+                Sets the memory budget in bytes. Entries are evicted as needed to fit the new
+                budget. A zero budget disables caching.
+                */
+                void set_memory_budget(std::size_t memory_budget);
+
+                /**
+                Returns the memory budget in bytes.
+                */
+                std::size_t get_memory_budget() const;
+
+                /**
+                Returns whether caching is enabled, i.e., whether the memory budget is non-zero.
+                */
+                bool is_enabled() const
+                {
+                    return get_memory_budget() != 0;
+                }
+
+                /**
+                Removes all cached entries and all access frequency data.
+                */
+                void clear();
+
+                /**
+                Removes all cached entries and all access frequency data of the given source. This
+                must be called when the source no longer exists; otherwise its entries take up the
+                budget until they are evicted, and its frequencies are kept until they age out.
+                */
+                void erase_source(std::uint64_t source_id);
+
+                /**
+                Returns the total size in bytes of the cached Plaintexts.
+                */
+                std::size_t get_byte_count() const;
+
+                /**
+                Returns the number of cached Plaintexts.
+                */
+                std::size_t get_entry_count() const;
+
+                /**
+                Returns the number of calls to get that were served from the cache.
+                */
+                std::uint64_t get_hit_count() const;
+
+                /**
+                Returns the number of calls to get that required calling the loader function.
+                */
+                std::uint64_t get_miss_count() const;
+
+                /**
+                Returns a new process-wide unique source identifier.
+                */
+                static std::uint64_t NewSourceId();
+
+                /**
+                Returns the process-wide PlaintextCache used by the sender for compressed
+                polynomial coefficients. It is disabled until a memory budget is set.
+                */
+                static PlaintextCache &Global();
+
+            private:
+                using key_type = std::pair<std::uint64_t, std::uint64_t>;
+
+                struct KeyHash {
+                    std::size_t operator()(const key_type &key) const noexcept
+                    {
+                        return static_cast<std::size_t>(
+                            key.first * 0x9E3779B97F4A7C15ULL ^ (key.second + (key.first >> 7)));
+                    }
+                };
+
+                struct Entry {
+                    std::shared_ptr<const seal::Plaintext> plain;
+
+                    std::size_t byte_count;
+
+                    std::uint32_t frequency;
+
+                    // Position of this entry's key in cached_keys_
+                    std::size_t key_idx;
+                };
+
+                /**
+                Increments the access frequency of a key that is not cached and returns the new
+                frequency. Also records the index of the key for erase_source.
+                */
+                std::uint32_t touch_uncached(const key_type &key);
+
+                /**
+                Evicts entries until the given number of additional bytes fits in the budget,
+                subject to the frequency condition. Returns whether enough space was made.
+                */
+                bool make_room(std::size_t byte_count, std::uint32_t frequency);
+
+                /**
+                Removes a cached entry, remembering its frequency.
+                */
+                void evict(const key_type &key);
+
+                /**
+                Halves all frequencies and drops uncached keys that reach zero.
+                */
+                void age();
+
+                mutable std::mutex mtx_;
+
+                // Read without locking by get_memory_budget and is_enabled
+                std::atomic<std::size_t> memory_budget_;
+
+                std::size_t byte_count_ = 0;
+
+                std::unordered_map<key_type, Entry, KeyHash> cached_;
+
+                // Keys of all cached entries; used for sampling eviction candidates
+                std::vector<key_type> cached_keys_;
+
+                // Access frequencies of keys that are not cached
+                std::unordered_map<key_type, std::uint32_t, KeyHash> uncached_frequencies_;
+
+                // One more than the largest index seen for each source that has cached entries or
+                // access frequencies; used by erase_source to find the keys of a source
+                std::unordered_map<std::uint64_t, std::uint64_t> source_index_counts_;
+
+                std::uint64_t access_count_ = 0;
+
+                std::uint64_t hit_count_ = 0;
+
+                std::uint64_t miss_count_ = 0;
+
+                std::minstd_rand rng_;
+
+                /**
+                The number of cached entries sampled when looking for an eviction victim
+                */
+                static constexpr std::size_t eviction_sample_count_ = 8;
+            };
+        } // namespace util
+    }     // namespace sender
+} // namespace apsi
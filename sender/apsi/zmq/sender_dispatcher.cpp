@@ -2,10 +2,18 @@
 // Licensed under the MIT license.
 
 // STD
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 // APSI
 #include "apsi/log.h"
@@ -25,35 +33,207 @@ namespace apsi {
     using namespace oprf;
 
     namespace sender {
+        namespace {
+            /**
+            Checks that the SenderDB is set and, unless it is stripped, that the OPRF key it holds
+            is equal to the given OPRF key.
+            */
+            void check_sender_db(
+                const shared_ptr<SenderDB> &sender_db, const OPRFKey &oprf_key, const char *action)
+            {
+                if (!sender_db) {
+                    throw invalid_argument("sender_db is not set");
+                }
+
+                if (!sender_db->is_stripped() && oprf_key != sender_db->get_oprf_key()) {
+                    APSI_LOG_ERROR(
+                        "Failed to " << action
+                                     << ": SenderDB OPRF key differs from the given OPRF key");
+                    throw logic_error("mismatching OPRF keys");
+                }
+            }
+
+            /**
+            Returns the OPRF key held by the SenderDB.
+            */
+            OPRFKey get_db_oprf_key(const shared_ptr<SenderDB> &sender_db, const char *action)
+            {
+                if (!sender_db) {
+                    throw invalid_argument("sender_db is not set");
+                }
+
+                try {
+                    return sender_db->get_oprf_key();
+                } catch (const logic_error &) {
+                    APSI_LOG_ERROR("Failed to " << action << ": missing OPRF key");
+                    throw;
+                }
+            }
+
+            /**
+            Sends an error response to a request that cannot be processed, so the receiver does not
+            wait for a response forever. A failure to send is only logged.
+            */
+            void send_error(
+                ZMQSenderChannel &chl,
+                SenderOperationType request_type,
+                vector<unsigned char> client_id,
+                const string &message)
+            {
+                try {
+                    auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                    nsop_response->sop_response =
+                        make_unique<SenderOperationResponseError>(request_type, message);
+                    nsop_response->client_id = move(client_id);
+                    chl.send(move(nsop_response));
+                } catch (const exception &ex) {
+                    APSI_LOG_ERROR("Failed to send error response: " << ex.what());
+                }
+            }
+
+            /**
+            Returns the uncompressed size of the ciphertexts and relinearization keys of a query.
+            */
+            size_t get_query_byte_count(const SenderOperation &sop)
+            {
+                const auto *sop_query = dynamic_cast<const SenderOperationQuery *>(&sop);
+                if (!sop_query) {
+                    return 0;
+                }
+
+                size_t byte_count = sop_query->relin_keys.save_size(compr_mode_type::none);
+                for (const auto &q : sop_query->data) {
+                    for (const auto &ct : q.second) {
+                        byte_count = add_safe(byte_count, ct.save_size(compr_mode_type::none));
+                    }
+                }
+
+                return byte_count;
+            }
+        } // namespace
+
         ZMQSenderDispatcher::ZMQSenderDispatcher(shared_ptr<SenderDB> sender_db, OPRFKey oprf_key)
-            : sender_db_(move(sender_db)), oprf_key_(move(oprf_key))
         {
-            if (!sender_db_) {
-                throw invalid_argument("sender_db is not set");
+            check_sender_db(sender_db, oprf_key, "create ZMQSenderDispatcher");
+            tenants_[string()] = { move(sender_db), move(oprf_key) };
+        }
+
+        ZMQSenderDispatcher::ZMQSenderDispatcher(shared_ptr<SenderDB> sender_db)
+        {
+            OPRFKey oprf_key = get_db_oprf_key(sender_db, "create ZMQSenderDispatcher");
+            tenants_[string()] = { move(sender_db), move(oprf_key) };
+        }
+
+        void ZMQSenderDispatcher::add_sender_db(
+            const string &db_name, shared_ptr<SenderDB> sender_db, OPRFKey oprf_key)
+        {
+            if (db_name.empty()) {
+                throw invalid_argument("db_name cannot be empty");
             }
+            check_sender_db(sender_db, oprf_key, "add SenderDB");
 
-            // If SenderDB is not stripped, the OPRF key it holds must be equal to the provided
-            // oprf_key
-            if (!sender_db_->is_stripped() && oprf_key_ != sender_db->get_oprf_key()) {
-                APSI_LOG_ERROR("Failed to create ZMQSenderDispatcher: SenderDB OPRF key differs "
-                               "from the given OPRF key");
-                throw logic_error("mismatching OPRF keys");
+            lock_guard<mutex> lock(tenants_mtx_);
+            if (tenants_.count(db_name)) {
+                APSI_LOG_ERROR(
+                    "Failed to add SenderDB: SenderDB `" << db_name << "` already exists");
+                throw invalid_argument("SenderDB already exists");
             }
+
+            size_t item_count = sender_db->get_item_count();
+            tenants_[db_name] = { move(sender_db), move(oprf_key) };
+            APSI_LOG_INFO("Added SenderDB `" << db_name << "` with " << item_count << " items");
         }
 
-        ZMQSenderDispatcher::ZMQSenderDispatcher(shared_ptr<SenderDB> sender_db)
-            : sender_db_(move(sender_db))
+        void ZMQSenderDispatcher::add_sender_db(
+            const string &db_name, shared_ptr<SenderDB> sender_db)
         {
-            if (!sender_db_) {
-                throw invalid_argument("sender_db is not set");
+            OPRFKey oprf_key = get_db_oprf_key(sender_db, "add SenderDB");
+            add_sender_db(db_name, move(sender_db), move(oprf_key));
+        }
+
+        void ZMQSenderDispatcher::set_sender_db(
+            const string &db_name,
+            shared_ptr<SenderDB> sender_db,
+            OPRFKey oprf_key,
+            bool replace_oprf_key)
+        {
+            check_sender_db(sender_db, oprf_key, "replace SenderDB");
+
+            lock_guard<mutex> lock(tenants_mtx_);
+            auto tenant_it = tenants_.find(db_name);
+            if (tenant_it == tenants_.end()) {
+                APSI_LOG_ERROR("Failed to replace SenderDB: SenderDB `" << db_name
+                                                                        << "` does not exist");
+                throw invalid_argument("SenderDB does not exist");
             }
 
-            try {
-                oprf_key_ = sender_db_->get_oprf_key();
-            } catch (const logic_error &) {
-                APSI_LOG_ERROR("Failed to create ZMQSenderDispatcher: missing OPRF key");
-                throw;
+            Tenant &tenant = tenant_it->second;
+            if (sender_db->get_params().to_string() !=
+                tenant.sender_db->get_params().to_string()) {
+                APSI_LOG_ERROR("Failed to replace SenderDB: PSIParams differ from the current "
+                               "SenderDB");
+                throw invalid_argument("mismatching PSIParams");
+            }
+
+            // Receivers that ran OPRF with the current key would silently get wrong results
+            if (!replace_oprf_key && oprf_key != tenant.oprf_key) {
+                APSI_LOG_ERROR("Failed to replace SenderDB: OPRF key differs from the current "
+                               "OPRF key");
+                throw invalid_argument("mismatching OPRF keys");
+            }
+
+            // Queries that are already running hold on to the previous SenderDB
+            tenant.sender_db = move(sender_db);
+            tenant.oprf_key = move(oprf_key);
+            APSI_LOG_INFO(
+                "Replaced SenderDB `" << db_name << "`; the new SenderDB holds "
+                                      << tenant.sender_db->get_item_count() << " items");
+        }
+
+        void ZMQSenderDispatcher::set_sender_db(
+            const string &db_name, shared_ptr<SenderDB> sender_db, bool replace_oprf_key)
+        {
+            OPRFKey oprf_key = get_db_oprf_key(sender_db, "replace SenderDB");
+            set_sender_db(db_name, move(sender_db), move(oprf_key), replace_oprf_key);
+        }
+
+        shared_ptr<SenderDB> ZMQSenderDispatcher::get_sender_db(const string &db_name) const
+        {
+            lock_guard<mutex> lock(tenants_mtx_);
+            auto tenant_it = tenants_.find(db_name);
+            return tenant_it == tenants_.end() ? nullptr : tenant_it->second.sender_db;
+        }
+
+        OPRFKey ZMQSenderDispatcher::get_oprf_key(const string &db_name) const
+        {
+            lock_guard<mutex> lock(tenants_mtx_);
+            auto tenant_it = tenants_.find(db_name);
+            if (tenant_it == tenants_.end()) {
+                APSI_LOG_ERROR(
+                    "Failed to get OPRF key: SenderDB `" << db_name << "` does not exist");
+                throw invalid_argument("SenderDB does not exist");
             }
+
+            return tenant_it->second.oprf_key;
+        }
+
+        vector<string> ZMQSenderDispatcher::get_db_names() const
+        {
+            lock_guard<mutex> lock(tenants_mtx_);
+            vector<string> result;
+            for (const auto &tenant : tenants_) {
+                result.push_back(tenant.first);
+            }
+            sort(result.begin(), result.end());
+
+            return result;
+        }
+
+        auto ZMQSenderDispatcher::get_tenant(const string &db_name) const -> Tenant
+        {
+            lock_guard<mutex> lock(tenants_mtx_);
+            auto tenant_it = tenants_.find(db_name);
+            return tenant_it == tenants_.end() ? Tenant() : tenant_it->second;
         }
 
         void ZMQSenderDispatcher::run(const atomic<bool> &stop, int port)
@@ -66,46 +246,85 @@ namespace apsi {
             APSI_LOG_INFO("ZMQSenderDispatcher listening on port " << port);
             chl.bind(ss.str());
 
-            auto seal_context = sender_db_->get_seal_context();
+            // Queries are loaded with the SEALContext of the SenderDB they are directed to
+            auto get_context = [this](const string &db_name) -> shared_ptr<SEALContext> {
+                shared_ptr<SenderDB> sender_db = get_sender_db(db_name);
+                return sender_db ? sender_db->get_seal_context() : nullptr;
+            };
 
             // Run until stopped
             bool logged_waiting = false;
             while (!stop) {
+                // Take in all requests that are waiting. Queries are added to the queue of their
+                // SenderDB; other requests are answered right away.
+                bool received = false;
                 unique_ptr<ZMQSenderOperation> sop;
-                if (!(sop = chl.receive_network_operation(seal_context))) {
-                    if (!logged_waiting) {
-                        // We want to log 'Waiting' only once, even if we have to wait
-                        // for several sleeps. And only once after processing a request as well.
-                        logged_waiting = true;
-                        APSI_LOG_INFO("Waiting for request from Receiver");
-                    }
+                while (!stop && (sop = chl.receive_db_operation(get_context, false))) {
+                    received = true;
+                    dispatch(move(sop), chl);
+                }
 
-                    this_thread::sleep_for(50ms);
+                // Process waiting queries for one SenderDB before taking in new requests
+                if (dispatch_next_queries(chl) || received) {
+                    logged_waiting = false;
                     continue;
                 }
 
-                switch (sop->sop->type()) {
-                case SenderOperationType::sop_parms:
-                    APSI_LOG_INFO("Received parameter request");
-                    dispatch_parms(move(sop), chl);
-                    break;
-
-                case SenderOperationType::sop_oprf:
-                    APSI_LOG_INFO("Received OPRF request");
-                    dispatch_oprf(move(sop), chl);
-                    break;
+                if (!logged_waiting) {
+                    // We want to log 'Waiting' only once, even if we have to wait
+                    // for several sleeps. And only once after processing a request as well.
+                    logged_waiting = true;
+                    APSI_LOG_INFO("Waiting for request from Receiver");
+                }
 
-                case SenderOperationType::sop_query:
-                    APSI_LOG_INFO("Received query");
-                    dispatch_query(move(sop), chl);
-                    break;
+                this_thread::sleep_for(50ms);
+            }
 
-                default:
-                    // We should never reach this point
-                    throw runtime_error("invalid operation");
+            // The receivers of queries that are still waiting would otherwise wait forever
+            for (auto &queue : query_queues_) {
+                for (auto &queued_query : queue.second) {
+                    send_error(
+                        chl,
+                        SenderOperationType::sop_query,
+                        move(queued_query.sop->client_id),
+                        "sender is stopping");
                 }
+            }
+            query_queues_.clear();
+            queued_db_names_.clear();
+            queued_query_byte_count_ = 0;
+        }
 
-                logged_waiting = false;
+        void ZMQSenderDispatcher::set_query_batch_size(size_t query_batch_size)
+        {
+            if (!query_batch_size) {
+                throw invalid_argument("query_batch_size must be positive");
+            }
+            query_batch_size_ = query_batch_size;
+        }
+
+        void ZMQSenderDispatcher::dispatch(
+            unique_ptr<ZMQSenderOperation> sop, ZMQSenderChannel &chl)
+        {
+            switch (sop->sop->type()) {
+            case SenderOperationType::sop_parms:
+                APSI_LOG_INFO("Received parameter request");
+                dispatch_parms(move(sop), chl);
+                break;
+
+            case SenderOperationType::sop_oprf:
+                APSI_LOG_INFO("Received OPRF request");
+                dispatch_oprf(move(sop), chl);
+                break;
+
+            case SenderOperationType::sop_query:
+                APSI_LOG_INFO("Received query");
+                enqueue_query(move(sop), chl);
+                break;
+
+            default:
+                // We should never reach this point
+                throw runtime_error("invalid operation");
             }
         }
 
@@ -115,12 +334,25 @@ namespace apsi {
             STOPWATCH(sender_stopwatch, "ZMQSenderDispatcher::dispatch_params");
 
             try {
+                shared_ptr<SenderDB> sender_db = get_sender_db(sop->db_name);
+                if (!sender_db) {
+                    APSI_LOG_ERROR(
+                        "Failed to process parameter request: SenderDB `" << sop->db_name
+                                                                          << "` does not exist");
+                    send_error(
+                        chl,
+                        SenderOperationType::sop_parms,
+                        move(sop->client_id),
+                        "SenderDB does not exist");
+                    return;
+                }
+
                 // Extract the parameter request
                 ParamsRequest params_request = to_params_request(move(sop->sop));
 
                 Sender::RunParams(
                     params_request,
-                    sender_db_,
+                    move(sender_db),
                     chl,
                     [&sop](Channel &c, unique_ptr<SenderOperationResponse> sop_response) {
                         auto nsop_response = make_unique<ZMQSenderOperationResponse>();
@@ -133,6 +365,11 @@ namespace apsi {
             } catch (const exception &ex) {
                 APSI_LOG_ERROR(
                     "Sender threw an exception while processing parameter request: " << ex.what());
+                send_error(
+                    chl,
+                    SenderOperationType::sop_parms,
+                    move(sop->client_id),
+                    "failed to process parameter request");
             }
         }
 
@@ -142,12 +379,26 @@ namespace apsi {
             STOPWATCH(sender_stopwatch, "ZMQSenderDispatcher::dispatch_oprf");
 
             try {
+                // Copy the OPRF key so it cannot change while the request is processed
+                Tenant tenant = get_tenant(sop->db_name);
+                if (!tenant.sender_db) {
+                    APSI_LOG_ERROR(
+                        "Failed to process OPRF request: SenderDB `" << sop->db_name
+                                                                     << "` does not exist");
+                    send_error(
+                        chl,
+                        SenderOperationType::sop_oprf,
+                        move(sop->client_id),
+                        "SenderDB does not exist");
+                    return;
+                }
+
                 // Extract the OPRF request
                 OPRFRequest oprf_request = to_oprf_request(move(sop->sop));
 
                 Sender::RunOPRF(
                     oprf_request,
-                    oprf_key_,
+                    tenant.oprf_key,
                     chl,
                     [&sop](Channel &c, unique_ptr<SenderOperationResponse> sop_response) {
                         auto nsop_response = make_unique<ZMQSenderOperationResponse>();
@@ -160,42 +411,194 @@ namespace apsi {
             } catch (const exception &ex) {
                 APSI_LOG_ERROR(
                     "Sender threw an exception while processing OPRF request: " << ex.what());
+                send_error(
+                    chl,
+                    SenderOperationType::sop_oprf,
+                    move(sop->client_id),
+                    "failed to process OPRF request");
             }
         }
 
-        void ZMQSenderDispatcher::dispatch_query(
+        void ZMQSenderDispatcher::enqueue_query(
             unique_ptr<ZMQSenderOperation> sop, ZMQSenderChannel &chl)
+        {
+            auto queue_it = query_queues_.find(sop->db_name);
+            size_t queued_count = (queue_it == query_queues_.end()) ? 0 : queue_it->second.size();
+            if (max_queued_queries_ && queued_count >= max_queued_queries_) {
+                APSI_LOG_ERROR(
+                    "Rejected query: SenderDB `" << sop->db_name << "` already has "
+                                                 << queued_count << " queries waiting");
+                send_error(
+                    chl,
+                    SenderOperationType::sop_query,
+                    move(sop->client_id),
+                    "too many queries waiting");
+                return;
+            }
+
+            // A query is admitted to an empty dispatcher even if it exceeds the budget by itself
+            size_t byte_count = get_query_byte_count(*sop->sop);
+            if (queued_query_memory_limit_ && queued_query_byte_count_ &&
+                add_safe(queued_query_byte_count_, byte_count) > queued_query_memory_limit_) {
+                APSI_LOG_ERROR(
+                    "Rejected query: waiting queries would hold more than "
+                    << queued_query_memory_limit_ << " bytes of query data");
+                send_error(
+                    chl,
+                    SenderOperationType::sop_query,
+                    move(sop->client_id),
+                    "too much query data waiting");
+                return;
+            }
+
+            if (queue_it == query_queues_.end()) {
+                queue_it = query_queues_.emplace(sop->db_name, deque<QueuedQuery>()).first;
+                queued_db_names_.push_back(sop->db_name);
+            }
+            queue_it->second.push_back({ move(sop), byte_count });
+            queued_query_byte_count_ += byte_count;
+        }
+
+        bool ZMQSenderDispatcher::dispatch_next_queries(ZMQSenderChannel &chl)
+        {
+            if (queued_db_names_.empty()) {
+                return false;
+            }
+
+            // Take a batch of queries from the SenderDB whose turn it is; it goes to the back of
+            // the line if it has more queries waiting
+            string db_name = move(queued_db_names_.front());
+            queued_db_names_.pop_front();
+            auto queue_it = query_queues_.find(db_name);
+            auto &queue = queue_it->second;
+            vector<unique_ptr<ZMQSenderOperation>> sops;
+            while (!queue.empty() && sops.size() < query_batch_size_) {
+                queued_query_byte_count_ -= queue.front().byte_count;
+                sops.push_back(move(queue.front().sop));
+                queue.pop_front();
+            }
+            if (queue.empty()) {
+                query_queues_.erase(queue_it);
+            } else {
+                queued_db_names_.push_back(db_name);
+            }
+
+            dispatch_db_queries(db_name, move(sops), chl);
+
+            return true;
+        }
+
+        void ZMQSenderDispatcher::dispatch_db_queries(
+            const string &db_name,
+            vector<unique_ptr<ZMQSenderOperation>> sops,
+            ZMQSenderChannel &chl)
         {
             STOPWATCH(sender_stopwatch, "ZMQSenderDispatcher::dispatch_query");
 
-            try {
-                // Create the Query object
-                Query query(to_query_request(move(sop->sop)), sender_db_);
+            // All queries in the batch use the same SenderDB, even if it is replaced in the
+            // meantime
+            shared_ptr<SenderDB> sender_db = get_sender_db(db_name);
+            if (!sender_db) {
+                APSI_LOG_ERROR(
+                    "Failed to process query request: SenderDB `" << db_name << "` does not exist");
+                for (auto &sop : sops) {
+                    send_error(
+                        chl,
+                        SenderOperationType::sop_query,
+                        move(sop->client_id),
+                        "SenderDB does not exist");
+                }
+                return;
+            }
 
-                // Query will send result to client in a stream of ResultPackages (ResultParts)
-                Sender::RunQuery(
-                    query,
-                    chl,
-                    // Lambda function for sending the query response
-                    [&sop](Channel &c, Response response) {
-                        auto nsop_response = make_unique<ZMQSenderOperationResponse>();
-                        nsop_response->sop_response = move(response);
-                        nsop_response->client_id = sop->client_id;
+            // Create the Query objects; invalid queries are answered with an error so they do not
+            // affect the others
+            vector<Query> queries;
+            vector<vector<unsigned char>> client_ids;
+            for (auto &sop : sops) {
+                try {
+                    Query query(to_query_request(move(sop->sop)), sender_db);
+                    if (query) {
+                        queries.push_back(move(query));
+                        client_ids.push_back(move(sop->client_id));
+                        continue;
+                    }
+                    APSI_LOG_ERROR("Failed to process query request: query is invalid");
+                } catch (const exception &ex) {
+                    APSI_LOG_ERROR("Failed to process query request: " << ex.what());
+                }
+                send_error(
+                    chl, SenderOperationType::sop_query, move(sop->client_id), "query is invalid");
+            }
+            if (queries.empty()) {
+                return;
+            }
+            if (queries.size() > 1) {
+                APSI_LOG_INFO("Processing " << queries.size() << " queries together");
+            }
 
-                        // We know for sure that the channel is a SenderChannel so use static_cast
-                        static_cast<ZMQSenderChannel &>(c).send(move(nsop_response));
+            // A query whose response or result part cannot be sent is abandoned, so that the other
+            // queries are still answered
+            vector<atomic<bool>> failed(queries.size());
+            for (auto &query_failed : failed) {
+                query_failed = false;
+            }
+
+            try {
+                // Queries will send results to clients in streams of ResultPackages (ResultParts)
+                Sender::RunQueries(
+                    vector<reference_wrapper<const Query>>(queries.begin(), queries.end()),
+                    chl,
+                    // Lambda function for sending the query responses
+                    [&client_ids, &failed](Channel &c, Response response, size_t query_idx) {
+                        if (failed[query_idx]) {
+                            return;
+                        }
+                        try {
+                            auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                            nsop_response->sop_response = move(response);
+                            nsop_response->client_id = client_ids[query_idx];
+
+                            // We know for sure that the channel is a SenderChannel so use
+                            // static_cast
+                            static_cast<ZMQSenderChannel &>(c).send(move(nsop_response));
+                        } catch (const exception &ex) {
+                            APSI_LOG_ERROR("Failed to send query response: " << ex.what());
+                            failed[query_idx] = true;
+                        }
                     },
                     // Lambda function for sending the result parts
-                    [&sop](Channel &c, ResultPart rp) {
-                        auto nrp = make_unique<ZMQResultPackage>();
-                        nrp->rp = move(rp);
-                        nrp->client_id = sop->client_id;
-
-                        // We know for sure that the channel is a SenderChannel so use static_cast
-                        static_cast<ZMQSenderChannel &>(c).send(move(nrp));
+                    [&client_ids, &failed](Channel &c, ResultPart rp, size_t query_idx) {
+                        if (failed[query_idx]) {
+                            return;
+                        }
+                        try {
+                            auto nrp = make_unique<ZMQResultPackage>();
+                            nrp->rp = move(rp);
+                            nrp->client_id = client_ids[query_idx];
+
+                            // We know for sure that the channel is a SenderChannel so use
+                            // static_cast
+                            static_cast<ZMQSenderChannel &>(c).send(move(nrp));
+                        } catch (const exception &ex) {
+                            APSI_LOG_ERROR("Failed to send result part: " << ex.what());
+                            failed[query_idx] = true;
+                        }
                     });
             } catch (const exception &ex) {
                 APSI_LOG_ERROR("Sender threw an exception while processing query: " << ex.what());
+
+                // The receivers would otherwise wait forever for the response or the remaining
+                // result parts; a receiver waiting for result parts fails on the error response
+                for (size_t query_idx = 0; query_idx < queries.size(); query_idx++) {
+                    if (!failed[query_idx]) {
+                        send_error(
+                            chl,
+                            SenderOperationType::sop_query,
+                            client_ids[query_idx],
+                            "failed to process query");
+                    }
+                }
             }
         }
     } // namespace sender
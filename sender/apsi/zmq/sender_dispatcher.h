@@ -5,8 +5,14 @@
 
 // STD
 #include <atomic>
+#include <cstddef>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 // APSI
 #include "apsi/network/sender_operation.h"
@@ -19,6 +25,25 @@ namespace apsi {
     namespace sender {
         /**
         The ZMQSenderDispatcher is in charge of handling incoming requests through the network.
+
+        A single ZMQSenderDispatcher can serve several SenderDBs, each identified by a name. The
+        SenderDB given to the constructor is the default SenderDB and has an empty name; more can
+        be added with ZMQSenderDispatcher::add_sender_db. A receiver selects the SenderDB with
+        network::ZMQChannel::set_db_name. All SenderDBs share the ThreadPoolMgr thread pool and
+        util::PlaintextCache::Global.
+
+        Queries wait in a queue per SenderDB, and the queues are served round-robin, so a SenderDB
+        that receives many queries does not delay the queries to the others by more than one batch
+        each. A query is admitted to its queue only if the queue is not full (see
+        ZMQSenderDispatcher::set_max_queued_queries) and the data of all waiting queries fits in a
+        global budget (see ZMQSenderDispatcher::set_queued_query_memory_limit); otherwise it is
+        rejected right away. Other requests are answered as soon as they arrive. The memory used
+        for evaluating a query is bounded by Sender::SetEvalMemoryLimit, while the SenderDBs
+        themselves are always held in memory in full.
+
+        A request that cannot be processed, for example because it names an unknown SenderDB, is
+        answered with a network::SenderOperationResponseError, so the receiver does not wait for a
+        response forever.
         */
         class ZMQSenderDispatcher {
         public:
@@ -41,15 +66,206 @@ namespace apsi {
             */
             ZMQSenderDispatcher(std::shared_ptr<SenderDB> sender_db);
 
+            /**
+            Adds a SenderDB with the given name, together with the OPRF key used to respond to OPRF
+            requests directed to it. The name must not be empty or already in use. This function
+            can be called from any thread while the dispatcher is running.
+            */
+            void add_sender_db(
+                const std::string &db_name,
+                std::shared_ptr<SenderDB> sender_db,
+                oprf::OPRFKey oprf_key);
+
+            /**
+            Adds a SenderDB with the given name, and uses the OPRF key it holds to respond to OPRF
+            requests directed to it. This function cannot be used if the SenderDB is stripped.
+            */
+            void add_sender_db(const std::string &db_name, std::shared_ptr<SenderDB> sender_db);
+
+            /**
+            Replaces the SenderDB with the given name and the OPRF key used to serve subsequent
+            requests directed to it. Queries that are already being processed finish on the
+            previous SenderDB. This function can be called from any thread while the dispatcher is
+            running, and it only swaps pointers, so the new SenderDB should be fully loaded, with
+            its caches generated, before it is set. The new SenderDB must use the same PSIParams as
+            the one it replaces, because receivers may already hold the parameters.
+
+            The OPRF key must also be the same as the current one unless replace_oprf_key is set.
+            A receiver that has hashed its items with the previous OPRF key and queries the new
+            SenderDB gets wrong results without noticing, so the OPRF key should only be replaced
+            when no such receivers remain. Throws std::invalid_argument if the PSIParams or the
+            OPRF keys differ.
+            */
+            void set_sender_db(
+                const std::string &db_name,
+                std::shared_ptr<SenderDB> sender_db,
+                oprf::OPRFKey oprf_key,
+                bool replace_oprf_key = false);
+
+            /**
+            Replaces the SenderDB with the given name, and uses the OPRF key it holds to serve
+            subsequent OPRF requests directed to it. This function cannot be used if the SenderDB is
+            stripped.
+            */
+            void set_sender_db(
+                const std::string &db_name,
+                std::shared_ptr<SenderDB> sender_db,
+                bool replace_oprf_key = false);
+
+            /**
+            Replaces the default SenderDB and the OPRF key used to serve subsequent requests.
+            */
+            void set_sender_db(
+                std::shared_ptr<SenderDB> sender_db,
+                oprf::OPRFKey oprf_key,
+                bool replace_oprf_key = false)
+            {
+                set_sender_db(
+                    std::string(), std::move(sender_db), std::move(oprf_key), replace_oprf_key);
+            }
+
+            /**
+            Replaces the default SenderDB, and uses the OPRF key it holds to serve subsequent OPRF
+            requests. This function cannot be used if the SenderDB is stripped.
+            */
+            void set_sender_db(std::shared_ptr<SenderDB> sender_db, bool replace_oprf_key = false)
+            {
+                set_sender_db(std::string(), std::move(sender_db), replace_oprf_key);
+            }
+
+            /**
+            Returns the SenderDB with the given name, or nullptr if there is no such SenderDB. The
+            default SenderDB is returned for an empty name.
+            */
+            std::shared_ptr<SenderDB> get_sender_db(const std::string &db_name = "") const;
+
+            /**
+            Returns the OPRF key used for the SenderDB with the given name. The default SenderDB is
+            used for an empty name. Throws std::invalid_argument if there is no such SenderDB.
+            */
+            oprf::OPRFKey get_oprf_key(const std::string &db_name = "") const;
+
+            /**
+            Returns the names of the SenderDBs served, including the empty name of the default
+            SenderDB.
+            */
+            std::vector<std::string> get_db_names() const;
+
             /**
             Run the dispatcher on the given port.
             */
             void run(const std::atomic<bool> &stop, int port);
 
+            /**
+            Sets the maximum number of queries that are processed together. When the queue of a
+            SenderDB is served, up to this many of its waiting queries are processed together with
+            Sender::RunQueries. The default value 1 processes each query separately.
+            */
+            void set_query_batch_size(std::size_t query_batch_size);
+
+            /**
+            Returns the maximum number of queries that are processed together.
+            */
+            std::size_t get_query_batch_size() const noexcept
+            {
+                return query_batch_size_;
+            }
+
+            /**
+            Sets the maximum number of queries that may wait to be processed for each SenderDB. A
+            query that arrives when its SenderDB already has this many queries waiting is answered
+            with a network::SenderOperationResponseError. The value 0 means no limit. The default
+            value is 16.
+            */
+            void set_max_queued_queries(std::size_t max_queued_queries) noexcept
+            {
+                max_queued_queries_ = max_queued_queries;
+            }
+
+            /**
+            Returns the maximum number of queries that may wait to be processed for each SenderDB.
+            */
+            std::size_t get_max_queued_queries() const noexcept
+            {
+                return max_queued_queries_;
+            }
+
+            /**
+            Sets the budget in bytes for the query data of all waiting queries, counted as the
+            uncompressed size of their ciphertexts and relinearization keys. A query that does not
+            fit in the budget is answered with a network::SenderOperationResponseError, unless no
+            other queries are waiting. The value 0 means no limit. The default value is 1 GB.
+            */
+            void set_queued_query_memory_limit(std::size_t queued_query_memory_limit) noexcept
+            {
+                queued_query_memory_limit_ = queued_query_memory_limit;
+            }
+
+            /**
+            Returns the budget in bytes for the query data of all waiting queries.
+            */
+            std::size_t get_queued_query_memory_limit() const noexcept
+            {
+                return queued_query_memory_limit_;
+            }
+
         private:
-            std::shared_ptr<sender::SenderDB> sender_db_;
+            /**
+            A SenderDB served by the dispatcher and the OPRF key used for it.
+            */
+            struct Tenant {
+                std::shared_ptr<SenderDB> sender_db;
+
+                oprf::OPRFKey oprf_key;
+            };
+
+            /**
+            The SenderDBs served, indexed by name. The default SenderDB has an empty name.
+            */
+            std::unordered_map<std::string, Tenant> tenants_;
+
+            /**
+            Protects tenants_, which can be modified while the dispatcher runs.
+            */
+            mutable std::mutex tenants_mtx_;
+
+            std::size_t query_batch_size_ = 1;
+
+            std::size_t max_queued_queries_ = 16;
+
+            std::size_t queued_query_memory_limit_ = std::size_t(1) << 30;
+
+            /**
+            A query waiting to be processed and the size of its query data.
+            */
+            struct QueuedQuery {
+                std::unique_ptr<network::ZMQSenderOperation> sop;
+
+                std::size_t byte_count;
+            };
+
+            /**
+            The queries waiting to be processed, indexed by the name of their SenderDB. These and
+            the members below are only used by the thread running the dispatcher.
+            */
+            std::unordered_map<std::string, std::deque<QueuedQuery>> query_queues_;
+
+            /**
+            The names of the SenderDBs with waiting queries in the order they are served.
+            */
+            std::deque<std::string> queued_db_names_;
 
-            oprf::OPRFKey oprf_key_;
+            /**
+            The total size of the query data of all waiting queries.
+            */
+            std::size_t queued_query_byte_count_ = 0;
+
+            /**
+            Dispatch a request of any kind to the Sender.
+            */
+            void dispatch(
+                std::unique_ptr<network::ZMQSenderOperation> sop,
+                network::ZMQSenderChannel &channel);
 
             /**
             Dispatch a Get Parameters request to the Sender.
@@ -66,11 +282,34 @@ namespace apsi {
                 network::ZMQSenderChannel &channel);
 
             /**
-            Dispatch a Query request to the Sender.
+            Returns a copy of the SenderDB with the given name and its OPRF key. The SenderDB is
+            nullptr if there is no such SenderDB.
+            */
+            Tenant get_tenant(const std::string &db_name) const;
+
+            /**
+            Adds a Query request to the queue of its SenderDB, or answers it with an error if the
+            queue is full or the query data does not fit in the budget.
             */
-            void dispatch_query(
+            void enqueue_query(
                 std::unique_ptr<network::ZMQSenderOperation> sop,
                 network::ZMQSenderChannel &channel);
+
+            /**
+            Processes a batch of waiting queries for the next SenderDB in round-robin order.
+            Returns false if no queries are waiting.
+            */
+            bool dispatch_next_queries(network::ZMQSenderChannel &channel);
+
+            /**
+            Dispatch one or more Query requests directed to the same SenderDB to the Sender to be
+            processed together. Each query that fails is answered with an error response, and a
+            query whose results cannot be sent does not stop the others.
+            */
+            void dispatch_db_queries(
+                const std::string &db_name,
+                std::vector<std::unique_ptr<network::ZMQSenderOperation>> sops,
+                network::ZMQSenderChannel &channel);
         }; // class ZMQSenderDispatcher
     }      // namespace sender
 } // namespace apsi
@@ -0,0 +1,343 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// APSI
+#include "apsi/crypto_context.h"
+#include "apsi/log.h"
+#include "apsi/requests.h"
+#include "apsi/responses.h"
+#include "apsi/util/stopwatch.h"
+#include "apsi/zmq/shard_coordinator.h"
+
+using namespace std;
+using namespace seal;
+
+namespace apsi {
+    using namespace network;
+    using namespace util;
+
+    namespace sender {
+        namespace {
+            /**
+            Polls a shard with the given function until it returns a message. Throws
+            std::runtime_error if the shard sends nothing within the timeout.
+            */
+            template <typename T, typename ReceiveFunc>
+            T receive_from_shard(
+                ReceiveFunc &&receive, const string &endpoint, chrono::milliseconds timeout)
+            {
+                auto deadline = chrono::steady_clock::now() + timeout;
+                T message;
+                while (!(message = receive())) {
+                    if (chrono::steady_clock::now() >= deadline) {
+                        APSI_LOG_ERROR(
+                            "Shard at " << endpoint << " sent nothing for " << timeout.count()
+                                        << " ms");
+                        throw runtime_error("shard timed out");
+                    }
+                    this_thread::sleep_for(1ms);
+                }
+
+                return message;
+            }
+
+            /**
+            Waits for a response of the expected type from a shard.
+            */
+            Response receive_shard_response(
+                ZMQReceiverChannel &chl,
+                SenderOperationType expected,
+                const string &endpoint,
+                chrono::milliseconds timeout)
+            {
+                return receive_from_shard<Response>(
+                    [&]() { return chl.receive_response(expected); }, endpoint, timeout);
+            }
+
+            /**
+            Waits for a ResultPackage from a shard.
+            */
+            unique_ptr<ResultPackage> receive_shard_result(
+                ZMQReceiverChannel &chl,
+                shared_ptr<SEALContext> context,
+                const string &endpoint,
+                chrono::milliseconds timeout)
+            {
+                return receive_from_shard<unique_ptr<ResultPackage>>(
+                    [&]() { return chl.receive_result(context); }, endpoint, timeout);
+            }
+
+            /**
+            Sends an error response to a request that cannot be processed, so the receiver does not
+            wait for a response forever. A failure to send is only logged.
+            */
+            void send_error(
+                ZMQSenderChannel &chl,
+                SenderOperationType request_type,
+                vector<unsigned char> client_id,
+                const string &message)
+            {
+                try {
+                    auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                    nsop_response->sop_response =
+                        make_unique<SenderOperationResponseError>(request_type, message);
+                    nsop_response->client_id = move(client_id);
+                    chl.send(move(nsop_response));
+                } catch (const exception &ex) {
+                    APSI_LOG_ERROR("Failed to send error response: " << ex.what());
+                }
+            }
+        } // namespace
+
+        ZMQShardCoordinator::ZMQShardCoordinator(
+            const vector<string> &shard_endpoints, chrono::milliseconds shard_timeout)
+            : shard_endpoints_(shard_endpoints)
+        {
+            if (shard_endpoints.empty()) {
+                throw invalid_argument("shard_endpoints cannot be empty");
+            }
+            set_shard_timeout(shard_timeout);
+
+            for (const auto &endpoint : shard_endpoints) {
+                auto chl = make_unique<ZMQReceiverChannel>();
+                chl->connect(endpoint);
+
+                // Every shard must use the same parameters
+                chl->send(make_unique<SenderOperationParms>());
+                ParamsResponse response = to_params_response(receive_shard_response(
+                    *chl, SenderOperationType::sop_parms, endpoint, shard_timeout_));
+                if (!params_) {
+                    params_ = move(response->params);
+                } else if (response->params->to_string() != params_->to_string()) {
+                    APSI_LOG_ERROR(
+                        "Failed to create ZMQShardCoordinator: PSIParams of shard at "
+                        << endpoint << " differ from the other shards");
+                    throw invalid_argument("mismatching PSIParams");
+                }
+
+                APSI_LOG_INFO("Connected to shard at " << endpoint);
+                shard_channels_.push_back(move(chl));
+            }
+
+            seal_context_ = CryptoContext(*params_).seal_context();
+        }
+
+        void ZMQShardCoordinator::set_shard_timeout(chrono::milliseconds shard_timeout)
+        {
+            if (shard_timeout.count() <= 0) {
+                throw invalid_argument("shard_timeout must be positive");
+            }
+            shard_timeout_ = shard_timeout;
+        }
+
+        void ZMQShardCoordinator::reconnect_shards()
+        {
+            for (size_t shard_idx = 0; shard_idx < shard_endpoints_.size(); shard_idx++) {
+                try {
+                    auto chl = make_unique<ZMQReceiverChannel>();
+                    chl->connect(shard_endpoints_[shard_idx]);
+                    shard_channels_[shard_idx] = move(chl);
+                } catch (const exception &ex) {
+                    APSI_LOG_ERROR(
+                        "Failed to reconnect to shard at " << shard_endpoints_[shard_idx] << ": "
+                                                           << ex.what());
+                }
+            }
+            APSI_LOG_INFO("Reconnected to the shards");
+        }
+
+        void ZMQShardCoordinator::run(const atomic<bool> &stop, int port)
+        {
+            ZMQSenderChannel chl;
+
+            stringstream ss;
+            ss << "tcp://*:" << port;
+
+            APSI_LOG_INFO("ZMQShardCoordinator listening on port " << port);
+            chl.bind(ss.str());
+
+            // Run until stopped
+            bool logged_waiting = false;
+            while (!stop) {
+                unique_ptr<ZMQSenderOperation> sop;
+                if (!(sop = chl.receive_network_operation(seal_context_))) {
+                    if (!logged_waiting) {
+                        // We want to log 'Waiting' only once, even if we have to wait
+                        // for several sleeps. And only once after processing a request as well.
+                        logged_waiting = true;
+                        APSI_LOG_INFO("Waiting for request from Receiver");
+                    }
+
+                    this_thread::sleep_for(50ms);
+                    continue;
+                }
+
+                // The shards serve a single SenderDB
+                if (!sop->db_name.empty()) {
+                    APSI_LOG_ERROR(
+                        "Failed to process request: SenderDB `" << sop->db_name
+                                                                << "` does not exist");
+                    send_error(
+                        chl, sop->sop->type(), move(sop->client_id), "SenderDB does not exist");
+                    logged_waiting = false;
+                    continue;
+                }
+
+                switch (sop->sop->type()) {
+                case SenderOperationType::sop_parms:
+                    APSI_LOG_INFO("Received parameter request");
+                    dispatch_parms(move(sop), chl);
+                    break;
+
+                case SenderOperationType::sop_oprf:
+                    APSI_LOG_INFO("Received OPRF request");
+                    dispatch_oprf(move(sop), chl);
+                    break;
+
+                case SenderOperationType::sop_query:
+                    APSI_LOG_INFO("Received query");
+                    dispatch_query(move(sop), chl);
+                    break;
+
+                default:
+                    // We should never reach this point
+                    throw runtime_error("invalid operation");
+                }
+
+                logged_waiting = false;
+            }
+        }
+
+        void ZMQShardCoordinator::dispatch_parms(
+            unique_ptr<ZMQSenderOperation> sop, ZMQSenderChannel &chl)
+        {
+            STOPWATCH(sender_stopwatch, "ZMQShardCoordinator::dispatch_params");
+
+            try {
+                auto response_params = make_unique<SenderOperationResponseParms>();
+                response_params->params = make_unique<PSIParams>(*params_);
+
+                auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                nsop_response->sop_response = move(response_params);
+                nsop_response->client_id = move(sop->client_id);
+                chl.send(move(nsop_response));
+            } catch (const exception &ex) {
+                APSI_LOG_ERROR(
+                    "Coordinator threw an exception while processing parameter request: "
+                    << ex.what());
+                send_error(
+                    chl,
+                    SenderOperationType::sop_parms,
+                    move(sop->client_id),
+                    "failed to process parameter request");
+            }
+        }
+
+        void ZMQShardCoordinator::dispatch_oprf(
+            unique_ptr<ZMQSenderOperation> sop, ZMQSenderChannel &chl)
+        {
+            STOPWATCH(sender_stopwatch, "ZMQShardCoordinator::dispatch_oprf");
+
+            try {
+                // All shards hold the same OPRF key, so any of them can answer
+                ZMQReceiverChannel &shard_chl = *shard_channels_.front();
+                shard_chl.send(move(sop->sop));
+
+                auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                nsop_response->sop_response = receive_shard_response(
+                    shard_chl,
+                    SenderOperationType::sop_oprf,
+                    shard_endpoints_.front(),
+                    shard_timeout_);
+                nsop_response->client_id = move(sop->client_id);
+                chl.send(move(nsop_response));
+            } catch (const exception &ex) {
+                APSI_LOG_ERROR(
+                    "Coordinator threw an exception while processing OPRF request: " << ex.what());
+
+                // The OPRF response may still arrive and must not be taken for the next one
+                reconnect_shards();
+                send_error(
+                    chl,
+                    SenderOperationType::sop_oprf,
+                    move(sop->client_id),
+                    "failed to process OPRF request");
+            }
+        }
+
+        void ZMQShardCoordinator::dispatch_query(
+            unique_ptr<ZMQSenderOperation> sop, ZMQSenderChannel &chl)
+        {
+            STOPWATCH(sender_stopwatch, "ZMQShardCoordinator::dispatch_query");
+
+            try {
+                // Every shard receives its own copy of the query
+                stringstream query_stream;
+                sop->sop->save(query_stream);
+                string query_str = query_stream.str();
+                for (auto &shard_chl : shard_channels_) {
+                    auto shard_sop = make_unique<SenderOperationQuery>();
+                    stringstream ss(query_str);
+                    shard_sop->load(ss, seal_context_);
+                    shard_chl->send(move(shard_sop));
+                }
+
+                // The receiver expects a single response announcing all ResultParts
+                vector<uint32_t> package_counts;
+                uint32_t package_count = 0;
+                for (size_t shard_idx = 0; shard_idx < shard_channels_.size(); shard_idx++) {
+                    QueryResponse response = to_query_response(receive_shard_response(
+                        *shard_channels_[shard_idx],
+                        SenderOperationType::sop_query,
+                        shard_endpoints_[shard_idx],
+                        shard_timeout_));
+                    package_counts.push_back(response->package_count);
+                    package_count += response->package_count;
+                }
+
+                auto response_query = make_unique<SenderOperationResponseQuery>();
+                response_query->package_count = package_count;
+                auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                nsop_response->sop_response = move(response_query);
+                nsop_response->client_id = sop->client_id;
+                chl.send(move(nsop_response));
+
+                // Stream the ResultParts of each shard to the receiver unchanged
+                for (size_t shard_idx = 0; shard_idx < shard_channels_.size(); shard_idx++) {
+                    for (uint32_t i = 0; i < package_counts[shard_idx]; i++) {
+                        auto nrp = make_unique<ZMQResultPackage>();
+                        nrp->rp = receive_shard_result(
+                            *shard_channels_[shard_idx],
+                            seal_context_,
+                            shard_endpoints_[shard_idx],
+                            shard_timeout_);
+                        nrp->client_id = sop->client_id;
+                        chl.send(move(nrp));
+                    }
+                }
+            } catch (const exception &ex) {
+                APSI_LOG_ERROR(
+                    "Coordinator threw an exception while processing query: " << ex.what());
+
+                // The other shards may still send responses and ResultParts for this query, which
+                // the next query must not read. A receiver that already got the combined response
+                // fails on the error response instead of waiting for the remaining ResultParts.
+                reconnect_shards();
+                send_error(
+                    chl,
+                    SenderOperationType::sop_query,
+                    move(sop->client_id),
+                    "failed to process query");
+            }
+        }
+    } // namespace sender
+} // namespace apsi
@@ -0,0 +1,134 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+// STD
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// APSI
+#include "apsi/network/zmq/zmq_channel.h"
+#include "apsi/psi_params.h"
+
+// SEAL
+#include "seal/context.h"
+
+namespace apsi {
+    namespace sender {
+        /**
+        The ZMQShardCoordinator serves receivers on behalf of several sender processes, each
+        serving a shard of the same SenderDB (see SenderDB::save_shard) with a
+        ZMQSenderDispatcher. The shards must together hold every bundle index exactly once, and
+        they must use the same OPRF key.
+
+        Parameter requests are answered by the coordinator with the parameters of the shards, and
+        OPRF requests are forwarded to the first shard. A query is forwarded to every shard. The
+        coordinator combines the query responses of the shards into one that announces the total
+        number of ResultParts, and then streams the ResultParts of each shard to the receiver
+        unchanged.
+
+        Requests are processed one at a time, so a slow shard delays the requests of all
+        receivers, not only the request it is working on. A shard that sends nothing for longer
+        than the shard timeout fails the request (see ZMQShardCoordinator::set_shard_timeout). To
+        serve more receivers at once, run several coordinators for the same shards.
+
+        If a request fails, the receiver is sent a network::SenderOperationResponseError, and the
+        coordinator reconnects to the shards so that responses and ResultParts of the failed
+        request that are still on their way cannot be mistaken for those of later requests.
+        */
+        class ZMQShardCoordinator {
+        public:
+            ZMQShardCoordinator() = delete;
+
+            /**
+            Creates a new ZMQShardCoordinator that forwards requests to the shards listening at
+            the given connection points, e.g., "tcp://localhost:1213". The parameters are requested
+            from each shard, and must be the same for all of them. Throws std::runtime_error if a
+            shard does not answer within the given shard timeout.
+            */
+            ZMQShardCoordinator(
+                const std::vector<std::string> &shard_endpoints,
+                std::chrono::milliseconds shard_timeout = std::chrono::seconds(60));
+
+            /**
+            Run the coordinator on the given port.
+            */
+            void run(const std::atomic<bool> &stop, int port);
+
+            /**
+            Returns the parameters of the shards.
+            */
+            const PSIParams &get_params() const
+            {
+                return *params_;
+            }
+
+            /**
+            Returns the number of shards.
+            */
+            std::size_t get_shard_count() const noexcept
+            {
+                return shard_channels_.size();
+            }
+
+            /**
+            Sets how long the coordinator waits for the next response or ResultPart from a shard.
+            If a shard sends nothing for this long, the request fails and the coordinator
+            reconnects to the shards. The timeout must leave time for the shards to process a
+            query. The default value is 60 seconds.
+            */
+            void set_shard_timeout(std::chrono::milliseconds shard_timeout);
+
+            /**
+            Returns how long the coordinator waits for the next response or ResultPart from a
+            shard.
+            */
+            std::chrono::milliseconds get_shard_timeout() const noexcept
+            {
+                return shard_timeout_;
+            }
+
+        private:
+            std::vector<std::string> shard_endpoints_;
+
+            std::vector<std::unique_ptr<network::ZMQReceiverChannel>> shard_channels_;
+
+            std::unique_ptr<PSIParams> params_;
+
+            std::shared_ptr<seal::SEALContext> seal_context_;
+
+            std::chrono::milliseconds shard_timeout_;
+
+            /**
+            Replaces the channels to the shards with new connections. Anything the shards still
+            send to the previous connections is discarded.
+            */
+            void reconnect_shards();
+
+            /**
+            Answer a Get Parameters request.
+            */
+            void dispatch_parms(
+                std::unique_ptr<network::ZMQSenderOperation> sop,
+                network::ZMQSenderChannel &channel);
+
+            /**
+            Forward an OPRF request to the first shard and its response to the receiver.
+            */
+            void dispatch_oprf(
+                std::unique_ptr<network::ZMQSenderOperation> sop,
+                network::ZMQSenderChannel &channel);
+
+            /**
+            Forward a Query request to all shards and their ResultParts to the receiver.
+            */
+            void dispatch_query(
+                std::unique_ptr<network::ZMQSenderOperation> sop,
+                network::ZMQSenderChannel &channel);
+        }; // class ZMQShardCoordinator
+    }      // namespace sender
+} // namespace apsi
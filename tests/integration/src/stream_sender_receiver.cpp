@@ -2,18 +2,27 @@
 // Licensed under the MIT license.
 
 // STD
+#include <functional>
+#include <memory>
 #include <sstream>
+#include <vector>
 
 // APSI
+#include "apsi/crypto_context.h"
 #include "apsi/log.h"
 #include "apsi/network/stream_channel.h"
 #include "apsi/oprf/oprf_sender.h"
+#include "apsi/powers.h"
 #include "apsi/receiver.h"
 #include "apsi/sender.h"
 #include "apsi/sender_db.h"
 #include "apsi/thread_pool_mgr.h"
+#include "apsi/util/utils.h"
 #include "test_utils.h"
 
+// SEAL
+#include "seal/modulus.h"
+
 // Google Test
 #include "gtest/gtest.h"
 
@@ -228,6 +237,124 @@ namespace APSITests {
                 verify_labeled_results(query_result, recv_items, recv_int_items, sender_items);
             }
         }
+
+        void RunLabeledBatchTest(
+            size_t sender_size,
+            vector<pair<size_t, size_t>> client_total_and_int_sizes,
+            const PSIParams &params,
+            size_t num_threads)
+        {
+            Log::SetConsoleDisabled(true);
+            Log::SetLogLevel(Log::Level::info);
+
+            ThreadPoolMgr::SetThreadCount(num_threads);
+
+            vector<pair<Item, Label>> sender_items;
+            for (size_t i = 0; i < sender_size; i++) {
+                sender_items.push_back(make_pair(
+                    Item(i + 1, i + 1),
+                    create_label(seal::util::safe_cast<unsigned char>((i + 1) & 0xFF), 10)));
+            }
+
+            auto sender_db = make_shared<SenderDB>(params, 10, 4, true);
+            sender_db->set_data(sender_items);
+            auto oprf_key = sender_db->get_oprf_key();
+
+            auto seal_context = sender_db->get_seal_context();
+
+            stringstream ss;
+            StreamChannel chl(ss);
+
+            // Each client has its own Receiver (and hence its own keys) and receives its results
+            // on its own channel
+            size_t client_count = client_total_and_int_sizes.size();
+            vector<unique_ptr<Receiver>> receivers;
+            vector<vector<Item>> all_recv_items(client_count);
+            vector<vector<Item>> all_recv_int_items(client_count);
+            vector<vector<LabelKey>> all_label_keys(client_count);
+            vector<IndexTranslationTable> itts(client_count);
+            vector<Query> queries;
+            for (size_t client_idx = 0; client_idx < client_count; client_idx++) {
+                auto client_size = client_total_and_int_sizes[client_idx].first;
+                auto int_size = client_total_and_int_sizes[client_idx].second;
+                ASSERT_TRUE(int_size <= client_size);
+
+                receivers.push_back(make_unique<Receiver>(params));
+                Receiver &receiver = *receivers.back();
+
+                vector<Item> &recv_int_items = all_recv_int_items[client_idx];
+                vector<Item> &recv_items = all_recv_items[client_idx];
+                recv_int_items = rand_subset(sender_items, int_size);
+                for (auto item : recv_int_items) {
+                    recv_items.push_back(item);
+                }
+                for (size_t i = int_size; i < client_size; i++) {
+                    recv_items.push_back({ i + 1, ~(i + 1) });
+                }
+
+                // OPRF
+                oprf::OPRFReceiver oprf_receiver = Receiver::CreateOPRFReceiver(recv_items);
+                ASSERT_NO_THROW(chl.send(Receiver::CreateOPRFRequest(oprf_receiver)));
+                OPRFRequest oprf_request =
+                    to_oprf_request(chl.receive_operation(nullptr, SenderOperationType::sop_oprf));
+                ASSERT_NO_THROW(Sender::RunOPRF(oprf_request, oprf_key, chl));
+                OPRFResponse oprf_response = to_oprf_response(chl.receive_response());
+                vector<HashedItem> hashed_recv_items;
+                tie(hashed_recv_items, all_label_keys[client_idx]) =
+                    Receiver::ExtractHashes(oprf_response, oprf_receiver);
+                ASSERT_EQ(hashed_recv_items.size(), recv_items.size());
+
+                // Create query and send; the sender only collects it for now
+                pair<Request, IndexTranslationTable> recv_query =
+                    receiver.create_query(hashed_recv_items);
+                itts[client_idx] = move(recv_query.second);
+                chl.send(move(recv_query.first));
+
+                QueryRequest sender_query = to_query_request(chl.receive_operation(seal_context));
+                queries.emplace_back(move(sender_query), sender_db);
+            }
+
+            // Process all queries together
+            vector<unique_ptr<stringstream>> result_streams;
+            vector<unique_ptr<StreamChannel>> result_chls;
+            for (size_t client_idx = 0; client_idx < client_count; client_idx++) {
+                result_streams.push_back(make_unique<stringstream>());
+                result_chls.push_back(make_unique<StreamChannel>(*result_streams.back()));
+            }
+            ASSERT_NO_THROW(Sender::RunQueries(
+                vector<reference_wrapper<const Query>>(queries.begin(), queries.end()),
+                chl,
+                [&](Channel &, Response response, size_t query_idx) {
+                    result_chls[query_idx]->send(move(response));
+                },
+                [&](Channel &, ResultPart rp, size_t query_idx) {
+                    result_chls[query_idx]->send(move(rp));
+                }));
+
+            for (size_t client_idx = 0; client_idx < client_count; client_idx++) {
+                Receiver &receiver = *receivers[client_idx];
+                StreamChannel &result_chl = *result_chls[client_idx];
+
+                // Receive query response
+                QueryResponse query_response = to_query_response(result_chl.receive_response());
+                uint32_t package_count = query_response->package_count;
+
+                // Receive all result parts and process result
+                vector<ResultPart> rps;
+                while (package_count--) {
+                    ASSERT_NO_THROW(
+                        rps.push_back(result_chl.receive_result(receiver.get_seal_context())));
+                }
+                auto query_result =
+                    receiver.process_result(all_label_keys[client_idx], itts[client_idx], rps);
+
+                verify_labeled_results(
+                    query_result,
+                    all_recv_items[client_idx],
+                    all_recv_int_items[client_idx],
+                    sender_items);
+            }
+        }
     } // namespace
 
     TEST(StreamSenderReceiverTests, UnlabeledEmpty1)
@@ -754,6 +881,152 @@ namespace APSITests {
             1);
     }
 
+    TEST(StreamSenderReceiverTests, LabeledMediumTiled1)
+    {
+        size_t sender_size = 500;
+
+        // Evaluate all bin bundles at each bundle index together
+        Sender::SetBinBundleTileSize(0);
+        RunLabeledTest(
+            sender_size,
+            { { 0, 0 }, { 1, 1 }, { 50, 10 }, { 100, 50 }, { 100, 100 } },
+            create_params1(),
+            thread::hardware_concurrency());
+
+        // Evaluate bin bundles in pairs
+        Sender::SetBinBundleTileSize(2);
+        RunLabeledTest(
+            sender_size,
+            { { 0, 0 }, { 1, 1 }, { 50, 10 }, { 100, 50 }, { 100, 100 } },
+            create_params2(),
+            thread::hardware_concurrency());
+        Sender::SetBinBundleTileSize(1);
+    }
+
+    TEST(StreamSenderReceiverTests, LabeledMediumEvalMemoryLimit)
+    {
+        size_t sender_size = 500;
+
+        // Evaluate the polynomials of each task one at a time
+        Sender::SetEvalMemoryLimit(1);
+        RunLabeledTest(
+            sender_size,
+            { { 0, 0 }, { 1, 1 }, { 50, 10 }, { 100, 50 }, { 100, 100 } },
+            create_params1(),
+            thread::hardware_concurrency());
+
+        // Also with all bin bundles at each bundle index in one task and several queries
+        Sender::SetBinBundleTileSize(0);
+        RunLabeledBatchTest(
+            sender_size,
+            { { 1, 0 }, { 50, 50 }, { 100, 30 } },
+            create_params2(),
+            thread::hardware_concurrency());
+        Sender::SetBinBundleTileSize(1);
+        Sender::SetEvalMemoryLimit(size_t(256) << 20);
+    }
+
+    TEST(StreamSenderReceiverTests, LabeledMediumBatched1)
+    {
+        size_t sender_size = 500;
+        RunLabeledBatchTest(
+            sender_size,
+            { { 0, 0 }, { 1, 1 }, { 50, 10 }, { 100, 50 }, { 100, 100 } },
+            create_params1(),
+            thread::hardware_concurrency());
+    }
+
+    TEST(StreamSenderReceiverTests, LabeledMediumBatched2)
+    {
+        size_t sender_size = 500;
+
+        // Also evaluate all bin bundles at each bundle index together
+        Sender::SetBinBundleTileSize(0);
+        RunLabeledBatchTest(
+            sender_size,
+            { { 1, 0 }, { 50, 50 }, { 100, 30 } },
+            create_params2(),
+            thread::hardware_concurrency());
+        Sender::SetBinBundleTileSize(1);
+    }
+
+    TEST(StreamSenderReceiverTests, LabeledMediumBatchedPS)
+    {
+        size_t sender_size = 500;
+
+        PSIParams::ItemParams item_params;
+        item_params.felts_per_item = 8;
+
+        PSIParams::TableParams table_params;
+        table_params.hash_func_count = 3;
+        table_params.max_items_per_bin = 16;
+        table_params.table_size = 4096;
+
+        PSIParams::QueryParams query_params;
+        query_params.ps_low_degree = 4;
+        query_params.query_powers = { 1, 3, 5 };
+
+        PSIParams::SEALParams seal_params;
+        seal_params.set_poly_modulus_degree(8192);
+        seal_params.set_coeff_modulus(CoeffModulus::BFVDefault(8192));
+        seal_params.set_plain_modulus(65537);
+
+        RunLabeledBatchTest(
+            sender_size,
+            { { 1, 1 }, { 50, 10 }, { 100, 100 } },
+            { item_params, table_params, query_params, seal_params },
+            thread::hardware_concurrency());
+    }
+
+    TEST(StreamSenderReceiverTests, MediumPowersSwitchedEarly)
+    {
+        size_t sender_size = 500;
+
+        PSIParams::ItemParams item_params;
+        item_params.felts_per_item = 8;
+
+        PSIParams::TableParams table_params;
+        table_params.hash_func_count = 3;
+        table_params.max_items_per_bin = 16;
+        table_params.table_size = 4096;
+
+        PSIParams::QueryParams query_params;
+        query_params.query_powers = { 1, 3, 5 };
+
+        // A longer coeff_modulus chain than the depth of the PowersDag requires
+        PSIParams::SEALParams seal_params;
+        seal_params.set_poly_modulus_degree(8192);
+        seal_params.set_coeff_modulus(CoeffModulus::Create(8192, { 36, 36, 36, 36, 36, 38 }));
+        seal_params.set_plain_modulus(65537);
+
+        PSIParams params(item_params, table_params, query_params, seal_params);
+
+        // The sources of the PowersDag are planned below the top level, so the sender switches
+        // the query powers down before using them
+        CryptoContext context(params);
+        uint32_t max_level = static_cast<uint32_t>(
+            context.seal_context()->first_context_data()->chain_index());
+        PowersDag pd;
+        ASSERT_TRUE(pd.configure(
+            query_params.query_powers,
+            create_powers_set(0, table_params.max_items_per_bin)));
+        pd.plan_levels(max_level, [](uint32_t) { return 1; });
+        for (auto &source : pd.source_nodes()) {
+            ASSERT_GT(max_level, source.level);
+        }
+
+        RunUnlabeledTest(
+            sender_size,
+            { { 0, 0 }, { 1, 1 }, { 50, 10 }, { 100, 50 }, { 100, 100 } },
+            params,
+            thread::hardware_concurrency());
+        RunLabeledTest(
+            sender_size,
+            { { 0, 0 }, { 1, 1 }, { 50, 10 }, { 100, 50 }, { 100, 100 } },
+            params,
+            thread::hardware_concurrency());
+    }
+
     TEST(StreamSenderReceiverTests, LabeledMediumMultiThreaded1)
     {
         size_t sender_size = 500;
@@ -2,10 +2,12 @@
 // Licensed under the MIT license.
 
 // STD
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <numeric>
 #include <random>
+#include <stdexcept>
 #include <vector>
 
 // APSI
@@ -181,4 +183,116 @@ namespace APSITests {
         random_interp(23);
         random_interp(101);
     }
+
+    TEST(InterpolateTests, NewtonInterpolator)
+    {
+        Modulus mod(3);
+
+        // Invalid modulus (not a prime)
+        ASSERT_THROW(auto ni = NewtonInterpolator({ 0 }, Modulus(4)), invalid_argument);
+
+        // Repeated points
+        ASSERT_THROW(auto ni = NewtonInterpolator({ 1, 2, 1 }, mod), logic_error);
+        ASSERT_THROW(auto ni = NewtonInterpolator({ 5, 0, 1, 2, 5 }, Modulus(7)), logic_error);
+
+        // No interpolation points
+        NewtonInterpolator empty_interp({}, mod);
+        ASSERT_EQ(0, empty_interp.point_count());
+        ASSERT_TRUE(empty_interp.interpolate({}) == vector<uint64_t>{ 0 });
+
+        // Invalid number of values
+        NewtonInterpolator interp({ 0, 1 }, mod);
+        ASSERT_EQ(2, interp.point_count());
+        ASSERT_THROW(auto poly = interp.interpolate({ 0 }), invalid_argument);
+        ASSERT_THROW(auto poly = interp.interpolate({ 0, 1, 2 }), invalid_argument);
+
+        // All values zero
+        auto poly = interp.interpolate({ 0, 0 });
+        ASSERT_EQ(2, poly.size());
+        ASSERT_EQ(0, poly[0]);
+        ASSERT_EQ(0, poly[1]);
+
+        // The same interpolator can be used repeatedly
+        poly = interp.interpolate({ 0, 1 });
+        ASSERT_EQ(2, poly.size());
+        ASSERT_EQ(0, poly[0]);
+        ASSERT_EQ(1, poly[1]);
+
+        poly = interp.interpolate({ 1, 0 });
+        ASSERT_EQ(2, poly.size());
+        ASSERT_EQ(1, poly[0]);
+        ASSERT_EQ(2, poly[1]);
+
+        // Interpolate many random value sets over the same random points; the result must match
+        // newton_interpolate_polyn
+        auto random_multi_interp = [](Modulus modulus, size_t point_count) {
+            random_device rd;
+            auto u = uniform_int_distribution<uint64_t>(0, modulus.value() - 1);
+
+            // Sample distinct points
+            vector<uint64_t> points(modulus.value());
+            iota(points.begin(), points.end(), 0);
+            shuffle(points.begin(), points.end(), mt19937_64(rd()));
+            points.resize(point_count);
+
+            NewtonInterpolator ni(points, modulus);
+            for (int i = 0; i < 5; i++) {
+                vector<uint64_t> values;
+                generate_n(back_inserter(values), points.size(), [&]() { return u(rd); });
+
+                auto p = ni.interpolate(values);
+                ASSERT_TRUE(p == newton_interpolate_polyn(points, values, modulus));
+                for (size_t j = 0; j < points.size(); j++) {
+                    ASSERT_EQ(uint64_t_poly_eval(p, points[j], modulus), values[j]);
+                }
+            }
+        };
+
+        random_multi_interp(7, 1);
+        random_multi_interp(13, 5);
+        random_multi_interp(101, 40);
+        random_multi_interp(65537, 100);
+    }
+
+    TEST(InterpolateTests, NewtonInterpolateMany)
+    {
+        Modulus mod(65537);
+
+        NewtonInterpolator empty_interp({}, mod);
+        auto polyns = empty_interp.interpolate_many({ {}, {} });
+        ASSERT_EQ(2, polyns.size());
+        ASSERT_TRUE(polyns[0] == vector<uint64_t>{ 0 });
+        ASSERT_TRUE(polyns[1] == vector<uint64_t>{ 0 });
+
+        NewtonInterpolator interp({ 1, 2, 3 }, mod);
+        ASSERT_TRUE(interp.interpolate_many({}).empty());
+
+        // Invalid number of values in one of the value sets
+        ASSERT_THROW(
+            auto polyns_err = interp.interpolate_many({ { 1, 2, 3 }, { 1, 2 } }), invalid_argument);
+
+        // Random points and value sets, including an all-zero value set; each result must match
+        // the single-polynomial interpolation
+        random_device rd;
+        auto u = uniform_int_distribution<uint64_t>(0, mod.value() - 1);
+        for (size_t point_count : { 1, 2, 17, 64 }) {
+            vector<uint64_t> points(mod.value());
+            iota(points.begin(), points.end(), 0);
+            shuffle(points.begin(), points.end(), mt19937_64(rd()));
+            points.resize(point_count);
+
+            vector<vector<uint64_t>> values_set(7);
+            for (size_t k = 1; k < values_set.size(); k++) {
+                generate_n(back_inserter(values_set[k]), point_count, [&]() { return u(rd); });
+            }
+            values_set[0].resize(point_count, 0);
+
+            NewtonInterpolator ni(points, mod);
+            polyns = ni.interpolate_many(values_set);
+            ASSERT_EQ(values_set.size(), polyns.size());
+            for (size_t k = 0; k < values_set.size(); k++) {
+                ASSERT_TRUE(polyns[k] == ni.interpolate(values_set[k]));
+            }
+        }
+    }
 } // namespace APSITests
@@ -4,6 +4,7 @@
 // STD
 #include <cstddef>
 #include <cstdint>
+#include <map>
 #include <numeric>
 #include <set>
 #include <sstream>
@@ -201,4 +202,39 @@ namespace APSITests {
         ASSERT_EQ(expected.size(), real.size());
         ASSERT_TRUE(equal(expected.begin(), expected.end(), real.begin()));
     }
+
+    TEST(PowersTest, PlanLevels)
+    {
+        PowersDag pd;
+        ASSERT_THROW(pd.plan_levels(3, [](uint32_t) { return 1; }), logic_error);
+
+        // One multiplication from the sources to every other power
+        ASSERT_TRUE(pd.configure({ 1, 2, 5 }, { 1, 2, 3, 4, 5, 6, 7 }));
+        pd.plan_levels(3, [](uint32_t) { return 1; });
+        map<uint32_t, uint32_t> levels;
+        pd.apply([&](auto &node) { levels[node.power] = node.level; });
+        ASSERT_EQ(2, levels[1]);
+        ASSERT_EQ(2, levels[2]);
+        ASSERT_EQ(1, levels[3]);
+        ASSERT_EQ(1, levels[4]);
+        ASSERT_EQ(2, levels[5]);
+        ASSERT_EQ(1, levels[6]);
+        ASSERT_EQ(1, levels[7]);
+
+        // Every parent is at least one level above its children, unless capped by max_level
+        ASSERT_TRUE(pd.configure({ 1 }, { 1, 2, 3, 4, 5, 6, 7, 8 }));
+        pd.plan_levels(10, [](uint32_t power) { return power <= 4 ? 2 : 1; });
+        pd.apply([&](auto &node) { levels[node.power] = node.level; });
+        pd.apply([&](auto &node) {
+            ASSERT_LE(node.power <= 4 ? 2u : 1u, node.level);
+            if (!node.is_source()) {
+                ASSERT_LT(node.level, levels[node.parents.first]);
+                ASSERT_LT(node.level, levels[node.parents.second]);
+            }
+        });
+        ASSERT_EQ(pd.depth() + 1, levels[1]);
+
+        pd.plan_levels(2, [](uint32_t power) { return power <= 4 ? 2 : 1; });
+        pd.apply([&](auto &node) { ASSERT_GE(2, node.level); });
+    }
 } // namespace APSITests
@@ -186,6 +186,89 @@ namespace APSITests {
             load_params.query_params().query_powers.cbegin()));
     }
 
+    TEST(PSIParamsTest, EstimateCost)
+    {
+        PSIParams::ItemParams item_params;
+        item_params.felts_per_item = 8;
+
+        PSIParams::TableParams table_params;
+        table_params.hash_func_count = 3;
+        table_params.max_items_per_bin = 16;
+        table_params.table_size = 2048;
+
+        PSIParams::QueryParams query_params;
+        query_params.query_powers = { 1, 2, 3 };
+
+        size_t pmd = 8192;
+        PSIParams::SEALParams seal_params;
+        seal_params.set_poly_modulus_degree(pmd);
+        seal_params.set_coeff_modulus(CoeffModulus::Create(pmd, { 40, 50, 40 }));
+        seal_params.set_plain_modulus(65537);
+
+        PSIParams psi_params(item_params, table_params, query_params, seal_params);
+        ASSERT_EQ(2, psi_params.bundle_idx_count());
+
+        // Empty SenderDB
+        auto cost = psi_params.estimate_cost(0, 10, 0);
+        ASSERT_EQ(0.0, cost.bin_bundle_count);
+        ASSERT_EQ(0.0, cost.packing_rate);
+        ASSERT_EQ(0, cost.label_size);
+        ASSERT_EQ(10 * 32, cost.response_byte_count);
+        ASSERT_EQ(0.0, cost.plaintext_multiplication_count);
+
+        // Two bundle indices, three query powers, and a query ciphertext at the 40 and 50-bit
+        // primes
+        ASSERT_EQ(10 * 32 + 2 * 3 * pmd * 90 / 8, cost.query_byte_count);
+
+        // Powers 4 through 16 are computed at both bundle indices
+        ASSERT_EQ(2 * 13, cost.ciphertext_multiplication_count);
+        ASSERT_EQ(2 * 13, cost.relinearization_count);
+
+        // Each bin receives 3 * 1000 / 2048 items on average and holds up to 15 items; the
+        // polynomials of degree 15 need 15 plaintext multiplications each
+        cost = psi_params.estimate_cost(1000, 10, 0);
+        ASSERT_GT(cost.bin_bundle_count, 1.9);
+        ASSERT_LE(cost.bin_bundle_count, 4.0);
+        ASSERT_GT(cost.packing_rate, 0.0);
+        ASSERT_LE(cost.packing_rate, 1.0);
+        ASSERT_DOUBLE_EQ(15 * cost.bin_bundle_count, cost.plaintext_multiplication_count);
+        ASSERT_GT(cost.sender_db_byte_count, 0.0);
+
+        // Labels are split into chunks of item_bit_count bits
+        size_t item_bit_count = psi_params.item_bit_count();
+        ASSERT_EQ(1, psi_params.label_size(1));
+        ASSERT_EQ(1, psi_params.label_size(item_bit_count / 8));
+        ASSERT_EQ(2, psi_params.label_size(item_bit_count / 8 + 1));
+        auto labeled_cost = psi_params.estimate_cost(1000, 10, item_bit_count / 8 + 1);
+        ASSERT_EQ(2, labeled_cost.label_size);
+        ASSERT_DOUBLE_EQ(cost.bin_bundle_count, labeled_cost.bin_bundle_count);
+        ASSERT_DOUBLE_EQ(
+            3 * cost.plaintext_multiplication_count, labeled_cost.plaintext_multiplication_count);
+        ASSERT_GT(labeled_cost.response_byte_count, cost.response_byte_count);
+
+        // More items need more BinBundles
+        auto large_cost = psi_params.estimate_cost(100000, 10, 0);
+        ASSERT_GT(large_cost.bin_bundle_count, 3.0 * 100000 / (2 * 1024 * 15));
+        ASSERT_LE(large_cost.packing_rate, 1.0);
+
+        // Paterson-Stockmeyer with low degree 3: powers 1, 2, 3 and 4, 8, 12, 16 are needed
+        query_params.ps_low_degree = 3;
+        query_params.query_powers = { 1, 3 };
+        PSIParams ps_params(item_params, table_params, query_params, seal_params);
+        cost = ps_params.estimate_cost(1000, 10, 0);
+
+        // Powers 2, 4, 8, 12, 16 at both bundle indices, then one multiplication with each of the
+        // high powers 4, 8, 12 for the inner polynomials of a degree 15 polynomial, and one
+        // relinearization per polynomial
+        ASSERT_DOUBLE_EQ(
+            2 * 5 + 3 * cost.bin_bundle_count, cost.ciphertext_multiplication_count);
+        ASSERT_DOUBLE_EQ(2 * 5 + cost.bin_bundle_count, cost.relinearization_count);
+
+        // The 12 coefficients of the inner polynomials are multiplied with low powers, and the 3
+        // constant coefficients of the inner polynomials with high powers
+        ASSERT_DOUBLE_EQ(15 * cost.bin_bundle_count, cost.plaintext_multiplication_count);
+    }
+
     TEST(PSIParamsTest, JSONLoadPSIParams)
     {
         string json =
@@ -45,6 +45,21 @@ namespace APSITests {
         ASSERT_EQ(out_size, in_size);
         ASSERT_EQ(header.type, header2.type);
         ASSERT_EQ(header.version, header2.version);
+        ASSERT_TRUE(header2.db_name.empty());
+
+        header.db_name = "tenant";
+        out_size = header.save(ss);
+
+        in_size = header2.load(ss);
+        ASSERT_EQ(out_size, in_size);
+        ASSERT_EQ(header.type, header2.type);
+        ASSERT_EQ(header.db_name, header2.db_name);
+
+        // Loading a header without a name clears the name
+        header.db_name.clear();
+        header.save(ss);
+        header2.load(ss);
+        ASSERT_TRUE(header2.db_name.empty());
     }
 
     TEST(SenderOperationTest, SaveLoadSenderOperationParms)
@@ -144,4 +144,34 @@ namespace APSITests {
         ASSERT_EQ(SenderOperationType::sop_query, sopr2.type());
         ASSERT_EQ(sopr.package_count, sopr2.package_count);
     }
+
+    TEST(SenderOperationResponseTest, SaveLoadSenderOperationResponseError)
+    {
+        SenderOperationResponseError sopr(SenderOperationType::sop_query, "query is invalid");
+        ASSERT_EQ(SenderOperationType::sop_query, sopr.type());
+
+        stringstream ss;
+        auto out_size = sopr.save(ss);
+        SenderOperationResponseError sopr2(SenderOperationType::sop_query, "");
+        size_t in_size = sopr2.load(ss);
+
+        ASSERT_EQ(out_size, in_size);
+        ASSERT_EQ("query is invalid", sopr2.message);
+
+        // Loading the error as the expected response reports the error
+        sopr.save(ss);
+        SenderOperationResponseQuery sopr_query;
+        ASSERT_THROW(sopr_query.load(ss), SenderOperationError);
+
+        SenderOperationResponseError sopr_oprf(SenderOperationType::sop_oprf, "");
+        sopr_oprf.save(ss);
+        SenderOperationResponseOPRF sopr3;
+        ASSERT_THROW(sopr3.load(ss), SenderOperationError);
+
+        // Other responses cannot be loaded as an error
+        SenderOperationResponseQuery sopr4;
+        sopr4.package_count = 1;
+        sopr4.save(ss);
+        ASSERT_THROW(sopr2.load(ss), runtime_error);
+    }
 } // namespace APSITests
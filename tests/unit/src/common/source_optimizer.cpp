@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+// APSI
+#include "apsi/powers.h"
+#include "apsi/util/source_optimizer.h"
+#include "apsi/util/utils.h"
+
+// Google Test
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::util;
+
+namespace APSITests {
+    TEST(SourceOptimizerTests, FindSources)
+    {
+        SourcesSearchOptions options;
+        options.max_depth = 2;
+        options.max_source_count = 4;
+        options.candidate_count = 5;
+
+        // Every candidate is a feasible set of target powers containing 1, and the best comes first
+        vector<SourcesCandidate> candidates = find_sources(0, 16, options);
+        ASSERT_FALSE(candidates.empty());
+        ASSERT_LE(candidates.size(), options.candidate_count);
+        set<uint32_t> target_powers = create_powers_set(0, 16);
+        for (size_t i = 0; i < candidates.size(); i++) {
+            const SourcesCandidate &candidate = candidates[i];
+            ASSERT_EQ(1, candidate.sources.count(1));
+            ASSERT_LE(candidate.sources.size(), options.max_source_count);
+            ASSERT_LE(candidate.depth, options.max_depth);
+            if (i) {
+                ASSERT_LE(candidates[i - 1].cost, candidate.cost);
+            }
+
+            PowersDag pd;
+            ASSERT_TRUE(pd.configure(candidate.sources, target_powers));
+            ASSERT_EQ(pd.depth(), candidate.depth);
+            ASSERT_EQ(
+                static_cast<uint32_t>(target_powers.size() - candidate.sources.size()),
+                candidate.multiplication_count);
+            ASSERT_LE(candidate.square_count, candidate.multiplication_count);
+        }
+
+        // With Paterson-Stockmeyer only the low powers and the multiples of ps_low_degree + 1 are
+        // targets
+        target_powers = create_powers_set(3, 16);
+        candidates = find_sources(3, 16, options);
+        ASSERT_FALSE(candidates.empty());
+        for (const auto &candidate : candidates) {
+            for (uint32_t source : candidate.sources) {
+                ASSERT_EQ(1, target_powers.count(source));
+            }
+            ASSERT_LE(candidate.depth, options.max_depth);
+        }
+    }
+
+    TEST(SourceOptimizerTests, FindSourcesLimits)
+    {
+        // Depth zero needs every target power as a source
+        SourcesSearchOptions options;
+        options.max_depth = 0;
+        options.max_source_count = 4;
+        vector<SourcesCandidate> candidates = find_sources(0, 4, options);
+        ASSERT_EQ(1, candidates.size());
+        ASSERT_EQ(set<uint32_t>({ 1, 2, 3, 4 }), candidates[0].sources);
+        ASSERT_EQ(0, candidates[0].depth);
+        ASSERT_EQ(0, candidates[0].multiplication_count);
+
+        options.max_source_count = 3;
+        ASSERT_TRUE(find_sources(0, 4, options).empty());
+
+        // Nothing is searched for or returned
+        options.max_depth = 10;
+        options.max_source_count = 0;
+        ASSERT_TRUE(find_sources(0, 4, options).empty());
+        options.max_source_count = 4;
+        options.beam_width = 0;
+        ASSERT_TRUE(find_sources(0, 4, options).empty());
+        options.beam_width = 64;
+        options.candidate_count = 0;
+        ASSERT_TRUE(find_sources(0, 4, options).empty());
+
+        // Expensive query ciphertexts favor fewer sources
+        options.candidate_count = 1;
+        options.query_weight = 100.0;
+        candidates = find_sources(0, 4, options);
+        ASSERT_EQ(1, candidates.size());
+        ASSERT_EQ(set<uint32_t>({ 1 }), candidates[0].sources);
+    }
+
+    TEST(SourceOptimizerTests, EvaluateSources)
+    {
+        // Powers 2 = 1 + 1 and 4 = 2 + 2 are squarings; 3 = 2 + 1 is not
+        SourcesCandidate candidate;
+        candidate.sources = { 1 };
+        ASSERT_TRUE(evaluate_sources(0, 4, 2.0, candidate));
+        ASSERT_EQ(2, candidate.depth);
+        ASSERT_EQ(3, candidate.multiplication_count);
+        ASSERT_EQ(2, candidate.square_count);
+        ASSERT_DOUBLE_EQ(2.0 + 3 - 0.25 * 2, candidate.cost);
+
+        // The search reports the same costs as evaluate_sources
+        SourcesSearchOptions options;
+        options.max_depth = 3;
+        options.max_source_count = 3;
+        vector<SourcesCandidate> candidates = find_sources(2, 20, options);
+        ASSERT_FALSE(candidates.empty());
+        for (const auto &found : candidates) {
+            SourcesCandidate evaluated;
+            evaluated.sources = found.sources;
+            ASSERT_TRUE(evaluate_sources(2, 20, options.query_weight, evaluated));
+            ASSERT_EQ(found.depth, evaluated.depth);
+            ASSERT_EQ(found.multiplication_count, evaluated.multiplication_count);
+            ASSERT_EQ(found.square_count, evaluated.square_count);
+            ASSERT_DOUBLE_EQ(found.cost, evaluated.cost);
+        }
+
+        // Sources must contain 1 and only target powers
+        candidate.sources = { 2, 3 };
+        ASSERT_FALSE(evaluate_sources(0, 4, 1.0, candidate));
+        candidate.sources = { 1, 5 };
+        ASSERT_FALSE(evaluate_sources(0, 4, 1.0, candidate));
+        ASSERT_FALSE(evaluate_sources(3, 16, 1.0, candidate));
+        candidate.sources = { 0, 1 };
+        ASSERT_FALSE(evaluate_sources(0, 4, 1.0, candidate));
+    }
+} // namespace APSITests
@@ -0,0 +1,64 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+// APSI
+#include "apsi/thread_pool_mgr.h"
+
+// Google Test
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace apsi;
+
+namespace APSITests {
+    TEST(ThreadPoolMgrTests, ParallelFor)
+    {
+        ThreadPoolMgr tpm;
+
+        // Nothing to do
+        tpm.parallel_for(0, [](size_t) { FAIL(); });
+
+        // Every index is processed exactly once
+        vector<atomic<size_t>> counts(100);
+        tpm.parallel_for(counts.size(), [&](size_t idx) { counts[idx]++; });
+        for (auto &count : counts) {
+            ASSERT_EQ(1, count);
+        }
+
+        // Exceptions are rethrown in the calling thread
+        ASSERT_THROW(
+            tpm.parallel_for(
+                10,
+                [](size_t idx) {
+                    if (idx == 7) {
+                        throw runtime_error("test");
+                    }
+                }),
+            runtime_error);
+    }
+
+    TEST(ThreadPoolMgrTests, ParallelForNested)
+    {
+        ThreadPoolMgr tpm;
+
+        // Calling parallel_for from more thread pool tasks than there are threads must not
+        // deadlock
+        atomic<size_t> total(0);
+        vector<future<void>> futures;
+        size_t task_count = 4 * ThreadPoolMgr::GetThreadCount();
+        for (size_t i = 0; i < task_count; i++) {
+            futures.push_back(tpm.thread_pool().enqueue(
+                [&]() { tpm.parallel_for(50, [&](size_t) { total++; }); }));
+        }
+        for (auto &f : futures) {
+            f.get();
+        }
+        ASSERT_EQ(50 * task_count, total);
+    }
+} // namespace APSITests
@@ -307,6 +307,30 @@ namespace APSITests {
         clientth.join();
     }
 
+    TEST_F(ZMQChannelTests, UnknownSenderDB)
+    {
+        ZMQSenderChannel svr;
+        ZMQReceiverChannel clt;
+
+        svr.bind("tcp://*:5553");
+        clt.connect("tcp://localhost:5553");
+        clt.set_db_name("unknown");
+
+        auto sop_query = make_unique<SenderOperationQuery>();
+        sop_query->relin_keys = *get_context()->relin_keys();
+        sop_query->data[0].push_back(get_context()->encryptor()->encrypt_zero_symmetric());
+        clt.send(unique_ptr<SenderOperation>(move(sop_query)));
+
+        // The query cannot be loaded without a SEALContext for the SenderDB
+        auto get_context_for_db = [](const string &db_name) -> shared_ptr<SEALContext> {
+            return db_name.empty() ? get_context()->seal_context() : nullptr;
+        };
+        ASSERT_EQ(nullptr, svr.receive_db_operation(get_context_for_db, true));
+
+        // The receiver gets an error instead of waiting for a response forever
+        ASSERT_THROW(clt.receive_response(SenderOperationType::sop_query), SenderOperationError);
+    }
+
     TEST_F(ZMQChannelTests, MultipleClients)
     {
         atomic<bool> finished{ false };
@@ -2,18 +2,23 @@
 // Licensed under the MIT license.
 
 // STD
+#include <algorithm>
 #include <cstddef>
+#include <functional>
 #include <memory>
 #include <numeric>
+#include <random>
 #include <sstream>
 #include <utility>
 #include <vector>
 
 // APSI
 #include "apsi/bin_bundle.h"
+#include "apsi/thread_pool_mgr.h"
 
 // SEAL
 #include "seal/keygenerator.h"
+#include "seal/util/uintarithsmallmod.h"
 
 // Google Test
 #include "gtest/gtest.h"
@@ -147,6 +152,65 @@ namespace APSITests {
             polyns.push_back({ 1, 2, 3, 4, 5 });
             bpp = BatchedPlaintextPolyn(polyns, context, 0, true);
             ASSERT_TRUE(bpp);
+            ASSERT_EQ(5, bpp.zero_coeffs.size());
+            ASSERT_TRUE(all_of(
+                bpp.zero_coeffs.begin(), bpp.zero_coeffs.end(), [](bool b) { return !b; }));
+
+            // Coefficients of degree 1 and 3 are zero in every polynomial
+            polyns.clear();
+            polyns.push_back({ 1, 0, 3 });
+            polyns.push_back({ 1, 0 });
+            polyns.push_back({ 3 });
+            polyns.push_back({ 1, 0, 3, 0, 5 });
+            bpp = BatchedPlaintextPolyn(polyns, context, 0, true);
+            ASSERT_TRUE(bpp);
+            ASSERT_EQ(5, bpp.zero_coeffs.size());
+            ASSERT_FALSE(bpp.is_zero_coeff(0));
+            ASSERT_TRUE(bpp.is_zero_coeff(1));
+            ASSERT_FALSE(bpp.is_zero_coeff(2));
+            ASSERT_TRUE(bpp.is_zero_coeff(3));
+            ASSERT_FALSE(bpp.is_zero_coeff(4));
+            ASSERT_FALSE(bpp.is_zero_coeff(5));
+
+            // Compressed coefficients are stored serialized
+            ASSERT_EQ(5, bpp.coeff_count());
+            ASSERT_EQ(5, bpp.batched_coeffs.size());
+            ASSERT_TRUE(bpp.plain_coeffs.empty());
+
+            // Uncompressed coefficients are stored as Plaintexts
+            bpp = BatchedPlaintextPolyn(polyns, context, 0, false);
+            ASSERT_TRUE(bpp);
+            ASSERT_EQ(5, bpp.coeff_count());
+            ASSERT_TRUE(bpp.batched_coeffs.empty());
+            ASSERT_EQ(5, bpp.plain_coeffs.size());
+            ASSERT_TRUE(bpp.is_zero_coeff(1));
+
+            // Packed coefficients are stored as bit-packed field elements
+            bpp = BatchedPlaintextPolyn(polyns, context, 0, true, true);
+            ASSERT_TRUE(bpp);
+            ASSERT_TRUE(bpp.packed);
+            ASSERT_EQ(4, bpp.packed_felt_count);
+            ASSERT_EQ(5, bpp.coeff_count());
+            ASSERT_EQ(5, bpp.batched_coeffs.size());
+            ASSERT_TRUE(bpp.plain_coeffs.empty());
+            ASSERT_TRUE(bpp.is_zero_coeff(1));
+            size_t bit_count =
+                static_cast<size_t>(params->seal_params().plain_modulus().bit_count());
+            for (const auto &coeff : bpp.batched_coeffs) {
+                ASSERT_EQ((4 * bit_count + 7) / 8, coeff.size());
+            }
+
+            // Packed coefficients encode to the same plaintexts as uncompressed ones
+            BatchedPlaintextPolyn bpp_uncompressed(polyns, context, 0, false);
+            BatchedPlaintextPolyn::CoeffBuffer coeff_buffer(MemoryManager::GetPool());
+            for (size_t deg = 0; deg < bpp.coeff_count(); deg++) {
+                const Plaintext &coeff = bpp.get_coeff(deg, coeff_buffer);
+                const Plaintext &expected = bpp_uncompressed.plain_coeffs[deg];
+                ASSERT_EQ(expected.coeff_count(), coeff.coeff_count());
+                ASSERT_EQ(expected.is_ntt_form(), coeff.is_ntt_form());
+                ASSERT_TRUE(equal(
+                    expected.data(), expected.data() + expected.coeff_count(), coeff.data()));
+            }
         };
 
         // Power-of-two felts_per_item
@@ -207,6 +271,84 @@ namespace APSITests {
             ASSERT_EQ(3, result[2]);
             ASSERT_EQ(15, result[3]);
             ASSERT_TRUE(all_of(result.begin() + 4, result.end(), [](auto a) { return a == 0; }));
+
+            // Uncompressed coefficients give the same result
+            BatchedPlaintextPolyn bpp_uncompressed(polyns, context, 0, false);
+            ct_eval = bpp_uncompressed.eval(ct_ones_vec, pool);
+            context.decryptor()->decrypt(ct_eval, ones_pt2);
+            context.encoder()->decode(ones_pt2, result);
+            ASSERT_EQ(6, result[0]);
+            ASSERT_EQ(3, result[1]);
+            ASSERT_EQ(3, result[2]);
+            ASSERT_EQ(15, result[3]);
+            ASSERT_TRUE(all_of(result.begin() + 4, result.end(), [](auto a) { return a == 0; }));
+
+            // So do packed coefficients
+            BatchedPlaintextPolyn bpp_packed(polyns, context, 0, true, true);
+            ct_eval = bpp_packed.eval(ct_ones_vec, pool);
+            context.decryptor()->decrypt(ct_eval, ones_pt2);
+            context.encoder()->decode(ones_pt2, result);
+            ASSERT_EQ(6, result[0]);
+            ASSERT_EQ(3, result[1]);
+            ASSERT_EQ(3, result[2]);
+            ASSERT_EQ(15, result[3]);
+            ASSERT_TRUE(all_of(result.begin() + 4, result.end(), [](auto a) { return a == 0; }));
+
+            // Polynomials of different degrees can be evaluated together
+            BatchedPlaintextPolyn bpp_short({ { 1, 1 }, { 2 } }, context, 0, true);
+            auto ct_evals = BatchedPlaintextPolyn::EvalMany(
+                { cref(bpp_short), cref(bpp_packed) }, ct_ones_vec, pool);
+            ASSERT_EQ(2, ct_evals.size());
+            context.decryptor()->decrypt(ct_evals[0], ones_pt2);
+            context.encoder()->decode(ones_pt2, result);
+            ASSERT_EQ(2, result[0]);
+            ASSERT_EQ(2, result[1]);
+            ASSERT_TRUE(all_of(result.begin() + 2, result.end(), [](auto a) { return a == 0; }));
+            context.decryptor()->decrypt(ct_evals[1], ones_pt2);
+            context.encoder()->decode(ones_pt2, result);
+            ASSERT_EQ(6, result[0]);
+            ASSERT_EQ(3, result[1]);
+            ASSERT_EQ(3, result[2]);
+            ASSERT_EQ(15, result[3]);
+            ASSERT_TRUE(all_of(result.begin() + 4, result.end(), [](auto a) { return a == 0; }));
+            ASSERT_TRUE(BatchedPlaintextPolyn::EvalMany({}, ct_ones_vec, pool).empty());
+
+            // Several sets of powers can be evaluated together
+            auto ct_evals_many = BatchedPlaintextPolyn::EvalMany(
+                { cref(bpp_short), cref(bpp_packed) },
+                { cref(ct_ones_vec), cref(ct_ones_vec) },
+                pool);
+            ASSERT_EQ(2, ct_evals_many.size());
+            for (const auto &set_evals : ct_evals_many) {
+                ASSERT_EQ(2, set_evals.size());
+                context.decryptor()->decrypt(set_evals[0], ones_pt2);
+                context.encoder()->decode(ones_pt2, result);
+                ASSERT_EQ(2, result[0]);
+                ASSERT_EQ(2, result[1]);
+                context.decryptor()->decrypt(set_evals[1], ones_pt2);
+                context.encoder()->decode(ones_pt2, result);
+                ASSERT_EQ(6, result[0]);
+                ASSERT_EQ(15, result[3]);
+            }
+
+            // Identically zero coefficients are skipped in evaluation
+            polyns.clear();
+            polyns.push_back({ 1, 0, 3 });
+            polyns.push_back({ 1, 0 });
+            polyns.push_back({ 3 });
+            polyns.push_back({ 1, 0, 3, 0, 5 });
+            bpp = BatchedPlaintextPolyn(polyns, context, 0, true);
+            ASSERT_TRUE(bpp.is_zero_coeff(1));
+            ASSERT_TRUE(bpp.is_zero_coeff(3));
+
+            ct_eval = bpp.eval(ct_ones_vec, pool);
+            context.decryptor()->decrypt(ct_eval, ones_pt2);
+            context.encoder()->decode(ones_pt2, result);
+            ASSERT_EQ(4, result[0]);
+            ASSERT_EQ(1, result[1]);
+            ASSERT_EQ(3, result[2]);
+            ASSERT_EQ(9, result[3]);
+            ASSERT_TRUE(all_of(result.begin() + 4, result.end(), [](auto a) { return a == 0; }));
         };
 
         // Power-of-two felts_per_item
@@ -216,6 +358,52 @@ namespace APSITests {
         test_fun(get_params2());
     }
 
+    TEST(BinBundleTests, BatchedPlaintextPolynPlaintextCache)
+    {
+        auto params = get_params1();
+        CryptoContext context(*params);
+        context.set_evaluator();
+
+        auto &plaintext_cache = apsi::sender::util::PlaintextCache::Global();
+        plaintext_cache.clear();
+        plaintext_cache.set_memory_budget(size_t(16) << 20);
+
+        vector<FEltPolyn> polyns{ { 1, 2, 3 }, { 4, 5 } };
+        BatchedPlaintextPolyn::CoeffBuffer coeff_buffer(MemoryManager::GetPool());
+        auto load_coeffs = [&](const BatchedPlaintextPolyn &bpp) {
+            for (size_t deg = 0; deg < bpp.coeff_count(); deg++) {
+                bpp.get_coeff(deg, coeff_buffer);
+            }
+        };
+
+        {
+            BatchedPlaintextPolyn bpp(polyns, context, 0, true);
+            load_coeffs(bpp);
+            ASSERT_EQ(3, plaintext_cache.get_entry_count());
+
+            // Moving keeps the cached coefficients with the polynomial
+            BatchedPlaintextPolyn bpp2(move(bpp));
+            ASSERT_EQ(3, plaintext_cache.get_entry_count());
+            load_coeffs(bpp2);
+            ASSERT_EQ(3, plaintext_cache.get_entry_count());
+
+            bpp = BatchedPlaintextPolyn(polyns, context, 0, true);
+            ASSERT_EQ(3, plaintext_cache.get_entry_count());
+            load_coeffs(bpp);
+            ASSERT_EQ(6, plaintext_cache.get_entry_count());
+
+            // Assigning erases the coefficients cached for the replaced polynomial
+            bpp2 = move(bpp);
+            ASSERT_EQ(3, plaintext_cache.get_entry_count());
+        }
+
+        // Destroying a polynomial erases its cached coefficients
+        ASSERT_EQ(0, plaintext_cache.get_entry_count());
+        ASSERT_EQ(0, plaintext_cache.get_byte_count());
+
+        plaintext_cache.set_memory_budget(0);
+    }
+
     TEST(BinBundleTests, BinBundleUnlabeledCreate)
     {
         auto test_fun = [](shared_ptr<PSIParams> params) {
@@ -300,6 +488,212 @@ namespace APSITests {
         test_fun(get_params2(), 3);
     }
 
+    TEST(BinBundleTests, BinBundleEvalMany)
+    {
+        auto params = get_params1();
+        size_t label_size = 2;
+        CryptoContext context(*params);
+        context.set_evaluator();
+        KeyGenerator keygen(*context.seal_context());
+        context.set_secret(keygen.secret_key());
+
+        // Insert four items with non-linear labels into every bin
+        size_t bins_per_bundle = params->bins_per_bundle();
+        const Modulus &plain_modulus = params->seal_params().plain_modulus();
+        BinBundle bb(context, label_size, 50, 0, bins_per_bundle, true, false);
+        for (felt_t round = 0; round < 4; round++) {
+            AlgItemLabel values;
+            for (size_t bin_idx = 0; bin_idx < bins_per_bundle; bin_idx++) {
+                felt_t item = static_cast<felt_t>(4 * bin_idx) + round + 1;
+                felt_t label_start = seal::util::multiply_uint_mod(item, item, plain_modulus);
+                values.push_back(make_pair(item, create_label(label_size, label_start)));
+            }
+            ASSERT_EQ(static_cast<int>(round) + 1, bb.multi_insert_for_real(values, 0));
+        }
+        bb.regen_cache();
+        const BinBundleCache &cache = bb.get_cache();
+
+        // Encrypt the powers of random query values
+        mt19937_64 rng(1);
+        vector<uint64_t> query(context.encoder()->slot_count());
+        for (auto &x : query) {
+            x = rng() % plain_modulus.value();
+        }
+        vector<Ciphertext> powers(6);
+        vector<uint64_t> power_values(query.size(), 1);
+        for (size_t power = 1; power < powers.size(); power++) {
+            for (size_t i = 0; i < query.size(); i++) {
+                power_values[i] =
+                    seal::util::multiply_uint_mod(power_values[i], query[i], plain_modulus);
+            }
+            Plaintext pt;
+            context.encoder()->encode(power_values, pt);
+            context.encryptor()->encrypt_symmetric(pt, powers[power]);
+            context.evaluator()->transform_to_ntt_inplace(powers[power]);
+        }
+
+        // Evaluate the matching polynomial and all label polynomials together
+        vector<reference_wrapper<const BatchedPlaintextPolyn>> polyns{ cref(
+            cache.batched_matching_polyn) };
+        vector<const vector<FEltPolyn> *> felt_polyns{ &cache.felt_matching_polyns };
+        for (size_t label_idx = 0; label_idx < label_size; label_idx++) {
+            polyns.push_back(cref(cache.batched_interp_polyns[label_idx]));
+            felt_polyns.push_back(&cache.felt_interp_polyns[label_idx]);
+        }
+        MemoryPoolHandle pool = MemoryManager::GetPool();
+        auto ct_evals = BatchedPlaintextPolyn::EvalMany(polyns, powers, pool);
+        ASSERT_EQ(polyns.size(), ct_evals.size());
+
+        // Each result must match evaluating the polynomial separately, and evaluating the
+        // polynomial of each bin on the query value in the clear
+        for (size_t polyn_idx = 0; polyn_idx < polyns.size(); polyn_idx++) {
+            Plaintext pt;
+            vector<uint64_t> result;
+            context.decryptor()->decrypt(ct_evals[polyn_idx], pt);
+            context.encoder()->decode(pt, result);
+
+            Ciphertext ct_eval = polyns[polyn_idx].get().eval(powers, pool);
+            vector<uint64_t> separate_result;
+            context.decryptor()->decrypt(ct_eval, pt);
+            context.encoder()->decode(pt, separate_result);
+            ASSERT_TRUE(result == separate_result);
+
+            for (size_t bin_idx = 0; bin_idx < bins_per_bundle; bin_idx++) {
+                const FEltPolyn &felt_polyn = (*felt_polyns[polyn_idx])[bin_idx];
+                uint64_t expected = 0;
+                for (auto it = felt_polyn.crbegin(); it != felt_polyn.crend(); it++) {
+                    expected =
+                        seal::util::multiply_uint_mod(expected, query[bin_idx], plain_modulus);
+                    expected = seal::util::add_uint_mod(expected, *it, plain_modulus);
+                }
+                ASSERT_EQ(expected, result[bin_idx]);
+            }
+        }
+    }
+
+    TEST(BinBundleTests, BatchedPlaintextPolynEvalMemory)
+    {
+        // Paterson-Stockmeyer needs more levels than the other parameters have
+        PSIParams::ItemParams item_params;
+        item_params.felts_per_item = 8;
+
+        PSIParams::TableParams table_params;
+        table_params.hash_func_count = 3;
+        table_params.max_items_per_bin = 16;
+        table_params.table_size = 1024;
+
+        PSIParams::QueryParams query_params;
+        query_params.query_powers = { 1, 3, 5 };
+
+        size_t pmd = 8192;
+        PSIParams::SEALParams seal_params;
+        seal_params.set_poly_modulus_degree(pmd);
+        seal_params.set_coeff_modulus(CoeffModulus::BFVDefault(pmd));
+        seal_params.set_plain_modulus(65537);
+
+        auto params =
+            make_shared<PSIParams>(item_params, table_params, query_params, seal_params);
+        CryptoContext context(*params);
+        KeyGenerator keygen(*context.seal_context());
+        RelinKeys relin_keys;
+        keygen.create_relin_keys(relin_keys);
+        context.set_evaluator(move(relin_keys));
+        context.set_secret(keygen.secret_key());
+        const Modulus &plain_modulus = params->seal_params().plain_modulus();
+
+        // Polynomials of degree 15, evaluated with and without Paterson-Stockmeyer; with
+        // ps_low_degree 3 there are four inner polynomials
+        size_t coeff_count = 16;
+        uint32_t ps_low_degree = 3;
+        mt19937_64 rng(1);
+        vector<FEltPolyn> felt_polyns(4, FEltPolyn(coeff_count));
+        vector<uint64_t> expected(felt_polyns.size(), 0);
+        for (size_t bin_idx = 0; bin_idx < felt_polyns.size(); bin_idx++) {
+            for (auto &coeff : felt_polyns[bin_idx]) {
+                coeff = rng() % plain_modulus.value();
+                expected[bin_idx] =
+                    seal::util::add_uint_mod(expected[bin_idx], coeff, plain_modulus);
+            }
+        }
+        vector<BatchedPlaintextPolyn> ps_bpps;
+        vector<BatchedPlaintextPolyn> bpps;
+        ps_bpps.reserve(4);
+        bpps.reserve(4);
+        for (size_t i = 0; i < 4; i++) {
+            ps_bpps.emplace_back(felt_polyns, context, ps_low_degree, false);
+            bpps.emplace_back(felt_polyns, context, 0, false);
+        }
+
+        // All powers encrypt ones, so every polynomial evaluates to the sum of its coefficients.
+        // Paterson-Stockmeyer expects the low powers one level above the high powers, and the
+        // high powers in coefficient form. Without Paterson-Stockmeyer, the powers are at the
+        // level of the high powers.
+        auto seal_context = context.seal_context();
+        auto low_parms_id = seal_context->first_context_data()->next_context_data()->parms_id();
+        auto high_parms_id =
+            seal_context->get_context_data(low_parms_id)->next_context_data()->parms_id();
+        Plaintext ones_pt(1);
+        ones_pt[0] = 1;
+        Ciphertext ones_ct;
+        context.encryptor()->encrypt_symmetric(ones_pt, ones_ct);
+        Ciphertext low_ct;
+        context.evaluator()->mod_switch_to(ones_ct, low_parms_id, low_ct);
+        context.evaluator()->transform_to_ntt_inplace(low_ct);
+        Ciphertext high_ct;
+        context.evaluator()->mod_switch_to(ones_ct, high_parms_id, high_ct);
+        vector<Ciphertext> ps_powers(coeff_count, low_ct);
+        for (size_t power = ps_low_degree + 1; power < coeff_count; power += ps_low_degree + 1) {
+            ps_powers[power] = high_ct;
+        }
+        context.evaluator()->transform_to_ntt_inplace(high_ct);
+        vector<Ciphertext> powers(coeff_count, high_ct);
+
+        auto check_results = [&](const vector<vector<Ciphertext>> &results) {
+            ASSERT_EQ(2, results.size());
+            for (const auto &set_results : results) {
+                ASSERT_EQ(4, set_results.size());
+                for (const auto &result : set_results) {
+                    Plaintext pt;
+                    vector<uint64_t> values;
+                    context.decryptor()->decrypt(result, pt);
+                    context.encoder()->decode(pt, values);
+                    ASSERT_TRUE(equal(expected.begin(), expected.end(), values.begin()));
+                }
+            }
+        };
+
+        // A new memory pool records how much the evaluation allocates. With more threads more
+        // inner polynomials are evaluated in parallel, and the estimate must grow accordingly.
+        size_t thread_count = ThreadPoolMgr::GetThreadCount();
+        for (size_t threads : { size_t(1), size_t(4) }) {
+            ThreadPoolMgr::SetThreadCount(threads);
+
+            MemoryPoolHandle ps_pool = MemoryPoolHandle::New();
+            auto ps_results = BatchedPlaintextPolyn::EvalPatstockMany(
+                vector<reference_wrapper<const BatchedPlaintextPolyn>>(
+                    ps_bpps.begin(), ps_bpps.end()),
+                { cref(context), cref(context) },
+                { cref(ps_powers), cref(ps_powers) },
+                ps_low_degree,
+                ps_pool);
+            check_results(ps_results);
+            size_t ps_limit = BatchedPlaintextPolyn::EstimateEvalBytes(
+                ps_bpps.size(), 2, coeff_count, ps_powers[1], ps_low_degree);
+            ASSERT_LE(ps_pool.alloc_byte_count(), ps_limit);
+
+            MemoryPoolHandle pool = MemoryPoolHandle::New();
+            auto results = BatchedPlaintextPolyn::EvalMany(
+                vector<reference_wrapper<const BatchedPlaintextPolyn>>(bpps.begin(), bpps.end()),
+                { cref(powers), cref(powers) },
+                pool);
+            check_results(results);
+            size_t limit =
+                BatchedPlaintextPolyn::EstimateEvalBytes(bpps.size(), 2, coeff_count, powers[1], 0);
+            ASSERT_LE(pool.alloc_byte_count(), limit);
+        }
+        ThreadPoolMgr::SetThreadCount(thread_count);
+    }
+
     TEST(BinBundleTests, BinBundleUnlabeledMultiInsert)
     {
         auto test_fun = [](shared_ptr<PSIParams> params) {
@@ -752,6 +1146,106 @@ namespace APSITests {
         test_fun(get_params2());
     }
 
+    TEST(BinBundleTests, BinBundleTryMultiInsert)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            CryptoContext context(*params);
+            context.set_evaluator();
+
+            // Bins can hold at most 2 items
+            BinBundle unlabeled(context, 0, 3, 0, params->bins_per_bundle(), true, false);
+            unlabeled.regen_cache();
+            ASSERT_EQ(0, unlabeled.get_largest_bin_size(0, params->bins_per_bundle()));
+            ASSERT_EQ(1, unlabeled.try_multi_insert(AlgItem{ 1, 2 }, 0, 3));
+            ASSERT_TRUE(unlabeled.cache_invalid());
+            ASSERT_EQ(2, unlabeled.try_multi_insert(AlgItem{ 1, 3 }, 1, 3));
+            ASSERT_EQ(2, unlabeled.get_largest_bin_size(0, 2));
+            ASSERT_EQ(1, unlabeled.get_largest_bin_size(2, 1));
+
+            // Bin 1 is full
+            ASSERT_EQ(-1, unlabeled.try_multi_insert(AlgItem{ 4, 5 }, 0, 3));
+            ASSERT_EQ(vector<felt_t>({ 1 }), unlabeled.get_item_bins()[0]);
+            ASSERT_THROW(
+                unlabeled.get_largest_bin_size(1, params->bins_per_bundle()), out_of_range);
+
+            // A repeated item part in bin 2 undoes the insertion into bin 1
+            BinBundle labeled(context, 1, 3, 0, params->bins_per_bundle(), true, false);
+            vector<pair<felt_t, vector<felt_t>>> item_labels{ { 1, { 11 } }, { 2, { 12 } } };
+            ASSERT_EQ(1, labeled.try_multi_insert(item_labels, 1, 3));
+            item_labels = { { 3, { 13 } }, { 2, { 14 } } };
+            ASSERT_EQ(-1, labeled.try_multi_insert(item_labels, 1, 3));
+            ASSERT_EQ(vector<felt_t>({ 1 }), labeled.get_item_bins()[1]);
+            ASSERT_EQ(vector<felt_t>({ 2 }), labeled.get_item_bins()[2]);
+            ASSERT_EQ(vector<felt_t>({ 11 }), labeled.get_label_bins()[0][1]);
+            ASSERT_EQ(1, labeled.get_largest_bin_size(0, params->bins_per_bundle()));
+
+            // The same data fits elsewhere
+            ASSERT_EQ(2, labeled.try_multi_insert(item_labels, 0, 3));
+            vector<felt_t> labels;
+            ASSERT_TRUE(labeled.try_get_multi_label({ 3, 2 }, 0, labels));
+            ASSERT_EQ(vector<felt_t>({ 13, 14 }), labels);
+
+            // Removing items updates the bin sizes
+            ASSERT_TRUE(labeled.try_multi_remove({ 3, 2 }, 0));
+            ASSERT_EQ(1, labeled.get_largest_bin_size(0, params->bins_per_bundle()));
+        };
+
+        // Power-of-two felts_per_item
+        test_fun(get_params1());
+
+        // Non-power-of-two felts_per_item
+        test_fun(get_params2());
+    }
+
+    TEST(BinBundleTests, BinBundleTryMerge)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            CryptoContext context(*params);
+            context.set_evaluator();
+
+            // Bins can hold at most 2 items
+            BinBundle bb(context, 1, 3, 0, params->bins_per_bundle(), true, false);
+            BinBundle other(context, 1, 3, 0, params->bins_per_bundle(), true, false);
+            vector<pair<felt_t, vector<felt_t>>> item_labels{ { 1, { 11 } }, { 2, { 12 } } };
+            ASSERT_EQ(1, bb.multi_insert_for_real(item_labels, 0));
+            bb.regen_cache();
+
+            // A repeated item part cannot be merged in labeled mode
+            item_labels = { { 3, { 13 } }, { 2, { 14 } } };
+            ASSERT_EQ(1, other.multi_insert_for_real(item_labels, 0));
+            ASSERT_FALSE(bb.can_merge(other));
+            ASSERT_FALSE(bb.try_merge(other));
+            ASSERT_FALSE(bb.cache_invalid());
+
+            // Merge valid items
+            other.clear();
+            item_labels = { { 3, { 13 } }, { 4, { 14 } } };
+            ASSERT_EQ(1, other.multi_insert_for_real(item_labels, 1));
+            ASSERT_TRUE(bb.try_merge(other));
+            ASSERT_TRUE(bb.cache_invalid());
+            ASSERT_EQ(vector<felt_t>({ 2, 3 }), bb.get_item_bins()[1]);
+            ASSERT_EQ(vector<felt_t>({ 4 }), bb.get_item_bins()[2]);
+            vector<felt_t> labels;
+            ASSERT_TRUE(bb.try_get_multi_label({ 3, 4 }, 1, labels));
+            ASSERT_EQ(vector<felt_t>({ 13, 14 }), labels);
+
+            // Bin 1 is now full
+            ASSERT_FALSE(bb.try_merge(other));
+
+            // BinBundles of different kinds cannot be merged
+            BinBundle unlabeled(context, 0, 3, 0, params->bins_per_bundle(), true, false);
+            ASSERT_THROW(bb.can_merge(unlabeled), invalid_argument);
+            other.strip();
+            ASSERT_THROW(bb.can_merge(other), logic_error);
+        };
+
+        // Power-of-two felts_per_item
+        test_fun(get_params1());
+
+        // Non-power-of-two felts_per_item
+        test_fun(get_params2());
+    }
+
     TEST(BinBundleTests, SaveLoadUnlabeled)
     {
         auto test_fun = [](shared_ptr<PSIParams> params) {
@@ -11,6 +11,7 @@
 #include "apsi/log.h"
 #include "apsi/psi_params.h"
 #include "apsi/sender_db.h"
+#include "apsi/thread_pool_mgr.h"
 
 // Google Test
 #include "gtest/gtest.h"
@@ -89,6 +90,26 @@ namespace APSITests {
             iota(label.begin(), label.end(), start);
             return label;
         }
+
+        /**
+        Sets the thread pool size for the lifetime of the object and restores the previous size
+        afterwards, also when a test assertion fails.
+        */
+        class ThreadCountGuard {
+        public:
+            ThreadCountGuard(size_t threads) : thread_count_(ThreadPoolMgr::GetThreadCount())
+            {
+                ThreadPoolMgr::SetThreadCount(threads);
+            }
+
+            ~ThreadCountGuard()
+            {
+                ThreadPoolMgr::SetThreadCount(thread_count_);
+            }
+
+        private:
+            size_t thread_count_;
+        };
     } // namespace
 
     TEST(SenderDBTests, Constructor)
@@ -529,6 +550,402 @@ namespace APSITests {
         test_fun(get_params2());
     }
 
+    TEST(SenderDBTests, Snapshot)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            SenderDB sender_db(*params, 20, 16, true);
+
+            // Insert until we have 2 BinBundles
+            uint64_t val = 0;
+            while (sender_db.get_bin_bundle_count() < 2) {
+                sender_db.insert_or_assign(
+                    { Item(val, ~val), create_label(static_cast<unsigned char>(val), 20) });
+                val++;
+            }
+
+            auto snapshot = sender_db.get_snapshot();
+            ASSERT_EQ(val, snapshot->get_item_count());
+            ASSERT_EQ(2, snapshot->get_bin_bundle_count());
+
+            // Remove everything; the snapshot must not change
+            while (val > 0) {
+                val--;
+                sender_db.remove(Item(val, ~val));
+            }
+            ASSERT_EQ(0, sender_db.get_item_count());
+            ASSERT_EQ(0, sender_db.get_bin_bundle_count());
+            ASSERT_EQ(0, sender_db.get_snapshot()->get_bin_bundle_count());
+            ASSERT_EQ(2, snapshot->get_bin_bundle_count());
+            ASSERT_NE(0, snapshot->get_item_count());
+
+            size_t cache_count = 0;
+            for (uint32_t bundle_idx = 0; bundle_idx < snapshot->get_bundle_idx_count();
+                 bundle_idx++) {
+                cache_count += snapshot->get_cache_at(bundle_idx).size();
+            }
+            ASSERT_EQ(2, cache_count);
+
+            // Insert a new item and overwrite its label; earlier snapshots are unaffected
+            sender_db.insert_or_assign({ Item(0, ~uint64_t(0)), create_label(0, 20) });
+            auto snapshot2 = sender_db.get_snapshot();
+            sender_db.insert_or_assign({ Item(0, ~uint64_t(0)), create_label(1, 20) });
+            ASSERT_EQ(1, snapshot2->get_item_count());
+            ASSERT_EQ(1, sender_db.get_item_count());
+            ASSERT_EQ(2, snapshot->get_bin_bundle_count());
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
+    TEST(SenderDBTests, SingleThread)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            // With a single thread, an update that waits for thread pool tasks from within a
+            // thread pool task never finishes
+            ThreadCountGuard guard(1);
+
+            SenderDB sender_db(*params, 20, 16, true);
+            vector<pair<Item, Label>> items;
+            for (uint64_t i = 0; i < 200; i++) {
+                items.push_back(
+                    make_pair(Item(i, ~i), create_label(static_cast<unsigned char>(i), 20)));
+            }
+            sender_db.insert_or_assign(items);
+            ASSERT_EQ(200, sender_db.get_item_count());
+
+            // Overwrite a label and remove an item
+            sender_db.insert_or_assign(make_pair(items[0].first, create_label(7, 20)));
+            ASSERT_EQ(create_label(7, 20), sender_db.get_label(items[0].first));
+            sender_db.remove(items[1].first);
+            ASSERT_FALSE(sender_db.has_item(items[1].first));
+            ASSERT_EQ(199, sender_db.get_item_count());
+
+            // Merge a part into the SenderDB
+            SenderDB part(*params, sender_db.get_oprf_key(), 20, 16, true);
+            part.insert_or_assign(make_pair(Item(1000, 0), create_label(1, 20)));
+            sender_db.merge(move(part));
+            ASSERT_EQ(200, sender_db.get_item_count());
+            ASSERT_EQ(create_label(1, 20), sender_db.get_label(Item(1000, 0)));
+
+            // Compact explicitly, and through a removal that crosses the compaction threshold
+            vector<Item> removed_items;
+            for (size_t i = 2; i < 100; i++) {
+                removed_items.push_back(items[i].first);
+            }
+            sender_db.remove(removed_items);
+            sender_db.compact();
+            sender_db.set_compaction_threshold(1.0);
+            sender_db.remove(items[100].first);
+            ASSERT_EQ(101, sender_db.get_item_count());
+            ASSERT_EQ(items[199].second, sender_db.get_label(items[199].first));
+
+            for (uint32_t bundle_idx = 0; bundle_idx < params->bundle_idx_count(); bundle_idx++) {
+                ASSERT_NO_THROW(sender_db.get_cache_at(bundle_idx));
+            }
+
+            // The unlabeled case
+            SenderDB unlabeled_db(*params, 0);
+            unlabeled_db.insert_or_assign(vector<Item>{ Item(0, 0), Item(1, 0) });
+            unlabeled_db.remove(Item(0, 0));
+            ASSERT_EQ(1, unlabeled_db.get_item_count());
+            ASSERT_TRUE(unlabeled_db.has_item(Item(1, 0)));
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
+    TEST(SenderDBTests, Merge)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            // Build two parts from disjoint slices of the data
+            oprf::OPRFKey oprf_key;
+            SenderDB sender_db(*params, oprf_key, 20, 16, true);
+            SenderDB part(*params, oprf_key, 20, 16, true);
+            vector<pair<Item, Label>> items;
+            for (uint64_t i = 0; i < 200; i++) {
+                items.push_back(
+                    make_pair(Item(i, i + 1), create_label(static_cast<unsigned char>(i), 20)));
+            }
+            sender_db.insert_or_assign(
+                vector<pair<Item, Label>>(items.begin(), items.begin() + 100));
+            part.insert_or_assign(vector<pair<Item, Label>>(items.begin() + 100, items.end()));
+            size_t bin_bundle_count = sender_db.get_bin_bundle_count();
+            size_t part_bin_bundle_count = part.get_bin_bundle_count();
+
+            // Parts with items in common cannot be merged
+            SenderDB overlapping(*params, oprf_key, 20, 16, true);
+            overlapping.insert_or_assign(items[0]);
+            ASSERT_THROW(sender_db.merge(move(overlapping)), invalid_argument);
+
+            // Parts with different OPRF keys cannot be merged
+            SenderDB other_key(*params, 20, 16, true);
+            other_key.insert_or_assign(items[199]);
+            ASSERT_THROW(sender_db.merge(move(other_key)), invalid_argument);
+
+            sender_db.merge(move(part));
+            ASSERT_EQ(200, sender_db.get_item_count());
+            ASSERT_EQ(200, sender_db.get_hashed_items().size());
+            ASSERT_GE(bin_bundle_count + part_bin_bundle_count, sender_db.get_bin_bundle_count());
+            ASSERT_EQ(0, part.get_item_count());
+            ASSERT_EQ(0, part.get_bin_bundle_count());
+            ASSERT_TRUE(part.get_hashed_items().empty());
+
+            // All items and labels can be found, and all caches are valid
+            for (const auto &item_label : items) {
+                ASSERT_TRUE(sender_db.has_item(item_label.first));
+                ASSERT_EQ(item_label.second, sender_db.get_label(item_label.first));
+            }
+            for (uint32_t bundle_idx = 0; bundle_idx < params->bundle_idx_count(); bundle_idx++) {
+                ASSERT_NO_THROW(sender_db.get_cache_at(bundle_idx));
+            }
+
+            // The merged SenderDB can be updated as usual
+            sender_db.remove(items[150].first);
+            ASSERT_FALSE(sender_db.has_item(items[150].first));
+            sender_db.insert_or_assign(make_pair(items[0].first, create_label(7, 20)));
+            ASSERT_EQ(create_label(7, 20), sender_db.get_label(items[0].first));
+            ASSERT_EQ(199, sender_db.get_item_count());
+
+            // Stripped parts are merged by adding their BinBundles
+            SenderDB stripped_db(*params, oprf_key, 20, 16, true);
+            SenderDB stripped_part(*params, oprf_key, 20, 16, true);
+            stripped_db.insert_or_assign(items[0]);
+            stripped_part.insert_or_assign(items[1]);
+            stripped_part.strip();
+            ASSERT_THROW(stripped_db.merge(move(stripped_part)), logic_error);
+            stripped_db.strip();
+            stripped_db.merge(move(stripped_part));
+            ASSERT_EQ(2, stripped_db.get_item_count());
+            ASSERT_EQ(2, stripped_db.get_bin_bundle_count());
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
+    TEST(SenderDBTests, Compact)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            oprf::OPRFKey oprf_key;
+            SenderDB sender_db(*params, oprf_key, 20, 16, true);
+            SenderDB auto_db(*params, oprf_key, 20, 16, true);
+            ASSERT_EQ(0.0, auto_db.get_compaction_threshold());
+            ASSERT_THROW(auto_db.set_compaction_threshold(1.5), invalid_argument);
+            auto_db.set_compaction_threshold(0.5);
+            ASSERT_EQ(0.5, auto_db.get_compaction_threshold());
+
+            // Compacting an empty SenderDB does nothing
+            sender_db.compact();
+            ASSERT_EQ(0, sender_db.get_bin_bundle_count());
+
+            vector<pair<Item, Label>> items;
+            for (uint64_t i = 0; i < 2000; i++) {
+                items.push_back(
+                    make_pair(Item(i, ~i), create_label(static_cast<unsigned char>(i), 20)));
+            }
+            sender_db.insert_or_assign(items);
+            auto_db.insert_or_assign(items);
+
+            // Remove all but every tenth item; this leaves holes in all BinBundles
+            vector<Item> removed_items;
+            vector<pair<Item, Label>> kept_items;
+            for (size_t i = 0; i < items.size(); i++) {
+                if (i % 10) {
+                    removed_items.push_back(items[i].first);
+                } else {
+                    kept_items.push_back(items[i]);
+                }
+            }
+            sender_db.remove(removed_items);
+            auto_db.remove(removed_items);
+
+            size_t bin_bundle_count = sender_db.get_bin_bundle_count();
+            double packing_rate = sender_db.get_packing_rate();
+            auto snapshot = sender_db.get_snapshot();
+            sender_db.compact();
+            ASSERT_GT(bin_bundle_count, sender_db.get_bin_bundle_count());
+            ASSERT_LT(packing_rate, sender_db.get_packing_rate());
+            ASSERT_EQ(kept_items.size(), sender_db.get_item_count());
+
+            // Earlier snapshots are unaffected
+            ASSERT_EQ(bin_bundle_count, snapshot->get_bin_bundle_count());
+
+            // The removal compacted the SenderDB with a compaction threshold
+            ASSERT_EQ(sender_db.get_bin_bundle_count(), auto_db.get_bin_bundle_count());
+
+            // All remaining items and labels can be found, and all caches are valid
+            for (const auto &item_label : kept_items) {
+                ASSERT_TRUE(sender_db.has_item(item_label.first));
+                ASSERT_EQ(item_label.second, sender_db.get_label(item_label.first));
+                ASSERT_EQ(item_label.second, auto_db.get_label(item_label.first));
+            }
+            for (uint32_t bundle_idx = 0; bundle_idx < params->bundle_idx_count(); bundle_idx++) {
+                ASSERT_NO_THROW(sender_db.get_cache_at(bundle_idx));
+            }
+
+            // The compacted SenderDB can be updated as usual
+            sender_db.remove(kept_items[0].first);
+            ASSERT_FALSE(sender_db.has_item(kept_items[0].first));
+            sender_db.insert_or_assign(items[1]);
+            ASSERT_EQ(items[1].second, sender_db.get_label(items[1].first));
+
+            // Stripped SenderDBs cannot be compacted
+            sender_db.strip();
+            ASSERT_THROW(sender_db.compact(), logic_error);
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
+    TEST(SenderDBTests, PlacementPolicy)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            vector<pair<Item, Label>> items;
+            for (uint64_t i = 0; i < 1000; i++) {
+                items.push_back(
+                    make_pair(Item(i, ~i), create_label(static_cast<unsigned char>(i), 20)));
+            }
+
+            for (auto policy : { PlacementPolicy::first_fit,
+                                 PlacementPolicy::best_fit,
+                                 PlacementPolicy::sorted_batch }) {
+                SenderDB sender_db(*params, 20, 16, true);
+                ASSERT_EQ(PlacementPolicy::first_fit, sender_db.get_placement_policy());
+                sender_db.set_placement_policy(policy);
+                ASSERT_EQ(policy, sender_db.get_placement_policy());
+
+                // Bulk load half of the items, then insert the rest and overwrite some labels
+                sender_db.set_data(vector<pair<Item, Label>>(items.begin(), items.begin() + 500));
+                sender_db.insert_or_assign(
+                    vector<pair<Item, Label>>(items.begin() + 500, items.end()));
+                sender_db.insert_or_assign(make_pair(items[0].first, create_label(7, 20)));
+                items[0].second = create_label(7, 20);
+                ASSERT_EQ(items.size(), sender_db.get_item_count());
+
+                // All items and labels can be found, and all caches are valid
+                for (const auto &item_label : items) {
+                    ASSERT_EQ(item_label.second, sender_db.get_label(item_label.first));
+                }
+                for (uint32_t bundle_idx = 0; bundle_idx < params->bundle_idx_count();
+                     bundle_idx++) {
+                    ASSERT_NO_THROW(sender_db.get_cache_at(bundle_idx));
+                }
+                items[0].second = create_label(0, 20);
+
+                // Unlabeled data is placed with the same policies
+                SenderDB unlabeled_db(*params, 0, 0, true);
+                unlabeled_db.set_placement_policy(policy);
+                vector<Item> unlabeled_items;
+                for (const auto &item_label : items) {
+                    unlabeled_items.push_back(item_label.first);
+                }
+                unlabeled_db.set_data(unlabeled_items);
+                ASSERT_EQ(unlabeled_items.size(), unlabeled_db.get_item_count());
+                for (const auto &item : unlabeled_items) {
+                    ASSERT_TRUE(unlabeled_db.has_item(item));
+                }
+            }
+
+            SenderDB sender_db(*params, 20, 16, true);
+            ASSERT_THROW(
+                sender_db.set_placement_policy(static_cast<PlacementPolicy>(3)), invalid_argument);
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
+    TEST(SenderDBTests, ItemIndex)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            oprf::OPRFKey oprf_key;
+            SenderDB sender_db(*params, oprf_key, 20, 16, true);
+            ASSERT_FALSE(sender_db.is_item_index_enabled());
+            sender_db.set_compaction_threshold(0.5);
+
+            vector<pair<Item, Label>> items;
+            for (uint64_t i = 0; i < 2000; i++) {
+                items.push_back(
+                    make_pair(Item(i, ~i), create_label(static_cast<unsigned char>(i), 20)));
+            }
+            auto check_labels = [](const SenderDB &db, const vector<pair<Item, Label>> &data) {
+                for (const auto &item_label : data) {
+                    ASSERT_EQ(item_label.second, db.get_label(item_label.first));
+                }
+            };
+
+            // Enabling the index indexes the existing items
+            sender_db.insert_or_assign(
+                vector<pair<Item, Label>>(items.begin(), items.begin() + 1000));
+            sender_db.set_item_index_enabled(true);
+            ASSERT_TRUE(sender_db.is_item_index_enabled());
+            check_labels(sender_db, vector<pair<Item, Label>>(items.begin(), items.begin() + 1000));
+
+            // Insertions and overwrites update the index
+            for (size_t i = 0; i < 1000; i += 3) {
+                items[i].second = create_label(static_cast<unsigned char>(i + 1), 20);
+            }
+            sender_db.insert_or_assign(items);
+            ASSERT_EQ(items.size(), sender_db.get_item_count());
+            check_labels(sender_db, items);
+
+            // Removals, including the compaction they trigger, move the items
+            vector<Item> removed_items;
+            vector<pair<Item, Label>> kept_items;
+            for (size_t i = 0; i < items.size(); i++) {
+                if (i % 10) {
+                    removed_items.push_back(items[i].first);
+                } else {
+                    kept_items.push_back(items[i]);
+                }
+            }
+            sender_db.remove(removed_items);
+            check_labels(sender_db, kept_items);
+            sender_db.compact();
+            check_labels(sender_db, kept_items);
+            for (auto &item_label : kept_items) {
+                item_label.second = create_label(3, 20);
+            }
+            sender_db.insert_or_assign(kept_items);
+            check_labels(sender_db, kept_items);
+
+            // Merged items are indexed, whether or not the other SenderDB has an index
+            SenderDB part(*params, oprf_key, 20, 16, true);
+            SenderDB indexed_part(*params, oprf_key, 20, 16, true);
+            indexed_part.set_item_index_enabled(true);
+            vector<pair<Item, Label>> part_items;
+            vector<pair<Item, Label>> indexed_part_items;
+            for (uint64_t i = 0; i < 200; i++) {
+                part_items.push_back(make_pair(Item(i, i), create_label(1, 20)));
+                indexed_part_items.push_back(make_pair(Item(i, i + 1), create_label(2, 20)));
+            }
+            part.insert_or_assign(part_items);
+            indexed_part.insert_or_assign(indexed_part_items);
+            sender_db.merge(move(part));
+            sender_db.merge(move(indexed_part));
+            check_labels(sender_db, kept_items);
+            check_labels(sender_db, part_items);
+            check_labels(sender_db, indexed_part_items);
+            sender_db.insert_or_assign(make_pair(part_items[0].first, create_label(9, 20)));
+            ASSERT_EQ(create_label(9, 20), sender_db.get_label(part_items[0].first));
+
+            // Disabling the index does not affect the labels
+            sender_db.set_item_index_enabled(false);
+            ASSERT_FALSE(sender_db.is_item_index_enabled());
+            check_labels(sender_db, kept_items);
+
+            // The index cannot be enabled for a stripped SenderDB
+            sender_db.strip();
+            ASSERT_THROW(sender_db.set_item_index_enabled(true), logic_error);
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
     TEST(SenderDBTests, SaveLoadUnlabeled)
     {
         auto test_fun = [](shared_ptr<PSIParams> params) {
@@ -666,6 +1083,52 @@ namespace APSITests {
         test_fun(get_params2());
     }
 
+    TEST(SenderDBTests, SaveLoadPacked)
+    {
+        auto test_fun = [](shared_ptr<PSIParams> params) {
+            SenderDB sender_db(*params, 20, 8, true, true);
+            ASSERT_TRUE(sender_db.is_packed());
+
+            // Create a vector of items and labels without duplicates
+            vector<pair<Item, Label>> items;
+            for (uint64_t i = 0; i < 200; i++) {
+                items.push_back(
+                    make_pair(Item(i, i + 1), create_label(static_cast<unsigned char>(i), 20)));
+            }
+
+            // Insert all items
+            sender_db.insert_or_assign(items);
+
+            stringstream ss;
+            size_t save_size = sender_db.save(ss);
+            auto other = SenderDB::Load(ss);
+            auto other_sdb = move(other.first);
+
+            ASSERT_EQ(save_size, other.second);
+            ASSERT_TRUE(other_sdb.is_packed());
+            ASSERT_EQ(sender_db.get_hashed_items().size(), other_sdb.get_hashed_items().size());
+            ASSERT_EQ(sender_db.get_bin_bundle_count(), other_sdb.get_bin_bundle_count());
+
+            // The loaded batched polynomials are packed and hold the same data
+            for (uint32_t bundle_idx = 0; bundle_idx < params->bundle_idx_count(); bundle_idx++) {
+                auto caches = sender_db.get_cache_at(bundle_idx);
+                auto other_caches = other_sdb.get_cache_at(bundle_idx);
+                ASSERT_EQ(caches.size(), other_caches.size());
+                for (size_t cache_idx = 0; cache_idx < caches.size(); cache_idx++) {
+                    const auto &bmp = caches[cache_idx].get().batched_matching_polyn;
+                    const auto &other_bmp = other_caches[cache_idx].get().batched_matching_polyn;
+                    ASSERT_TRUE(bmp.packed);
+                    ASSERT_TRUE(other_bmp.packed);
+                    ASSERT_EQ(bmp.packed_felt_count, other_bmp.packed_felt_count);
+                    ASSERT_EQ(bmp.batched_coeffs, other_bmp.batched_coeffs);
+                }
+            }
+        };
+
+        test_fun(get_params1());
+        test_fun(get_params2());
+    }
+
     TEST(SenderDBTests, StripUnlabeled)
     {
         auto test_fun = [](shared_ptr<PSIParams> params) {
@@ -686,6 +1149,16 @@ namespace APSITests {
             ASSERT_TRUE(sender_db.has_item(Item(0, 0)));
             auto pr = sender_db.get_packing_rate();
 
+            // A query holding on to the snapshot taken before stripping is not affected
+            auto snapshot = sender_db.get_snapshot();
+            uint32_t bundle_idx = 0;
+            while (!snapshot->get_bin_bundle_count(bundle_idx)) {
+                bundle_idx++;
+            }
+            size_t felt_polyn_count =
+                snapshot->get_cache_at(bundle_idx)[0].get().felt_matching_polyns.size();
+            ASSERT_NE(0, felt_polyn_count);
+
             // Strip and check sizes
             sender_db.strip();
             ASSERT_TRUE(sender_db.is_stripped());
@@ -693,6 +1166,16 @@ namespace APSITests {
             ASSERT_EQ(1, sender_db.get_item_count());
             ASSERT_EQ(1, sender_db.get_bin_bundle_count());
             ASSERT_EQ(pr, sender_db.get_packing_rate());
+            ASSERT_NE(snapshot, sender_db.get_snapshot());
+            ASSERT_EQ(
+                felt_polyn_count,
+                snapshot->get_cache_at(bundle_idx)[0].get().felt_matching_polyns.size());
+            ASSERT_EQ(
+                0,
+                sender_db.get_snapshot()
+                    ->get_cache_at(bundle_idx)[0]
+                    .get()
+                    .felt_matching_polyns.size());
 
             // Attempt operations on a stripped SenderDB
             ASSERT_THROW(sender_db.has_item(Item(0, 0)), logic_error);
@@ -768,4 +1251,98 @@ namespace APSITests {
         test_fun(get_params1());
         test_fun(get_params2());
     }
+
+    TEST(SenderDBTests, SaveLoadShard)
+    {
+        // Use a larger table so the SenderDB has several bundle indices
+        PSIParams::TableParams table_params = get_params1()->table_params();
+        table_params.table_size = 2048;
+        PSIParams params(
+            get_params1()->item_params(),
+            table_params,
+            get_params1()->query_params(),
+            get_params1()->seal_params());
+        uint32_t bundle_idx_count = params.bundle_idx_count();
+        ASSERT_EQ(4, bundle_idx_count);
+
+        SenderDB sender_db(params, 0, 0, false);
+        ASSERT_FALSE(sender_db.is_shard());
+        ASSERT_EQ(0, sender_db.get_bundle_idx_begin());
+        ASSERT_EQ(bundle_idx_count, sender_db.get_bundle_idx_end());
+
+        vector<Item> items;
+        for (uint64_t i = 0; i < 200; i++) {
+            items.push_back(Item(i, i + 1));
+        }
+        sender_db.insert_or_assign(items);
+
+        // Only a stripped SenderDB can be sharded
+        stringstream ss;
+        ASSERT_THROW(sender_db.save_shard(ss, 0, 2), logic_error);
+        sender_db.strip();
+        ASSERT_THROW(sender_db.save_shard(ss, 2, 2), invalid_argument);
+        ASSERT_THROW(sender_db.save_shard(ss, 2, bundle_idx_count + 1), invalid_argument);
+
+        // Save and load two shards
+        stringstream ss1, ss2;
+        size_t save_size1 = sender_db.save_shard(ss1, 0, 2);
+        size_t save_size2 = sender_db.save_shard(ss2, 2, bundle_idx_count);
+        auto shard1 = SenderDB::Load(ss1);
+        auto shard2 = SenderDB::Load(ss2);
+        ASSERT_EQ(save_size1, shard1.second);
+        ASSERT_EQ(save_size2, shard2.second);
+
+        SenderDB &sdb1 = shard1.first;
+        SenderDB &sdb2 = shard2.first;
+        ASSERT_TRUE(sdb1.is_shard());
+        ASSERT_TRUE(sdb1.is_stripped());
+        ASSERT_EQ(0, sdb1.get_bundle_idx_begin());
+        ASSERT_EQ(2, sdb1.get_bundle_idx_end());
+        ASSERT_TRUE(sdb2.is_shard());
+        ASSERT_EQ(2, sdb2.get_bundle_idx_begin());
+        ASSERT_EQ(bundle_idx_count, sdb2.get_bundle_idx_end());
+
+        // Each shard holds exactly the BinBundles of its bundle indices
+        ASSERT_EQ(
+            sender_db.get_bin_bundle_count(),
+            sdb1.get_bin_bundle_count() + sdb2.get_bin_bundle_count());
+        for (uint32_t bundle_idx = 0; bundle_idx < bundle_idx_count; bundle_idx++) {
+            const SenderDB &owner = bundle_idx < 2 ? sdb1 : sdb2;
+            const SenderDB &other = bundle_idx < 2 ? sdb2 : sdb1;
+            ASSERT_EQ(
+                sender_db.get_bin_bundle_count(bundle_idx),
+                owner.get_bin_bundle_count(bundle_idx));
+            ASSERT_EQ(0, other.get_bin_bundle_count(bundle_idx));
+        }
+
+        // Each shard counts the items with a location at its bundle indices; some items have
+        // locations in both shards
+        ASSERT_LT(0, sdb1.get_item_count());
+        ASSERT_GT(200, sdb1.get_item_count());
+        ASSERT_LT(0, sdb2.get_item_count());
+        ASSERT_GT(200, sdb2.get_item_count());
+        ASSERT_LE(200, sdb1.get_item_count() + sdb2.get_item_count());
+
+        // A stripped SenderDB still counts the items of a shard after saving and loading
+        stringstream ss_full;
+        sender_db.save(ss_full);
+        SenderDB loaded_db = SenderDB::Load(ss_full).first;
+        ASSERT_EQ(200, loaded_db.get_item_count());
+        stringstream ss_loaded1;
+        loaded_db.save_shard(ss_loaded1, 0, 2);
+        ASSERT_EQ(sdb1.get_item_count(), SenderDB::Load(ss_loaded1).first.get_item_count());
+
+        // A shard can only be saved within its range
+        stringstream ss3;
+        ASSERT_THROW(sdb1.save_shard(ss3, 0, bundle_idx_count), invalid_argument);
+        sdb1.save(ss3);
+        SenderDB sdb3 = SenderDB::Load(ss3).first;
+        ASSERT_EQ(0, sdb3.get_bundle_idx_begin());
+        ASSERT_EQ(2, sdb3.get_bundle_idx_end());
+        ASSERT_EQ(sdb1.get_item_count(), sdb3.get_item_count());
+
+        // Clearing a shard makes it hold all bundle indices again
+        sdb1.clear();
+        ASSERT_FALSE(sdb1.is_shard());
+    }
 } // namespace APSITests
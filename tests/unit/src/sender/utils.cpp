@@ -1,9 +1,28 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT license.
 
+// STD
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
 // APSI
+#include "apsi/crypto_context.h"
+#include "apsi/psi_params.h"
 #include "apsi/util/cuckoo_filter.h"
 #include "apsi/util/cuckoo_filter_table.h"
+#include "apsi/util/hashed_item_set.h"
+#include "apsi/util/item_index.h"
+#include "apsi/util/ntt_multiply_accumulator.h"
+#include "apsi/util/plaintext_cache.h"
+
+// SEAL
+#include "seal/keygenerator.h"
 
 // Google Test
 #include "gtest/gtest.h"
@@ -12,8 +31,56 @@ using namespace std;
 using namespace apsi;
 using namespace apsi::sender;
 using namespace apsi::sender::util;
+using namespace seal;
 
 namespace APSITests {
+    namespace {
+        PSIParams create_item_index_params()
+        {
+            PSIParams::ItemParams item_params;
+            item_params.felts_per_item = 8;
+
+            PSIParams::TableParams table_params;
+            table_params.hash_func_count = 3;
+            table_params.max_items_per_bin = 8;
+            table_params.table_size = 2048;
+
+            PSIParams::QueryParams query_params;
+            query_params.query_powers = { 1, 3, 5 };
+
+            size_t pmd = 4096;
+            PSIParams::SEALParams seal_params;
+            seal_params.set_poly_modulus_degree(pmd);
+            seal_params.set_coeff_modulus(CoeffModulus::BFVDefault(pmd));
+            seal_params.set_plain_modulus(65537);
+
+            return PSIParams(item_params, table_params, query_params, seal_params);
+        }
+
+        PSIParams create_accumulator_params()
+        {
+            PSIParams::ItemParams item_params;
+            item_params.felts_per_item = 8;
+
+            PSIParams::TableParams table_params;
+            table_params.hash_func_count = 3;
+            table_params.max_items_per_bin = 16;
+            table_params.table_size = 1024;
+
+            PSIParams::QueryParams query_params;
+            query_params.query_powers = { 1, 3, 5 };
+
+            // With 60-bit primes only 2^(128 - 2 * 60) products fit in the 128-bit accumulators
+            size_t pmd = 8192;
+            PSIParams::SEALParams seal_params;
+            seal_params.set_poly_modulus_degree(pmd);
+            seal_params.set_coeff_modulus(CoeffModulus::Create(pmd, { 60, 60, 60 }));
+            seal_params.set_plain_modulus(65537);
+
+            return PSIParams(item_params, table_params, query_params, seal_params);
+        }
+    } // namespace
+
     TEST(SenderUtilsTests, CuckooFilterBasics)
     {
         CuckooFilter filter(70 * 2, 12);
@@ -579,4 +646,504 @@ namespace APSITests {
         ASSERT_FALSE(table.find_tag_in_buckets(0, 1, 0x21));
         ASSERT_FALSE(table.find_tag_in_buckets(0, 2, 0x65));
     }
+
+    TEST(SenderUtilsTests, PlaintextCacheDisabled)
+    {
+        PlaintextCache cache;
+        ASSERT_FALSE(cache.is_enabled());
+
+        size_t load_count = 0;
+        auto loader = [&](Plaintext &pt) {
+            load_count++;
+            pt.resize(100);
+        };
+
+        auto pt = cache.get(0, 0, loader);
+        ASSERT_EQ(100, pt->coeff_count());
+        pt = cache.get(0, 0, loader);
+        ASSERT_EQ(2, load_count);
+        ASSERT_EQ(0, cache.get_entry_count());
+        ASSERT_EQ(0, cache.get_byte_count());
+        ASSERT_EQ(0, cache.get_hit_count());
+        ASSERT_EQ(2, cache.get_miss_count());
+    }
+
+    TEST(SenderUtilsTests, PlaintextCacheHitsAndBudget)
+    {
+        size_t entry_size = sizeof(Plaintext) + 100 * sizeof(Plaintext::pt_coeff_type);
+        PlaintextCache cache(2 * entry_size);
+        ASSERT_TRUE(cache.is_enabled());
+
+        size_t load_count = 0;
+        auto loader = [&](Plaintext &pt) {
+            load_count++;
+            pt.resize(100);
+        };
+
+        auto pt1 = cache.get(0, 1, loader);
+        auto pt2 = cache.get(0, 1, loader);
+        ASSERT_EQ(pt1, pt2);
+        ASSERT_EQ(1, load_count);
+        ASSERT_EQ(1, cache.get_hit_count());
+        ASSERT_EQ(1, cache.get_miss_count());
+        ASSERT_EQ(1, cache.get_entry_count());
+        ASSERT_EQ(entry_size, cache.get_byte_count());
+
+        cache.get(1, 1, loader);
+        ASSERT_EQ(2, cache.get_entry_count());
+        ASSERT_EQ(2 * entry_size, cache.get_byte_count());
+
+        // Does not fit and is not used more frequently than what is cached
+        cache.get(2, 1, loader);
+        ASSERT_EQ(2, cache.get_entry_count());
+        ASSERT_EQ(2 * entry_size, cache.get_byte_count());
+
+        // Shrinking the budget evicts entries
+        cache.set_memory_budget(entry_size);
+        ASSERT_EQ(1, cache.get_entry_count());
+        ASSERT_EQ(entry_size, cache.get_byte_count());
+
+        // The more frequently used entry survives
+        size_t old_load_count = load_count;
+        cache.get(0, 1, loader);
+        ASSERT_EQ(old_load_count, load_count);
+
+        cache.clear();
+        ASSERT_EQ(0, cache.get_entry_count());
+        ASSERT_EQ(0, cache.get_byte_count());
+        ASSERT_TRUE(cache.is_enabled());
+
+        cache.set_memory_budget(0);
+        ASSERT_FALSE(cache.is_enabled());
+    }
+
+    TEST(SenderUtilsTests, PlaintextCacheFrequencyAdmission)
+    {
+        size_t entry_size = sizeof(Plaintext) + 100 * sizeof(Plaintext::pt_coeff_type);
+        PlaintextCache cache(entry_size);
+
+        size_t load_count = 0;
+        auto loader = [&](Plaintext &pt) {
+            load_count++;
+            pt.resize(100);
+        };
+
+        // Key (0, 0) is cached once
+        cache.get(0, 0, loader);
+        ASSERT_EQ(1, cache.get_entry_count());
+
+        // Key (0, 1) is accessed repeatedly; once it is used more frequently it replaces (0, 0)
+        cache.get(0, 1, loader);
+        cache.get(0, 1, loader);
+        ASSERT_EQ(3, load_count);
+        cache.get(0, 1, loader);
+        ASSERT_EQ(3, load_count);
+        ASSERT_EQ(1, cache.get_entry_count());
+
+        // Key (0, 0) must now be reloaded
+        cache.get(0, 0, loader);
+        ASSERT_EQ(4, load_count);
+    }
+
+    TEST(SenderUtilsTests, PlaintextCacheEraseSource)
+    {
+        size_t entry_size = sizeof(Plaintext) + 100 * sizeof(Plaintext::pt_coeff_type);
+        PlaintextCache cache(2 * entry_size);
+
+        size_t load_count = 0;
+        auto loader = [&](Plaintext &pt) {
+            load_count++;
+            pt.resize(100);
+        };
+
+        // Source 5 fills the cache; source 6 is only tracked
+        cache.get(5, 0, loader);
+        cache.get(5, 3, loader);
+        cache.get(5, 3, loader);
+        cache.get(6, 0, loader);
+        ASSERT_EQ(2, cache.get_entry_count());
+        ASSERT_EQ(3, load_count);
+
+        // Erasing an unknown source does nothing
+        cache.erase_source(7);
+        ASSERT_EQ(2, cache.get_entry_count());
+
+        // Erasing source 5 frees its space, so source 6 is now cached
+        cache.erase_source(5);
+        ASSERT_EQ(0, cache.get_entry_count());
+        ASSERT_EQ(0, cache.get_byte_count());
+        cache.get(6, 0, loader);
+        cache.get(6, 0, loader);
+        ASSERT_EQ(4, load_count);
+        ASSERT_EQ(1, cache.get_entry_count());
+
+        // The frequencies of source 5 are gone too: a key that was used twice before counts as
+        // used once and does not replace the more frequently used entries
+        cache.get(6, 1, loader);
+        cache.get(6, 1, loader);
+        ASSERT_EQ(2, cache.get_entry_count());
+        cache.get(5, 3, loader);
+        ASSERT_EQ(6, load_count);
+        ASSERT_EQ(2, cache.get_entry_count());
+        cache.get(6, 0, loader);
+        cache.get(6, 1, loader);
+        ASSERT_EQ(6, load_count);
+
+        cache.erase_source(6);
+        ASSERT_EQ(0, cache.get_entry_count());
+        ASSERT_EQ(0, cache.get_byte_count());
+    }
+
+    TEST(SenderUtilsTests, PlaintextCacheSourceIds)
+    {
+        uint64_t id1 = PlaintextCache::NewSourceId();
+        uint64_t id2 = PlaintextCache::NewSourceId();
+        ASSERT_NE(id1, id2);
+    }
+
+    TEST(SenderUtilsTests, HashedItemSetBasics)
+    {
+        HashedItemSet items;
+        ASSERT_TRUE(items.empty());
+        ASSERT_EQ(items.end(), items.begin());
+        ASSERT_EQ(items.end(), items.find(HashedItem(0, 0)));
+        ASSERT_EQ(0, items.erase(HashedItem(0, 0)));
+
+        // The all-zero item is stored like any other
+        ASSERT_TRUE(items.insert(HashedItem(0, 0)));
+        ASSERT_FALSE(items.insert(HashedItem(0, 0)));
+        ASSERT_TRUE(items.contains(HashedItem(0, 0)));
+        ASSERT_EQ(1, items.size());
+
+        // Insert enough items to grow the table several times
+        for (uint64_t i = 1; i < 1000; i++) {
+            ASSERT_TRUE(items.insert(HashedItem(i, ~i)));
+        }
+        ASSERT_EQ(1000, items.size());
+        ASSERT_LE(items.size() * 8, items.capacity() * 7);
+        for (uint64_t i = 1; i < 1000; i++) {
+            ASSERT_TRUE(items.contains(HashedItem(i, ~i)));
+            ASSERT_FALSE(items.contains(HashedItem(~i, i)));
+            ASSERT_EQ(HashedItem(i, ~i), *items.find(HashedItem(i, ~i)));
+        }
+
+        // Iteration visits every item exactly once
+        set<pair<uint64_t, uint64_t>> visited;
+        for (const auto &item : items) {
+            auto words = item.get_as<uint64_t>();
+            ASSERT_TRUE(visited.emplace(words[0], words[1]).second);
+        }
+        ASSERT_EQ(items.size(), visited.size());
+    }
+
+    TEST(SenderUtilsTests, HashedItemSetErase)
+    {
+        HashedItemSet items;
+        items.reserve(1000);
+        size_t capacity = items.capacity();
+        ASSERT_LE(1000 * 8, capacity * 7);
+
+        // Repeatedly insert and erase at most half the reserved size; deleted slots are reused
+        // and the table does not grow
+        for (uint64_t round = 0; round < 20; round++) {
+            for (uint64_t i = 0; i < 500; i++) {
+                ASSERT_TRUE(items.insert(HashedItem(round * 500 + i, round)));
+            }
+            for (uint64_t i = 0; i < 500; i++) {
+                if (i % 5) {
+                    ASSERT_EQ(1, items.erase(HashedItem(round * 500 + i, round)));
+                }
+            }
+            ASSERT_EQ(100, items.size());
+            for (uint64_t i = 0; i < 500; i++) {
+                ASSERT_EQ(!(i % 5), items.contains(HashedItem(round * 500 + i, round)));
+            }
+            for (uint64_t i = 0; i < 500; i += 5) {
+                ASSERT_EQ(1, items.erase(HashedItem(round * 500 + i, round)));
+            }
+            ASSERT_TRUE(items.empty());
+        }
+        ASSERT_EQ(capacity, items.capacity());
+
+        // Copies are independent, and moving leaves the source empty
+        items.insert(HashedItem(1, 2));
+        HashedItemSet copy = items;
+        copy.insert(HashedItem(3, 4));
+        ASSERT_EQ(1, items.size());
+        ASSERT_EQ(2, copy.size());
+        HashedItemSet moved = move(copy);
+        ASSERT_EQ(2, moved.size());
+        ASSERT_TRUE(moved.contains(HashedItem(3, 4)));
+        ASSERT_TRUE(copy.empty());
+        ASSERT_FALSE(copy.contains(HashedItem(3, 4)));
+
+        items.clear();
+        ASSERT_TRUE(items.empty());
+        ASSERT_EQ(0, items.capacity());
+        ASSERT_FALSE(items.contains(HashedItem(1, 2)));
+    }
+
+    TEST(SenderUtilsTests, ItemIndexBasics)
+    {
+        PSIParams params = create_item_index_params();
+        uint32_t bins_per_bundle = params.bins_per_bundle();
+        ItemIndex index(params);
+        ASSERT_TRUE(index.empty());
+        ASSERT_EQ(index.end(), index.begin());
+        ASSERT_EQ(no_bundle_pos, index.find_bundle_pos(HashedItem(0, 0), 0));
+        ASSERT_EQ(0, index.erase(HashedItem(0, 0)));
+
+        // Every item has a location at bundle index 0 and one at bundle index 1
+        auto locations_of = [&](uint64_t i, uint32_t bundle_pos) {
+            ItemLocations locations;
+            locations.push_back({ static_cast<uint32_t>(i % 64 * 8), bundle_pos, 0 });
+            locations.push_back(
+                { static_cast<uint32_t>(bins_per_bundle + i % 64 * 8), bundle_pos + 1, 0 });
+            return locations;
+        };
+        for (uint64_t i = 0; i < 1000; i++) {
+            index.insert_or_assign(HashedItem(i, ~i), locations_of(i, i % 4));
+        }
+        ASSERT_EQ(1000, index.size());
+        ASSERT_LE(index.size() * 8, index.capacity() * 7);
+        for (uint64_t i = 0; i < 1000; i++) {
+            ASSERT_EQ(i % 4, index.find_bundle_pos(HashedItem(i, ~i), i % 64 * 8));
+            ASSERT_EQ(
+                i % 4 + 1, index.find_bundle_pos(HashedItem(i, ~i), bins_per_bundle + i % 64 * 8));
+            ASSERT_EQ(no_bundle_pos, index.find_bundle_pos(HashedItem(i, ~i), 2 * bins_per_bundle));
+            ASSERT_EQ(no_bundle_pos, index.find_bundle_pos(HashedItem(~i, i), i % 64 * 8));
+        }
+
+        // Overwriting replaces the locations, and erased items are gone
+        index.insert_or_assign(HashedItem(0, ~uint64_t(0)), locations_of(0, 3));
+        ASSERT_EQ(1000, index.size());
+        ASSERT_EQ(3, index.find_bundle_pos(HashedItem(0, ~uint64_t(0)), 0));
+        for (uint64_t i = 500; i < 1000; i++) {
+            ASSERT_EQ(1, index.erase(HashedItem(i, ~i)));
+        }
+        ASSERT_EQ(500, index.size());
+        ASSERT_EQ(no_bundle_pos, index.find_bundle_pos(HashedItem(500, ~uint64_t(500)), 0));
+
+        // Iteration visits every item exactly once
+        set<pair<uint64_t, uint64_t>> visited;
+        for (const auto &entry : index) {
+            auto words = entry.item.get_as<uint64_t>();
+            ASSERT_TRUE(visited.emplace(words[0], words[1]).second);
+            ASSERT_EQ(2, index.get_locations(entry).size());
+        }
+        ASSERT_EQ(index.size(), visited.size());
+
+        // An item has at most hash_func_count_max locations
+        ItemLocations locations;
+        for (size_t i = 0; i < ItemLocations::max_size; i++) {
+            locations.push_back({ 0, 0, 0 });
+        }
+        ASSERT_THROW(locations.push_back({ 0, 0, 0 }), length_error);
+
+        // Clearing keeps the index usable
+        index.clear();
+        ASSERT_TRUE(index.empty());
+        ASSERT_EQ(0, index.capacity());
+        index.insert_or_assign(HashedItem(1, 2), locations_of(1, 0));
+        ASSERT_EQ(0, index.find_bundle_pos(HashedItem(1, 2), 8));
+    }
+
+    TEST(SenderUtilsTests, ItemIndexRemap)
+    {
+        PSIParams params = create_item_index_params();
+        uint32_t bins_per_bundle = params.bins_per_bundle();
+        size_t felts_per_item = params.item_params().felts_per_item;
+        ItemIndex index(params);
+
+        // Each item has one location; the expected positions are remapped right away
+        struct Expected {
+            HashedItem item;
+            uint32_t cuckoo_idx;
+            size_t bundle_pos;
+        };
+        vector<Expected> expected;
+        auto insert_items = [&](uint64_t first, uint64_t count) {
+            for (uint64_t i = first; i < first + count; i++) {
+                uint32_t bundle_idx = static_cast<uint32_t>(i % params.bundle_idx_count());
+                uint32_t cuckoo_idx =
+                    bundle_idx * bins_per_bundle + static_cast<uint32_t>(i % 64 * felts_per_item);
+                ItemLocations locations;
+                locations.push_back({ cuckoo_idx, static_cast<uint32_t>(i % 6), 0 });
+                index.insert_or_assign(HashedItem(i, i + 1), locations);
+                expected.push_back({ HashedItem(i, i + 1), cuckoo_idx, i % 6 });
+            }
+        };
+        auto remap = [&](const vector<BundleRemap> &remaps) {
+            index.remap(remaps);
+            for (auto &e : expected) {
+                uint32_t bin_idx = e.cuckoo_idx % bins_per_bundle;
+                const BundleRemap &bundle_remap = remaps[e.cuckoo_idx / bins_per_bundle];
+                if (!bundle_remap.empty() && e.bundle_pos != no_bundle_pos) {
+                    e.bundle_pos = bundle_remap.remap(e.bundle_pos, bin_idx, felts_per_item);
+                }
+            }
+        };
+        auto check_items = [&]() {
+            for (const auto &e : expected) {
+                size_t bundle_pos = index.find_bundle_pos(e.item, e.cuckoo_idx);
+                if (e.bundle_pos == no_bundle_pos) {
+                    ASSERT_LE(6, bundle_pos);
+                } else {
+                    ASSERT_EQ(e.bundle_pos, bundle_pos);
+                }
+            }
+        };
+
+        // Bundle index 0 loses its first BinBundle; bundle index 1 keeps its BinBundles, but the
+        // groups of the BinBundle at position 5 are moved to positions 0 and 1
+        insert_items(0, 1000);
+        vector<BundleRemap> remaps(params.bundle_idx_count());
+        remaps[0].new_positions = { no_bundle_pos, 0, 1, 2, 3, 4 };
+        remaps[1].moved_groups[5] = vector<size_t>(bins_per_bundle / felts_per_item);
+        for (size_t group = 0; group < remaps[1].moved_groups[5].size(); group++) {
+            remaps[1].moved_groups[5][group] = group % 2;
+        }
+        remap(remaps);
+        check_items();
+
+        // Items inserted after a remap already have their current positions
+        insert_items(1000, 100);
+        check_items();
+
+        // Many more remaps than max_pending_remaps; the new BinBundles are rotated each time
+        for (size_t round = 0; round < 3 * ItemIndex::max_pending_remaps; round++) {
+            vector<BundleRemap> rotate(params.bundle_idx_count());
+            rotate[round % params.bundle_idx_count()].new_positions = { 5, 0, 1, 2, 3, 4 };
+            remap(rotate);
+            check_items();
+            insert_items(2000 + round * 10, 10);
+            check_items();
+        }
+
+        // The locations returned with the entries are current
+        for (const auto &entry : index) {
+            ItemLocations locations = index.get_locations(entry);
+            ASSERT_EQ(1, locations.size());
+            ASSERT_EQ(
+                index.find_bundle_pos(entry.item, locations.begin()->cuckoo_idx),
+                locations.begin()->bundle_pos);
+        }
+
+        // Copies are independent
+        ItemIndex copy = index;
+        copy.remap(remaps);
+        check_items();
+    }
+
+    TEST(SenderUtilsTests, NTTMultiplyAccumulator)
+    {
+        PSIParams params = create_accumulator_params();
+        CryptoContext context(params);
+        context.set_evaluator();
+        KeyGenerator keygen(*context.seal_context());
+        context.set_secret(keygen.secret_key());
+        auto evaluator = context.evaluator();
+        parms_id_type parms_id = context.seal_context()->first_parms_id();
+        size_t pmd = params.seal_params().poly_modulus_degree();
+        uint64_t plain_modulus = params.seal_params().plain_modulus().value();
+        auto is_zero = [](const Ciphertext &ct) {
+            return all_of(ct.data(), ct.data() + ct.dyn_array().size(), [](uint64_t coeff) {
+                return !coeff;
+            });
+        };
+
+        NTTMultiplyAccumulator acc(*context.seal_context(), parms_id, MemoryManager::GetPool());
+        ASSERT_TRUE(acc.empty());
+        ASSERT_EQ(256, acc.get_max_lazy_term_count());
+
+        // Nothing accumulated gives an identically zero result
+        Ciphertext result;
+        acc.finalize(result);
+        ASSERT_EQ(2, result.size());
+        ASSERT_TRUE(result.is_ntt_form());
+        ASSERT_EQ(parms_id, result.parms_id());
+        ASSERT_TRUE(is_zero(result));
+
+        // Ciphertexts with two components, and a product with three components to grow the
+        // accumulator
+        mt19937_64 rng(1);
+        auto random_plain = [&]() {
+            Plaintext plain(pmd);
+            for (size_t i = 0; i < pmd; i++) {
+                plain[i] = rng() % plain_modulus;
+            }
+            return plain;
+        };
+        vector<Ciphertext> cts(4);
+        for (auto &ct : cts) {
+            context.encryptor()->encrypt_symmetric(random_plain(), ct);
+        }
+        evaluator->square_inplace(cts.back());
+        for (auto &ct : cts) {
+            evaluator->transform_to_ntt_inplace(ct);
+        }
+        ASSERT_EQ(3, cts.back().size());
+
+        // Accumulate more products than fit in the accumulators without an early reduction. The
+        // ciphertext with three components is used only after the first 100 products.
+        size_t term_count = acc.get_max_lazy_term_count() + 50;
+        Ciphertext expected;
+        Ciphertext product;
+        for (size_t term_idx = 0; term_idx < term_count; term_idx++) {
+            const Ciphertext &ct = cts[term_idx < 100 ? term_idx % 3 : term_idx % cts.size()];
+            Plaintext plain = random_plain();
+            evaluator->transform_to_ntt_inplace(plain, parms_id);
+            acc.multiply_plain_add(ct, plain);
+
+            evaluator->multiply_plain(ct, plain, product);
+            if (term_idx) {
+                evaluator->add_inplace(expected, product);
+            } else {
+                expected = product;
+            }
+        }
+        ASSERT_FALSE(acc.empty());
+
+        // The result is fully reduced, so it equals the sum computed by the Evaluator
+        acc.finalize(result);
+        ASSERT_EQ(expected.size(), result.size());
+        ASSERT_TRUE(result.is_ntt_form());
+        ASSERT_EQ(parms_id, result.parms_id());
+        ASSERT_TRUE(equal(
+            result.data(), result.data() + result.dyn_array().size(), expected.data()));
+
+        // Both results decrypt the same after leaving NTT form and switching to the last level
+        evaluator->transform_from_ntt_inplace(result);
+        evaluator->transform_from_ntt_inplace(expected);
+        evaluator->mod_switch_to_next_inplace(result);
+        evaluator->mod_switch_to_next_inplace(expected);
+        Plaintext result_pt;
+        Plaintext expected_pt;
+        context.decryptor()->decrypt(result, result_pt);
+        context.decryptor()->decrypt(expected, expected_pt);
+        ASSERT_EQ(expected_pt, result_pt);
+
+        // After a reset the accumulator starts over but keeps its three components
+        acc.reset();
+        ASSERT_TRUE(acc.empty());
+        acc.finalize(result);
+        ASSERT_EQ(3, result.size());
+        ASSERT_TRUE(is_zero(result));
+
+        // Only NTT-form inputs at the accumulator's parms_id are accepted
+        Plaintext plain = random_plain();
+        ASSERT_THROW(acc.multiply_plain_add(cts[0], plain), invalid_argument);
+        evaluator->transform_to_ntt_inplace(plain, context.seal_context()->last_parms_id());
+        ASSERT_THROW(acc.multiply_plain_add(cts[0], plain), invalid_argument);
+        plain = random_plain();
+        evaluator->transform_to_ntt_inplace(plain, parms_id);
+        Ciphertext non_ntt = cts[0];
+        evaluator->transform_from_ntt_inplace(non_ntt);
+        ASSERT_THROW(acc.multiply_plain_add(non_ntt, plain), invalid_argument);
+
+        ASSERT_THROW(
+            NTTMultiplyAccumulator(
+                *context.seal_context(), parms_id_zero, MemoryManager::GetPool()),
+            invalid_argument);
+    }
 } // namespace APSITests
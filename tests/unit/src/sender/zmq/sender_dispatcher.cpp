@@ -0,0 +1,174 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// APSI
+#include "apsi/network/zmq/zmq_channel.h"
+#include "apsi/oprf/oprf_sender.h"
+#include "apsi/psi_params.h"
+#include "apsi/receiver.h"
+#include "apsi/sender_db.h"
+#include "apsi/zmq/sender_dispatcher.h"
+
+// Google Test
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::network;
+using namespace apsi::oprf;
+using namespace apsi::receiver;
+using namespace apsi::sender;
+using namespace seal;
+
+namespace APSITests {
+    namespace {
+        shared_ptr<PSIParams> get_params(size_t felts_per_item)
+        {
+            PSIParams::ItemParams item_params;
+            item_params.felts_per_item = static_cast<uint32_t>(felts_per_item);
+
+            PSIParams::TableParams table_params;
+            table_params.hash_func_count = 3;
+            table_params.max_items_per_bin = 8;
+            table_params.table_size = 512;
+
+            PSIParams::QueryParams query_params;
+            query_params.query_powers = { 1, 3, 5 };
+
+            size_t pmd = 4096;
+            PSIParams::SEALParams seal_params;
+            seal_params.set_poly_modulus_degree(pmd);
+            seal_params.set_coeff_modulus(CoeffModulus::BFVDefault(pmd));
+            seal_params.set_plain_modulus(65537);
+
+            return make_shared<PSIParams>(item_params, table_params, query_params, seal_params);
+        }
+
+        shared_ptr<SenderDB> create_sender_db(
+            const PSIParams &params, const OPRFKey &oprf_key, uint64_t item_count)
+        {
+            auto sender_db = make_shared<SenderDB>(params, oprf_key);
+            vector<Item> items;
+            for (uint64_t i = 0; i < item_count; i++) {
+                items.emplace_back(i, i + 1);
+            }
+            sender_db->insert_or_assign(items);
+            return sender_db;
+        }
+
+        /**
+        Sends three queries to the dispatcher before it starts running, so they wait together, and
+        returns how many of them the dispatcher rejects.
+        */
+        size_t count_rejected_queries(ZMQSenderDispatcher &dispatcher, int port)
+        {
+            ZMQReceiverChannel chl;
+            chl.connect("tcp://localhost:" + to_string(port));
+            Receiver receiver(dispatcher.get_sender_db()->get_params());
+            for (uint64_t i = 0; i < 3; i++) {
+                chl.send(receiver.create_query({ HashedItem(i, i) }).first);
+            }
+
+            atomic<bool> stop{ false };
+            thread dispatcher_thread([&]() { dispatcher.run(stop, port); });
+
+            // Rejections are sent as the queries arrive, before the admitted query is processed
+            size_t rejected_count = 0;
+            size_t response_count = 0;
+            while (response_count < 3) {
+                try {
+                    if (!chl.receive_response(SenderOperationType::sop_query)) {
+                        this_thread::sleep_for(50ms);
+                        continue;
+                    }
+                } catch (const SenderOperationError &) {
+                    rejected_count++;
+                }
+                response_count++;
+            }
+
+            stop = true;
+            dispatcher_thread.join();
+            return rejected_count;
+        }
+    } // namespace
+
+    TEST(ZMQSenderDispatcherTests, SetSenderDB)
+    {
+        auto params = get_params(8);
+        OPRFKey oprf_key;
+        ZMQSenderDispatcher dispatcher(create_sender_db(*params, oprf_key, 10));
+        dispatcher.add_sender_db("named", create_sender_db(*params, oprf_key, 20));
+        ASSERT_EQ(10, dispatcher.get_sender_db()->get_item_count());
+        ASSERT_EQ(20, dispatcher.get_sender_db("named")->get_item_count());
+
+        // Replace the default SenderDB, and the named one with a stripped SenderDB
+        dispatcher.set_sender_db(create_sender_db(*params, oprf_key, 30));
+        ASSERT_EQ(30, dispatcher.get_sender_db()->get_item_count());
+        auto stripped_db = create_sender_db(*params, oprf_key, 40);
+        OPRFKey stripped_key = stripped_db->strip();
+        dispatcher.set_sender_db("named", stripped_db, stripped_key);
+        ASSERT_EQ(stripped_db, dispatcher.get_sender_db("named"));
+        ASSERT_EQ(40, dispatcher.get_sender_db("named")->get_item_count());
+
+        // A SenderDB that is not served cannot be replaced
+        ASSERT_THROW(
+            dispatcher.set_sender_db("other", create_sender_db(*params, oprf_key, 1)),
+            invalid_argument);
+        ASSERT_THROW(dispatcher.get_oprf_key("other"), invalid_argument);
+        ASSERT_THROW(dispatcher.set_sender_db(nullptr), invalid_argument);
+
+        // The parameters must not change
+        auto other_params = get_params(4);
+        auto current_db = dispatcher.get_sender_db();
+        ASSERT_THROW(
+            dispatcher.set_sender_db(create_sender_db(*other_params, oprf_key, 10)),
+            invalid_argument);
+        ASSERT_THROW(
+            dispatcher.set_sender_db(create_sender_db(*other_params, oprf_key, 10), true),
+            invalid_argument);
+        ASSERT_EQ(current_db, dispatcher.get_sender_db());
+
+        // The OPRF key must not change unless explicitly replaced
+        OPRFKey new_oprf_key;
+        ASSERT_THROW(
+            dispatcher.set_sender_db(create_sender_db(*params, new_oprf_key, 10)),
+            invalid_argument);
+        ASSERT_THROW(
+            dispatcher.set_sender_db("named", stripped_db, new_oprf_key), invalid_argument);
+        ASSERT_EQ(current_db, dispatcher.get_sender_db());
+        ASSERT_TRUE(oprf_key == dispatcher.get_oprf_key());
+
+        dispatcher.set_sender_db(create_sender_db(*params, new_oprf_key, 50), true);
+        ASSERT_EQ(50, dispatcher.get_sender_db()->get_item_count());
+        ASSERT_TRUE(new_oprf_key == dispatcher.get_oprf_key());
+        ASSERT_TRUE(oprf_key == dispatcher.get_oprf_key("named"));
+    }
+
+    TEST(ZMQSenderDispatcherTests, QueryAdmission)
+    {
+        auto params = get_params(8);
+        OPRFKey oprf_key;
+        ZMQSenderDispatcher dispatcher(create_sender_db(*params, oprf_key, 10));
+        ASSERT_EQ(16, dispatcher.get_max_queued_queries());
+        ASSERT_EQ(size_t(1) << 30, dispatcher.get_queued_query_memory_limit());
+
+        // Only one query may wait for the SenderDB
+        dispatcher.set_max_queued_queries(1);
+        ASSERT_EQ(2, count_rejected_queries(dispatcher, 5566));
+
+        // The query data of one query exceeds the budget, but an idle dispatcher admits it
+        dispatcher.set_max_queued_queries(0);
+        dispatcher.set_queued_query_memory_limit(1);
+        ASSERT_EQ(2, count_rejected_queries(dispatcher, 5567));
+    }
+} // namespace APSITests
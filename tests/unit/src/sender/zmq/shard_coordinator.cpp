@@ -0,0 +1,268 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// STD
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// APSI
+#include "apsi/crypto_context.h"
+#include "apsi/network/zmq/zmq_channel.h"
+#include "apsi/oprf/oprf_sender.h"
+#include "apsi/psi_params.h"
+#include "apsi/receiver.h"
+#include "apsi/sender_db.h"
+#include "apsi/zmq/sender_dispatcher.h"
+#include "apsi/zmq/shard_coordinator.h"
+
+// Google Test
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace apsi;
+using namespace apsi::network;
+using namespace apsi::oprf;
+using namespace apsi::receiver;
+using namespace apsi::sender;
+using namespace seal;
+
+namespace APSITests {
+    namespace {
+        shared_ptr<PSIParams> get_params()
+        {
+            static shared_ptr<PSIParams> params = nullptr;
+            if (!params) {
+                PSIParams::ItemParams item_params;
+                item_params.felts_per_item = 8;
+
+                // A larger table so the SenderDB has several bundle indices to shard
+                PSIParams::TableParams table_params;
+                table_params.hash_func_count = 3;
+                table_params.max_items_per_bin = 8;
+                table_params.table_size = 2048;
+
+                PSIParams::QueryParams query_params;
+                query_params.query_powers = { 1, 3, 5 };
+
+                size_t pmd = 4096;
+                PSIParams::SEALParams seal_params;
+                seal_params.set_poly_modulus_degree(pmd);
+                seal_params.set_coeff_modulus(CoeffModulus::BFVDefault(pmd));
+                seal_params.set_plain_modulus(65537);
+
+                params =
+                    make_shared<PSIParams>(item_params, table_params, query_params, seal_params);
+            }
+
+            return params;
+        }
+
+        /**
+        Creates a stripped SenderDB holding the items (i, i + 1) for i in [0, 100).
+        */
+        shared_ptr<SenderDB> create_sender_db(const OPRFKey &oprf_key)
+        {
+            auto sender_db = make_shared<SenderDB>(*get_params(), oprf_key, 0, 0, false);
+            vector<Item> items;
+            for (uint64_t i = 0; i < 100; i++) {
+                items.emplace_back(i, i + 1);
+            }
+            sender_db->insert_or_assign(items);
+            sender_db->strip();
+            return sender_db;
+        }
+
+        /**
+        Queries the item (0, 1), which the SenderDB holds, and the item (1000, 1001), which it does
+        not hold, in the given order through the given channel.
+        */
+        vector<MatchRecord> query_items(ZMQReceiverChannel &chl, bool held_item_first)
+        {
+            vector<Item> items{ Item(0, 1), Item(1000, 1001) };
+            if (!held_item_first) {
+                swap(items[0], items[1]);
+            }
+            auto hashed_items = Receiver::RequestOPRF(items, chl);
+
+            Receiver receiver(*get_params());
+            return receiver.request_query(hashed_items.first, hashed_items.second, chl);
+        }
+
+        /**
+        Runs a function on a new thread until it is stopped.
+        */
+        class Runner {
+        public:
+            template <typename F>
+            Runner(F &&run) : thread_([this, run]() { run(stop_); })
+            {}
+
+            ~Runner()
+            {
+                stop_ = true;
+                thread_.join();
+            }
+
+        private:
+            atomic<bool> stop_{ false };
+
+            thread thread_;
+        };
+    } // namespace
+
+    TEST(ZMQShardCoordinatorTests, Query)
+    {
+        // Serve two shards of the SenderDB with separate dispatchers
+        OPRFKey oprf_key;
+        auto sender_db = create_sender_db(oprf_key);
+        uint32_t bundle_idx_count = get_params()->bundle_idx_count();
+        stringstream ss1, ss2;
+        sender_db->save_shard(ss1, 0, bundle_idx_count / 2);
+        sender_db->save_shard(ss2, bundle_idx_count / 2, bundle_idx_count);
+        ZMQSenderDispatcher dispatcher1(
+            make_shared<SenderDB>(SenderDB::Load(ss1).first), oprf_key);
+        ZMQSenderDispatcher dispatcher2(
+            make_shared<SenderDB>(SenderDB::Load(ss2).first), oprf_key);
+        Runner shard1([&](const atomic<bool> &stop) { dispatcher1.run(stop, 5560); });
+        Runner shard2([&](const atomic<bool> &stop) { dispatcher2.run(stop, 5561); });
+
+        ZMQShardCoordinator coordinator({ "tcp://localhost:5560", "tcp://localhost:5561" });
+        ASSERT_EQ(2, coordinator.get_shard_count());
+        ASSERT_EQ(get_params()->to_string(), coordinator.get_params().to_string());
+        Runner coordinator_runner([&](const atomic<bool> &stop) { coordinator.run(stop, 5562); });
+
+        ZMQReceiverChannel chl;
+        chl.connect("tcp://localhost:5562");
+        ASSERT_EQ(get_params()->to_string(), Receiver::RequestParams(chl).to_string());
+
+        auto result = query_items(chl, true);
+        ASSERT_EQ(2, result.size());
+        ASSERT_TRUE(result[0].found);
+        ASSERT_FALSE(result[1].found);
+
+        // The shards serve only the default SenderDB
+        ZMQReceiverChannel named_chl;
+        named_chl.connect("tcp://localhost:5562");
+        named_chl.set_db_name("other");
+        ASSERT_THROW(Receiver::RequestParams(named_chl), SenderOperationError);
+    }
+
+    TEST(ZMQShardCoordinatorTests, ShardFailure)
+    {
+        // One shard holds the whole SenderDB
+        OPRFKey oprf_key;
+        ZMQSenderDispatcher dispatcher(create_sender_db(oprf_key), oprf_key);
+        Runner shard([&](const atomic<bool> &stop) { dispatcher.run(stop, 5563); });
+
+        // The other shard holds no BinBundles and fails queries on request
+        atomic<bool> fail_queries{ true };
+        Runner failing_shard([&](const atomic<bool> &stop) {
+            ZMQSenderChannel shard_chl;
+            shard_chl.bind("tcp://*:5564");
+            auto seal_context = CryptoContext(*get_params()).seal_context();
+            while (!stop) {
+                auto sop = shard_chl.receive_network_operation(seal_context);
+                if (!sop) {
+                    this_thread::sleep_for(50ms);
+                    continue;
+                }
+
+                auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                nsop_response->client_id = move(sop->client_id);
+                if (sop->sop->type() == SenderOperationType::sop_parms) {
+                    auto response_parms = make_unique<SenderOperationResponseParms>();
+                    response_parms->params = make_unique<PSIParams>(*get_params());
+                    nsop_response->sop_response = move(response_parms);
+                } else if (fail_queries) {
+                    nsop_response->sop_response = make_unique<SenderOperationResponseError>(
+                        SenderOperationType::sop_query, "shard failed");
+                } else {
+                    auto response_query = make_unique<SenderOperationResponseQuery>();
+                    response_query->package_count = 0;
+                    nsop_response->sop_response = move(response_query);
+                }
+                shard_chl.send(move(nsop_response));
+            }
+        });
+
+        ZMQShardCoordinator coordinator({ "tcp://localhost:5563", "tcp://localhost:5564" });
+        Runner coordinator_runner([&](const atomic<bool> &stop) { coordinator.run(stop, 5565); });
+
+        ZMQReceiverChannel chl;
+        chl.connect("tcp://localhost:5565");
+
+        // The receiver is told about the failure instead of waiting forever
+        ASSERT_THROW(query_items(chl, true), SenderOperationError);
+
+        // The next query does not see what the other shard sent for the failed query
+        fail_queries = false;
+        auto result = query_items(chl, false);
+        ASSERT_EQ(2, result.size());
+        ASSERT_FALSE(result[0].found);
+        ASSERT_TRUE(result[1].found);
+    }
+
+    TEST(ZMQShardCoordinatorTests, ShardTimeout)
+    {
+        // One shard holds the whole SenderDB
+        OPRFKey oprf_key;
+        ZMQSenderDispatcher dispatcher(create_sender_db(oprf_key), oprf_key);
+        Runner shard([&](const atomic<bool> &stop) { dispatcher.run(stop, 5568); });
+
+        // The other shard holds no BinBundles and ignores queries on request
+        atomic<bool> ignore_queries{ true };
+        Runner silent_shard([&](const atomic<bool> &stop) {
+            ZMQSenderChannel shard_chl;
+            shard_chl.bind("tcp://*:5569");
+            auto seal_context = CryptoContext(*get_params()).seal_context();
+            while (!stop) {
+                auto sop = shard_chl.receive_network_operation(seal_context);
+                if (!sop) {
+                    this_thread::sleep_for(50ms);
+                    continue;
+                }
+
+                auto nsop_response = make_unique<ZMQSenderOperationResponse>();
+                nsop_response->client_id = move(sop->client_id);
+                if (sop->sop->type() == SenderOperationType::sop_parms) {
+                    auto response_parms = make_unique<SenderOperationResponseParms>();
+                    response_parms->params = make_unique<PSIParams>(*get_params());
+                    nsop_response->sop_response = move(response_parms);
+                } else if (ignore_queries) {
+                    continue;
+                } else {
+                    auto response_query = make_unique<SenderOperationResponseQuery>();
+                    response_query->package_count = 0;
+                    nsop_response->sop_response = move(response_query);
+                }
+                shard_chl.send(move(nsop_response));
+            }
+        });
+
+        ZMQShardCoordinator coordinator(
+            { "tcp://localhost:5568", "tcp://localhost:5569" }, 500ms);
+        ASSERT_EQ(500ms, coordinator.get_shard_timeout());
+        ASSERT_THROW(coordinator.set_shard_timeout(0ms), invalid_argument);
+        Runner coordinator_runner([&](const atomic<bool> &stop) { coordinator.run(stop, 5570); });
+
+        ZMQReceiverChannel chl;
+        chl.connect("tcp://localhost:5570");
+
+        // The receiver is told that the silent shard timed out instead of waiting forever
+        ASSERT_THROW(query_items(chl, true), SenderOperationError);
+
+        // The coordinator reconnected and serves the next query once the shard answers again
+        ignore_queries = false;
+        auto result = query_items(chl, true);
+        ASSERT_EQ(2, result.size());
+        ASSERT_TRUE(result[0].found);
+        ASSERT_FALSE(result[1].found);
+    }
+} // namespace APSITests